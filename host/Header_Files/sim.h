@@ -0,0 +1,138 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_HG
+#define SIM_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+#include "em_cmu.h"
+#include "em_core.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_NEVER				UINT64_MAX
+#define SIM_NS_PER_S			1000000000ULL
+#define SIM_NS_PER_MS			1000000ULL
+#define SIM_NS_PER_US			1000ULL
+
+// Energy modes of the simulated core, residency is kept for each
+enum sim_modes {
+	SIM_EM0,				//0, running, or waking up
+	SIM_EM1,				//1, sleep, HF peripherals clocked
+	SIM_EM2,				//2, deep sleep, LFA and LFB clocked
+	SIM_EM3,				//3, stop, only the ULFRCO runs
+	SIM_MODES				//4
+} ;
+
+// How the firmware's accesses to a register are trapped
+enum sim_access {
+	SIM_RW,					//0, plain memory, the model reads it when it needs it
+	SIM_TRAP_WRITE,			//1, kept up to date by the model, writes are acted on
+	SIM_TRAP_ALL			//2, reads have side effects or poll a status, writes are acted on
+} ;
+
+// Cycle costs of the CPU model, the firmware's work is counted in calls
+#define SIM_CALL_CYCLES			24		// an average firmware function call and body
+#define SIM_ACCESS_CYCLES		3		// a trapped peripheral register access
+#define SIM_LIB_CYCLES			40		// an emlib function
+#define SIM_CRITICAL_CYCLES		2		// entering or leaving a critical section
+#define SIM_IRQ_ENTRY_CYCLES	12		// exception entry, stacking and vector fetch
+#define SIM_IRQ_TAIL_CYCLES		6		// tail chained exception entry
+#define SIM_IRQ_EXIT_CYCLES		12		// exception return, unstacking
+#define SIM_EM23_WAKE_NS		10700	// EFM32PG12 datasheet wake up from EM2 and EM3
+
+// The simulator's view of the registers of a peripheral at its firmware address
+#define SIM_ALIAS(regs)			((__typeof__(regs)) sim_alias((uintptr_t) (regs)))
+#define SIM_REG_INDEX(type, reg)	(offsetof(type, reg) / SIM_REG_SIZE)
+#define SIM_REG_COUNT(type)		(sizeof(type) / SIM_REG_SIZE)
+
+// The model holding a source or peripheral as its first member
+#define SIM_MODEL(type, member, pointer)	((type *)((char *)(pointer) - offsetof(type, member)))
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// A source of events on the virtual clock, a peripheral or a device
+typedef struct SIM_SOURCE {
+	const char				*name;
+	uint64_t				(*next)(struct SIM_SOURCE *source);	// time of the next event, or SIM_NEVER
+	void					(*run)(struct SIM_SOURCE *source, uint64_t now);	// handles the events due at now
+	uint32_t				domain;		// deepest sim_modes its clock runs in
+	uint64_t				events;		// events handled
+	uint64_t				frozen;		// events while its clock was stopped by the energy mode
+	struct SIM_SOURCE		*link;
+} SIM_SOURCE ;
+
+// A simulated peripheral, its registers and its interrupt
+typedef struct SIM_PERIPH {
+	SIM_SOURCE				source;
+	uintptr_t				base;		// firmware address of the registers
+	const uint8_t			*access;	// sim_access of each register
+	uint32_t				registers;	// registers in access
+	CMU_Clock_TypeDef		clock;		// clock gate of the peripheral
+	uint32_t				(*read)(struct SIM_PERIPH *periph, uint32_t reg);	// trapped read, returns the value read
+	void					(*write)(struct SIM_PERIPH *periph, uint32_t reg, uint32_t value);	// trapped write
+	uint64_t				(*sync)(struct SIM_PERIPH *periph, uint64_t now);	// updates the registers read untrapped, returns their next change
+	volatile uint32_t		*flags;		// IF in the simulator's view, or 0 without an interrupt
+	volatile uint32_t		*enables;	// IEN in the simulator's view
+	IRQn_Type				irq;
+	void					(*handler)(void);	// the firmware's interrupt handler
+	uint64_t				accesses;	// trapped accesses
+	uint64_t				gated;		// trapped accesses with the clock gated
+	uint64_t				irqs;		// interrupts taken
+	struct SIM_PERIPH		*link;
+} SIM_PERIPH ;
+
+// Totals of the run
+typedef struct {
+	uint64_t				now;		// virtual time in ns
+	uint64_t				residency[SIM_MODES];	// ns in each energy mode
+	uint64_t				cycles;		// core cycles executed
+	uint64_t				wakes;		// wakes from EM1 or deeper
+	uint64_t				no_sleeps;	// WFI with an interrupt already pending, the core did not sleep
+	uint64_t				irqs;		// interrupts taken
+	uint64_t				traps;		// register accesses trapped
+	uint64_t				calls;		// firmware function calls
+} SIM_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_open(void);
+void sim_trace(bool enable);
+void sim_source_add(SIM_SOURCE *source);
+void sim_periph_add(SIM_PERIPH *periph);
+void *sim_alias(uintptr_t address);
+uint32_t sim_register_read(uintptr_t address);
+void sim_register_write(uintptr_t address, uint32_t value);
+uint64_t sim_now(void);
+uint32_t sim_mode(void);
+void sim_reschedule(void);
+void sim_cpu(uint32_t cycles);
+void sim_advance(uint64_t ns);
+void sim_irq_enable(IRQn_Type irq, bool enable);
+void sim_irq_service(void);
+CORE_irqState_t sim_primask_set(CORE_irqState_t primask);
+bool sim_in_handler(void);
+void sim_sleep(uint32_t mode);
+void sim_end(uint64_t end, void (*report)(void));
+void sim_finish(void) __attribute__((noreturn));
+void sim_fatal(const char *format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+void sim_stats(SIM_STATS *stats);
+SIM_PERIPH *sim_periphs(void);
+SIM_SOURCE *sim_sources(void);
+
+#endif
@@ -0,0 +1,49 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_EMLIB_HG
+#define SIM_EMLIB_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_cmu.h"
+#include "em_gpio.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_ULFRCO_HZ			1000
+#define SIM_LFXO_HZ				32768
+#define SIM_PINS				16
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// Called when the level driven on a pin changes
+typedef void (*SIM_PIN_WATCH)(bool level);
+
+// Totals of the clock management unit
+typedef struct {
+	uint32_t				band_changes;	// HFRCO band changes
+	uint32_t				enables[cmuClock_COUNT];	// times each clock was turned on
+} SIM_CMU_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+bool sim_clock_on(CMU_Clock_TypeDef clock);
+uint32_t sim_clock_hz(CMU_Clock_TypeDef clock);
+void sim_cmu_stats(SIM_CMU_STATS *stats);
+void sim_gpio_watch(GPIO_Port_TypeDef port, unsigned int pin, SIM_PIN_WATCH watch);
+bool sim_gpio_level(GPIO_Port_TypeDef port, unsigned int pin);
+
+#endif
@@ -0,0 +1,47 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_HM18_HG
+#define SIM_HM18_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_HM18_LINE			128		// longest line kept
+#define SIM_HM18_LINES			8		// last lines kept
+#define SIM_HM18_COMMAND_GAP_NS	(20 * 1000000ULL)	// quiet line that ends an AT command
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// Totals of the HM-18 and the lines it received
+typedef struct {
+	uint64_t				bytes;		// bytes received from the LEUART
+	uint64_t				lines;		// lines received
+	uint64_t				keepalives;	// empty lines received
+	uint64_t				queries;	// queries sent to the firmware
+	uint64_t				replies;	// AT command replies sent
+	char					last[SIM_HM18_LINES][SIM_HM18_LINE];	// last lines, oldest first
+	uint32_t				kept;		// lines in last
+} SIM_HM18_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_hm18_open(uint64_t query_ns, const char *query);
+void sim_hm18_stats(SIM_HM18_STATS *stats);
+
+#endif
@@ -0,0 +1,61 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_I2C_HG
+#define SIM_I2C_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_i2c.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_I2C_BITS_START		1		// START or repeated START condition
+#define SIM_I2C_BITS_BYTE		9		// a byte and its acknowledge
+#define SIM_I2C_BITS_RX			8		// a byte received, before the master answers
+#define SIM_I2C_BITS_ACK		1		// the master's ACK or NACK of a byte received
+#define SIM_I2C_BITS_STOP		1		// STOP condition
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// A slave on a simulated bus, addressed by its 7 bit address
+typedef struct SIM_I2C_DEVICE {
+	const char				*name;
+	uint8_t					address;
+	bool					(*address_ack)(bool read);	// addressed after a START, returns its ACK
+	bool					(*write)(uint8_t byte);		// a byte written to it, returns its ACK
+	uint8_t					(*read)(void);				// the next byte it sends
+	void					(*stop)(void);				// STOP, or the master left it for another START
+	struct SIM_I2C_DEVICE	*link;
+} SIM_I2C_DEVICE ;
+
+// Totals of a bus
+typedef struct {
+	uint64_t				busy_ns;	// START to STOP
+	uint64_t				transfers;	// STOPs ending a transfer
+	uint64_t				addresses;	// START and address phases
+	uint64_t				tx_bytes;	// data bytes written
+	uint64_t				rx_bytes;	// data bytes read
+	uint64_t				nacks;		// bytes and addresses NACKed by the slave
+	uint64_t				resets;		// START and STOP on an idle bus
+} SIM_I2C_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_i2c_open(void);
+void sim_i2c_attach(I2C_TypeDef *i2c, SIM_I2C_DEVICE *device);
+void sim_i2c_stats(I2C_TypeDef *i2c, SIM_I2C_STATS *stats);
+
+#endif
@@ -0,0 +1,42 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_LDMA_HG
+#define SIM_LDMA_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_ldma.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// Totals of the LDMA
+typedef struct {
+	uint64_t				bytes[DMA_CHAN_COUNT];		// bytes moved by each channel
+	uint64_t				transfers[DMA_CHAN_COUNT];	// transfers started on each channel
+	uint64_t				errors;		// transfers ended by an injected error
+} SIM_LDMA_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_ldma_open(void);
+void sim_ldma_poll(void);
+void sim_ldma_fail(uint32_t channel, uint32_t bytes);
+void sim_ldma_stats(SIM_LDMA_STATS *stats);
+
+#endif
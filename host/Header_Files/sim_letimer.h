@@ -0,0 +1,33 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_LETIMER_HG
+#define SIM_LETIMER_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_letimer.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_letimer_open(void);
+
+#endif
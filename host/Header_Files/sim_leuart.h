@@ -0,0 +1,45 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_LEUART_HG
+#define SIM_LEUART_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_leuart.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_LEUART_FRAME_BITS	10		// start, 8 data bits and stop
+#define SIM_LEUART_RX_QUEUE		256		// bytes a device can have on the line
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// Totals of the LEUART
+typedef struct {
+	uint64_t				tx_bytes;	// frames sent
+	uint64_t				rx_bytes;	// frames received into RXDATA
+	uint64_t				rx_dropped;	// frames received with the receiver disabled or blocked
+	uint64_t				overruns;	// frames lost to a full RXDATA
+} SIM_LEUART_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_leuart_open(void);
+void sim_leuart_attach(void (*receive)(uint8_t byte));
+void sim_leuart_send(const uint8_t *bytes, uint32_t length);
+void sim_leuart_stats(SIM_LEUART_STATS *stats);
+
+#endif
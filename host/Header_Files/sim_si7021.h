@@ -0,0 +1,47 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_SI7021_HG
+#define SIM_SI7021_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+
+
+/* The developer's include statements */
+#include "sim.h"
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_SI7021_ADDRESS		0x40
+#define SIM_SI7021_POWER_UP_NS	(18 * SIM_NS_PER_MS)	// typical power up time at 25 C
+#define SIM_SI7021_USER1_RESET	0x3A
+#define SIM_SI7021_USER1_WRITE	0x85	// RES1, HTRE and RES0, the other bits are kept
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// Totals of the SI7021
+typedef struct {
+	uint64_t				power_ups;		// rail turned on
+	uint64_t				conversions[2];	// humidity and temperature conversions started
+	uint64_t				reads;			// measurements read
+	uint64_t				busy_nacks;		// addressed while off, powering up or converting
+	uint64_t				on_ns;			// rail on time
+} SIM_SI7021_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_si7021_open(void);
+void sim_si7021_stats(SIM_SI7021_STATS *stats);
+
+#endif
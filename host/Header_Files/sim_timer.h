@@ -0,0 +1,33 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_TIMER_HG
+#define SIM_TIMER_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_timer.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_timer_open(void);
+
+#endif
@@ -0,0 +1,45 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SIM_VEML6030_HG
+#define SIM_VEML6030_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+
+
+/* The developer's include statements */
+#include "sim.h"
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_VEML6030_ADDRESS	0x48
+#define SIM_VEML6030_ALS		0x04	// ambient light output register
+#define SIM_VEML6030_REGISTERS	8
+#define SIM_VEML6030_LUX_COUNT	0.0576	// lx per count at gain 1 and 100 ms
+#define SIM_VEML6030_PEAK_LUX	2000.0	// noon, a bright window
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+// Totals of the VEML6030
+typedef struct {
+	uint64_t				writes;		// register writes
+	uint64_t				reads;		// register reads
+} SIM_VEML6030_STATS ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_veml6030_open(void);
+void sim_veml6030_stats(SIM_VEML6030_STATS *stats);
+
+#endif
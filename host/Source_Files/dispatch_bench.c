@@ -0,0 +1,166 @@
+/**
+ * @file dispatch_bench.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host micro-benchmark of the scheduler's post to handler cost as events are added
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+#include "scheduler.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define BENCH_RUNS			20001	// timed dispatches of each case, odd for the median
+#define BENCH_WARM_UP		1000	// untimed dispatches first, to warm the caches and the predictor
+#define BENCH_DEADLINE_US	1000000	// deadline of every event in the BENCH_DEADLINES case, never missed
+
+// Cases of one event table
+enum bench_cases {
+	BENCH_ALONE,		//0, the lowest priority event is the only one pending
+	BENCH_CROWDED,		//1, the highest priority event, every other event of the table pending
+	BENCH_DEADLINES,	//2, as BENCH_CROWDED with a deadline on every event, EDF compares them all
+	BENCH_CASES			//3
+} ;
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static SCHEDULER_TABLE		table;
+static uint64_t				handled_at;	// time stamp counter as the handler is entered
+static uint64_t				samples[BENCH_RUNS];
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t bench_now(void);
+static void bench_handler(void);
+static void bench_table(uint32_t events, uint32_t deadline_us);
+static uint64_t bench_dispatch(uint32_t event);
+static void bench_case(uint32_t events, uint32_t bench_case, uint64_t *min, uint64_t *median);
+static int bench_compare(const void *a, const void *b);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to time the post of an event to the entry of its handler, with
+ *   1 to SCHEDULER_MAX_EVENTS events in the table
+ *
+ * @details
+ * 	 A post is add_scheduled_event as an interrupt makes it, then the main
+ * 	 loop's get_scheduled_events and scheduler_dispatch, with the
+ * 	 instrumentation and EDF compiled in as the firmware ships.  The times
+ * 	 are host time stamp counter cycles, not Cortex-M4 cycles: their change
+ * 	 as events are added is what is measured.  Without deadlines the
+ * 	 priority lookup of scheduler_dispatch does not grow with the events
+ * 	 pending, with a deadline on every event EDF compares each one
+ *
+ ******************************************************************************/
+
+int main(void) {
+	printf("%-8s %12s %12s %12s %12s %12s %12s\n", "events", "alone min", "median", "crowded min", "median",
+			"deadline min", "median");
+	for(uint32_t events = 1; events <= SCHEDULER_MAX_EVENTS; events *= 2) {
+		uint64_t min[BENCH_CASES], median[BENCH_CASES];
+		for(uint32_t i = 0; i < BENCH_CASES; i++) {
+			bench_case(events, i, &min[i], &median[i]);
+		}
+		printf("%-8lu %12llu %12llu %12llu %12llu %12llu %12llu\n", (unsigned long) events,
+				(unsigned long long) min[BENCH_ALONE], (unsigned long long) median[BENCH_ALONE],
+				(unsigned long long) min[BENCH_CROWDED], (unsigned long long) median[BENCH_CROWDED],
+				(unsigned long long) min[BENCH_DEADLINES], (unsigned long long) median[BENCH_DEADLINES]);
+	}
+	printf("cycles of the host time stamp counter from add_scheduled_event to the handler, %d runs\n", BENCH_RUNS);
+	return 0;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t bench_now(void) {
+	_mm_lfence();	// the time stamp is not taken before the code ahead of it ends
+	return __rdtsc();
+}
+
+static void bench_handler(void) {
+	handled_at = bench_now();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to build an event table of events, event bit n at priority n,
+ *   as the SCHEDULER_TABLE macros build the application's, each with
+ *   deadline_us, 0 for none
+ *
+ ******************************************************************************/
+
+static void bench_table(uint32_t events, uint32_t deadline_us) {
+	for(uint32_t i = 0; i <= SCHEDULER_MAX_PRIORITY; i++) {
+		table.dispatch[i].event = (i < events) ? (1u << i) : 0;
+		table.dispatch[i].handler = (i < events) ? bench_handler : 0;
+	}
+	for(uint32_t i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+		table.priority_mask[i] = (i < events) ? (1u << i) : 0;
+		table.deadline_us[i] = (i < events) ? deadline_us : 0;
+		table.overrun_policy[i] = SCHEDULER_OVERRUN_COALESCE;
+	}
+	table.handler_events = 0;
+	scheduler_open(&table);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to post an event and run the main loop until its handler
+ *
+ * @return
+ *   Cycles from the post to the entry of the handler
+ *
+ ******************************************************************************/
+
+static uint64_t bench_dispatch(uint32_t event) {
+	uint64_t posted = bench_now();
+	add_scheduled_event(event);
+	if(get_scheduled_events()) {
+		scheduler_dispatch();
+	}
+	remove_scheduled_event(event);	// as the application's handlers do, outside the time
+	return handled_at - posted;
+}
+
+static void bench_case(uint32_t events, uint32_t bench_case, uint64_t *min, uint64_t *median) {
+	uint32_t event = (bench_case == BENCH_ALONE) ? 1u : (1u << (events - 1));
+	uint32_t others = event - 1;	// every lower priority event
+	bench_table(events, (bench_case == BENCH_DEADLINES) ? BENCH_DEADLINE_US : 0);
+	if((bench_case != BENCH_ALONE) && others) {
+		add_scheduled_event(others);	// left pending, the handler of event runs first
+	}
+	for(uint32_t i = 0; i < BENCH_WARM_UP; i++) {
+		bench_dispatch(event);
+	}
+	for(uint32_t i = 0; i < BENCH_RUNS; i++) {
+		samples[i] = bench_dispatch(event);
+	}
+	qsort(samples, BENCH_RUNS, sizeof(samples[0]), bench_compare);
+	*min = samples[0];
+	*median = samples[BENCH_RUNS / 2];
+}
+
+static int bench_compare(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
@@ -0,0 +1,448 @@
+/**
+ * @file ldma_test.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host test of the I2C driver's LDMA transfers on the simulated board
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_i2c.h"
+#include "sim_ldma.h"
+
+#include "cmu.h"
+#include "i2c.h"
+#include "ldma.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define TEST_ADDRESS		0x50	// the memory device on I2C0
+#define TEST_MEMORY			256
+#define TEST_NO_NACK		UINT32_MAX
+#define TEST_TIMEOUT_NS		(10 * SIM_NS_PER_S)	// the whole run, a hung transfer ends it
+#define TEST_LATE_NS		(2 * SIM_NS_PER_MS)	// the LDMA interrupt is held off this long
+#define TEST_LATE_STEP_NS	(10 * SIM_NS_PER_US)
+
+// Events of the test, as APP_EVENTS lists those of the application
+#define TEST_EVENTS(X) \
+	/* event				handler				priority	deadline_us	overrun policy				run mode */ \
+	X(TEST_DONE_CB,			test_done_cb,		0,			0,			SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(TEST_SETTLE_CB,		test_settle_cb,		1,			0,			SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(TEST_STOP_CB,			test_stop_cb,		2,			0,			SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD)
+
+enum test_event_bits {
+	TEST_EVENTS(SCHEDULER_EVENT_INDEX)
+	TEST_EVENT_COUNT
+} ;
+
+enum test_events {
+	TEST_EVENTS(SCHEDULER_EVENT_BIT)
+} ;
+
+TEST_EVENTS(SCHEDULER_EVENT_HANDLER)
+
+// A transfer of a case and what it is expected to do
+typedef struct {
+	uint32_t				result;		// i2c_results the driver hands back
+	uint32_t				payload;	// bytes read, the payload of the completion event
+	uint64_t				dma_bytes;	// bytes the LDMA moved
+	uint64_t				dma_errors;
+	uint64_t				bus_rx;		// bytes read on the bus
+} TEST_OUTCOME ;
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static const SCHEDULER_TABLE test_scheduler_table = {
+	.dispatch		= { TEST_EVENTS(SCHEDULER_TABLE_DISPATCH) },
+	.priority_mask	= { TEST_EVENTS(SCHEDULER_TABLE_PRIORITY) },
+	.deadline_us	= { TEST_EVENTS(SCHEDULER_TABLE_DEADLINE) },
+	.overrun_policy	= { TEST_EVENTS(SCHEDULER_TABLE_POLICY) },
+	.handler_events	= 0 TEST_EVENTS(SCHEDULER_TABLE_HANDLER),
+};
+
+// The memory device, a register pointer written first then bytes from it
+static SIM_I2C_DEVICE		device;
+static uint8_t				memory[TEST_MEMORY];
+static uint8_t				pointer;
+static uint32_t				written;	// bytes written since the START
+static bool					nack_address;
+static uint32_t				nack_at = TEST_NO_NACK;	// byte written that is NACKed
+
+static bool					done;
+static uint32_t				payload;
+static uint32_t				result;
+static uint32_t				failures;
+static uint32_t				cases;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static bool test_address(bool read);
+static bool test_write(uint8_t byte);
+static uint8_t test_read(void);
+static void test_stop(void);
+static void test_timeout(void);
+static void test_open(void);
+static void test_transfer(const uint8_t *tx, uint32_t tx_len, uint8_t *buffer, uint32_t rx_len, bool late_ldma,
+		TEST_OUTCOME *outcome);
+static void test_check(const char *name, bool pass, const char *why);
+static void test_read_case(const char *name, uint32_t rx_len, uint64_t dma_bytes);
+static void test_write_case(const char *name, uint32_t tx_len, uint64_t dma_bytes);
+static void test_write_nack(void);
+static void test_ldma_error(void);
+static void test_address_nack(void);
+static void test_late_ldma(void);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to run the LDMA cases of the I2C driver against a memory device
+ *
+ * @details
+ * 	 Each case runs a transfer through i2c_start and the firmware's interrupt
+ * 	 handlers and checks the bytes, the result and what the LDMA and the bus
+ * 	 did.  The bus must be idle after every case, the next one starts on it
+ *
+ * @return
+ *   0 if every case passed
+ *
+ ******************************************************************************/
+
+int main(void) {
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	test_open();
+
+	test_read_case("read 6 bytes, 4 by LDMA", I2C_DMA_MIN_BYTES + 2, I2C_DMA_MIN_BYTES);
+	test_read_case("read 5 bytes, none by LDMA", I2C_DMA_MIN_BYTES + 1, 0);
+	test_read_case("read 16 bytes, 14 by LDMA", 16, 14);
+	test_write_case("write 4 bytes by LDMA", I2C_DMA_MIN_BYTES, I2C_DMA_MIN_BYTES);
+	test_write_case("write 3 bytes, none by LDMA", I2C_DMA_MIN_BYTES - 1, 0);
+	test_write_nack();
+	test_ldma_error();
+	test_address_nack();
+	test_late_ldma();
+	test_read_case("read 6 bytes after the errors", I2C_DMA_MIN_BYTES + 2, I2C_DMA_MIN_BYTES);
+
+	printf("%lu of %lu cases passed\n", (unsigned long)(cases - failures), (unsigned long) cases);
+	return failures ? 1 : 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Functions of the test events, the stop and settle events end the
+ *   transfer in thread mode as the application's do
+ *
+ ******************************************************************************/
+
+void test_done_cb(void) {
+	remove_scheduled_event(TEST_DONE_CB);
+	payload = scheduler_current_record()->payload;
+	done = true;
+}
+
+void test_settle_cb(void) {
+	remove_scheduled_event(TEST_SETTLE_CB);
+	i2c_settled(I2C0);
+}
+
+void test_stop_cb(void) {
+	remove_scheduled_event(TEST_STOP_CB);
+	i2c_stopped(I2C0);
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static bool test_address(bool read) {
+	(void) read;
+	written = 0;
+	return !nack_address;
+}
+
+static bool test_write(uint8_t byte) {
+	if(written == nack_at) {
+		return false;
+	}
+	if(!written++) {
+		pointer = byte;
+	}
+	else {
+		memory[pointer++] = byte;
+	}
+	return true;
+}
+
+static uint8_t test_read(void) {
+	return memory[pointer++];
+}
+
+static void test_stop(void) {
+}
+
+static void test_timeout(void) {
+	printf("FAIL  a transfer did not end in %llu s of virtual time\n",
+			(unsigned long long)(TEST_TIMEOUT_NS / SIM_NS_PER_S));
+	exit(1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set up the simulated board and open I2C0 with the test events
+ *
+ ******************************************************************************/
+
+static void test_open(void) {
+	I2C_OPEN_STRUCT i2c_open_s;
+
+	sim_open();
+	sim_i2c_open();
+	sim_ldma_open();
+	device.name = "memory";
+	device.address = TEST_ADDRESS;
+	device.address_ack = test_address;
+	device.write = test_write;
+	device.read = test_read;
+	device.stop = test_stop;
+	sim_i2c_attach(I2C0, &device);
+	sim_end(TEST_TIMEOUT_NS, test_timeout);
+	for(int i = 0; i < TEST_MEMORY; i++) {
+		memory[i] = (uint8_t)(i * 7 + 1);
+	}
+
+	cmu_open();
+	scheduler_open(&test_scheduler_table);
+	sleep_open();
+	i2c_open_s.freq = I2C_FREQ_FAST_MAX;
+	i2c_open_s.SCLPEN = true;
+	i2c_open_s.SCL_route = I2C_ROUTELOC0_SCLLOC_LOC6;
+	i2c_open_s.SDAPEN = true;
+	i2c_open_s.SDA_route = I2C_ROUTELOC0_SDALOC_LOC8;
+	i2c_open_s.clhr = i2cClockHLRAsymetric;
+	i2c_open_s.master = true;
+	i2c_open_s.refFreq = 0;
+	i2c_open_s.enable = true;
+	i2c_open_s.settle_timer = 0;
+	i2c_open_s.stop_event = TEST_STOP_CB;
+	i2c_open_s.settle_event = TEST_SETTLE_CB;
+	i2c_open(I2C0, &i2c_open_s);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to run one transfer to its completion event
+ *
+ * @details
+ * 	 The main loop of the firmware runs until the completion event is
+ * 	 dispatched.  With late_ldma the LDMA interrupt is held off for
+ * 	 TEST_LATE_NS after the start, as a long interrupt of higher priority
+ * 	 would, while the I2C interrupt is still taken
+ *
+ ******************************************************************************/
+
+static void test_transfer(const uint8_t *tx, uint32_t tx_len, uint8_t *buffer, uint32_t rx_len, bool late_ldma,
+		TEST_OUTCOME *outcome) {
+	I2C_TRANSFER transfer;
+	SIM_LDMA_STATS ldma_before, ldma_after;
+	SIM_I2C_STATS bus_before, bus_after;
+
+	transfer.address = TEST_ADDRESS;
+	transfer.tx = tx;
+	transfer.tx_len = tx_len;
+	transfer.rx = 0;
+	transfer.buffer = buffer;
+	transfer.rx_len = rx_len;
+	transfer.order = I2C_MSB_FIRST;
+	transfer.settle = 0;
+	transfer.result = &result;
+	transfer.callback = TEST_DONE_CB;
+
+	sim_ldma_stats(&ldma_before);
+	sim_i2c_stats(I2C0, &bus_before);
+	done = false;
+	payload = 0;
+	result = I2C_DONE;
+	if(late_ldma) {
+		NVIC_DisableIRQ(LDMA_IRQn);
+	}
+	i2c_start(I2C0, &transfer);
+	if(late_ldma) {
+		for(uint64_t waited = 0; waited < TEST_LATE_NS; waited += TEST_LATE_STEP_NS) {
+			sim_advance(TEST_LATE_STEP_NS);
+			sim_irq_service();
+		}
+		NVIC_EnableIRQ(LDMA_IRQn);
+	}
+	while(!done) {
+		if(!get_scheduled_events()) {
+			enter_sleep();
+		}
+		scheduler_dispatch();
+	}
+	sim_ldma_stats(&ldma_after);
+	sim_i2c_stats(I2C0, &bus_after);
+
+	outcome->result = result;
+	outcome->payload = payload;
+	outcome->dma_bytes = ldma_after.bytes[LDMA_CHANNEL_I2C0] - ldma_before.bytes[LDMA_CHANNEL_I2C0];
+	outcome->dma_errors = ldma_after.errors - ldma_before.errors;
+	outcome->bus_rx = bus_after.rx_bytes - bus_before.rx_bytes;
+}
+
+static void test_check(const char *name, bool pass, const char *why) {
+	if(pass && i2c_busy(I2C0)) {
+		pass = false;
+		why = "the bus was left busy";
+	}
+	cases++;
+	if(!pass) {
+		failures++;
+	}
+	printf("%s  %s%s%s\n", pass ? "PASS" : "FAIL", name, pass ? "" : ": ", pass ? "" : why);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read from the register pointer 0x10, checking the bytes
+ *   read are the memory's and the LDMA moved dma_bytes of them
+ *
+ ******************************************************************************/
+
+static void test_read_case(const char *name, uint32_t rx_len, uint64_t dma_bytes) {
+	const uint8_t tx[1] = {0x10};
+	uint8_t buffer[TEST_MEMORY];
+	TEST_OUTCOME outcome;
+	memset(buffer, 0, sizeof(buffer));
+	test_transfer(tx, sizeof(tx), buffer, rx_len, false, &outcome);
+	if(outcome.result != I2C_DONE) {
+		test_check(name, false, "the transfer did not end with I2C_DONE");
+	}
+	else if((outcome.payload != rx_len) || (outcome.bus_rx != rx_len) || memcmp(buffer, &memory[tx[0]], rx_len)) {
+		test_check(name, false, "the bytes read are not the memory's");
+	}
+	else {
+		test_check(name, outcome.dma_bytes == dma_bytes, "the LDMA moved another number of bytes");
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to write tx_len bytes, the register pointer 0x80 and data,
+ *   checking they reach the memory and the LDMA moved dma_bytes of them
+ *
+ ******************************************************************************/
+
+static void test_write_case(const char *name, uint32_t tx_len, uint64_t dma_bytes) {
+	uint8_t tx[TEST_MEMORY];
+	TEST_OUTCOME outcome;
+	tx[0] = 0x80;
+	for(uint32_t i = 1; i < tx_len; i++) {
+		tx[i] = (uint8_t)(0xA0 + tx_len + i);
+	}
+	test_transfer(tx, tx_len, 0, 0, false, &outcome);
+	if(outcome.result != I2C_DONE) {
+		test_check(name, false, "the transfer did not end with I2C_DONE");
+	}
+	else if(memcmp(&memory[tx[0]], &tx[1], tx_len - 1)) {
+		test_check(name, false, "the bytes written did not reach the memory");
+	}
+	else {
+		test_check(name, outcome.dma_bytes == dma_bytes, "the LDMA moved another number of bytes");
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to have the device NACK the third byte the LDMA writes
+ *
+ ******************************************************************************/
+
+static void test_write_nack(void) {
+	const uint8_t tx[6] = {0x40, 1, 2, 3, 4, 5};
+	TEST_OUTCOME outcome;
+	nack_at = 2;
+	test_transfer(tx, sizeof(tx), 0, 0, false, &outcome);
+	nack_at = TEST_NO_NACK;
+	test_check("NACK of a byte written by LDMA", outcome.result == I2C_NACKED, "the NACK was not handed back");
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to fail the LDMA after two bytes of a read
+ *
+ ******************************************************************************/
+
+static void test_ldma_error(void) {
+	const uint8_t tx[1] = {0x10};
+	uint8_t buffer[8];
+	TEST_OUTCOME outcome;
+	sim_ldma_fail(LDMA_CHANNEL_I2C0, 2);
+	test_transfer(tx, sizeof(tx), buffer, sizeof(buffer), false, &outcome);
+	if(outcome.dma_errors != 1) {
+		test_check("LDMA error during a read", false, "the error was not injected");
+	}
+	else {
+		test_check("LDMA error during a read", outcome.result == I2C_ERROR, "the error was not handed back");
+	}
+}
+
+static void test_address_nack(void) {
+	uint8_t buffer[8];
+	TEST_OUTCOME outcome;
+	nack_address = true;
+	test_transfer(0, 0, buffer, sizeof(buffer), false, &outcome);
+	nack_address = false;
+	if(outcome.result != I2C_NACKED) {
+		test_check("NACK of the read address", false, "the NACK was not handed back");
+	}
+	else {
+		test_check("NACK of the read address", !outcome.dma_bytes && !outcome.bus_rx, "bytes were read");
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to hold the LDMA interrupt off until well after the read
+ *
+ * @details
+ * 	 The interrupt runs after the second to last byte has ended.  The bus
+ * 	 must have waited for the driver's ACK of that byte instead of
+ * 	 acknowledging it automatically, the read ends on its last byte
+ *
+ ******************************************************************************/
+
+static void test_late_ldma(void) {
+	const uint8_t tx[1] = {0x20};
+	uint8_t buffer[8];
+	TEST_OUTCOME outcome;
+	memset(buffer, 0, sizeof(buffer));
+	test_transfer(tx, sizeof(tx), buffer, sizeof(buffer), true, &outcome);
+	if(outcome.result != I2C_DONE) {
+		test_check("late LDMA interrupt", false, "the transfer did not end with I2C_DONE");
+	}
+	else if(outcome.bus_rx != sizeof(buffer)) {
+		test_check("late LDMA interrupt", false, "another number of bytes was read on the bus");
+	}
+	else {
+		test_check("late LDMA interrupt", !memcmp(buffer, &memory[tx[0]], sizeof(buffer)),
+				"the bytes read are not the memory's");
+	}
+}
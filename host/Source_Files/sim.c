@@ -0,0 +1,978 @@
+/**
+ * @file sim.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Core of the host simulator: virtual clock, register traps and interrupts
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#define _GNU_SOURCE
+#include <execinfo.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "sim_emlib.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_EFLAGS_TF			0x100	// x86 trap flag, single steps the trapped access
+#define SIM_PF_WRITE			0x2		// page fault error code of a write
+#define SIM_FATAL_FRAMES		32		// calls shown of the stack of an error
+#define SIM_RUN_LIMIT			1000	// events of one instant before a model is taken to be stuck
+#define SIM_REX					0x40	// x86-64 REX prefix, its low nibble is W R X B
+#define SIM_REX_W				0x08
+#define SIM_REX_R				0x04
+#define SIM_MOV_LOAD			0x8B	// mov r32, r/m32
+#define SIM_MOV_STORE			0x89	// mov r/m32, r32
+#define SIM_MOV_IMM				0xC7	// mov r/m32, imm32
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static uint8_t			*alias;		// simulator's view of the register windows
+static SIM_PERIPH		*periph_at[SIM_PERIPH_COUNT];
+static SIM_PERIPH		*periphs;	// ordered by interrupt number, the order they are taken in
+static SIM_SOURCE		*sources;
+
+static SIM_STATS		stats;
+static uint32_t			mode;		// sim_modes of the core
+static uint64_t			next_event = SIM_NEVER;	// earliest next of the sources
+static uint64_t			sync_at = SIM_NEVER;	// earliest change of a register read untrapped
+static uint64_t			cycle_ns;	// remainder of the cycles converted to ns, in ns * SystemCoreClock
+static uint64_t			end_at = SIM_NEVER;
+static void				(*report)(void);
+static bool				tracing;	// trapped accesses are printed
+
+static uint64_t			irq_enabled;	// NVIC enables, one bit per interrupt number
+static bool				irq_dirty;	// a flag or an enable may have changed since the last check
+static CORE_irqState_t	primask;
+static bool				handler;	// the core is in handler mode
+static uint32_t			deep_mode = SIM_EM2;	// mode of SLEEPDEEP, EM2 or EM3 as last entered
+
+// The register access being single stepped
+static struct {
+	SIM_PERIPH			*periph;
+	uint32_t			reg;
+	uint32_t			old;		// value before a write
+	bool				write;
+} trap;
+
+// General registers of the signal context by their x86 encoding
+static const int		gregs_of[16] = {REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+							REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15};
+
+DWT_Type				sim_dwt;
+CoreDebug_Type			sim_core_debug;
+SCB_Type				sim_scb;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static SIM_PERIPH *sim_periph_find(uintptr_t address);
+static volatile uint32_t *sim_reg(SIM_PERIPH *periph, uint32_t reg);
+static int sim_prot(SIM_PERIPH *periph, uint32_t reg);
+static void sim_segv(int sig, siginfo_t *info, void *context);
+static bool sim_emulate(ucontext_t *uc, SIM_PERIPH *periph, uint32_t reg, bool write);
+static void sim_step(int sig, siginfo_t *info, void *context);
+static void sim_written(SIM_PERIPH *periph, uint32_t reg, uint32_t value);
+static void sim_access(SIM_PERIPH *periph);
+static void sim_step_to(uint64_t t);
+static void sim_advance_to(uint64_t t);
+static void sim_run_due(void);
+static SIM_PERIPH *sim_irq_pending(void);
+static void sim_irq_take(SIM_PERIPH *periph, bool tail);
+static void sim_wfi(uint32_t sleep_mode);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to map the peripheral registers and install the traps
+ *
+ * @details
+ * 	 The register windows are one shared memory object mapped twice: at the
+ * 	 fixed addresses the firmware uses, protected register by register, and
+ * 	 once more for the simulator, which reads and writes the registers as the
+ * 	 silicon would without trapping.  A protected access faults and the fault
+ * 	 handler makes it, or opens the page and single steps an access it cannot
+ * 	 decode, then the trap handler protects the page again and hands a write
+ * 	 to the peripheral model
+ *
+ * @note
+ *   This function is called once, before any peripheral is added
+ *
+ ******************************************************************************/
+
+void sim_open(void) {
+	size_t size = SIM_PERIPH_COUNT * SIM_PERIPH_SIZE;
+	if(sysconf(_SC_PAGESIZE) != SIM_REG_SIZE) {
+		sim_fatal("the registers are trapped with %lu byte pages, the host has %ld", SIM_REG_SIZE, sysconf(_SC_PAGESIZE));
+	}
+	int fd = memfd_create("sim_registers", 0);
+	if((fd < 0) || (ftruncate(fd, size) != 0)) {
+		sim_fatal("no memory for the register windows");
+	}
+	void *view = mmap((void *) SIM_PERIPH_BASE, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+	if(view != (void *) SIM_PERIPH_BASE) {
+		sim_fatal("the register windows cannot be mapped at 0x%lx", SIM_PERIPH_BASE);
+	}
+	alias = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(alias == MAP_FAILED) {
+		sim_fatal("the register windows cannot be mapped for the simulator");
+	}
+	close(fd);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = sim_segv;
+	sigaction(SIGSEGV, &action, 0);
+	action.sa_sigaction = sim_step;
+	sigaction(SIGTRAP, &action, 0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to print the trapped register accesses, with their offsets
+ *
+ ******************************************************************************/
+
+void sim_trace(bool enable) {
+	tracing = enable;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add a source of events to the virtual clock
+ *
+ * @param[in] source
+ *   Is the device or peripheral, it must stay valid for the run
+ *
+ ******************************************************************************/
+
+void sim_source_add(SIM_SOURCE *source) {
+	source->link = sources;
+	sources = source;
+	sim_reschedule();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add a peripheral and protect its registers
+ *
+ * @details
+ * 	 Peripherals are kept in the order of their interrupt numbers, the order
+ * 	 in which the NVIC takes interrupts of the same priority
+ *
+ * @param[in] periph
+ *   Is the peripheral, it must stay valid for the run
+ *
+ ******************************************************************************/
+
+void sim_periph_add(SIM_PERIPH *periph) {
+	uint32_t window = (periph->base - SIM_PERIPH_BASE) / SIM_PERIPH_SIZE;
+	if((periph->base < SIM_PERIPH_BASE) || (window >= SIM_PERIPH_COUNT) || periph_at[window]) {
+		sim_fatal("%s has no free register window", periph->source.name);
+	}
+	periph_at[window] = periph;
+	for(uint32_t reg = 0; reg < periph->registers; reg++) {
+		mprotect((void *)(periph->base + reg * SIM_REG_SIZE), SIM_REG_SIZE, sim_prot(periph, reg));
+	}
+
+	SIM_PERIPH **link = &periphs;
+	while(*link && ((*link)->irq < periph->irq)) {
+		link = &(*link)->link;
+	}
+	periph->link = *link;
+	*link = periph;
+	sim_source_add(&periph->source);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the simulator's view of a firmware register address
+ *
+ * @param[in] address
+ *   Is the address the firmware uses
+ *
+ * @return
+ *   The same register, accessed without a trap
+ *
+ ******************************************************************************/
+
+void *sim_alias(uintptr_t address) {
+	return alias + (address - SIM_PERIPH_BASE);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read a register as a bus master other than the core
+ *
+ * @details
+ * 	 The read has the side effects of a read by the core, such as taking a
+ * 	 byte out of a receive buffer, without costing the core cycles
+ *
+ * @note
+ *   This function is called by the LDMA model
+ *
+ ******************************************************************************/
+
+uint32_t sim_register_read(uintptr_t address) {
+	SIM_PERIPH *periph = sim_periph_find(address);
+	if(!periph) {
+		sim_fatal("read of 0x%lx, no register", (unsigned long) address);
+	}
+	uint32_t reg = (address - periph->base) / SIM_REG_SIZE;
+	if((periph->access[reg] == SIM_TRAP_ALL) && periph->read) {
+		*sim_reg(periph, reg) = periph->read(periph, reg);
+		sim_reschedule();
+		irq_dirty = true;
+	}
+	return *sim_reg(periph, reg);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to write a register as a bus master other than the core
+ *
+ * @note
+ *   This function is called by the LDMA model and by the emlib functions
+ *
+ ******************************************************************************/
+
+void sim_register_write(uintptr_t address, uint32_t value) {
+	SIM_PERIPH *periph = sim_periph_find(address);
+	if(!periph) {
+		sim_fatal("write of 0x%lx, no register", (unsigned long) address);
+	}
+	uint32_t reg = (address - periph->base) / SIM_REG_SIZE;
+	if((periph->access[reg] != SIM_RW) && periph->write) {
+		periph->write(periph, reg, value);
+		sim_reschedule();
+	}
+	else {
+		*sim_reg(periph, reg) = value;
+	}
+	irq_dirty = true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the virtual time
+ *
+ * @return
+ *   ns since the start of the run
+ *
+ ******************************************************************************/
+
+uint64_t sim_now(void) {
+	return stats.now;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the energy mode of the core
+ *
+ ******************************************************************************/
+
+uint32_t sim_mode(void) {
+	return mode;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the next event after a model changed
+ *
+ * @details
+ * 	 Asks every source for its next event and every peripheral for the next
+ * 	 change of the registers the firmware reads untrapped, such as a counter
+ *
+ * @note
+ *   This function is called by the models whenever they schedule or cancel
+ *   an event outside their run function
+ *
+ ******************************************************************************/
+
+void sim_reschedule(void) {
+	next_event = SIM_NEVER;
+	for(SIM_SOURCE *source = sources; source; source = source->link) {
+		uint64_t next = source->next(source);
+		if(next < next_event) {
+			next_event = next;
+		}
+	}
+	sync_at = SIM_NEVER;
+	for(SIM_PERIPH *periph = periphs; periph; periph = periph->link) {
+		if(periph->sync) {
+			uint64_t next = periph->sync(periph, stats.now);
+			if(next < sync_at) {
+				sync_at = next;
+			}
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to run the core for a number of cycles
+ *
+ * @details
+ * 	 The cycles are converted to time at the current core clock, so a clock
+ * 	 band change changes the time the same work takes.  The DWT cycle counter
+ * 	 counts them while it is enabled, it stops while the core sleeps
+ *
+ * @param[in] cycles
+ *   Is the number of HFCLK cycles
+ *
+ ******************************************************************************/
+
+void sim_cpu(uint32_t cycles) {
+	uint32_t hz = SystemCoreClock ? SystemCoreClock : 1;
+	stats.cycles += cycles;
+	if(sim_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) {
+		sim_dwt.CYCCNT += cycles;
+	}
+	cycle_ns += (uint64_t) cycles * SIM_NS_PER_S;
+	uint64_t ns = cycle_ns / hz;
+	cycle_ns -= ns * hz;
+	sim_advance_to(stats.now + ns);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to let time pass without the core running
+ *
+ * @param[in] ns
+ *   Is the time in ns
+ *
+ ******************************************************************************/
+
+void sim_advance(uint64_t ns) {
+	sim_advance_to(stats.now + ns);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the NVIC enable of an interrupt
+ *
+ ******************************************************************************/
+
+void sim_irq_enable(IRQn_Type irq, bool enable) {
+	if(enable) {
+		irq_enabled |= 1ULL << irq;
+	}
+	else {
+		irq_enabled &= ~(1ULL << irq);
+	}
+	irq_dirty = true;
+	sim_irq_service();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to take the pending interrupts
+ *
+ * @details
+ * 	 Interrupts are taken at the points the core could be interrupted: the
+ * 	 end of a critical section, a firmware function call and the wake from a
+ * 	 sleep.  They are taken lowest number first, tail chained.  When the last
+ * 	 one returns to thread mode with SLEEPONEXIT set, the core sleeps again in
+ * 	 the mode of SLEEPDEEP without returning to the main loop
+ *
+ * @note
+ *   This function does nothing in handler mode or in a critical section
+ *
+ ******************************************************************************/
+
+void sim_irq_service(void) {
+	if(primask || handler) {
+		return;
+	}
+	irq_dirty = false;
+	bool returned = false;	// an exception returned, the core may sleep on exit
+	bool tail = false;
+	for(;;) {
+		SIM_PERIPH *periph = sim_irq_pending();
+		if(periph) {
+			sim_irq_take(periph, tail);
+			returned = true;
+			tail = true;
+			continue;
+		}
+		if(returned && (sim_scb.SCR & SCB_SCR_SLEEPONEXIT_Msk)) {
+			sim_wfi((sim_scb.SCR & SCB_SCR_SLEEPDEEP_Msk) ? deep_mode : SIM_EM1);
+			tail = false;
+			continue;
+		}
+		break;
+	}
+	if(stats.now >= end_at) {
+		sim_finish();
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set PRIMASK
+ *
+ * @details
+ * 	 Interrupts that became pending in the critical section are taken as it
+ * 	 ends
+ *
+ * @return
+ *   The PRIMASK before
+ *
+ ******************************************************************************/
+
+CORE_irqState_t sim_primask_set(CORE_irqState_t set) {
+	CORE_irqState_t was = primask;
+	primask = set;
+	if(!primask) {
+		sim_irq_service();
+	}
+	return was;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to tell whether the core is in handler mode
+ *
+ ******************************************************************************/
+
+bool sim_in_handler(void) {
+	return handler;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to execute a WFI in an energy mode
+ *
+ * @details
+ * 	 The core sleeps until an enabled interrupt is pending, then takes it if
+ * 	 PRIMASK is clear.  With PRIMASK set the wake returns here, as the
+ * 	 firmware's sleep entry does, and the interrupt is taken at the end of
+ * 	 its critical section
+ *
+ * @note
+ *   This function is called by the EMU_EnterEMx functions
+ *
+ ******************************************************************************/
+
+void sim_sleep(uint32_t sleep_mode) {
+	if(sleep_mode >= SIM_EM2) {
+		deep_mode = sleep_mode;
+		sim_scb.SCR |= SCB_SCR_SLEEPDEEP_Msk;
+	}
+	else {
+		sim_scb.SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+	}
+	sim_wfi(sleep_mode);
+	sim_irq_service();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the length of the run
+ *
+ * @param[in] end
+ *   Is the virtual time the run ends at
+ *
+ * @param[in] report_fn
+ *   Is called once the run ended, before the simulator exits
+ *
+ ******************************************************************************/
+
+void sim_end(uint64_t end, void (*report_fn)(void)) {
+	end_at = end;
+	report = report_fn;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end the run
+ *
+ ******************************************************************************/
+
+void sim_finish(void) {
+	if(report) {
+		report();
+	}
+	fflush(stdout);
+	exit(0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to stop the run on an error of the firmware or of the simulator
+ *
+ ******************************************************************************/
+
+void sim_fatal(const char *format, ...) {
+	va_list args;
+	fflush(stdout);
+	fprintf(stderr, "sim: at %llu.%09llu s: ", (unsigned long long)(stats.now / SIM_NS_PER_S),
+			(unsigned long long)(stats.now % SIM_NS_PER_S));
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fprintf(stderr, "\n");
+	void *frames[SIM_FATAL_FRAMES];
+	backtrace_symbols_fd(frames, backtrace(frames, SIM_FATAL_FRAMES), STDERR_FILENO);
+	exit(2);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the run so far
+ *
+ ******************************************************************************/
+
+void sim_stats(SIM_STATS *totals) {
+	*totals = stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to walk the peripherals, in interrupt number order
+ *
+ ******************************************************************************/
+
+SIM_PERIPH *sim_periphs(void) {
+	return periphs;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to walk the sources of events
+ *
+ ******************************************************************************/
+
+SIM_SOURCE *sim_sources(void) {
+	return sources;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function called at the entry of every firmware function
+ *
+ * @details
+ * 	 The firmware is built with -finstrument-functions, so every call costs
+ * 	 the core SIM_CALL_CYCLES, and is a point interrupts can be taken at
+ *
+ ******************************************************************************/
+
+void __cyg_profile_func_enter(void *function, void *site) {
+	(void) function;
+	(void) site;
+	stats.calls++;
+	sim_cpu(SIM_CALL_CYCLES);
+	if(irq_dirty) {
+		sim_irq_service();
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function called at the exit of every firmware function
+ *
+ ******************************************************************************/
+
+void __cyg_profile_func_exit(void *function, void *site) {
+	(void) function;
+	(void) site;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the peripheral of a firmware address
+ *
+ * @return
+ *   The peripheral, or 0 if the address is not one of its registers
+ *
+ ******************************************************************************/
+
+static SIM_PERIPH *sim_periph_find(uintptr_t address) {
+	if((address < SIM_PERIPH_BASE) || (address >= SIM_PERIPH_BASE + SIM_PERIPH_COUNT * SIM_PERIPH_SIZE)) {
+		return 0;
+	}
+	SIM_PERIPH *periph = periph_at[(address - SIM_PERIPH_BASE) / SIM_PERIPH_SIZE];
+	if(!periph || (address >= periph->base + periph->registers * SIM_REG_SIZE)) {
+		return 0;
+	}
+	return periph;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the simulator's view of a register
+ *
+ ******************************************************************************/
+
+static volatile uint32_t *sim_reg(SIM_PERIPH *periph, uint32_t reg) {
+	return sim_alias(periph->base + reg * SIM_REG_SIZE);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the page protection of a register
+ *
+ ******************************************************************************/
+
+static int sim_prot(SIM_PERIPH *periph, uint32_t reg) {
+	switch(periph->access[reg]) {
+		case SIM_TRAP_WRITE:
+			return PROT_READ;
+		case SIM_TRAP_ALL:
+			return PROT_NONE;
+		default:
+			return PROT_READ | PROT_WRITE;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to handle a trapped register access
+ *
+ * @details
+ * 	 The access costs the core its cycles before it is made, so a status
+ * 	 polled in a loop sees time pass.  A read takes its value from the model,
+ * 	 then a plain 32 bit move is made here and stepped over.  Any other
+ * 	 instruction is single stepped with the page opened
+ *
+ * @note
+ *   A fault outside the register windows is the firmware's own, the default
+ *   action is restored so it ends the process as it would without the traps
+ *
+ ******************************************************************************/
+
+static void sim_segv(int sig, siginfo_t *info, void *context) {
+	ucontext_t *uc = context;
+	uintptr_t address = (uintptr_t) info->si_addr;
+	SIM_PERIPH *periph = sim_periph_find(address);
+	(void) sig;
+	if(!periph || trap.periph) {
+		sim_fatal("segmentation fault at 0x%lx, pc 0x%llx", (unsigned long) address,
+				(unsigned long long) uc->uc_mcontext.gregs[REG_RIP]);
+	}
+	uint32_t reg = (address - periph->base) / SIM_REG_SIZE;
+	trap.periph = periph;
+	trap.reg = reg;
+	trap.write = (uc->uc_mcontext.gregs[REG_ERR] & SIM_PF_WRITE) != 0;
+	sim_access(periph);
+	if(!trap.write && periph->read) {
+		*sim_reg(periph, reg) = periph->read(periph, reg);
+		sim_reschedule();
+		irq_dirty = true;
+	}
+	if(tracing && !trap.write) {
+		printf("%12.6f %s[0x%02x] -> 0x%08lx\n", (double) stats.now / SIM_NS_PER_S, periph->source.name,
+				reg * 4, (unsigned long) *sim_reg(periph, reg));
+	}
+	if(sim_emulate(uc, periph, reg, trap.write)) {
+		trap.periph = 0;
+		return;
+	}
+	trap.old = *sim_reg(periph, reg);
+	mprotect((void *)(periph->base + reg * SIM_REG_SIZE), SIM_REG_SIZE, PROT_READ | PROT_WRITE);
+	uc->uc_mcontext.gregs[REG_EFL] |= SIM_EFLAGS_TF;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to make a trapped access that is a 32 bit mov in the handler
+ *
+ * @details
+ * 	 The firmware's register accesses compile to mov with a ModRM operand,
+ * 	 the address is the fault's so only the length of the operand is decoded.
+ * 	 Making the move here saves opening the page and the single step, the two
+ * 	 most of the cost of a trap
+ *
+ * @return
+ *   true if the access was made and the pc moved past it
+ *
+ ******************************************************************************/
+
+static bool sim_emulate(ucontext_t *uc, SIM_PERIPH *periph, uint32_t reg, bool write) {
+	greg_t *gregs = uc->uc_mcontext.gregs;
+	const uint8_t *pc = (const uint8_t *) gregs[REG_RIP];
+	const uint8_t *at = pc;
+	uint8_t rex = 0;
+	if((*at & 0xF0) == SIM_REX) {
+		rex = *at++;
+	}
+	uint8_t opcode = *at++;
+	if((rex & SIM_REX_W) || ((opcode != SIM_MOV_LOAD) && (opcode != SIM_MOV_STORE) && (opcode != SIM_MOV_IMM))) {
+		return false;
+	}
+	uint8_t modrm = *at++;
+	uint32_t mod = modrm >> 6;
+	uint32_t operand = ((modrm >> 3) & 0x7) | ((rex & SIM_REX_R) ? 0x8 : 0);
+	uint32_t rm = modrm & 0x7;
+	if((mod == 3) || ((opcode == SIM_MOV_IMM) && (operand & 0x7))) {
+		return false;
+	}
+	if(rm == 4) {
+		uint8_t sib = *at++;
+		if((mod == 0) && ((sib & 0x7) == 5)) {
+			at += 4;	// no base, a 32 bit displacement
+		}
+	}
+	else if((mod == 0) && (rm == 5)) {
+		at += 4;		// rip relative
+	}
+	at += (mod == 1) ? 1 : ((mod == 2) ? 4 : 0);
+
+	volatile uint32_t *value = sim_reg(periph, reg);
+	if(opcode == SIM_MOV_LOAD) {
+		if(write) {
+			return false;
+		}
+		gregs[gregs_of[operand]] = *value;		// a 32 bit move zero extends
+	}
+	else if(opcode == SIM_MOV_STORE) {
+		sim_written(periph, reg, (uint32_t) gregs[gregs_of[operand]]);
+	}
+	else {
+		uint32_t imm;
+		memcpy(&imm, at, sizeof(imm));
+		at += sizeof(imm);
+		sim_written(periph, reg, imm);
+	}
+	gregs[REG_RIP] = (greg_t) at;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to finish a trapped register access after its single step
+ *
+ * @details
+ * 	 The register is put back to its value before a write, the model then
+ * 	 acts on the value written as the silicon would, such as executing a
+ * 	 command or clearing flags
+ *
+ ******************************************************************************/
+
+static void sim_step(int sig, siginfo_t *info, void *context) {
+	ucontext_t *uc = context;
+	(void) info;
+	SIM_PERIPH *periph = trap.periph;
+	if(!periph) {
+		signal(sig, SIG_DFL);
+		return;
+	}
+	uc->uc_mcontext.gregs[REG_EFL] &= ~SIM_EFLAGS_TF;
+	trap.periph = 0;
+	volatile uint32_t *reg = sim_reg(periph, trap.reg);
+	mprotect((void *)(periph->base + trap.reg * SIM_REG_SIZE), SIM_REG_SIZE, sim_prot(periph, trap.reg));
+	if(trap.write) {
+		uint32_t value = *reg;
+		*reg = trap.old;
+		sim_written(periph, trap.reg, value);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to hand a value the core wrote to the peripheral model
+ *
+ * @details
+ * 	 The model acts on the value as the silicon would, such as executing a
+ * 	 command or clearing flags, the register itself is the model's to set
+ *
+ ******************************************************************************/
+
+static void sim_written(SIM_PERIPH *periph, uint32_t reg, uint32_t value) {
+	if(tracing) {
+		printf("%12.6f %s[0x%02x] <- 0x%08lx\n", (double) stats.now / SIM_NS_PER_S, periph->source.name,
+				reg * 4, (unsigned long) value);
+	}
+	if(periph->write) {
+		periph->write(periph, reg, value);
+	}
+	sim_reschedule();
+	irq_dirty = true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to count a trapped access and its cost
+ *
+ ******************************************************************************/
+
+static void sim_access(SIM_PERIPH *periph) {
+	stats.traps++;
+	periph->accesses++;
+	if(!sim_clock_on(periph->clock)) {
+		periph->gated++;
+	}
+	sim_cpu(SIM_ACCESS_CYCLES);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to move the virtual clock, without events in between
+ *
+ ******************************************************************************/
+
+static void sim_step_to(uint64_t t) {
+	if(t <= stats.now) {
+		return;
+	}
+	stats.residency[mode] += t - stats.now;
+	stats.now = t;
+	if(stats.now >= sync_at) {
+		sync_at = SIM_NEVER;
+		for(SIM_PERIPH *periph = periphs; periph; periph = periph->link) {
+			if(periph->sync) {
+				uint64_t next = periph->sync(periph, stats.now);
+				if(next < sync_at) {
+					sync_at = next;
+				}
+			}
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to move the virtual clock, handling the events on the way
+ *
+ ******************************************************************************/
+
+static void sim_advance_to(uint64_t t) {
+	while(next_event <= t) {
+		sim_step_to(next_event);
+		sim_run_due();
+	}
+	sim_step_to(t);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to handle the events due now
+ *
+ * @details
+ * 	 An event of a source whose clock the energy mode stops is still handled,
+ * 	 it is counted as frozen: the firmware slept too deep for the peripheral
+ *
+ ******************************************************************************/
+
+static void sim_run_due(void) {
+	for(int round = 0; next_event <= stats.now; round++) {
+		if(round == SIM_RUN_LIMIT) {
+			sim_fatal("a model keeps scheduling events at the same time");
+		}
+		for(SIM_SOURCE *source = sources; source; source = source->link) {
+			if(source->next(source) <= stats.now) {
+				if(mode > source->domain) {
+					source->frozen++;
+				}
+				source->events++;
+				source->run(source, stats.now);
+			}
+		}
+		sim_reschedule();
+	}
+	irq_dirty = true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the interrupt the NVIC takes next
+ *
+ * @return
+ *   The peripheral of the lowest numbered pending and enabled interrupt, or 0
+ *
+ ******************************************************************************/
+
+static SIM_PERIPH *sim_irq_pending(void) {
+	for(SIM_PERIPH *periph = periphs; periph; periph = periph->link) {
+		if(periph->flags && ((irq_enabled >> periph->irq) & 1) && (*periph->flags & *periph->enables)) {
+			return periph;
+		}
+	}
+	return 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to take an interrupt
+ *
+ * @details
+ * 	 The handler runs in handler mode with the active vector and RETTOBASE
+ * 	 set in the ICSR, as the only active exception.  Entry, tail chaining
+ * 	 and return cost their cycles
+ *
+ ******************************************************************************/
+
+static void sim_irq_take(SIM_PERIPH *periph, bool tail) {
+	if(!periph->handler) {
+		sim_fatal("%s interrupt without a handler", periph->source.name);
+	}
+	handler = true;
+	sim_scb.ICSR = (periph->irq + 16) | SCB_ICSR_RETTOBASE_Msk;
+	stats.irqs++;
+	periph->irqs++;
+	sim_cpu(tail ? SIM_IRQ_TAIL_CYCLES : SIM_IRQ_ENTRY_CYCLES);
+	periph->handler();
+	sim_cpu(SIM_IRQ_EXIT_CYCLES);
+	sim_scb.ICSR = 0;
+	handler = false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to sleep until an interrupt is pending
+ *
+ * @details
+ * 	 The virtual clock jumps from event to event until one makes an enabled
+ * 	 interrupt pending.  Waking from EM2 or EM3 takes SIM_EM23_WAKE_NS, which
+ * 	 is counted as EM0.  The run ends here when its end comes first, and
+ * 	 stops with an error when nothing is left to wake the core
+ *
+ ******************************************************************************/
+
+static void sim_wfi(uint32_t sleep_mode) {
+	if(sim_irq_pending()) {
+		stats.no_sleeps++;
+		return;
+	}
+	stats.wakes++;
+	mode = sleep_mode;
+	while(!sim_irq_pending()) {
+		if(next_event == SIM_NEVER) {
+			sim_fatal("the core sleeps in EM%lu with nothing left to wake it", (unsigned long) sleep_mode);
+		}
+		if(next_event >= end_at) {
+			sim_advance_to(end_at);
+			mode = SIM_EM0;
+			sim_finish();
+		}
+		sim_advance_to(next_event);
+	}
+	mode = SIM_EM0;
+	if(sleep_mode >= SIM_EM2) {
+		sim_advance(SIM_EM23_WAKE_NS);
+	}
+}
@@ -0,0 +1,342 @@
+/**
+ * @file sim_emlib.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated core, clock, energy and GPIO functions of emlib
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdio.h>
+
+#include "em_assert.h"
+#include "em_chip.h"
+#include "em_core.h"
+#include "em_emu.h"
+
+#include "sim.h"
+#include "sim_emlib.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static bool						clock_enabled[cmuClock_COUNT];
+static CMU_Select_TypeDef		clock_select[cmuClock_COUNT];
+static CMU_HFRCOFreq_TypeDef	hfrco_band = cmuHFRCOFreq_19M0Hz;
+static SIM_CMU_STATS			cmu_stats;
+
+static uint32_t					pin_out[gpioPortCount];
+static GPIO_Mode_TypeDef		pin_mode[gpioPortCount][SIM_PINS];
+static SIM_PIN_WATCH			pin_watch[gpioPortCount][SIM_PINS];
+
+uint32_t						SystemCoreClock = cmuHFRCOFreq_19M0Hz;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sim_gpio_drive(GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, bool out);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to tell whether a peripheral or oscillator clock runs
+ *
+ * @details
+ * 	 The low energy peripherals also need the low energy interface clock and
+ * 	 an oscillator selected for their branch
+ *
+ ******************************************************************************/
+
+bool sim_clock_on(CMU_Clock_TypeDef clock) {
+	switch(clock) {
+		case cmuClock_HF:
+		case cmuClock_CORE:
+			return true;
+		case cmuClock_LFA:
+		case cmuClock_LFB:
+			return clock_select[clock] != cmuSelect_Disabled;
+		case cmuClock_LETIMER0:
+			return clock_enabled[clock] && clock_enabled[cmuClock_CORELE] && sim_clock_on(cmuClock_LFA);
+		case cmuClock_LEUART0:
+			return clock_enabled[clock] && clock_enabled[cmuClock_CORELE] && sim_clock_on(cmuClock_LFB);
+		case cmuClock_I2C0:
+		case cmuClock_I2C1:
+		case cmuClock_TIMER0:
+			return clock_enabled[clock] && clock_enabled[cmuClock_HFPER];
+		default:
+			return clock_enabled[clock];
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the frequency of a clock branch
+ *
+ ******************************************************************************/
+
+uint32_t sim_clock_hz(CMU_Clock_TypeDef clock) {
+	switch(clock) {
+		case cmuClock_LFA:
+		case cmuClock_LFB:
+			return (clock_select[clock] == cmuSelect_ULFRCO) ? SIM_ULFRCO_HZ : SIM_LFXO_HZ;
+		case cmuClock_LETIMER0:
+			return sim_clock_hz(cmuClock_LFA);
+		case cmuClock_LEUART0:
+			return sim_clock_hz(cmuClock_LFB);
+		default:
+			return hfrco_band;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the clock management unit
+ *
+ ******************************************************************************/
+
+void sim_cmu_stats(SIM_CMU_STATS *stats) {
+	*stats = cmu_stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to be told when the level driven on a pin changes
+ *
+ * @param[in] watch
+ *   Is called with the new level, a pin has one watcher
+ *
+ ******************************************************************************/
+
+void sim_gpio_watch(GPIO_Port_TypeDef port, unsigned int pin, SIM_PIN_WATCH watch) {
+	pin_watch[port][pin] = watch;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the level driven on a pin, low unless it is an output
+ *
+ ******************************************************************************/
+
+bool sim_gpio_level(GPIO_Port_TypeDef port, unsigned int pin) {
+	return (pin_mode[port][pin] == gpioModePushPull) && (pin_out[port] & (1 << pin));
+}
+
+//***********************************************************************************
+// Core
+//***********************************************************************************
+
+void CHIP_Init(void) {
+	sim_cpu(SIM_LIB_CYCLES);
+}
+
+CORE_irqState_t CORE_EnterCritical(void) {
+	sim_cpu(SIM_CRITICAL_CYCLES);
+	return sim_primask_set(1);
+}
+
+void CORE_ExitCritical(CORE_irqState_t irqState) {
+	sim_cpu(SIM_CRITICAL_CYCLES);
+	sim_primask_set(irqState);
+}
+
+bool CORE_InIrqContext(void) {
+	return sim_in_handler();
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) {
+	sim_cpu(SIM_CRITICAL_CYCLES);
+	sim_irq_enable(IRQn, true);
+}
+
+void NVIC_DisableIRQ(IRQn_Type IRQn) {
+	sim_cpu(SIM_CRITICAL_CYCLES);
+	sim_irq_enable(IRQn, false);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to clear a pending interrupt
+ *
+ * @details
+ * 	 The interrupts are level sensitive, one whose flags are still set and
+ * 	 enabled pends again at once, so there is nothing to clear
+ *
+ ******************************************************************************/
+
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {
+	(void) IRQn;
+	sim_cpu(SIM_CRITICAL_CYCLES);
+}
+
+void SystemCoreClockUpdate(void) {
+	sim_cpu(SIM_LIB_CYCLES);
+	SystemCoreClock = hfrco_band;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function called by EFM_ASSERT when the assertion fails
+ *
+ * @details
+ * 	 On the board the debugger stops in the loop of the emlib version, here
+ * 	 the run stops with the place of the failed assertion
+ *
+ ******************************************************************************/
+
+void assertEFM(const char *file, int line) {
+	sim_fatal("EFM_ASSERT failed at %s:%d", file, line);
+}
+
+//***********************************************************************************
+// EMU
+//***********************************************************************************
+
+bool EMU_DCDCInit(const EMU_DCDCInit_TypeDef *dcdcInit) {
+	(void) dcdcInit;
+	sim_cpu(SIM_LIB_CYCLES);
+	return true;
+}
+
+void EMU_EM23Init(const EMU_EM23Init_TypeDef *em23Init) {
+	(void) em23Init;
+	sim_cpu(SIM_LIB_CYCLES);
+}
+
+void EMU_EnterEM1(void) {
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_sleep(SIM_EM1);
+}
+
+void EMU_EnterEM2(bool restore) {
+	(void) restore;
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_sleep(SIM_EM2);
+}
+
+void EMU_EnterEM3(bool restore) {
+	(void) restore;
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_sleep(SIM_EM3);
+}
+
+//***********************************************************************************
+// CMU
+//***********************************************************************************
+
+void CMU_ClockEnable(CMU_Clock_TypeDef clock, bool enable) {
+	sim_cpu(SIM_LIB_CYCLES);
+	if(enable && !clock_enabled[clock]) {
+		cmu_stats.enables[clock]++;
+	}
+	clock_enabled[clock] = enable;
+}
+
+uint32_t CMU_ClockFreqGet(CMU_Clock_TypeDef clock) {
+	sim_cpu(SIM_LIB_CYCLES);
+	return sim_clock_hz(clock);
+}
+
+void CMU_ClockSelectSet(CMU_Clock_TypeDef clock, CMU_Select_TypeDef ref) {
+	sim_cpu(SIM_LIB_CYCLES);
+	clock_select[clock] = ref;
+}
+
+void CMU_OscillatorEnable(CMU_Osc_TypeDef osc, bool enable, bool wait) {
+	(void) osc;
+	(void) enable;
+	(void) wait;
+	sim_cpu(SIM_LIB_CYCLES);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to change the band of the HFRCO
+ *
+ * @details
+ * 	 As emlib, SystemCoreClock follows the band, the simulated core runs at
+ * 	 the new frequency from here on
+ *
+ ******************************************************************************/
+
+void CMU_HFRCOBandSet(CMU_HFRCOFreq_TypeDef setFreq) {
+	sim_cpu(SIM_LIB_CYCLES);
+	if(setFreq != hfrco_band) {
+		cmu_stats.band_changes++;
+	}
+	hfrco_band = setFreq;
+	SystemCoreClock = hfrco_band;
+}
+
+CMU_HFRCOFreq_TypeDef CMU_HFRCOBandGet(void) {
+	sim_cpu(SIM_LIB_CYCLES);
+	return hfrco_band;
+}
+
+void CMU_HFXOInit(const CMU_HFXOInit_TypeDef *hfxoInit) {
+	(void) hfxoInit;
+	sim_cpu(SIM_LIB_CYCLES);
+}
+
+//***********************************************************************************
+// GPIO
+//***********************************************************************************
+
+void GPIO_DriveStrengthSet(GPIO_Port_TypeDef port, GPIO_DriveStrength_TypeDef strength) {
+	(void) port;
+	(void) strength;
+	sim_cpu(SIM_LIB_CYCLES);
+}
+
+void GPIO_PinModeSet(GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, unsigned int out) {
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_gpio_drive(port, pin, mode, out);
+}
+
+void GPIO_PinOutSet(GPIO_Port_TypeDef port, unsigned int pin) {
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_gpio_drive(port, pin, pin_mode[port][pin], true);
+}
+
+void GPIO_PinOutClear(GPIO_Port_TypeDef port, unsigned int pin) {
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_gpio_drive(port, pin, pin_mode[port][pin], false);
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the mode and output of a pin, telling its watcher when
+ *   the level driven changes
+ *
+ ******************************************************************************/
+
+static void sim_gpio_drive(GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, bool out) {
+	EFM_ASSERT((port < gpioPortCount) && (pin < SIM_PINS));
+	bool was = sim_gpio_level(port, pin);
+	pin_mode[port][pin] = mode;
+	if(out) {
+		pin_out[port] |= 1 << pin;
+	}
+	else {
+		pin_out[port] &= ~(1 << pin);
+	}
+	bool level = sim_gpio_level(port, pin);
+	if((level != was) && pin_watch[port][pin]) {
+		pin_watch[port][pin](level);
+	}
+}
@@ -0,0 +1,182 @@
+/**
+ * @file sim_hm18.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated HM-18 BLE module on LEUART0, a phone connected through it
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <string.h>
+
+#include "sim.h"
+#include "sim_leuart.h"
+#include "sim_hm18.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_HM18_NAME_CMD		"AT+NAME"
+#define SIM_HM18_NAME_REPLY		"OK+Set:"
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static SIM_SOURCE			source;
+static char					line[SIM_HM18_LINE];	// line being received
+static uint32_t				length;
+static uint64_t				command_at = SIM_NEVER;	// end of the quiet after an AT command
+static uint64_t				query_period;
+static uint64_t				query_at = SIM_NEVER;
+static const char			*query_text;
+static uint32_t				oldest;		// index of the oldest line in stats.last
+static SIM_HM18_STATS		stats;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sim_hm18_receive(uint8_t byte);
+static void sim_hm18_keep(void);
+static void sim_hm18_reply(const char *text);
+static void sim_hm18_command(void);
+static uint64_t sim_hm18_next(SIM_SOURCE *source);
+static void sim_hm18_run(SIM_SOURCE *source, uint64_t now);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to put the HM-18 on LEUART0
+ *
+ * @param[in] query_ns
+ *   Period the phone sends query at, 0 for never
+ *
+ * @param[in] query
+ *   Text the phone sends
+ *
+ ******************************************************************************/
+
+void sim_hm18_open(uint64_t query_ns, const char *query) {
+	query_period = query_ns;
+	query_text = query;
+	query_at = query_ns ? query_ns : SIM_NEVER;
+	source.name = "HM-18";
+	source.next = sim_hm18_next;
+	source.run = sim_hm18_run;
+	source.domain = SIM_EM3;	// the module has its own clock
+	sim_source_add(&source);
+	sim_leuart_attach(sim_hm18_receive);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the HM-18, the lines kept oldest first
+ *
+ ******************************************************************************/
+
+void sim_hm18_stats(SIM_HM18_STATS *totals) {
+	*totals = stats;
+	for(uint32_t i = 0; i < stats.kept; i++) {
+		memcpy(totals->last[i], stats.last[(oldest + i) % SIM_HM18_LINES], SIM_HM18_LINE);
+	}
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to take a frame from the firmware
+ *
+ * @details
+ * 	 AT commands have no terminator, the module answers one when the line
+ * 	 has been quiet for SIM_HM18_COMMAND_GAP_NS.  Anything else is sent on to
+ * 	 the phone a line at a time
+ *
+ ******************************************************************************/
+
+static void sim_hm18_receive(uint8_t byte) {
+	stats.bytes++;
+	if(byte == '\n') {
+		sim_hm18_keep();
+		return;
+	}
+	if(length < SIM_HM18_LINE - 1) {
+		line[length++] = byte;
+	}
+	if((length >= 2) && !strncmp(line, "AT", 2)) {
+		command_at = sim_now() + SIM_HM18_COMMAND_GAP_NS;
+		sim_reschedule();
+	}
+}
+
+static void sim_hm18_keep(void) {
+	line[length] = 0;
+	if(!length) {
+		stats.keepalives++;
+		return;
+	}
+	stats.lines++;
+	if(stats.kept < SIM_HM18_LINES) {
+		strcpy(stats.last[stats.kept++], line);
+	}
+	else {
+		strcpy(stats.last[oldest], line);
+		oldest = (oldest + 1) % SIM_HM18_LINES;
+	}
+	length = 0;
+}
+
+static void sim_hm18_reply(const char *text) {
+	sim_leuart_send((const uint8_t *) text, strlen(text));
+	stats.replies++;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to answer the AT command received, as the HM-10 datasheet does
+ *
+ ******************************************************************************/
+
+static void sim_hm18_command(void) {
+	char reply[sizeof(SIM_HM18_NAME_REPLY) + SIM_HM18_LINE];
+	line[length] = 0;
+	if(!strcmp(line, "AT")) {
+		sim_hm18_reply("OK");
+	}
+	else if(!strcmp(line, "AT+RESET")) {
+		sim_hm18_reply("OK+RESET");
+	}
+	else if(!strncmp(line, SIM_HM18_NAME_CMD, strlen(SIM_HM18_NAME_CMD))) {
+		strcpy(reply, SIM_HM18_NAME_REPLY);
+		strcat(reply, line + strlen(SIM_HM18_NAME_CMD));
+		sim_hm18_reply(reply);
+	}
+	length = 0;
+}
+
+static uint64_t sim_hm18_next(SIM_SOURCE *source) {
+	(void) source;
+	return (command_at < query_at) ? command_at : query_at;
+}
+
+static void sim_hm18_run(SIM_SOURCE *source, uint64_t now) {
+	(void) source;
+	if(command_at <= now) {
+		command_at = SIM_NEVER;
+		sim_hm18_command();
+	}
+	if(query_at <= now) {
+		query_at += query_period;
+		sim_leuart_send((const uint8_t *) query_text, strlen(query_text));
+		stats.queries++;
+	}
+}
@@ -0,0 +1,570 @@
+/**
+ * @file sim_i2c.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated I2C0 and I2C1 masters and their buses
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "em_i2c.h"
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_i2c.h"
+#include "sim_ldma.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_I2C_BUSES			2
+
+// Phases of the bus, the master is busy on the bus in all but SIM_I2C_IDLE
+enum sim_i2c_states {
+	SIM_I2C_IDLE,			//0, bus free
+	SIM_I2C_HOLD,			//1, SCL held, waiting for data or a command
+	SIM_I2C_RESET,			//2, START and STOP on an idle bus
+	SIM_I2C_ADDRESS,		//3, START and the address byte
+	SIM_I2C_TX,				//4, a data byte written
+	SIM_I2C_RX,				//5, a data byte read
+	SIM_I2C_RX_FULL,		//6, a byte read, the receive buffer is full
+	SIM_I2C_RX_ANSWER,		//7, a byte read, waiting for ACK or NACK
+	SIM_I2C_NACK,			//8, the master's NACK
+	SIM_I2C_STOP			//9, STOP condition
+} ;
+
+// The answer to a byte being read, given before it is read
+enum sim_i2c_answers {
+	SIM_I2C_ANSWER_NONE,
+	SIM_I2C_ANSWER_ACK,
+	SIM_I2C_ANSWER_NACK
+} ;
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+typedef struct {
+	SIM_PERIPH				periph;
+	I2C_TypeDef				*regs;		// the simulator's view
+	SIM_I2C_DEVICE			*devices;
+	SIM_I2C_DEVICE			*device;	// addressed by the last address phase
+	uint32_t				state;		// sim_i2c_states
+	uint64_t				phase_end;	// end of the phase on the bus, or SIM_NEVER
+	uint64_t				busy_from;
+	bool					start;		// START issued, not yet sent
+	bool					stop;		// STOP issued, not yet sent
+	uint32_t				answer;		// sim_i2c_answers of the byte being read
+	bool					reading;
+	bool					nacked;
+	bool					tx_full;
+	uint8_t					tx_byte;
+	bool					rx_full;
+	uint8_t					rx_byte;
+	uint8_t					shift;
+	uint32_t				ref_hz;		// HFPERCLK the bus frequency was set for
+	uint32_t				scl_hz;
+	SIM_I2C_STATS			stats;
+} SIM_I2C ;
+
+static SIM_I2C				buses[SIM_I2C_BUSES];
+
+static const uint8_t		access[SIM_REG_COUNT(I2C_TypeDef)] = {
+	[SIM_REG_INDEX(I2C_TypeDef, CMD)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, STATE)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, STATUS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, RXDATA)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, RXDOUBLE)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, RXDATAP)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, RXDOUBLEP)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, TXDATA)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, TXDOUBLE)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, IF)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, IFS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(I2C_TypeDef, IFC)] = SIM_TRAP_ALL
+};
+
+extern void I2C0_IRQHandler(void) __attribute__((weak));
+extern void I2C1_IRQHandler(void) __attribute__((weak));
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static SIM_I2C *sim_i2c_bus(I2C_TypeDef *i2c);
+static uint64_t sim_i2c_next(SIM_SOURCE *source);
+static void sim_i2c_run(SIM_SOURCE *source, uint64_t now);
+static uint32_t sim_i2c_read(SIM_PERIPH *periph, uint32_t reg);
+static void sim_i2c_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value);
+static void sim_i2c_command(SIM_I2C *bus, uint32_t cmd);
+static void sim_i2c_phase(SIM_I2C *bus, uint32_t state, uint32_t bits);
+static void sim_i2c_kick(SIM_I2C *bus);
+static void sim_i2c_received(SIM_I2C *bus, uint8_t byte);
+static void sim_i2c_flags(SIM_I2C *bus);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add I2C0 and I2C1 to the simulator
+ *
+ ******************************************************************************/
+
+void sim_i2c_open(void) {
+	static const char *names[SIM_I2C_BUSES] = {"I2C0", "I2C1"};
+	static const uintptr_t bases[SIM_I2C_BUSES] = {I2C0_BASE, I2C1_BASE};
+	static const CMU_Clock_TypeDef clocks[SIM_I2C_BUSES] = {cmuClock_I2C0, cmuClock_I2C1};
+	static const IRQn_Type irqs[SIM_I2C_BUSES] = {I2C0_IRQn, I2C1_IRQn};
+	void (*handlers[SIM_I2C_BUSES])(void) = {I2C0_IRQHandler, I2C1_IRQHandler};
+
+	for(int i = 0; i < SIM_I2C_BUSES; i++) {
+		SIM_I2C *bus = &buses[i];
+		bus->regs = SIM_ALIAS((I2C_TypeDef *) bases[i]);
+		bus->state = SIM_I2C_IDLE;
+		bus->phase_end = SIM_NEVER;
+		bus->ref_hz = SystemCoreClock;
+		bus->scl_hz = I2C_FREQ_STANDARD_MAX;
+		bus->periph.source.name = names[i];
+		bus->periph.source.next = sim_i2c_next;
+		bus->periph.source.run = sim_i2c_run;
+		bus->periph.source.domain = SIM_EM1;
+		bus->periph.base = bases[i];
+		bus->periph.access = access;
+		bus->periph.registers = SIM_REG_COUNT(I2C_TypeDef);
+		bus->periph.clock = clocks[i];
+		bus->periph.read = sim_i2c_read;
+		bus->periph.write = sim_i2c_write;
+		bus->periph.flags = &bus->regs->IF;
+		bus->periph.enables = &bus->regs->IEN;
+		bus->periph.irq = irqs[i];
+		bus->periph.handler = handlers[i];
+		sim_i2c_flags(bus);
+		sim_periph_add(&bus->periph);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to put a slave on a bus
+ *
+ ******************************************************************************/
+
+void sim_i2c_attach(I2C_TypeDef *i2c, SIM_I2C_DEVICE *device) {
+	SIM_I2C *bus = sim_i2c_bus(i2c);
+	device->link = bus->devices;
+	bus->devices = device;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of a bus
+ *
+ ******************************************************************************/
+
+void sim_i2c_stats(I2C_TypeDef *i2c, SIM_I2C_STATS *stats) {
+	*stats = sim_i2c_bus(i2c)->stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to enable the peripheral and set its bus frequency
+ *
+ ******************************************************************************/
+
+void I2C_Init(I2C_TypeDef *i2c, const I2C_Init_TypeDef *init) {
+	SIM_I2C *bus = sim_i2c_bus(i2c);
+	sim_cpu(SIM_LIB_CYCLES);
+	I2C_BusFreqSet(i2c, init->refFreq, init->freq, init->clhr);
+	if(init->enable) {
+		bus->regs->CTRL |= I2C_CTRL_EN;
+	}
+	else {
+		bus->regs->CTRL &= ~I2C_CTRL_EN;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the SCL frequency
+ *
+ * @details
+ * 	 The divider is set for the HFPERCLK given, or the current one for 0.  The
+ * 	 bus runs at the frequency set scaled by HFPERCLK now over HFPERCLK then,
+ * 	 so a band change the divider was not set again for is seen on the bus
+ *
+ ******************************************************************************/
+
+void I2C_BusFreqSet(I2C_TypeDef *i2c, uint32_t freqRef, uint32_t freqScl, I2C_ClockHLR_TypeDef i2cMode) {
+	SIM_I2C *bus = sim_i2c_bus(i2c);
+	(void) i2cMode;
+	sim_cpu(SIM_LIB_CYCLES);
+	bus->ref_hz = freqRef ? freqRef : sim_clock_hz(cmuClock_HFPER);
+	bus->scl_hz = freqScl;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the model of a peripheral
+ *
+ ******************************************************************************/
+
+static SIM_I2C *sim_i2c_bus(I2C_TypeDef *i2c) {
+	if(i2c == I2C0) {
+		return &buses[0];
+	}
+	if(i2c != I2C1) {
+		sim_fatal("no I2C at %p", (void *) i2c);
+	}
+	return &buses[1];
+}
+
+static uint64_t sim_i2c_next(SIM_SOURCE *source) {
+	return SIM_MODEL(SIM_I2C, periph.source, source)->phase_end;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end the phase on the bus
+ *
+ * @details
+ * 	 The addressed slave acknowledges and takes or gives its byte as the
+ * 	 phase ends.  After a NACK or a written byte the master holds SCL until
+ * 	 it is given data or a command, as the silicon does
+ *
+ ******************************************************************************/
+
+static void sim_i2c_run(SIM_SOURCE *source, uint64_t now) {
+	SIM_I2C *bus = SIM_MODEL(SIM_I2C, periph.source, source);
+	uint32_t state = bus->state;
+	bus->phase_end = SIM_NEVER;
+	bus->state = SIM_I2C_HOLD;
+	switch(state) {
+		case SIM_I2C_RESET:
+			bus->state = SIM_I2C_IDLE;
+			bus->regs->IF |= I2C_IF_MSTOP;
+			break;
+		case SIM_I2C_ADDRESS: {
+			bool ack = false;
+			bus->reading = bus->shift & 1;
+			bus->device = 0;
+			for(SIM_I2C_DEVICE *device = bus->devices; device; device = device->link) {
+				if(device->address == (bus->shift >> 1)) {
+					bus->device = device;
+					ack = device->address_ack(bus->reading);
+				}
+			}
+			bus->nacked = !ack;
+			if(!ack) {
+				bus->stats.nacks++;
+				bus->regs->IF |= I2C_IF_NACK;
+				break;
+			}
+			bus->regs->IF |= I2C_IF_ACK;
+			if(bus->reading) {
+				sim_i2c_phase(bus, SIM_I2C_RX, SIM_I2C_BITS_RX);
+			}
+			else if(!bus->tx_full) {
+				bus->regs->IF |= I2C_IF_TXC;
+			}
+			break;
+		}
+		case SIM_I2C_TX: {
+			bool ack = bus->device->write(bus->shift);
+			bus->stats.tx_bytes++;
+			bus->nacked = !ack;
+			if(!ack) {
+				bus->stats.nacks++;
+			}
+			bus->regs->IF |= ack ? I2C_IF_ACK : I2C_IF_NACK;
+			if(!bus->tx_full) {
+				bus->regs->IF |= I2C_IF_TXC;
+			}
+			break;
+		}
+		case SIM_I2C_RX: {
+			uint8_t byte = bus->device->read();
+			bus->stats.rx_bytes++;
+			if(bus->rx_full) {
+				bus->shift = byte;
+				bus->state = SIM_I2C_RX_FULL;
+			}
+			else {
+				sim_i2c_received(bus, byte);
+			}
+			break;
+		}
+		case SIM_I2C_NACK:
+			break;
+		case SIM_I2C_STOP:
+			bus->state = SIM_I2C_IDLE;
+			bus->regs->IF |= I2C_IF_MSTOP;
+			bus->stats.transfers++;
+			bus->stats.busy_ns += now - bus->busy_from;
+			if(bus->device) {
+				bus->device->stop();
+				bus->device = 0;
+			}
+			break;
+		default:
+			sim_fatal("%s phase %lu has no end", source->name, (unsigned long) state);
+	}
+	sim_i2c_kick(bus);
+	sim_i2c_flags(bus);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read a trapped register
+ *
+ * @details
+ * 	 Reading RXDATA takes the byte out of the receive buffer, which lets a
+ * 	 byte held in the shift register in
+ *
+ ******************************************************************************/
+
+static uint32_t sim_i2c_read(SIM_PERIPH *periph, uint32_t reg) {
+	SIM_I2C *bus = SIM_MODEL(SIM_I2C, periph, periph);
+	switch(reg) {
+		case SIM_REG_INDEX(I2C_TypeDef, RXDATA): {
+			uint8_t byte = bus->rx_byte;
+			bus->rx_full = false;
+			if(bus->state == SIM_I2C_RX_FULL) {
+				sim_i2c_received(bus, bus->shift);
+			}
+			sim_i2c_flags(bus);
+			return byte;
+		}
+		case SIM_REG_INDEX(I2C_TypeDef, RXDATAP):
+			return bus->rx_byte;
+		case SIM_REG_INDEX(I2C_TypeDef, STATE): {
+			uint32_t value = bus->nacked ? I2C_STATE_NACKED : 0;
+			if(bus->state == SIM_I2C_IDLE) {
+				return value | I2C_STATE_STATE_IDLE;
+			}
+			value |= I2C_STATE_BUSY | I2C_STATE_MASTER | (bus->reading ? 0 : I2C_STATE_TRANSMITTER);
+			switch(bus->state) {
+				case SIM_I2C_HOLD:
+				case SIM_I2C_RX_FULL:
+				case SIM_I2C_RX_ANSWER:
+					return value | I2C_STATE_STATE_WAIT;
+				case SIM_I2C_ADDRESS:
+					return value | I2C_STATE_STATE_ADDR;
+				default:
+					return value | I2C_STATE_STATE_DATA;
+			}
+		}
+		case SIM_REG_INDEX(I2C_TypeDef, STATUS):
+			return (bus->tx_full ? 0 : I2C_STATUS_TXBL) | (bus->rx_full ? I2C_STATUS_RXDATAV : 0) |
+					(bus->regs->IF & I2C_IF_TXC ? I2C_STATUS_TXC : 0);
+		case SIM_REG_INDEX(I2C_TypeDef, IF):
+			return bus->regs->IF;
+		default:
+			return 0;	// write only
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to act on a trapped write
+ *
+ ******************************************************************************/
+
+static void sim_i2c_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value) {
+	SIM_I2C *bus = SIM_MODEL(SIM_I2C, periph, periph);
+	switch(reg) {
+		case SIM_REG_INDEX(I2C_TypeDef, CMD):
+			sim_i2c_command(bus, value);
+			break;
+		case SIM_REG_INDEX(I2C_TypeDef, TXDATA):
+			if(bus->tx_full) {
+				bus->regs->IF |= I2C_IF_TXOF;
+			}
+			bus->tx_byte = value;
+			bus->tx_full = true;
+			sim_i2c_kick(bus);
+			break;
+		case SIM_REG_INDEX(I2C_TypeDef, IFS):
+			bus->regs->IF |= value & I2C_IF_MASK;
+			break;
+		case SIM_REG_INDEX(I2C_TypeDef, IFC):
+			bus->regs->IF &= ~(value & I2C_IF_MASK);
+			break;
+		default:
+			break;		// read only
+	}
+	sim_i2c_flags(bus);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to execute the bits of a CMD write
+ *
+ * @details
+ * 	 START and STOP wait for the phase on the bus to end.  ACK and NACK
+ * 	 answer the byte received, or the one being read when given early.
+ * 	 ABORT frees the bus at once, without a STOP on it
+ *
+ ******************************************************************************/
+
+static void sim_i2c_command(SIM_I2C *bus, uint32_t cmd) {
+	if(cmd & I2C_CMD_ABORT) {
+		bus->state = SIM_I2C_IDLE;
+		bus->phase_end = SIM_NEVER;
+		bus->start = false;
+		bus->stop = false;
+		bus->answer = SIM_I2C_ANSWER_NONE;
+		bus->nacked = false;
+		if(bus->device) {
+			bus->device->stop();
+			bus->device = 0;
+		}
+	}
+	if(cmd & I2C_CMD_CLEARTX) {
+		bus->tx_full = false;
+	}
+	if(cmd & I2C_CMD_CONT) {
+		bus->nacked = false;
+	}
+	if(cmd & (I2C_CMD_ACK | I2C_CMD_NACK)) {
+		uint32_t answer = (cmd & I2C_CMD_NACK) ? SIM_I2C_ANSWER_NACK : SIM_I2C_ANSWER_ACK;
+		if(bus->state == SIM_I2C_RX_ANSWER) {
+			if(answer == SIM_I2C_ANSWER_ACK) {
+				sim_i2c_phase(bus, SIM_I2C_RX, SIM_I2C_BITS_ACK + SIM_I2C_BITS_RX);
+			}
+			else {
+				sim_i2c_phase(bus, SIM_I2C_NACK, SIM_I2C_BITS_ACK);
+			}
+		}
+		else if((bus->state == SIM_I2C_RX) || (bus->state == SIM_I2C_RX_FULL)) {
+			bus->answer = answer;
+		}
+	}
+	if(cmd & I2C_CMD_START) {
+		bus->start = true;
+	}
+	if(cmd & I2C_CMD_STOP) {
+		bus->stop = true;
+	}
+	sim_i2c_kick(bus);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start a phase on the bus
+ *
+ * @details
+ * 	 The bit time is that of the divider set, stretched or shrunk by the
+ * 	 HFPERCLK band the divider was not set for
+ *
+ ******************************************************************************/
+
+static void sim_i2c_phase(SIM_I2C *bus, uint32_t state, uint32_t bits) {
+	uint64_t hfper = sim_clock_hz(cmuClock_HFPER);
+	uint64_t bit_ns = (SIM_NS_PER_S * bus->ref_hz + bus->scl_hz * hfper - 1) / (bus->scl_hz * hfper);
+	bus->state = state;
+	bus->phase_end = sim_now() + bits * bit_ns;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start the next phase while the master holds or frees the bus
+ *
+ ******************************************************************************/
+
+static void sim_i2c_kick(SIM_I2C *bus) {
+	if((bus->state != SIM_I2C_IDLE) && (bus->state != SIM_I2C_HOLD)) {
+		return;
+	}
+	if(bus->state == SIM_I2C_IDLE) {
+		if(bus->start && bus->stop && !bus->tx_full) {
+			bus->start = false;
+			bus->stop = false;
+			bus->stats.resets++;
+			sim_i2c_phase(bus, SIM_I2C_RESET, SIM_I2C_BITS_START + SIM_I2C_BITS_STOP);
+			return;
+		}
+		bus->stop = false;	// no STOP on a free bus
+	}
+	else if(bus->stop) {
+		bus->stop = false;
+		sim_i2c_phase(bus, SIM_I2C_STOP, SIM_I2C_BITS_STOP);
+		return;
+	}
+	if(bus->start && bus->tx_full) {
+		if(bus->state == SIM_I2C_IDLE) {
+			bus->busy_from = sim_now();
+		}
+		else if(bus->device) {
+			bus->device->stop();	// repeated START
+		}
+		bus->start = false;
+		bus->tx_full = false;
+		bus->shift = bus->tx_byte;
+		bus->stats.addresses++;
+		sim_i2c_phase(bus, SIM_I2C_ADDRESS, SIM_I2C_BITS_START + SIM_I2C_BITS_BYTE);
+	}
+	else if((bus->state == SIM_I2C_HOLD) && !bus->start && !bus->reading && !bus->nacked && bus->tx_full) {
+		bus->tx_full = false;
+		bus->shift = bus->tx_byte;
+		sim_i2c_phase(bus, SIM_I2C_TX, SIM_I2C_BITS_BYTE);
+	}
+	sim_i2c_flags(bus);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to put a byte read into the receive buffer and answer it
+ *
+ * @details
+ * 	 With AUTOACK set as the byte comes in, the ACK and the next byte follow
+ * 	 at once, otherwise the master waits for an ACK or NACK command unless
+ * 	 one was given early
+ *
+ ******************************************************************************/
+
+static void sim_i2c_received(SIM_I2C *bus, uint8_t byte) {
+	bus->rx_byte = byte;
+	bus->rx_full = true;
+	uint32_t answer = bus->answer;
+	bus->answer = SIM_I2C_ANSWER_NONE;
+	if((answer == SIM_I2C_ANSWER_NONE) && (bus->regs->CTRL & I2C_CTRL_AUTOACK)) {
+		answer = SIM_I2C_ANSWER_ACK;
+	}
+	switch(answer) {
+		case SIM_I2C_ANSWER_ACK:
+			sim_i2c_phase(bus, SIM_I2C_RX, SIM_I2C_BITS_ACK + SIM_I2C_BITS_RX);
+			break;
+		case SIM_I2C_ANSWER_NACK:
+			sim_i2c_phase(bus, SIM_I2C_NACK, SIM_I2C_BITS_ACK);
+			break;
+		default:
+			bus->state = SIM_I2C_RX_ANSWER;
+			break;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to update the level flags and the LDMA requests
+ *
+ * @details
+ * 	 TXBL and RXDATAV follow the buffers, they are not cleared by IFC
+ *
+ ******************************************************************************/
+
+static void sim_i2c_flags(SIM_I2C *bus) {
+	uint32_t flags = bus->regs->IF & ~(I2C_IF_TXBL | I2C_IF_RXDATAV);
+	flags |= bus->tx_full ? 0 : I2C_IF_TXBL;
+	flags |= bus->rx_full ? I2C_IF_RXDATAV : 0;
+	bus->regs->IF = flags;
+	sim_ldma_poll();
+}
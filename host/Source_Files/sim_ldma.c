@@ -0,0 +1,349 @@
+/**
+ * @file sim_ldma.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated LDMA, moving bytes between memory and the I2C buffers
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "em_ldma.h"
+
+#include "sim.h"
+#include "sim_ldma.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_LDMA_NO_FAIL		UINT32_MAX
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+typedef struct {
+	bool					active;
+	LDMA_PeripheralSignal_t	signal;
+	const LDMA_Descriptor_t	*descriptor;	// transfer descriptor being moved
+	uintptr_t				src;
+	uintptr_t				dst;
+	uint32_t				src_inc;
+	uint32_t				dst_inc;
+	uint32_t				left;		// bytes still to move
+	uint32_t				moved;		// bytes moved by this transfer
+	uint32_t				fail_at;	// bytes moved before an injected error
+} SIM_LDMA_CHANNEL ;
+
+static SIM_PERIPH			ldma;
+static LDMA_TypeDef			*regs;		// the simulator's view
+static SIM_LDMA_CHANNEL		channels[DMA_CHAN_COUNT];
+static uint32_t				fail_next[DMA_CHAN_COUNT];
+static SIM_LDMA_STATS		stats;
+static bool					polling;
+
+static const uint8_t		access[SIM_REG_COUNT(LDMA_TypeDef)] = {
+	[SIM_REG_INDEX(LDMA_TypeDef, SWREQ)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LDMA_TypeDef, IF)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LDMA_TypeDef, IFS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LDMA_TypeDef, IFC)] = SIM_TRAP_ALL
+};
+
+extern void LDMA_IRQHandler(void) __attribute__((weak));
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t sim_ldma_next(SIM_SOURCE *source);
+static void sim_ldma_run(SIM_SOURCE *source, uint64_t now);
+static uint32_t sim_ldma_read(SIM_PERIPH *periph, uint32_t reg);
+static void sim_ldma_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value);
+static bool sim_ldma_request(LDMA_PeripheralSignal_t signal);
+static void sim_ldma_load(uint32_t ch, const LDMA_Descriptor_t *descriptor);
+static void sim_ldma_done(uint32_t ch);
+static void sim_ldma_move(uint32_t ch);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add the LDMA to the simulator
+ *
+ ******************************************************************************/
+
+void sim_ldma_open(void) {
+	regs = SIM_ALIAS(LDMA);
+	for(int ch = 0; ch < DMA_CHAN_COUNT; ch++) {
+		fail_next[ch] = SIM_LDMA_NO_FAIL;
+	}
+	ldma.source.name = "LDMA";
+	ldma.source.next = sim_ldma_next;
+	ldma.source.run = sim_ldma_run;
+	ldma.source.domain = SIM_EM1;
+	ldma.base = LDMA_BASE;
+	ldma.access = access;
+	ldma.registers = SIM_REG_COUNT(LDMA_TypeDef);
+	ldma.clock = cmuClock_LDMA;
+	ldma.read = sim_ldma_read;
+	ldma.write = sim_ldma_write;
+	ldma.flags = &regs->IF;
+	ldma.enables = &regs->IEN;
+	ldma.irq = LDMA_IRQn;
+	ldma.handler = LDMA_IRQHandler;
+	sim_periph_add(&ldma);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to serve the peripheral requests of the active channels
+ *
+ * @details
+ * 	 A channel moves a byte for each request of its signal, taking no time,
+ * 	 until its count is done, then sets its done flag.  A move can raise
+ * 	 another request, the channels are served until none is left
+ *
+ * @note
+ *   This function is called by the peripheral models when a buffer changes
+ *
+ ******************************************************************************/
+
+void sim_ldma_poll(void) {
+	if(polling) {
+		return;
+	}
+	polling = true;
+	bool moved;
+	do {
+		moved = false;
+		for(uint32_t ch = 0; ch < DMA_CHAN_COUNT; ch++) {
+			if(channels[ch].active && sim_ldma_request(channels[ch].signal)) {
+				sim_ldma_move(ch);
+				moved = true;
+			}
+		}
+	} while(moved);
+	polling = false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to make the next transfer of a channel end in an error
+ *
+ * @param[in] bytes
+ *   Is the number of bytes the transfer moves before the error
+ *
+ ******************************************************************************/
+
+void sim_ldma_fail(uint32_t channel, uint32_t bytes) {
+	fail_next[channel] = bytes;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the LDMA
+ *
+ ******************************************************************************/
+
+void sim_ldma_stats(SIM_LDMA_STATS *totals) {
+	*totals = stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to reset the LDMA and enable its interrupt
+ *
+ ******************************************************************************/
+
+void LDMA_Init(const LDMA_Init_t *init) {
+	(void) init;
+	sim_cpu(SIM_LIB_CYCLES);
+	regs->CHEN = 0;
+	regs->IEN = LDMA_IEN_ERROR;
+	NVIC_EnableIRQ(LDMA_IRQn);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start a transfer of a list of descriptors
+ *
+ ******************************************************************************/
+
+void LDMA_StartTransfer(int ch, const LDMA_TransferCfg_t *transfer, const LDMA_Descriptor_t *descriptor) {
+	sim_cpu(SIM_LIB_CYCLES);
+	SIM_LDMA_CHANNEL *channel = &channels[ch];
+	channel->signal = transfer->ldmaReqSel;
+	channel->moved = 0;
+	channel->fail_at = fail_next[ch];
+	fail_next[ch] = SIM_LDMA_NO_FAIL;
+	stats.transfers[ch]++;
+	regs->IF &= ~(1 << ch);
+	regs->CHDONE &= ~(1 << ch);
+	regs->CHEN |= 1 << ch;
+	regs->IEN |= 1 << ch;
+	sim_ldma_load(ch, descriptor);
+	sim_ldma_poll();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to stop a channel, leaving its flags
+ *
+ ******************************************************************************/
+
+void LDMA_StopTransfer(int ch) {
+	sim_cpu(SIM_LIB_CYCLES);
+	channels[ch].active = false;
+	regs->IEN &= ~(1 << ch);
+	regs->CHEN &= ~(1 << ch);
+}
+
+bool LDMA_TransferDone(int ch) {
+	sim_cpu(SIM_LIB_CYCLES);
+	return (regs->CHDONE >> ch) & 1;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t sim_ldma_next(SIM_SOURCE *source) {
+	(void) source;
+	return SIM_NEVER;
+}
+
+static void sim_ldma_run(SIM_SOURCE *source, uint64_t now) {
+	(void) source;
+	(void) now;
+}
+
+static uint32_t sim_ldma_read(SIM_PERIPH *periph, uint32_t reg) {
+	(void) periph;
+	return (reg == SIM_REG_INDEX(LDMA_TypeDef, IF)) ? regs->IF : 0;
+}
+
+static void sim_ldma_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value) {
+	(void) periph;
+	switch(reg) {
+		case SIM_REG_INDEX(LDMA_TypeDef, IFS):
+			regs->IF |= value;
+			break;
+		case SIM_REG_INDEX(LDMA_TypeDef, IFC):
+			regs->IF &= ~value;
+			break;
+		default:
+			break;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to tell whether a peripheral request signal is raised
+ *
+ ******************************************************************************/
+
+static bool sim_ldma_request(LDMA_PeripheralSignal_t signal) {
+	switch(signal) {
+		case ldmaPeripheralSignal_I2C0_TXBL:
+			return SIM_ALIAS(I2C0)->IF & I2C_IF_TXBL;
+		case ldmaPeripheralSignal_I2C0_RXDATAV:
+			return SIM_ALIAS(I2C0)->IF & I2C_IF_RXDATAV;
+		case ldmaPeripheralSignal_I2C1_TXBL:
+			return SIM_ALIAS(I2C1)->IF & I2C_IF_TXBL;
+		case ldmaPeripheralSignal_I2C1_RXDATAV:
+			return SIM_ALIAS(I2C1)->IF & I2C_IF_RXDATAV;
+		default:
+			return false;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to move one byte of a channel
+ *
+ * @details
+ * 	 Peripheral registers are accessed as the bus master would, with their
+ * 	 side effects, memory as memory
+ *
+ ******************************************************************************/
+
+static void sim_ldma_move(uint32_t ch) {
+	SIM_LDMA_CHANNEL *channel = &channels[ch];
+	if(channel->moved == channel->fail_at) {
+		channel->active = false;
+		regs->CHEN &= ~(1 << ch);
+		regs->IF |= LDMA_IF_ERROR;
+		stats.errors++;
+		return;
+	}
+	uint8_t byte;
+	if(channel->src_inc) {
+		byte = *(uint8_t *) channel->src;
+		channel->src++;
+	}
+	else {
+		byte = sim_register_read(channel->src);
+	}
+	if(channel->dst_inc) {
+		*(uint8_t *) channel->dst = byte;
+		channel->dst++;
+	}
+	else {
+		sim_register_write(channel->dst, byte);
+	}
+	channel->moved++;
+	stats.bytes[ch]++;
+	if(!--channel->left) {
+		sim_ldma_done(ch);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to load a descriptor into a channel
+ *
+ * @details
+ * 	 A write descriptor is executed as it is loaded, a transfer descriptor
+ * 	 waits for the requests of its signal
+ *
+ ******************************************************************************/
+
+static void sim_ldma_load(uint32_t ch, const LDMA_Descriptor_t *descriptor) {
+	SIM_LDMA_CHANNEL *channel = &channels[ch];
+	channel->descriptor = descriptor;
+	channel->active = true;
+	if(descriptor->xfer.structType == ldmaCtrlStructTypeWrite) {
+		sim_register_write(descriptor->wri.dstAddr, descriptor->wri.immVal);
+		sim_ldma_done(ch);
+		return;
+	}
+	channel->src = descriptor->xfer.srcAddr;
+	channel->dst = descriptor->xfer.dstAddr;
+	channel->src_inc = descriptor->xfer.srcInc;
+	channel->dst_inc = descriptor->xfer.dstInc;
+	channel->left = descriptor->xfer.xferCnt + 1;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end a descriptor, loading the one it links to
+ *
+ ******************************************************************************/
+
+static void sim_ldma_done(uint32_t ch) {
+	const LDMA_Descriptor_t *descriptor = channels[ch].descriptor;
+	if(descriptor->xfer.doneIfs) {
+		regs->IF |= 1 << ch;
+	}
+	if(descriptor->xfer.link) {
+		sim_ldma_load(ch, descriptor + descriptor->xfer.linkAddr / 4);
+		return;
+	}
+	channels[ch].active = false;
+	regs->CHEN &= ~(1 << ch);
+	regs->CHDONE |= 1 << ch;
+}
@@ -0,0 +1,312 @@
+/**
+ * @file sim_letimer.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated LETIMER0, a down counter on the LFA clock
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "em_letimer.h"
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_letimer.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_LETIMER_MATCHES		3		// COMP0, COMP1 and the underflow
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static SIM_PERIPH			letimer;
+static LETIMER_TypeDef		*regs;		// the simulator's view
+static bool					running;
+static uint32_t				hz;			// LFA clock while running
+static uint64_t				tick_start;	// LFA tick the counter held start_cnt at
+static uint64_t				tick_done;	// last LFA tick whose flags are set
+static uint32_t				start_cnt;
+static uint32_t				top;		// loaded on an underflow
+static uint64_t				next_event = SIM_NEVER;
+
+static const uint32_t		match_flags[SIM_LETIMER_MATCHES] = {LETIMER_IF_COMP0, LETIMER_IF_COMP1, LETIMER_IF_UF};
+
+static const uint8_t		access[SIM_REG_COUNT(LETIMER_TypeDef)] = {
+	[SIM_REG_INDEX(LETIMER_TypeDef, CTRL)] = SIM_TRAP_WRITE,
+	[SIM_REG_INDEX(LETIMER_TypeDef, CMD)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LETIMER_TypeDef, STATUS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LETIMER_TypeDef, CNT)] = SIM_TRAP_WRITE,
+	[SIM_REG_INDEX(LETIMER_TypeDef, COMP0)] = SIM_TRAP_WRITE,
+	[SIM_REG_INDEX(LETIMER_TypeDef, COMP1)] = SIM_TRAP_WRITE,
+	[SIM_REG_INDEX(LETIMER_TypeDef, IF)] = SIM_TRAP_WRITE,	// not polled, kept up to date by the events
+	[SIM_REG_INDEX(LETIMER_TypeDef, IFS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LETIMER_TypeDef, IFC)] = SIM_TRAP_ALL
+	// SYNCBUSY is plain memory reading 0, the writes take effect at once
+};
+
+extern void LETIMER0_IRQHandler(void) __attribute__((weak));
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t sim_letimer_tick(uint64_t t);
+static uint64_t sim_letimer_time(uint64_t tick);
+static uint32_t sim_letimer_value(uint64_t tick);
+static uint64_t sim_letimer_match(uint32_t flag);
+static void sim_letimer_rebase(uint32_t cnt);
+static void sim_letimer_schedule(void);
+static uint64_t sim_letimer_next(SIM_SOURCE *source);
+static void sim_letimer_run(SIM_SOURCE *source, uint64_t now);
+static uint32_t sim_letimer_read(SIM_PERIPH *periph, uint32_t reg);
+static void sim_letimer_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value);
+static uint64_t sim_letimer_sync(SIM_PERIPH *periph, uint64_t now);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add LETIMER0 to the simulator
+ *
+ ******************************************************************************/
+
+void sim_letimer_open(void) {
+	regs = SIM_ALIAS(LETIMER0);
+	top = _LETIMER_CNT_MASK;
+	letimer.source.name = "LETIMER0";
+	letimer.source.next = sim_letimer_next;
+	letimer.source.run = sim_letimer_run;
+	letimer.source.domain = SIM_EM3;
+	letimer.base = LETIMER0_BASE;
+	letimer.access = access;
+	letimer.registers = SIM_REG_COUNT(LETIMER_TypeDef);
+	letimer.clock = cmuClock_LETIMER0;
+	letimer.read = sim_letimer_read;
+	letimer.write = sim_letimer_write;
+	letimer.sync = sim_letimer_sync;
+	letimer.flags = &regs->IF;
+	letimer.enables = &regs->IEN;
+	letimer.irq = LETIMER0_IRQn;
+	letimer.handler = LETIMER0_IRQHandler;
+	sim_periph_add(&letimer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to configure the LETIMER, starting it if asked
+ *
+ ******************************************************************************/
+
+void LETIMER_Init(LETIMER_TypeDef *timer, const LETIMER_Init_TypeDef *init) {
+	sim_cpu(SIM_LIB_CYCLES);
+	uint32_t ctrl = init->repMode | (init->ufoa0 << _LETIMER_CTRL_UFOA0_SHIFT) | (init->ufoa1 << _LETIMER_CTRL_UFOA1_SHIFT);
+	ctrl |= (init->out0Pol ? LETIMER_CTRL_OPOL0 : 0) | (init->out1Pol ? LETIMER_CTRL_OPOL1 : 0);
+	ctrl |= (init->bufTop ? LETIMER_CTRL_BUFTOP : 0) | (init->comp0Top ? LETIMER_CTRL_COMP0TOP : 0);
+	ctrl |= init->debugRun ? LETIMER_CTRL_DEBUGRUN : 0;
+	sim_register_write((uintptr_t) &timer->CTRL, ctrl);
+	if(init->enable) {
+		sim_register_write((uintptr_t) &timer->CMD, LETIMER_CMD_START);
+	}
+}
+
+void LETIMER_Enable(LETIMER_TypeDef *timer, bool enable) {
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_register_write((uintptr_t) &timer->CMD, enable ? LETIMER_CMD_START : LETIMER_CMD_STOP);
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t sim_letimer_tick(uint64_t t) {
+	return t * hz / SIM_NS_PER_S;
+}
+
+static uint64_t sim_letimer_time(uint64_t tick) {
+	return (tick * SIM_NS_PER_S + hz - 1) / hz;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the count at an LFA tick
+ *
+ * @details
+ * 	 The counter counts down from start_cnt, an underflow loads top
+ *
+ ******************************************************************************/
+
+static uint32_t sim_letimer_value(uint64_t tick) {
+	if(!running) {
+		return start_cnt;
+	}
+	uint64_t d = tick - tick_start;
+	if(d <= start_cnt) {
+		return start_cnt - d;
+	}
+	return top - ((d - start_cnt - 1) % ((uint64_t) top + 1));
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the first tick after tick_done that sets a flag
+ *
+ ******************************************************************************/
+
+static uint64_t sim_letimer_match(uint32_t flag) {
+	uint64_t period = (uint64_t) top + 1;
+	uint64_t first;
+	if(flag == LETIMER_IF_UF) {
+		first = (uint64_t) start_cnt + 1;
+	}
+	else {
+		uint32_t compare = (flag == LETIMER_IF_COMP0) ? regs->COMP0 : regs->COMP1;
+		if(compare > top) {
+			return SIM_NEVER;
+		}
+		first = (compare <= start_cnt) ? start_cnt - compare : (uint64_t) start_cnt + 1 + top - compare;
+	}
+	uint64_t done = tick_done - tick_start;
+	if(first <= done) {
+		first += ((done - first) / period + 1) * period;
+	}
+	return tick_start + first;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to restart the count from a value at the current tick
+ *
+ ******************************************************************************/
+
+static void sim_letimer_rebase(uint32_t cnt) {
+	start_cnt = cnt & _LETIMER_CNT_MASK;
+	top = (regs->CTRL & LETIMER_CTRL_COMP0TOP) ? (regs->COMP0 & _LETIMER_CNT_MASK) : _LETIMER_CNT_MASK;
+	if(running) {
+		tick_start = sim_letimer_tick(sim_now());
+		tick_done = tick_start;
+	}
+	regs->CNT = start_cnt;
+	sim_letimer_schedule();
+}
+
+static void sim_letimer_schedule(void) {
+	next_event = SIM_NEVER;
+	if(running) {
+		for(int i = 0; i < SIM_LETIMER_MATCHES; i++) {
+			uint64_t tick = sim_letimer_match(match_flags[i]);
+			if((tick != SIM_NEVER) && (sim_letimer_time(tick) < next_event)) {
+				next_event = sim_letimer_time(tick);
+			}
+		}
+	}
+	letimer.source.domain = (sim_clock_hz(cmuClock_LFA) == SIM_ULFRCO_HZ) ? SIM_EM3 : SIM_EM2;
+}
+
+static uint64_t sim_letimer_next(SIM_SOURCE *source) {
+	(void) source;
+	return next_event;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the flags of the matches and underflows up to now
+ *
+ ******************************************************************************/
+
+static void sim_letimer_run(SIM_SOURCE *source, uint64_t now) {
+	(void) source;
+	uint64_t tick = sim_letimer_tick(now);
+	for(int i = 0; i < SIM_LETIMER_MATCHES; i++) {
+		if(sim_letimer_match(match_flags[i]) <= tick) {
+			regs->IF |= match_flags[i];
+		}
+	}
+	tick_done = tick;
+	regs->CNT = sim_letimer_value(tick);
+	sim_letimer_schedule();
+}
+
+static uint32_t sim_letimer_read(SIM_PERIPH *periph, uint32_t reg) {
+	(void) periph;
+	switch(reg) {
+		case SIM_REG_INDEX(LETIMER_TypeDef, STATUS):
+			return running ? LETIMER_STATUS_RUNNING : 0;
+		case SIM_REG_INDEX(LETIMER_TypeDef, IF):
+			return regs->IF;
+		default:
+			return 0;	// write only
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to act on a trapped write
+ *
+ ******************************************************************************/
+
+static void sim_letimer_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value) {
+	(void) periph;
+	uint32_t cnt = sim_letimer_value(sim_letimer_tick(sim_now()));
+	switch(reg) {
+		case SIM_REG_INDEX(LETIMER_TypeDef, CMD):
+			if((value & LETIMER_CMD_START) && !running) {
+				hz = sim_clock_hz(cmuClock_LETIMER0);
+				running = true;
+			}
+			if(value & LETIMER_CMD_STOP) {
+				running = false;
+			}
+			sim_letimer_rebase((value & LETIMER_CMD_CLEAR) ? 0 : cnt);
+			break;
+		case SIM_REG_INDEX(LETIMER_TypeDef, CNT):
+			sim_letimer_rebase(value);
+			break;
+		case SIM_REG_INDEX(LETIMER_TypeDef, CTRL):
+			regs->CTRL = value;
+			sim_letimer_rebase(cnt);
+			break;
+		case SIM_REG_INDEX(LETIMER_TypeDef, COMP0):
+			regs->COMP0 = value & _LETIMER_CNT_MASK;
+			sim_letimer_rebase(cnt);
+			break;
+		case SIM_REG_INDEX(LETIMER_TypeDef, COMP1):
+			regs->COMP1 = value & _LETIMER_CNT_MASK;
+			sim_letimer_schedule();
+			break;
+		case SIM_REG_INDEX(LETIMER_TypeDef, IFS):
+			regs->IF |= value & LETIMER_IF_MASK;
+			break;
+		case SIM_REG_INDEX(LETIMER_TypeDef, IFC):
+			regs->IF &= ~(value & LETIMER_IF_MASK);
+			break;
+		default:
+			break;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to keep CNT, read without a trap, at the count of now
+ *
+ * @return
+ *   The time of the next LFA tick while running
+ *
+ ******************************************************************************/
+
+static uint64_t sim_letimer_sync(SIM_PERIPH *periph, uint64_t now) {
+	(void) periph;
+	if(!running) {
+		return SIM_NEVER;
+	}
+	uint64_t tick = sim_letimer_tick(now);
+	regs->CNT = sim_letimer_value(tick);
+	return sim_letimer_time(tick + 1);
+}
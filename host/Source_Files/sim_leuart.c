@@ -0,0 +1,342 @@
+/**
+ * @file sim_leuart.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated LEUART0, 8N1 frames on the LFB clock
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "em_leuart.h"
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_leuart.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static SIM_PERIPH			leuart;
+static LEUART_TypeDef		*regs;		// the simulator's view
+static uint32_t				baudrate = 9600;
+static bool					tx_full;
+static uint8_t				tx_byte;
+static uint8_t				tx_shift;
+static uint64_t				tx_end = SIM_NEVER;	// end of the frame being sent
+static bool					rx_full;
+static uint8_t				rx_byte;
+static uint8_t				rx_queue[SIM_LEUART_RX_QUEUE];	// frames on the line to the receiver
+static uint32_t				rx_head;
+static uint32_t				rx_count;
+static uint64_t				rx_end = SIM_NEVER;	// end of the frame being received
+static void					(*device_receive)(uint8_t byte);
+static SIM_LEUART_STATS		stats;
+
+static const uint8_t		access[SIM_REG_COUNT(LEUART_TypeDef)] = {
+	[SIM_REG_INDEX(LEUART_TypeDef, CMD)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, STATUS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, RXDATAX)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, RXDATA)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, RXDATAXP)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, TXDATAX)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, TXDATA)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, IF)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, IFS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(LEUART_TypeDef, IFC)] = SIM_TRAP_ALL
+	// SYNCBUSY is plain memory reading 0, the writes take effect at once
+};
+
+extern void LEUART0_IRQHandler(void) __attribute__((weak));
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t sim_leuart_frame_ns(void);
+static uint64_t sim_leuart_next(SIM_SOURCE *source);
+static void sim_leuart_run(SIM_SOURCE *source, uint64_t now);
+static uint32_t sim_leuart_read(SIM_PERIPH *periph, uint32_t reg);
+static void sim_leuart_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value);
+static void sim_leuart_command(uint32_t cmd);
+static void sim_leuart_kick(void);
+static void sim_leuart_flags(void);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add LEUART0 to the simulator
+ *
+ ******************************************************************************/
+
+void sim_leuart_open(void) {
+	regs = SIM_ALIAS(LEUART0);
+	leuart.source.name = "LEUART0";
+	leuart.source.next = sim_leuart_next;
+	leuart.source.run = sim_leuart_run;
+	leuart.source.domain = SIM_EM2;
+	leuart.base = LEUART0_BASE;
+	leuart.access = access;
+	leuart.registers = SIM_REG_COUNT(LEUART_TypeDef);
+	leuart.clock = cmuClock_LEUART0;
+	leuart.read = sim_leuart_read;
+	leuart.write = sim_leuart_write;
+	leuart.flags = &regs->IF;
+	leuart.enables = &regs->IEN;
+	leuart.irq = LEUART0_IRQn;
+	leuart.handler = LEUART0_IRQHandler;
+	sim_leuart_flags();
+	sim_periph_add(&leuart);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to connect the device on the other end of the line
+ *
+ * @param[in] receive
+ *   Is called with each frame sent, as its stop bit ends
+ *
+ ******************************************************************************/
+
+void sim_leuart_attach(void (*receive)(uint8_t byte)) {
+	device_receive = receive;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function for the device to send frames to the LEUART
+ *
+ * @details
+ * 	 The frames follow each other on the line at the baud rate, whether or
+ * 	 not the receiver takes them
+ *
+ ******************************************************************************/
+
+void sim_leuart_send(const uint8_t *bytes, uint32_t length) {
+	for(uint32_t i = 0; i < length; i++) {
+		if(rx_count == SIM_LEUART_RX_QUEUE) {
+			sim_fatal("LEUART0 line holds more than %d frames", SIM_LEUART_RX_QUEUE);
+		}
+		rx_queue[(rx_head + rx_count++) % SIM_LEUART_RX_QUEUE] = bytes[i];
+	}
+	if((rx_end == SIM_NEVER) && rx_count) {
+		rx_end = sim_now() + sim_leuart_frame_ns();
+		sim_reschedule();
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the LEUART
+ *
+ ******************************************************************************/
+
+void sim_leuart_stats(SIM_LEUART_STATS *totals) {
+	*totals = stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the frame format and baud rate, enabling as asked
+ *
+ ******************************************************************************/
+
+void LEUART_Init(LEUART_TypeDef *uart, const LEUART_Init_TypeDef *init) {
+	sim_cpu(SIM_LIB_CYCLES);
+	baudrate = init->baudrate;
+	LEUART_Enable(uart, init->enable);
+}
+
+void LEUART_Enable(LEUART_TypeDef *uart, LEUART_Enable_TypeDef enable) {
+	sim_cpu(SIM_LIB_CYCLES);
+	uint32_t cmd = (enable & leuartEnableRx) ? LEUART_CMD_RXEN : LEUART_CMD_RXDIS;
+	cmd |= (enable & leuartEnableTx) ? LEUART_CMD_TXEN : LEUART_CMD_TXDIS;
+	sim_register_write((uintptr_t) &uart->CMD, cmd);
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t sim_leuart_frame_ns(void) {
+	return (SIM_LEUART_FRAME_BITS * SIM_NS_PER_S + baudrate - 1) / baudrate;
+}
+
+static uint64_t sim_leuart_next(SIM_SOURCE *source) {
+	(void) source;
+	return (tx_end < rx_end) ? tx_end : rx_end;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end the frames on the line
+ *
+ ******************************************************************************/
+
+static void sim_leuart_run(SIM_SOURCE *source, uint64_t now) {
+	(void) source;
+	if(tx_end <= now) {
+		tx_end = SIM_NEVER;
+		stats.tx_bytes++;
+		if(device_receive) {
+			device_receive(tx_shift);
+		}
+		sim_leuart_kick();
+		if(tx_end == SIM_NEVER) {
+			regs->IF |= LEUART_IF_TXC;
+		}
+	}
+	if(rx_end <= now) {
+		uint8_t byte = rx_queue[rx_head];
+		rx_head = (rx_head + 1) % SIM_LEUART_RX_QUEUE;
+		rx_count--;
+		rx_end = rx_count ? now + sim_leuart_frame_ns() : SIM_NEVER;
+		if(!(regs->STATUS & LEUART_STATUS_RXENS) || (regs->STATUS & LEUART_STATUS_RXBLOCK)) {
+			stats.rx_dropped++;
+		}
+		else if(rx_full) {
+			stats.overruns++;
+			regs->IF |= LEUART_IF_RXOF;
+		}
+		else {
+			stats.rx_bytes++;
+			rx_byte = byte;
+			rx_full = true;
+		}
+	}
+	sim_leuart_flags();
+}
+
+static uint32_t sim_leuart_read(SIM_PERIPH *periph, uint32_t reg) {
+	(void) periph;
+	switch(reg) {
+		case SIM_REG_INDEX(LEUART_TypeDef, RXDATA):
+		case SIM_REG_INDEX(LEUART_TypeDef, RXDATAX):
+			if(!rx_full) {
+				regs->IF |= LEUART_IF_RXUF;
+			}
+			rx_full = false;
+			sim_leuart_flags();
+			return rx_byte;
+		case SIM_REG_INDEX(LEUART_TypeDef, RXDATAXP):
+			return rx_byte;
+		case SIM_REG_INDEX(LEUART_TypeDef, STATUS):
+			return regs->STATUS;
+		case SIM_REG_INDEX(LEUART_TypeDef, IF):
+			return regs->IF;
+		default:
+			return 0;	// write only
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to act on a trapped write
+ *
+ ******************************************************************************/
+
+static void sim_leuart_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value) {
+	(void) periph;
+	switch(reg) {
+		case SIM_REG_INDEX(LEUART_TypeDef, CMD):
+			sim_leuart_command(value);
+			break;
+		case SIM_REG_INDEX(LEUART_TypeDef, TXDATA):
+		case SIM_REG_INDEX(LEUART_TypeDef, TXDATAX):
+			if(tx_full) {
+				regs->IF |= LEUART_IF_TXOF;
+			}
+			tx_byte = value;
+			tx_full = true;
+			sim_leuart_kick();
+			break;
+		case SIM_REG_INDEX(LEUART_TypeDef, IFS):
+			regs->IF |= value & LEUART_IF_MASK;
+			break;
+		case SIM_REG_INDEX(LEUART_TypeDef, IFC):
+			regs->IF &= ~(value & LEUART_IF_MASK);
+			break;
+		default:
+			break;
+	}
+	sim_leuart_flags();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to execute the bits of a CMD write
+ *
+ ******************************************************************************/
+
+static void sim_leuart_command(uint32_t cmd) {
+	if(cmd & LEUART_CMD_CLEARTX) {
+		tx_full = false;
+	}
+	if(cmd & LEUART_CMD_CLEARRX) {
+		rx_full = false;
+	}
+	if(cmd & LEUART_CMD_TXEN) {
+		regs->STATUS |= LEUART_STATUS_TXENS;
+	}
+	if(cmd & LEUART_CMD_TXDIS) {
+		regs->STATUS &= ~LEUART_STATUS_TXENS;
+	}
+	if(cmd & LEUART_CMD_RXEN) {
+		regs->STATUS |= LEUART_STATUS_RXENS;
+	}
+	if(cmd & LEUART_CMD_RXDIS) {
+		regs->STATUS &= ~LEUART_STATUS_RXENS;
+	}
+	if(cmd & LEUART_CMD_RXBLOCKEN) {
+		regs->STATUS |= LEUART_STATUS_RXBLOCK;
+	}
+	if(cmd & LEUART_CMD_RXBLOCKDIS) {
+		regs->STATUS &= ~LEUART_STATUS_RXBLOCK;
+	}
+	sim_leuart_kick();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start the next frame from the transmit buffer
+ *
+ ******************************************************************************/
+
+static void sim_leuart_kick(void) {
+	if((tx_end == SIM_NEVER) && tx_full && (regs->STATUS & LEUART_STATUS_TXENS)) {
+		tx_shift = tx_byte;
+		tx_full = false;
+		tx_end = sim_now() + sim_leuart_frame_ns();
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to update the level flags and status
+ *
+ * @details
+ * 	 TXBL and RXDATAV follow the buffers, they are not cleared by IFC
+ *
+ ******************************************************************************/
+
+static void sim_leuart_flags(void) {
+	uint32_t flags = regs->IF & ~(LEUART_IF_TXBL | LEUART_IF_RXDATAV);
+	flags |= tx_full ? 0 : LEUART_IF_TXBL;
+	flags |= rx_full ? LEUART_IF_RXDATAV : 0;
+	regs->IF = flags;
+	uint32_t status = regs->STATUS & ~(LEUART_STATUS_TXBL | LEUART_STATUS_RXDATAV | LEUART_STATUS_TXC | LEUART_STATUS_TXIDLE);
+	status |= tx_full ? 0 : LEUART_STATUS_TXBL;
+	status |= rx_full ? LEUART_STATUS_RXDATAV : 0;
+	status |= (!tx_full && (tx_end == SIM_NEVER)) ? (LEUART_STATUS_TXC | LEUART_STATUS_TXIDLE) : 0;
+	regs->STATUS = status;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file sim_main.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Runs the firmware on the host simulator for days of virtual time
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_i2c.h"
+#include "sim_ldma.h"
+#include "sim_letimer.h"
+#include "sim_leuart.h"
+#include "sim_timer.h"
+#include "sim_si7021.h"
+#include "sim_veml6030.h"
+#include "sim_hm18.h"
+
+#include "app.h"
+#include "cmu.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_DEFAULT_DAYS		1.0
+#define SIM_DEFAULT_QUERY_S		3600.0		// the phone asks for the histograms hourly
+#define SIM_PERCENT(part, whole)	((whole) ? 100.0 * (double)(part) / (double)(whole) : 0.0)
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static struct timespec		host_start;
+static const char			*mode_names[SIM_MODES] = {"EM0", "EM1", "EM2", "EM3"};
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sim_usage(const char *name);
+static double sim_seconds(uint64_t ns);
+static void sim_report(void);
+static void sim_report_bus(const char *name, I2C_TypeDef *i2c, double seconds);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+int firmware_main(void);
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set up the simulated board and run the firmware's main on it
+ *
+ * @details
+ * 	 The firmware does not return, the run ends in sim_finish with the report
+ * 	 once the virtual clock reaches the end
+ *
+ ******************************************************************************/
+
+int main(int argc, char **argv) {
+	double seconds = SIM_DEFAULT_DAYS * 24 * 3600;
+	double query = SIM_DEFAULT_QUERY_S;
+	bool trace = false;
+	int option;
+	while((option = getopt(argc, argv, "d:s:q:th")) != -1) {
+		switch(option) {
+			case 'd':
+				seconds = atof(optarg) * 24 * 3600;
+				break;
+			case 's':
+				seconds = atof(optarg);
+				break;
+			case 'q':
+				query = atof(optarg);
+				break;
+			case 't':
+				trace = true;
+				break;
+			default:
+				sim_usage(argv[0]);
+				return 1;
+		}
+	}
+	if(seconds <= 0 || query < 0) {
+		sim_usage(argv[0]);
+		return 1;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	clock_gettime(CLOCK_MONOTONIC, &host_start);
+	sim_open();
+	sim_trace(trace);
+	sim_i2c_open();
+	sim_ldma_open();
+	sim_letimer_open();
+	sim_leuart_open();
+	sim_timer_open();
+	sim_si7021_open();
+	sim_veml6030_open();
+	sim_hm18_open((uint64_t)(query * SIM_NS_PER_S), (const char[]){STATS_DUMP_CMD, 0});
+	sim_end((uint64_t)(seconds * SIM_NS_PER_S), sim_report);
+	firmware_main();
+	sim_fatal("the firmware's main returned");
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sim_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-d days | -s seconds] [-q query period in s, 0 for none] [-t trace registers]\n", name);
+}
+
+static double sim_seconds(uint64_t ns) {
+	return (double) ns / SIM_NS_PER_S;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to print the totals of the run
+ *
+ * @details
+ * 	 The firmware's own counters are printed next to the simulator's, they
+ * 	 should agree to within the firmware's tick
+ *
+ ******************************************************************************/
+
+static void sim_report(void) {
+	struct timespec host_end;
+	SIM_STATS totals;
+	SIM_CMU_STATS cmu;
+	SIM_LDMA_STATS ldma;
+	SIM_LEUART_STATS leuart;
+	SIM_SI7021_STATS si7021;
+	SIM_VEML6030_STATS veml6030;
+	SIM_HM18_STATS hm18;
+	SLEEP_STATS sleep;
+	uint64_t fw_total = 0;
+	uint64_t ldma_bytes = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &host_end);
+	sim_stats(&totals);
+	sim_cmu_stats(&cmu);
+	sim_ldma_stats(&ldma);
+	sim_leuart_stats(&leuart);
+	sim_si7021_stats(&si7021);
+	sim_veml6030_stats(&veml6030);
+	sim_hm18_stats(&hm18);
+	sleep_stats(&sleep);
+
+	double seconds = sim_seconds(totals.now);
+	double host = (double)(host_end.tv_sec - host_start.tv_sec) + (host_end.tv_nsec - host_start.tv_nsec) / 1e9;
+	printf("virtual time         %.0f s (%.2f days) in %.2f s host time, %.0fx\n", seconds, seconds / 86400, host,
+			host > 0 ? seconds / host : 0);
+	printf("wakes                %llu, %.3f/s, firmware counted %lu\n", (unsigned long long) totals.wakes,
+			totals.wakes / seconds, (unsigned long) sleep_wake_count());
+	printf("  not slept          %llu, WFI returned at once, an interrupt was pending\n",
+			(unsigned long long) totals.no_sleeps);
+	printf("interrupts           %llu\n", (unsigned long long) totals.irqs);
+	printf("core cycles          %llu, %llu calls, %llu register traps\n", (unsigned long long) totals.cycles,
+			(unsigned long long) totals.calls, (unsigned long long) totals.traps);
+
+	for(int i = 0; i < SIM_MODES; i++) {
+		fw_total += sleep.residency[i];
+	}
+	printf("residency            simulated          firmware\n");
+	for(int i = 0; i < SIM_MODES; i++) {
+		printf("  %s              %12.3f s %7.3f%% %7.3f%%\n", mode_names[i], sim_seconds(totals.residency[i]),
+				SIM_PERCENT(totals.residency[i], totals.now), SIM_PERCENT(sleep.residency[i], fw_total));
+	}
+
+	sim_report_bus("I2C0", I2C0, seconds);
+	sim_report_bus("I2C1", I2C1, seconds);
+	for(int i = 0; i < DMA_CHAN_COUNT; i++) {
+		ldma_bytes += ldma.bytes[i];
+		if(ldma.transfers[i]) {
+			printf("LDMA ch%d             %llu transfers, %llu bytes\n", i, (unsigned long long) ldma.transfers[i],
+					(unsigned long long) ldma.bytes[i]);
+		}
+	}
+	printf("LDMA                 %llu bytes, %llu errors\n", (unsigned long long) ldma_bytes,
+			(unsigned long long) ldma.errors);
+	printf("LEUART0              %llu bytes sent, %llu received, %llu dropped, %llu overruns\n",
+			(unsigned long long) leuart.tx_bytes, (unsigned long long) leuart.rx_bytes,
+			(unsigned long long) leuart.rx_dropped, (unsigned long long) leuart.overruns);
+	printf("SI7021               %llu power ups, %.1f s on, %llu RH %llu T conversions, %llu reads, %llu busy NACKs\n",
+			(unsigned long long) si7021.power_ups, sim_seconds(si7021.on_ns),
+			(unsigned long long) si7021.conversions[0], (unsigned long long) si7021.conversions[1],
+			(unsigned long long) si7021.reads, (unsigned long long) si7021.busy_nacks);
+	printf("VEML6030             %llu register writes, %llu reads\n", (unsigned long long) veml6030.writes,
+			(unsigned long long) veml6030.reads);
+	printf("HFRCO                %u band changes, firmware counted %lu\n", cmu.band_changes,
+			(unsigned long) cmu_clock_changes());
+	printf("scheduler            %lu overruns, %lu deadline misses\n", (unsigned long) scheduler_overruns_total(),
+			(unsigned long) scheduler_deadline_misses_total());
+
+	for(SIM_PERIPH *periph = sim_periphs(); periph; periph = periph->link) {
+		printf("%-20s %llu traps, %llu gated, %llu interrupts\n", periph->source.name,
+				(unsigned long long) periph->accesses, (unsigned long long) periph->gated,
+				(unsigned long long) periph->irqs);
+	}
+	for(SIM_SOURCE *source = sim_sources(); source; source = source->link) {
+		if(source->frozen) {
+			printf("%-20s %llu events while its clock was stopped\n", source->name, (unsigned long long) source->frozen);
+		}
+	}
+
+	printf("BLE                  %llu bytes, %llu lines, %llu keepalives, %llu queries, %llu AT replies\n",
+			(unsigned long long) hm18.bytes, (unsigned long long) hm18.lines, (unsigned long long) hm18.keepalives,
+			(unsigned long long) hm18.queries, (unsigned long long) hm18.replies);
+	for(uint32_t i = 0; i < hm18.kept; i++) {
+		printf("  | %s\n", hm18.last[i]);
+	}
+}
+
+static void sim_report_bus(const char *name, I2C_TypeDef *i2c, double seconds) {
+	SIM_I2C_STATS bus;
+	sim_i2c_stats(i2c, &bus);
+	printf("%-20s %llu transfers, %.3f s busy (%.4f%%), %llu B sent %llu B read, %.1f B/h, %llu NACKs, %llu resets\n",
+			name, (unsigned long long) bus.transfers, sim_seconds(bus.busy_ns),
+			SIM_PERCENT(bus.busy_ns, (uint64_t)(seconds * SIM_NS_PER_S)), (unsigned long long) bus.tx_bytes,
+			(unsigned long long) bus.rx_bytes, (bus.tx_bytes + bus.rx_bytes) * 3600.0 / seconds,
+			(unsigned long long) bus.nacks, (unsigned long long) bus.resets);
+}
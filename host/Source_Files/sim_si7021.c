@@ -0,0 +1,250 @@
+/**
+ * @file sim_si7021.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated SI7021 humidity and temperature sensor on I2C1
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <math.h>
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_i2c.h"
+#include "sim_si7021.h"
+
+#include "brd_config.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_SI7021_MEASURE_RH		0xF5	// no hold master mode
+#define SIM_SI7021_MEASURE_T		0xF3	// no hold master mode
+#define SIM_SI7021_WRITE_USER1		0xE6
+#define SIM_SI7021_READ_USER1		0xE7
+#define SIM_SI7021_CRC_POLYNOMIAL	0x31
+#define SIM_SI7021_DAY_NS			(24 * 3600 * SIM_NS_PER_S)
+
+// What the next read returns
+enum sim_si7021_reads {
+	SIM_SI7021_READ_NONE,
+	SIM_SI7021_READ_USER,
+	SIM_SI7021_READ_MEASUREMENT
+} ;
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+// Maximum conversion times in us by RES1:RES0, from the datasheet
+static const uint32_t		rh_us[4] = {12000, 3100, 4500, 7000};
+static const uint32_t		t_us[4] = {10800, 3800, 6200, 2400};
+
+static SIM_I2C_DEVICE		device;
+static bool					powered;
+static uint64_t				powered_at;
+static uint64_t				ready_at;	// end of the power up or the conversion
+static uint8_t				user1;
+static uint32_t				next_read;	// sim_si7021_reads
+static uint8_t				command;	// first byte written since the START
+static uint32_t				written;	// bytes written since the START
+static uint8_t				bytes[3];	// MS byte, LS byte and checksum
+static uint32_t				read_index;
+static SIM_SI7021_STATS		stats;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sim_si7021_rail(bool level);
+static uint32_t sim_si7021_resolution(void);
+static void sim_si7021_measure(bool humidity);
+static uint8_t sim_si7021_crc(const uint8_t *data, uint32_t count);
+static bool sim_si7021_address(bool read);
+static bool sim_si7021_write(uint8_t byte);
+static uint8_t sim_si7021_read(void);
+static void sim_si7021_stop(void);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to put the SI7021 on I2C1, powered by its enable pin
+ *
+ ******************************************************************************/
+
+void sim_si7021_open(void) {
+	device.name = "SI7021";
+	device.address = SIM_SI7021_ADDRESS;
+	device.address_ack = sim_si7021_address;
+	device.write = sim_si7021_write;
+	device.read = sim_si7021_read;
+	device.stop = sim_si7021_stop;
+	sim_i2c_attach(I2C1, &device);
+	sim_gpio_watch(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN, sim_si7021_rail);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the SI7021
+ *
+ ******************************************************************************/
+
+void sim_si7021_stats(SIM_SI7021_STATS *totals) {
+	*totals = stats;
+	if(powered) {
+		totals->on_ns += sim_now() - powered_at;
+	}
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to power the sensor up or down with its rail
+ *
+ * @details
+ * 	 Powering up resets user register 1, so a resolution written before is lost
+ *
+ ******************************************************************************/
+
+static void sim_si7021_rail(bool level) {
+	if(level == powered) {
+		return;
+	}
+	powered = level;
+	if(powered) {
+		stats.power_ups++;
+		powered_at = sim_now();
+		ready_at = powered_at + SIM_SI7021_POWER_UP_NS;
+		user1 = SIM_SI7021_USER1_RESET;
+		next_read = SIM_SI7021_READ_NONE;
+	}
+	else {
+		stats.on_ns += sim_now() - powered_at;
+	}
+}
+
+static uint32_t sim_si7021_resolution(void) {
+	return ((user1 >> 6) & 0x2) | (user1 & 0x1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start a conversion of the room's humidity or temperature
+ *
+ * @details
+ * 	 The room follows a day: the humidity is highest before dawn and the
+ * 	 temperature in the afternoon.  A humidity conversion also converts the
+ * 	 temperature, as the sensor compensates with it
+ *
+ ******************************************************************************/
+
+static void sim_si7021_measure(bool humidity) {
+	double day = (double)(sim_now() % SIM_SI7021_DAY_NS) / SIM_SI7021_DAY_NS;
+	uint32_t resolution = sim_si7021_resolution();
+	uint32_t code;
+	uint64_t us = t_us[resolution];
+	if(humidity) {
+		double rh = 35.0 + 10.0 * cos(2 * M_PI * (day - 5.0 / 24));
+		code = (uint32_t)((rh + 6) * 65536 / 125) & 0xFFFC;
+		us += rh_us[resolution];
+	}
+	else {
+		double celsius = 21.0 + 3.0 * cos(2 * M_PI * (day - 15.0 / 24));
+		code = (uint32_t)((celsius + 46.85) * 65536 / 175.72) & 0xFFFC;
+	}
+	stats.conversions[humidity ? 0 : 1]++;
+	bytes[0] = code >> 8;
+	bytes[1] = code;
+	bytes[2] = sim_si7021_crc(bytes, 2);
+	ready_at = sim_now() + us * SIM_NS_PER_US;
+	next_read = SIM_SI7021_READ_MEASUREMENT;
+}
+
+static uint8_t sim_si7021_crc(const uint8_t *data, uint32_t count) {
+	uint8_t crc = 0;
+	for(uint32_t i = 0; i < count; i++) {
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ SIM_SI7021_CRC_POLYNOMIAL) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to answer its address
+ *
+ * @details
+ * 	 The sensor NACKs while it is off, powering up or converting, and a read
+ * 	 with nothing to read
+ *
+ ******************************************************************************/
+
+static bool sim_si7021_address(bool read) {
+	if(!powered || (sim_now() < ready_at) || (read && (next_read == SIM_SI7021_READ_NONE))) {
+		stats.busy_nacks++;
+		return false;
+	}
+	written = 0;
+	read_index = 0;
+	return true;
+}
+
+static bool sim_si7021_write(uint8_t byte) {
+	if(!written++) {
+		command = byte;
+		switch(command) {
+			case SIM_SI7021_MEASURE_RH:
+				sim_si7021_measure(true);
+				break;
+			case SIM_SI7021_MEASURE_T:
+				sim_si7021_measure(false);
+				break;
+			case SIM_SI7021_READ_USER1:
+				next_read = SIM_SI7021_READ_USER;
+				break;
+			default:
+				break;
+		}
+	}
+	else if((command == SIM_SI7021_WRITE_USER1) && (written == 2)) {
+		user1 = (user1 & ~SIM_SI7021_USER1_WRITE) | (byte & SIM_SI7021_USER1_WRITE);
+	}
+	return true;
+}
+
+static uint8_t sim_si7021_read(void) {
+	if(next_read == SIM_SI7021_READ_USER) {
+		return user1;
+	}
+	if(next_read == SIM_SI7021_READ_MEASUREMENT) {
+		if(read_index == 0) {
+			stats.reads++;
+		}
+		return (read_index < sizeof(bytes)) ? bytes[read_index++] : 0xFF;
+	}
+	return 0xFF;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end a transfer, a measurement read is not read again
+ *
+ ******************************************************************************/
+
+static void sim_si7021_stop(void) {
+	if((next_read == SIM_SI7021_READ_MEASUREMENT) && read_index) {
+		next_read = SIM_SI7021_READ_NONE;
+	}
+}
@@ -0,0 +1,201 @@
+/**
+ * @file sim_timer.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated TIMER0, an up counter on HFPERCLK
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "em_timer.h"
+
+#include "sim.h"
+#include "sim_emlib.h"
+#include "sim_timer.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_TIMER_TOP			0xFFFFUL
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static SIM_PERIPH			timer;
+static TIMER_TypeDef		*regs;		// the simulator's view
+static bool					running;
+static uint64_t				start_ns;	// time the count was start_cnt
+static uint32_t				start_cnt;
+static uint64_t				tick_ps;	// HFPERCLK period times the prescaler
+static uint64_t				overflow = SIM_NEVER;
+
+static const uint8_t		access[SIM_REG_COUNT(TIMER_TypeDef)] = {
+	[SIM_REG_INDEX(TIMER_TypeDef, CMD)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(TIMER_TypeDef, STATUS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(TIMER_TypeDef, IF)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(TIMER_TypeDef, IFS)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(TIMER_TypeDef, IFC)] = SIM_TRAP_ALL,
+	[SIM_REG_INDEX(TIMER_TypeDef, TOP)] = SIM_TRAP_WRITE,
+	[SIM_REG_INDEX(TIMER_TypeDef, CNT)] = SIM_TRAP_ALL
+};
+
+extern void TIMER0_IRQHandler(void) __attribute__((weak));
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint32_t sim_timer_count(void);
+static void sim_timer_rebase(uint32_t cnt);
+static uint64_t sim_timer_next(SIM_SOURCE *source);
+static void sim_timer_run(SIM_SOURCE *source, uint64_t now);
+static uint32_t sim_timer_read(SIM_PERIPH *periph, uint32_t reg);
+static void sim_timer_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to add TIMER0 to the simulator
+ *
+ ******************************************************************************/
+
+void sim_timer_open(void) {
+	regs = SIM_ALIAS(TIMER0);
+	regs->TOP = SIM_TIMER_TOP;
+	timer.source.name = "TIMER0";
+	timer.source.next = sim_timer_next;
+	timer.source.run = sim_timer_run;
+	timer.source.domain = SIM_EM1;
+	timer.base = TIMER0_BASE;
+	timer.access = access;
+	timer.registers = SIM_REG_COUNT(TIMER_TypeDef);
+	timer.clock = cmuClock_TIMER0;
+	timer.read = sim_timer_read;
+	timer.write = sim_timer_write;
+	timer.flags = &regs->IF;
+	timer.enables = &regs->IEN;
+	timer.irq = TIMER0_IRQn;
+	timer.handler = TIMER0_IRQHandler;
+	sim_periph_add(&timer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to configure the prescaler, starting the timer if asked
+ *
+ ******************************************************************************/
+
+void TIMER_Init(TIMER_TypeDef *tim, const TIMER_Init_TypeDef *init) {
+	sim_cpu(SIM_LIB_CYCLES);
+	uint32_t ctrl = (init->prescale << _TIMER_CTRL_PRESC_SHIFT) | (init->oneShot ? TIMER_CTRL_OSMEN : 0);
+	ctrl |= (init->mode == timerModeDown) ? TIMER_CTRL_MODE_DOWN : 0;
+	regs->CTRL = ctrl;
+	sim_register_write((uintptr_t) &tim->CMD, init->enable ? TIMER_CMD_START : TIMER_CMD_STOP);
+}
+
+void TIMER_Enable(TIMER_TypeDef *tim, bool enable) {
+	sim_cpu(SIM_LIB_CYCLES);
+	sim_register_write((uintptr_t) &tim->CMD, enable ? TIMER_CMD_START : TIMER_CMD_STOP);
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the count now, up counting only
+ *
+ ******************************************************************************/
+
+static uint32_t sim_timer_count(void) {
+	if(!running) {
+		return start_cnt;
+	}
+	uint64_t ticks = (sim_now() - start_ns) * 1000 / tick_ps;
+	return (start_cnt + ticks) % ((uint64_t) regs->TOP + 1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to restart the count from a value now
+ *
+ ******************************************************************************/
+
+static void sim_timer_rebase(uint32_t cnt) {
+	uint32_t presc = (regs->CTRL & _TIMER_CTRL_PRESC_MASK) >> _TIMER_CTRL_PRESC_SHIFT;
+	tick_ps = (SIM_NS_PER_S * 1000ULL << presc) / sim_clock_hz(cmuClock_HFPER);
+	start_cnt = cnt;
+	start_ns = sim_now();
+	overflow = SIM_NEVER;
+	if(running) {
+		overflow = start_ns + (((uint64_t) regs->TOP + 1 - cnt) * tick_ps + 999) / 1000;
+	}
+}
+
+static uint64_t sim_timer_next(SIM_SOURCE *source) {
+	(void) source;
+	return overflow;
+}
+
+static void sim_timer_run(SIM_SOURCE *source, uint64_t now) {
+	(void) source;
+	(void) now;
+	regs->IF |= TIMER_IF_OF;
+	if(regs->CTRL & TIMER_CTRL_OSMEN) {
+		running = false;
+	}
+	sim_timer_rebase(0);
+}
+
+static uint32_t sim_timer_read(SIM_PERIPH *periph, uint32_t reg) {
+	(void) periph;
+	switch(reg) {
+		case SIM_REG_INDEX(TIMER_TypeDef, STATUS):
+			return running ? TIMER_STATUS_RUNNING : 0;
+		case SIM_REG_INDEX(TIMER_TypeDef, IF):
+			return regs->IF;
+		case SIM_REG_INDEX(TIMER_TypeDef, CNT):
+			return sim_timer_count();
+		default:
+			return 0;	// write only
+	}
+}
+
+static void sim_timer_write(SIM_PERIPH *periph, uint32_t reg, uint32_t value) {
+	(void) periph;
+	uint32_t cnt = sim_timer_count();
+	switch(reg) {
+		case SIM_REG_INDEX(TIMER_TypeDef, CMD):
+			if(value & TIMER_CMD_START) {
+				running = true;
+			}
+			if(value & TIMER_CMD_STOP) {
+				running = false;
+			}
+			sim_timer_rebase(cnt);
+			break;
+		case SIM_REG_INDEX(TIMER_TypeDef, TOP):
+			regs->TOP = value & SIM_TIMER_TOP;
+			sim_timer_rebase(cnt);
+			break;
+		case SIM_REG_INDEX(TIMER_TypeDef, CNT):
+			sim_timer_rebase(value & SIM_TIMER_TOP);
+			break;
+		case SIM_REG_INDEX(TIMER_TypeDef, IFS):
+			regs->IF |= value & TIMER_IF_MASK;
+			break;
+		case SIM_REG_INDEX(TIMER_TypeDef, IFC):
+			regs->IF &= ~(value & TIMER_IF_MASK);
+			break;
+		default:
+			break;
+	}
+}
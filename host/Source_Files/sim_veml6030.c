@@ -0,0 +1,139 @@
+/**
+ * @file sim_veml6030.c
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Simulated VEML6030 ambient light sensor on I2C0
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <math.h>
+
+#include "sim.h"
+#include "sim_i2c.h"
+#include "sim_veml6030.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SIM_VEML6030_ALS_SD		0x0001	// ALS_CONF_0 shut down
+#define SIM_VEML6030_DAY_NS		(24 * 3600 * SIM_NS_PER_S)
+#define SIM_VEML6030_MAX_COUNT	0xFFFF
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static SIM_I2C_DEVICE		device;
+static uint16_t				registers[SIM_VEML6030_REGISTERS];
+static uint8_t				command;	// register selected by the first byte written
+static uint32_t				written;	// bytes written since the START
+static uint32_t				read_index;
+static uint16_t				value;		// register being read
+static SIM_VEML6030_STATS	stats;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint16_t sim_veml6030_als(void);
+static bool sim_veml6030_address(bool read);
+static bool sim_veml6030_write(uint8_t byte);
+static uint8_t sim_veml6030_read(void);
+static void sim_veml6030_stop(void);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to put the VEML6030 on I2C0, shut down as after its power up
+ *
+ ******************************************************************************/
+
+void sim_veml6030_open(void) {
+	registers[0] = SIM_VEML6030_ALS_SD;
+	device.name = "VEML6030";
+	device.address = SIM_VEML6030_ADDRESS;
+	device.address_ack = sim_veml6030_address;
+	device.write = sim_veml6030_write;
+	device.read = sim_veml6030_read;
+	device.stop = sim_veml6030_stop;
+	sim_i2c_attach(I2C0, &device);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the totals of the VEML6030
+ *
+ ******************************************************************************/
+
+void sim_veml6030_stats(SIM_VEML6030_STATS *totals) {
+	*totals = stats;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the ALS count of the light now
+ *
+ * @details
+ * 	 Daylight rises at 6:00, peaks at noon and is gone at 18:00
+ *
+ ******************************************************************************/
+
+static uint16_t sim_veml6030_als(void) {
+	if(registers[0] & SIM_VEML6030_ALS_SD) {
+		return 0;
+	}
+	double hour = (double)(sim_now() % SIM_VEML6030_DAY_NS) * 24 / SIM_VEML6030_DAY_NS;
+	double lux = (hour > 6 && hour < 18) ? SIM_VEML6030_PEAK_LUX * sin(M_PI * (hour - 6) / 12) : 0;
+	double count = lux / SIM_VEML6030_LUX_COUNT;
+	return (count > SIM_VEML6030_MAX_COUNT) ? SIM_VEML6030_MAX_COUNT : (uint16_t) count;
+}
+
+static bool sim_veml6030_address(bool read) {
+	(void) read;
+	written = 0;
+	read_index = 0;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to take a command code, then the register LS byte and MS byte
+ *
+ ******************************************************************************/
+
+static bool sim_veml6030_write(uint8_t byte) {
+	if(!written++) {
+		command = byte % SIM_VEML6030_REGISTERS;
+		return true;
+	}
+	if(written == 2) {
+		registers[command] = (registers[command] & 0xFF00) | byte;
+	}
+	else if(written == 3) {
+		registers[command] = (registers[command] & 0x00FF) | (byte << 8);
+		stats.writes++;
+	}
+	return true;
+}
+
+static uint8_t sim_veml6030_read(void) {
+	if(!read_index) {
+		value = (command == SIM_VEML6030_ALS) ? sim_veml6030_als() : registers[command];
+		stats.reads++;
+	}
+	return (read_index++ & 1) ? (value >> 8) : (value & 0xFF);
+}
+
+static void sim_veml6030_stop(void) {
+}
@@ -0,0 +1,36 @@
+/**
+ * @file em_assert.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib assertion
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_ASSERT_H
+#define EM_ASSERT_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+// As emlib with DEBUG_EFM, the simulator reports the failed assertion and stops
+#define EFM_ASSERT(expr)		((expr) ? ((void)0) : assertEFM(__FILE__, __LINE__))
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void assertEFM(const char *file, int line) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file em_chip.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib chip errata
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_CHIP_H
+#define EM_CHIP_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void CHIP_Init(void);
+
+#endif
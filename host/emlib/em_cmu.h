@@ -0,0 +1,97 @@
+/**
+ * @file em_cmu.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib clock management unit
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_CMU_H
+#define EM_CMU_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define CMU_HFXOINIT_DEFAULT	{ 0 }
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	cmuClock_HF,
+	cmuClock_HFPER,
+	cmuClock_CORE,
+	cmuClock_CORELE,
+	cmuClock_LFA,
+	cmuClock_LFB,
+	cmuClock_GPIO,
+	cmuClock_LDMA,
+	cmuClock_I2C0,
+	cmuClock_I2C1,
+	cmuClock_TIMER0,
+	cmuClock_LETIMER0,
+	cmuClock_LEUART0,
+	cmuClock_COUNT
+} CMU_Clock_TypeDef;
+
+typedef enum {
+	cmuOsc_LFXO,
+	cmuOsc_LFRCO,
+	cmuOsc_HFXO,
+	cmuOsc_HFRCO,
+	cmuOsc_AUXHFRCO,
+	cmuOsc_ULFRCO
+} CMU_Osc_TypeDef;
+
+typedef enum {
+	cmuSelect_Disabled,
+	cmuSelect_LFXO,
+	cmuSelect_LFRCO,
+	cmuSelect_HFXO,
+	cmuSelect_HFRCO,
+	cmuSelect_ULFRCO
+} CMU_Select_TypeDef;
+
+typedef enum {
+	cmuHFRCOFreq_1M0Hz		= 1000000,
+	cmuHFRCOFreq_2M0Hz		= 2000000,
+	cmuHFRCOFreq_4M0Hz		= 4000000,
+	cmuHFRCOFreq_7M0Hz		= 7000000,
+	cmuHFRCOFreq_13M0Hz		= 13000000,
+	cmuHFRCOFreq_16M0Hz		= 16000000,
+	cmuHFRCOFreq_19M0Hz		= 19000000,
+	cmuHFRCOFreq_26M0Hz		= 26000000,
+	cmuHFRCOFreq_32M0Hz		= 32000000,
+	cmuHFRCOFreq_38M0Hz		= 38000000
+} CMU_HFRCOFreq_TypeDef;
+
+typedef struct {
+	uint32_t				ctuneStartup;
+} CMU_HFXOInit_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void CMU_ClockEnable(CMU_Clock_TypeDef clock, bool enable);
+uint32_t CMU_ClockFreqGet(CMU_Clock_TypeDef clock);
+void CMU_ClockSelectSet(CMU_Clock_TypeDef clock, CMU_Select_TypeDef ref);
+void CMU_OscillatorEnable(CMU_Osc_TypeDef osc, bool enable, bool wait);
+void CMU_HFRCOBandSet(CMU_HFRCOFreq_TypeDef setFreq);
+CMU_HFRCOFreq_TypeDef CMU_HFRCOBandGet(void);
+void CMU_HFXOInit(const CMU_HFXOInit_TypeDef *hfxoInit);
+
+#endif
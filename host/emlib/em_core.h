@@ -0,0 +1,46 @@
+/**
+ * @file em_core.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib critical sections
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_CORE_H
+#define EM_CORE_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+// The simulated PRIMASK, a critical section holds off the simulated interrupts
+#define CORE_DECLARE_IRQ_STATE	CORE_irqState_t irqState
+#define CORE_ENTER_CRITICAL()	irqState = CORE_EnterCritical()
+#define CORE_EXIT_CRITICAL()	CORE_ExitCritical(irqState)
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef uint32_t CORE_irqState_t;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+CORE_irqState_t CORE_EnterCritical(void);
+void CORE_ExitCritical(CORE_irqState_t irqState);
+bool CORE_InIrqContext(void);
+
+#endif
@@ -0,0 +1,408 @@
+/**
+ * @file em_device.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the EFM32PG12 device header
+ *
+ * Every peripheral register sits on a page of its own at the fixed address
+ * of its peripheral, so the simulator can trap the firmware's accesses to a
+ * register and act on them as the silicon would.  Only the registers and bit
+ * fields the firmware uses are defined, with their EFM32PG12 values.
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_DEVICE_H
+#define EM_DEVICE_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define __IOM	volatile		// read write register
+#ifdef SIM_MODEL_VIEW
+#define __IM	volatile		// the models set the read only registers
+#else
+#define __IM	volatile const	// read only register
+#endif
+#define __OM	volatile		// write only register
+
+// Core intrinsics cost no call in the CPU model
+#define SIM_INTRINSIC			static inline __attribute__((always_inline, no_instrument_function))
+
+// A register padded to a page, so every register is protected on its own
+#define SIM_REG_SIZE			0x1000UL
+#define SIM_REG(qual, name)		union { qual uint32_t name; uint8_t name##_PAGE[SIM_REG_SIZE]; }
+
+// Each peripheral has a window of registers at a fixed address
+#define SIM_PERIPH_BASE			0x40000000UL
+#define SIM_PERIPH_SIZE			0x00100000UL
+#define I2C0_BASE				(SIM_PERIPH_BASE + 0 * SIM_PERIPH_SIZE)
+#define I2C1_BASE				(SIM_PERIPH_BASE + 1 * SIM_PERIPH_SIZE)
+#define LETIMER0_BASE			(SIM_PERIPH_BASE + 2 * SIM_PERIPH_SIZE)
+#define LEUART0_BASE			(SIM_PERIPH_BASE + 3 * SIM_PERIPH_SIZE)
+#define LDMA_BASE				(SIM_PERIPH_BASE + 4 * SIM_PERIPH_SIZE)
+#define TIMER0_BASE				(SIM_PERIPH_BASE + 5 * SIM_PERIPH_SIZE)
+#define SIM_PERIPH_COUNT		6
+
+// Interrupt numbers of the EFM32PG12, handled lowest number first
+typedef enum {
+	LDMA_IRQn		= 8,
+	TIMER0_IRQn		= 10,
+	I2C0_IRQn		= 16,
+	LEUART0_IRQn	= 21,
+	LETIMER0_IRQn	= 26,
+	I2C1_IRQn		= 42
+} IRQn_Type;
+
+//***********************************************************************************
+// Cortex-M4 core
+//***********************************************************************************
+
+typedef struct {
+	__IOM uint32_t	CTRL;
+	__IOM uint32_t	CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	__IOM uint32_t	DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+	__IOM uint32_t	ICSR;
+	__IOM uint32_t	SCR;
+} SCB_Type;
+
+extern DWT_Type			sim_dwt;
+extern CoreDebug_Type	sim_core_debug;
+extern SCB_Type			sim_scb;
+
+#define DWT						(&sim_dwt)
+#define CoreDebug				(&sim_core_debug)
+#define SCB						(&sim_scb)
+
+#define DWT_CTRL_CYCCNTENA_Msk			(1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk		(1UL << 24)
+#define SCB_SCR_SLEEPONEXIT_Msk			(1UL << 1)
+#define SCB_SCR_SLEEPDEEP_Msk			(1UL << 2)
+#define SCB_ICSR_VECTACTIVE_Msk			(0x1FFUL << 0)
+#define SCB_ICSR_RETTOBASE_Msk			(1UL << 11)
+
+extern uint32_t SystemCoreClock;
+
+//***********************************************************************************
+// I2C
+//***********************************************************************************
+
+typedef struct {
+	SIM_REG(__IOM, CTRL);
+	SIM_REG(__OM, CMD);
+	SIM_REG(__IM, STATE);
+	SIM_REG(__IM, STATUS);
+	SIM_REG(__IOM, CLKDIV);
+	SIM_REG(__IOM, SADDR);
+	SIM_REG(__IOM, SADDRMASK);
+	SIM_REG(__IM, RXDATA);
+	SIM_REG(__IM, RXDOUBLE);
+	SIM_REG(__IM, RXDATAP);
+	SIM_REG(__IM, RXDOUBLEP);
+	SIM_REG(__OM, TXDATA);
+	SIM_REG(__OM, TXDOUBLE);
+	SIM_REG(__IM, IF);
+	SIM_REG(__OM, IFS);
+	SIM_REG(__OM, IFC);
+	SIM_REG(__IOM, IEN);
+	SIM_REG(__IOM, ROUTEPEN);
+	SIM_REG(__IOM, ROUTELOC0);
+} I2C_TypeDef;
+
+#define I2C0					((I2C_TypeDef *) I2C0_BASE)
+#define I2C1					((I2C_TypeDef *) I2C1_BASE)
+
+#define I2C_CTRL_EN				(0x1UL << 0)
+#define I2C_CTRL_AUTOACK		(0x1UL << 2)
+
+#define I2C_CMD_START			(0x1UL << 0)
+#define I2C_CMD_STOP			(0x1UL << 1)
+#define I2C_CMD_ACK				(0x1UL << 2)
+#define I2C_CMD_NACK			(0x1UL << 3)
+#define I2C_CMD_CONT			(0x1UL << 4)
+#define I2C_CMD_ABORT			(0x1UL << 5)
+#define I2C_CMD_CLEARTX			(0x1UL << 6)
+#define I2C_CMD_CLEARPC			(0x1UL << 7)
+
+#define I2C_STATE_BUSY			(0x1UL << 0)
+#define I2C_STATE_MASTER		(0x1UL << 1)
+#define I2C_STATE_TRANSMITTER	(0x1UL << 2)
+#define I2C_STATE_NACKED		(0x1UL << 3)
+#define _I2C_STATE_STATE_MASK	0xE0UL
+#define I2C_STATE_STATE_IDLE	(0x0UL << 5)
+#define I2C_STATE_STATE_WAIT	(0x1UL << 5)
+#define I2C_STATE_STATE_ADDR	(0x3UL << 5)
+#define I2C_STATE_STATE_DATA	(0x5UL << 5)
+
+#define I2C_STATUS_TXC			(0x1UL << 7)
+#define I2C_STATUS_TXBL			(0x1UL << 8)
+#define I2C_STATUS_RXDATAV		(0x1UL << 9)
+
+#define I2C_IF_START			(0x1UL << 0)
+#define I2C_IF_RSTART			(0x1UL << 1)
+#define I2C_IF_ADDR				(0x1UL << 2)
+#define I2C_IF_TXC				(0x1UL << 3)
+#define I2C_IF_TXBL				(0x1UL << 4)
+#define I2C_IF_RXDATAV			(0x1UL << 5)
+#define I2C_IF_ACK				(0x1UL << 6)
+#define I2C_IF_NACK				(0x1UL << 7)
+#define I2C_IF_MSTOP			(0x1UL << 8)
+#define I2C_IF_ARBLOST			(0x1UL << 9)
+#define I2C_IF_BUSERR			(0x1UL << 10)
+#define I2C_IF_BUSHOLD			(0x1UL << 11)
+#define I2C_IF_TXOF				(0x1UL << 12)
+#define I2C_IF_RXUF				(0x1UL << 13)
+#define I2C_IF_MASK				0x0007FFFFUL
+
+#define I2C_IEN_ACK				I2C_IF_ACK
+#define I2C_IEN_NACK			I2C_IF_NACK
+#define I2C_IEN_MSTOP			I2C_IF_MSTOP
+#define I2C_IEN_RXDATAV			I2C_IF_RXDATAV
+#define I2C_IEN_TXC				I2C_IF_TXC
+
+#define I2C_ROUTEPEN_SDAPEN		(0x1UL << 0)
+#define I2C_ROUTEPEN_SCLPEN		(0x1UL << 1)
+#define I2C_ROUTELOC0_SDALOC_LOC8	(8UL << 0)
+#define I2C_ROUTELOC0_SDALOC_LOC19	(19UL << 0)
+#define I2C_ROUTELOC0_SCLLOC_LOC6	(6UL << 8)
+#define I2C_ROUTELOC0_SCLLOC_LOC19	(19UL << 8)
+
+//***********************************************************************************
+// LETIMER
+//***********************************************************************************
+
+typedef struct {
+	SIM_REG(__IOM, CTRL);
+	SIM_REG(__OM, CMD);
+	SIM_REG(__IM, STATUS);
+	SIM_REG(__IOM, CNT);
+	SIM_REG(__IOM, COMP0);
+	SIM_REG(__IOM, COMP1);
+	SIM_REG(__IOM, REP0);
+	SIM_REG(__IOM, REP1);
+	SIM_REG(__IM, IF);
+	SIM_REG(__OM, IFS);
+	SIM_REG(__OM, IFC);
+	SIM_REG(__IOM, IEN);
+	SIM_REG(__IM, SYNCBUSY);
+	SIM_REG(__IOM, ROUTEPEN);
+	SIM_REG(__IOM, ROUTELOC0);
+} LETIMER_TypeDef;
+
+#define LETIMER0				((LETIMER_TypeDef *) LETIMER0_BASE)
+
+#define _LETIMER_CTRL_REPMODE_MASK		0x3UL
+#define _LETIMER_CTRL_REPMODE_FREE		0x0UL
+#define _LETIMER_CTRL_REPMODE_ONESHOT	0x1UL
+#define _LETIMER_CTRL_REPMODE_BUFFERED	0x2UL
+#define _LETIMER_CTRL_REPMODE_DOUBLE	0x3UL
+#define _LETIMER_CTRL_UFOA0_SHIFT		2
+#define _LETIMER_CTRL_UFOA1_SHIFT		4
+#define _LETIMER_CTRL_UFOA0_NONE		0x0UL
+#define _LETIMER_CTRL_UFOA0_PWM			0x3UL
+#define _LETIMER_CTRL_UFOA1_NONE		0x0UL
+#define _LETIMER_CTRL_UFOA1_PWM			0x3UL
+#define LETIMER_CTRL_OPOL0				(0x1UL << 6)
+#define LETIMER_CTRL_OPOL1				(0x1UL << 7)
+#define LETIMER_CTRL_BUFTOP				(0x1UL << 8)
+#define LETIMER_CTRL_COMP0TOP			(0x1UL << 9)
+#define LETIMER_CTRL_DEBUGRUN			(0x1UL << 12)
+
+#define LETIMER_CMD_START		(0x1UL << 0)
+#define LETIMER_CMD_STOP		(0x1UL << 1)
+#define LETIMER_CMD_CLEAR		(0x1UL << 2)
+
+#define LETIMER_STATUS_RUNNING	(0x1UL << 0)
+
+#define LETIMER_IF_COMP0		(0x1UL << 0)
+#define LETIMER_IF_COMP1		(0x1UL << 1)
+#define LETIMER_IF_UF			(0x1UL << 2)
+#define LETIMER_IF_REP0			(0x1UL << 3)
+#define LETIMER_IF_REP1			(0x1UL << 4)
+#define LETIMER_IF_MASK			0x1FUL
+
+#define LETIMER_IEN_COMP0		LETIMER_IF_COMP0
+#define LETIMER_IEN_COMP1		LETIMER_IF_COMP1
+#define LETIMER_IEN_UF			LETIMER_IF_UF
+
+#define _LETIMER_CNT_MASK		0xFFFFUL
+
+#define LETIMER_ROUTEPEN_OUT0PEN			(0x1UL << 0)
+#define LETIMER_ROUTEPEN_OUT1PEN			(0x1UL << 1)
+#define LETIMER_ROUTELOC0_OUT0LOC_LOC28		(28UL << 0)
+#define LETIMER_ROUTELOC0_OUT1LOC_LOC28		(28UL << 8)
+
+//***********************************************************************************
+// LEUART
+//***********************************************************************************
+
+typedef struct {
+	SIM_REG(__IOM, CTRL);
+	SIM_REG(__OM, CMD);
+	SIM_REG(__IM, STATUS);
+	SIM_REG(__IOM, CLKDIV);
+	SIM_REG(__IOM, STARTFRAME);
+	SIM_REG(__IOM, SIGFRAME);
+	SIM_REG(__IM, RXDATAX);
+	SIM_REG(__IM, RXDATA);
+	SIM_REG(__IM, RXDATAXP);
+	SIM_REG(__OM, TXDATAX);
+	SIM_REG(__OM, TXDATA);
+	SIM_REG(__IM, IF);
+	SIM_REG(__OM, IFS);
+	SIM_REG(__OM, IFC);
+	SIM_REG(__IOM, IEN);
+	SIM_REG(__IOM, PULSECTRL);
+	SIM_REG(__IOM, FREEZE);
+	SIM_REG(__IM, SYNCBUSY);
+	SIM_REG(__IOM, ROUTEPEN);
+	SIM_REG(__IOM, ROUTELOC0);
+} LEUART_TypeDef;
+
+#define LEUART0					((LEUART_TypeDef *) LEUART0_BASE)
+
+#define LEUART_CMD_RXEN			(0x1UL << 0)
+#define LEUART_CMD_RXDIS		(0x1UL << 1)
+#define LEUART_CMD_TXEN			(0x1UL << 2)
+#define LEUART_CMD_TXDIS		(0x1UL << 3)
+#define LEUART_CMD_RXBLOCKEN	(0x1UL << 4)
+#define LEUART_CMD_RXBLOCKDIS	(0x1UL << 5)
+#define LEUART_CMD_CLEARTX		(0x1UL << 6)
+#define LEUART_CMD_CLEARRX		(0x1UL << 7)
+
+#define LEUART_STATUS_RXENS		(0x1UL << 0)
+#define LEUART_STATUS_TXENS		(0x1UL << 1)
+#define LEUART_STATUS_RXBLOCK	(0x1UL << 2)
+#define LEUART_STATUS_TXC		(0x1UL << 3)
+#define LEUART_STATUS_TXBL		(0x1UL << 4)
+#define LEUART_STATUS_RXDATAV	(0x1UL << 5)
+#define LEUART_STATUS_TXIDLE	(0x1UL << 6)
+
+#define LEUART_IF_TXC			(0x1UL << 0)
+#define LEUART_IF_TXBL			(0x1UL << 1)
+#define LEUART_IF_RXDATAV		(0x1UL << 2)
+#define LEUART_IF_RXOF			(0x1UL << 3)
+#define LEUART_IF_RXUF			(0x1UL << 4)
+#define LEUART_IF_TXOF			(0x1UL << 5)
+#define LEUART_IF_MASK			0x7FFUL
+
+#define LEUART_IEN_TXC			LEUART_IF_TXC
+#define LEUART_IEN_TXBL			LEUART_IF_TXBL
+#define LEUART_IEN_RXDATAV		LEUART_IF_RXDATAV
+
+#define LEUART_ROUTEPEN_RXPEN			(0x1UL << 0)
+#define LEUART_ROUTEPEN_TXPEN			(0x1UL << 1)
+#define LEUART_ROUTELOC0_RXLOC_LOC18	(18UL << 0)
+#define LEUART_ROUTELOC0_TXLOC_LOC18	(18UL << 8)
+
+//***********************************************************************************
+// LDMA
+//***********************************************************************************
+
+typedef struct {
+	SIM_REG(__IOM, CTRL);
+	SIM_REG(__IM, STATUS);
+	SIM_REG(__IOM, CHEN);
+	SIM_REG(__IM, CHBUSY);
+	SIM_REG(__IOM, CHDONE);
+	SIM_REG(__OM, SWREQ);
+	SIM_REG(__IOM, REQDIS);
+	SIM_REG(__IM, IF);
+	SIM_REG(__OM, IFS);
+	SIM_REG(__OM, IFC);
+	SIM_REG(__IOM, IEN);
+} LDMA_TypeDef;
+
+#define LDMA					((LDMA_TypeDef *) LDMA_BASE)
+
+#define DMA_CHAN_COUNT			8
+#define LDMA_IF_DONE_MASK		0xFFUL
+#define LDMA_IF_ERROR			(0x1UL << 31)
+#define LDMA_IEN_ERROR			LDMA_IF_ERROR
+
+//***********************************************************************************
+// TIMER
+//***********************************************************************************
+
+typedef struct {
+	SIM_REG(__IOM, CTRL);
+	SIM_REG(__OM, CMD);
+	SIM_REG(__IM, STATUS);
+	SIM_REG(__IM, IF);
+	SIM_REG(__OM, IFS);
+	SIM_REG(__OM, IFC);
+	SIM_REG(__IOM, IEN);
+	SIM_REG(__IOM, TOP);
+	SIM_REG(__IOM, TOPB);
+	SIM_REG(__IOM, CNT);
+} TIMER_TypeDef;
+
+#define TIMER0					((TIMER_TypeDef *) TIMER0_BASE)
+
+#define _TIMER_CTRL_PRESC_SHIFT	24
+#define _TIMER_CTRL_PRESC_MASK	(0xFUL << 24)
+#define TIMER_CTRL_OSMEN		(0x1UL << 4)
+#define TIMER_CTRL_MODE_DOWN	(0x1UL << 0)
+
+#define TIMER_CMD_START			(0x1UL << 0)
+#define TIMER_CMD_STOP			(0x1UL << 1)
+
+#define TIMER_STATUS_RUNNING	(0x1UL << 0)
+
+#define TIMER_IF_OF				(0x1UL << 0)
+#define TIMER_IF_UF				(0x1UL << 1)
+#define TIMER_IF_MASK			0x3UL
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+void SystemCoreClockUpdate(void);
+
+/***************************************************************************//**
+ * @brief
+ *   Count leading zeros, 32 for 0 as on the Cortex-M4
+ ******************************************************************************/
+SIM_INTRINSIC uint32_t __CLZ(uint32_t value) {
+	return value ? (uint32_t)__builtin_clz(value) : 32;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Reverse the bit order of a word
+ ******************************************************************************/
+SIM_INTRINSIC uint32_t __RBIT(uint32_t value) {
+	uint32_t result = 0;
+	for(int i = 0; i < 32; i++) {
+		result = (result << 1) | (value & 1);
+		value >>= 1;
+	}
+	return result;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Data memory barrier, the simulated core is in order
+ ******************************************************************************/
+SIM_INTRINSIC void __DMB(void) {
+	__asm__ volatile("" ::: "memory");
+}
+
+#endif
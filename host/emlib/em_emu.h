@@ -0,0 +1,58 @@
+/**
+ * @file em_emu.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib energy management unit
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_EMU_H
+#define EM_EMU_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define EMU_DCDCINIT_DEFAULT	{ 0 }
+#define EMU_EM23INIT_DEFAULT	{ false, emuVScaleEM23_FastWakeup }
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	emuVScaleEM23_FastWakeup,
+	emuVScaleEM23_LowPower
+} EMU_VScaleEM23_TypeDef;
+
+typedef struct {
+	uint32_t				powerConfig;
+} EMU_DCDCInit_TypeDef;
+
+typedef struct {
+	bool					em23VregFullEn;
+	EMU_VScaleEM23_TypeDef	vScaleEM23Voltage;
+} EMU_EM23Init_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+bool EMU_DCDCInit(const EMU_DCDCInit_TypeDef *dcdcInit);
+void EMU_EM23Init(const EMU_EM23Init_TypeDef *em23Init);
+void EMU_EnterEM1(void);
+void EMU_EnterEM2(bool restore);
+void EMU_EnterEM3(bool restore);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file em_gpio.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib GPIO
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_GPIO_H
+#define EM_GPIO_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	gpioPortA,
+	gpioPortB,
+	gpioPortC,
+	gpioPortD,
+	gpioPortE,
+	gpioPortF,
+	gpioPortCount
+} GPIO_Port_TypeDef;
+
+typedef enum {
+	gpioModeDisabled,
+	gpioModeInput,
+	gpioModePushPull,
+	gpioModeWiredAnd
+} GPIO_Mode_TypeDef;
+
+typedef enum {
+	gpioDriveStrengthStrongAlternateStrong,
+	gpioDriveStrengthWeakAlternateWeak
+} GPIO_DriveStrength_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void GPIO_DriveStrengthSet(GPIO_Port_TypeDef port, GPIO_DriveStrength_TypeDef strength);
+void GPIO_PinModeSet(GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, unsigned int out);
+void GPIO_PinOutSet(GPIO_Port_TypeDef port, unsigned int pin);
+void GPIO_PinOutClear(GPIO_Port_TypeDef port, unsigned int pin);
+
+#endif
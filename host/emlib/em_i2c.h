@@ -0,0 +1,55 @@
+/**
+ * @file em_i2c.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib I2C
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_I2C_H
+#define EM_I2C_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define I2C_FREQ_STANDARD_MAX	92000
+#define I2C_FREQ_FAST_MAX		392157
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	i2cClockHLRStandard,
+	i2cClockHLRAsymetric,
+	i2cClockHLRFast
+} I2C_ClockHLR_TypeDef;
+
+typedef struct {
+	bool					enable;
+	bool					master;
+	uint32_t				refFreq;
+	uint32_t				freq;
+	I2C_ClockHLR_TypeDef	clhr;
+} I2C_Init_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void I2C_Init(I2C_TypeDef *i2c, const I2C_Init_TypeDef *init);
+void I2C_BusFreqSet(I2C_TypeDef *i2c, uint32_t freqRef, uint32_t freqScl, I2C_ClockHLR_TypeDef i2cMode);
+
+#endif
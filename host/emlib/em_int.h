@@ -0,0 +1,25 @@
+/**
+ * @file em_int.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the deprecated emlib interrupt API
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_INT_H
+#define EM_INT_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+#include "em_core.h"
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file em_ldma.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib LDMA
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_LDMA_H
+#define EM_LDMA_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define LDMA_INIT_DEFAULT		{ 0 }
+
+// The transfer of a peripheral request signal
+#define LDMA_TRANSFER_CFG_PERIPHERAL(signal)	{ .ldmaReqSel = (signal) }
+
+// Single byte transfers between memory and a peripheral register.  The
+// addresses are host pointers, so they are held in uintptr_t.  A relative
+// link jumps linkjmp descriptors, counted in words as the silicon does
+#define LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(src, dest, count) \
+	{ .xfer = { .structType = ldmaCtrlStructTypeXfer, .xferCnt = (count) - 1, .srcInc = 1, .dstInc = 0, \
+				.doneIfs = 1, .srcAddr = (uintptr_t)(src), .dstAddr = (uintptr_t)(dest) } }
+#define LDMA_DESCRIPTOR_SINGLE_P2M_BYTE(src, dest, count) \
+	{ .xfer = { .structType = ldmaCtrlStructTypeXfer, .xferCnt = (count) - 1, .srcInc = 0, .dstInc = 1, \
+				.doneIfs = 1, .srcAddr = (uintptr_t)(src), .dstAddr = (uintptr_t)(dest) } }
+#define LDMA_DESCRIPTOR_LINKREL_P2M_BYTE(src, dest, count, linkjmp) \
+	{ .xfer = { .structType = ldmaCtrlStructTypeXfer, .xferCnt = (count) - 1, .srcInc = 0, .dstInc = 1, \
+				.doneIfs = 0, .link = 1, .linkAddr = (linkjmp) * 4, \
+				.srcAddr = (uintptr_t)(src), .dstAddr = (uintptr_t)(dest) } }
+
+// Write of an immediate value to an address
+#define LDMA_DESCRIPTOR_SINGLE_WRITE(value, address) \
+	{ .wri = { .structType = ldmaCtrlStructTypeWrite, .doneIfs = 1, .immVal = (value), \
+			   .dstAddr = (uintptr_t)(address) } }
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	ldmaPeripheralSignal_NONE,
+	ldmaPeripheralSignal_I2C0_RXDATAV,
+	ldmaPeripheralSignal_I2C0_TXBL,
+	ldmaPeripheralSignal_I2C1_RXDATAV,
+	ldmaPeripheralSignal_I2C1_TXBL
+} LDMA_PeripheralSignal_t;
+
+typedef enum {
+	ldmaCtrlStructTypeXfer,
+	ldmaCtrlStructTypeSync,
+	ldmaCtrlStructTypeWrite
+} LDMA_CtrlStructType_t;
+
+typedef union {
+	struct {
+		uint32_t			structType;	// LDMA_CtrlStructType_t
+		uint32_t			xferCnt;	// bytes to move less one
+		uint32_t			srcInc;		// 1 to step the source
+		uint32_t			dstInc;		// 1 to step the destination
+		uint32_t			doneIfs;	// 1 to set the done flag of the channel
+		uint32_t			link;		// 1 to load the descriptor at linkAddr next
+		int32_t				linkAddr;	// relative link in words, 4 a descriptor
+		uintptr_t			srcAddr;
+		uintptr_t			dstAddr;
+	} xfer;
+	struct {
+		uint32_t			structType;
+		uint32_t			reserved[3];
+		uint32_t			doneIfs;
+		uint32_t			link;
+		int32_t				linkAddr;
+		uintptr_t			immVal;		// value written
+		uintptr_t			dstAddr;
+	} wri;
+} LDMA_Descriptor_t;
+
+typedef struct {
+	LDMA_PeripheralSignal_t	ldmaReqSel;
+} LDMA_TransferCfg_t;
+
+typedef struct {
+	uint8_t					ldmaInitCtrlNumFixed;
+} LDMA_Init_t;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void LDMA_Init(const LDMA_Init_t *init);
+void LDMA_StartTransfer(int ch, const LDMA_TransferCfg_t *transfer, const LDMA_Descriptor_t *descriptor);
+void LDMA_StopTransfer(int ch);
+bool LDMA_TransferDone(int ch);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file em_letimer.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib LETIMER
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_LETIMER_H
+#define EM_LETIMER_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	letimerRepeatFree		= _LETIMER_CTRL_REPMODE_FREE,
+	letimerRepeatOneshot	= _LETIMER_CTRL_REPMODE_ONESHOT,
+	letimerRepeatBuffered	= _LETIMER_CTRL_REPMODE_BUFFERED,
+	letimerRepeatDouble		= _LETIMER_CTRL_REPMODE_DOUBLE
+} LETIMER_RepeatMode_TypeDef;
+
+typedef enum {
+	letimerUFOANone			= _LETIMER_CTRL_UFOA0_NONE,
+	letimerUFOAPwm			= _LETIMER_CTRL_UFOA0_PWM
+} LETIMER_UFOA_TypeDef;
+
+typedef struct {
+	bool						enable;
+	bool						debugRun;
+	bool						comp0Top;
+	bool						bufTop;
+	uint8_t						out0Pol;
+	uint8_t						out1Pol;
+	LETIMER_UFOA_TypeDef		ufoa0;
+	LETIMER_UFOA_TypeDef		ufoa1;
+	LETIMER_RepeatMode_TypeDef	repMode;
+	uint32_t					topValue;
+} LETIMER_Init_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void LETIMER_Init(LETIMER_TypeDef *letimer, const LETIMER_Init_TypeDef *init);
+void LETIMER_Enable(LETIMER_TypeDef *letimer, bool enable);
+
+#endif
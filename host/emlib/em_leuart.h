@@ -0,0 +1,66 @@
+/**
+ * @file em_leuart.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib LEUART
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_LEUART_H
+#define EM_LEUART_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	leuartDatabits8			= 8,
+	leuartDatabits9			= 9
+} LEUART_Databits_TypeDef;
+
+typedef enum {
+	leuartDisable,
+	leuartEnableRx,
+	leuartEnableTx,
+	leuartEnable
+} LEUART_Enable_TypeDef;
+
+typedef enum {
+	leuartNoParity,
+	leuartEvenParity,
+	leuartOddParity
+} LEUART_Parity_TypeDef;
+
+typedef enum {
+	leuartStopbits1			= 1,
+	leuartStopbits2			= 2
+} LEUART_Stopbits_TypeDef;
+
+typedef struct {
+	LEUART_Enable_TypeDef	enable;
+	uint32_t				refFreq;
+	uint32_t				baudrate;
+	LEUART_Databits_TypeDef	databits;
+	LEUART_Parity_TypeDef	parity;
+	LEUART_Stopbits_TypeDef	stopbits;
+} LEUART_Init_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void LEUART_Init(LEUART_TypeDef *leuart, const LEUART_Init_TypeDef *init);
+void LEUART_Enable(LEUART_TypeDef *leuart, LEUART_Enable_TypeDef enable);
+
+#endif
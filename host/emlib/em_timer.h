@@ -0,0 +1,67 @@
+/**
+ * @file em_timer.h
+ * @author Gerritt Luoma
+ * @date May 24th, 2021
+ * @brief Host stand in for the emlib TIMER
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef EM_TIMER_H
+#define EM_TIMER_H
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define TIMER_INIT_DEFAULT		{ true, false, false, timerModeUp, timerPrescale1 }
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	timerModeUp,
+	timerModeDown
+} TIMER_Mode_TypeDef;
+
+typedef enum {
+	timerPrescale1,
+	timerPrescale2,
+	timerPrescale4,
+	timerPrescale8,
+	timerPrescale16,
+	timerPrescale32,
+	timerPrescale64,
+	timerPrescale128,
+	timerPrescale256,
+	timerPrescale512,
+	timerPrescale1024
+} TIMER_Prescale_TypeDef;
+
+typedef struct {
+	bool					enable;
+	bool					debugRun;
+	bool					oneShot;
+	TIMER_Mode_TypeDef		mode;
+	TIMER_Prescale_TypeDef	prescale;
+} TIMER_Init_TypeDef;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void TIMER_Init(TIMER_TypeDef *timer, const TIMER_Init_TypeDef *init);
+void TIMER_Enable(TIMER_TypeDef *timer, bool enable);
+
+#endif
@@ -19,6 +19,7 @@
 #include "i2c.h"
 #include "brd_config.h"
 #include "HW_delay.h"
+#include "task.h"
 
 //***********************************************************************************
 // defined files
@@ -34,27 +35,59 @@
 #define SI7021_TEMP_COMMAND		0xF3 // Temperature no hold master mode command
 #define SI7021_READ_COMMAND		0xE7 // Read previous temperature or humidity command
 #define SI7021_WRITE_COMMAND	0xE6 // Write user register 1 command
+#define SI7021_MEASUREMENT_BYTES	3 // MS Byte, LS Byte and checksum, read as a burst
+#define SI7021_CRC_POLYNOMIAL	0x31 // x^8 + x^5 + x^4 + 1, the checksum starts from 0x00
+#define SI7021_USER1_BYTES		1 // user register 1
+
+// Conversion times in software timer ticks, rounded up from the datasheet
+// maximums of the reset resolution, 12 bit RH and 14 bit temperature.  The
+// supply is off between samples so user register 1 is back at its reset value
+// for every sample.  A humidity conversion is followed by a temperature one
+#define SI7021_H_CONVERSION		((23 * SW_TIMER_HZ + 999) / 1000) // 12 ms RH + 10.8 ms temperature
+#define SI7021_T_CONVERSION		((11 * SW_TIMER_HZ + 999) / 1000) // 10.8 ms temperature
+#define SI7021_READ_RETRIES		3 // reads after the first one NACKed, the conversion ran long
+#define SI7021_RETRY_DELAY		((2 * SW_TIMER_HZ + 999) / 1000) // 2 ms between reads
 
 // SI7021 TDD commands
 #define RESET_VALUE 			0x3A
 #define RESOLUTION_CONFIG		0x01
 #define RESOLUTION_FOR_8_12		0x3B
 #define PREVIOUS_USER1_VALUE	0x3B
+#define SI7021_WRITE_DELAY		(15 * SW_TIMER_HZ / 1000) // 15 ms after a user register write
 
 
 //***********************************************************************************
 // global variables
 //***********************************************************************************
 
+enum si7021_measurements {
+	SI7021_HUMIDITY,		//0
+	SI7021_TEMPERATURE,		//1
+	SI7021_MEASUREMENT_TYPES	//2
+} ;
+
+// A measurement is run as a child task of the caller, sharing its event and timer
+typedef struct {
+	TASK					task;
+	uint32_t				type;		// SI7021_HUMIDITY or SI7021_TEMPERATURE
+	const uint8_t			*command;	// no hold master mode measure command
+	uint32_t				conversion;	// conversion time in software timer ticks
+	uint32_t				retries;	// reads left after a NACK
+	uint32_t				result;		// i2c_results of the last read, I2C_DONE once data is valid, I2C_ERROR for a bad checksum
+	uint32_t				data;		// 16 bit code read
+	uint8_t					bytes[SI7021_MEASUREMENT_BYTES];	// burst read, in bus order
+} SI7021_MEASUREMENT ;
+
 //***********************************************************************************
 // function prototypes
 //***********************************************************************************
 
-void si7021_i2c_open();
-void si7021_h_read(uint32_t SI7021_H_READ_CB);
-void si7021_t_read(uint32_t SI7021_T_READ_CB);
-float si7021_humidity_conversion();
-float si7021_temperature_conversion();
-bool tdd_i2c_routine(uint32_t si7021_read_cb, uint32_t si7021_t_read_cb);
+void si7021_i2c_open(uint32_t settle_timer, uint32_t stop_event, uint32_t settle_event);
+void si7021_measure_init(SI7021_MEASUREMENT *measurement, uint32_t type);
+TASK_STATUS si7021_measure_run(SI7021_MEASUREMENT *measurement);
+uint32_t si7021_conversions(uint32_t type);
+float si7021_humidity_conversion(uint32_t raw);
+float si7021_temperature_conversion(uint32_t raw);
+TASK_STATUS si7021_self_test(TASK *task);
 
 #endif
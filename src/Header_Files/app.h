@@ -21,6 +21,10 @@
 #include "ble.h"
 #include "HW_delay.h"
 #include "veml6030.h"
+#include "sw_timer.h"
+#include "task.h"
+#include "energy.h"
+#include "sensor_power.h"
 
 #include "stdio.h"
 #include "string.h"
@@ -36,40 +40,177 @@
 
 #define		SYSTEM_BLOCK_EM		EM3
 
-// Application scheduled events
-#define 	LETIMER0_COMP0_CB 0x00000001 //0b0001
-#define 	LETIMER0_COMP1_CB 0x00000002 //0b0010
-#define 	LETIMER0_UF_CB    0x00000004 //0b0100
-
-#define 	SI7021_H_READ_CB  0x00000008 //0b1000
-
-#define		BOOT_UP_CB		  0x00000010 //0b10000
-
-#define		BLE_TX_DONE_CB	  0x00000040 //0b100000
-#define 	BLE_RX_DONE_CB	  0x00000080 //0b1000000
-
-#define		VEML6030_READ_CB  0x00000100 //0b10000000
-
-#define		SI7021_T_READ_CB  0x00000200
-
+// Relative deadlines in microseconds for earliest deadline first dispatch.
+// Sensor completions carry data that goes stale, the LETIMER events keep the
+// software timers on time, formatting and sending over BLE can wait
+#define		LETIMER0_DEADLINE_US	1000
+#define		SENSOR_READ_DEADLINE_US	2000
+#define		BLE_DEADLINE_US			20000
+
+/***************************************************************************//**
+ * @brief Application events
+ * @details
+ *  Every scheduled event is declared once here with its handler, its unique
+ *  dispatch priority (higher is serviced first), its relative deadline in
+ *  microseconds (0 for none), the policy for a post while it is still
+ *  pending and whether it may be serviced in the posting interrupt.  The
+ *  event bits, the handler prototypes, the scheduler table in app.c and its
+ *  compile time checks are all generated from this list, a new event only
+ *  needs a row and a handler
+ *
+ *  The boot step events are only posted before sampling starts, so their
+ *  high priority delays nothing
+ *
+ *  Overrun policy: the LETIMER events coalesce, sw_timer_process catches up
+ *  from the tick count.  Each boot step waits on one thing at a time, COMP1
+ *  is unused and each bus stops and settles one transfer at a time, so a
+ *  second post of those events is a fault
+ *
+ *  Run mode: the LETIMER events and received characters are serviced in
+ *  handler mode.  The stats dump is the thread mode work of a received
+ *  STATS_DUMP_CMD, and the I2C stop events end a transfer in thread mode
+ *  because releasing the bus, walking the software timer wheel and starting
+ *  the next transfer do not fit the interrupt budget of the bus.  The end of
+ *  an I2C settle time is thread mode too, so the main loop is the only
+ *  context posting completions to the queue of a bus, and the completion
+ *  event it posts wakes the main loop anyway
+ *
+ ******************************************************************************/
+
+#define APP_EVENTS(X) \
+	/* event					handler							priority	deadline_us					overrun policy				run mode */ \
+	X(LETIMER0_COMP0_CB,		scheduled_letimer0_comp0_cb,	12,			LETIMER0_DEADLINE_US,		SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_HANDLER) \
+	X(LETIMER0_COMP1_CB,		scheduled_letimer0_comp1_cb,	11,			0,							SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(LETIMER0_UF_CB,			scheduled_letimer0_uf_cb,		13,			LETIMER0_DEADLINE_US,		SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_HANDLER) \
+	X(SI7021_H_READ_CB,			humidity_done_cb,				10,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(BOOT_UP_CB,				scheduled_boot_up_cb,			3,			0,							SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(BLE_TX_DONE_CB,			scheduled_ble_tx_done_cb,		2,			BLE_DEADLINE_US,			SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(BLE_RX_DONE_CB,			scheduled_ble_rx_done_cb,		1,			BLE_DEADLINE_US,			SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_HANDLER) \
+	X(VEML6030_READ_CB,			light_done_cb,					8,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(SI7021_T_READ_CB,			temp_done_cb,					9,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(SI7021_H_SAMPLE_CB,		scheduled_si7021_h_sample_cb,	7,			0,							SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(SI7021_T_SAMPLE_CB,		scheduled_si7021_t_sample_cb,	6,			0,							SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(VEML6030_SAMPLE_CB,		scheduled_veml6030_sample_cb,	5,			0,							SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(BLE_KEEPALIVE_CB,			scheduled_ble_keepalive_cb,		4,			0,							SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(PERF_REPORT_CB,			scheduled_perf_report_cb,		0,			0,							SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(BOOT_POWER_CB,			scheduled_boot_power_cb,		14,			0,							SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(BOOT_SI7021_CB,			scheduled_boot_si7021_cb,		15,			0,							SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(BOOT_VEML6030_CB,			scheduled_boot_veml6030_cb,		16,			0,							SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(STATS_DUMP_CB,			scheduled_stats_dump_cb,		17,			BLE_DEADLINE_US,			SCHEDULER_OVERRUN_COALESCE,	SCHEDULER_MODE_THREAD) \
+	X(I2C0_SETTLE_CB,			scheduled_i2c0_settle_cb,		18,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(I2C1_SETTLE_CB,			scheduled_i2c1_settle_cb,		19,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(I2C0_STOP_CB,				scheduled_i2c0_stop_cb,			20,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD) \
+	X(I2C1_STOP_CB,				scheduled_i2c1_stop_cb,			21,			SENSOR_READ_DEADLINE_US,	SCHEDULER_OVERRUN_FAULT,	SCHEDULER_MODE_THREAD)
+
+// Event bit numbers, in list order
+enum app_event_bits {
+	APP_EVENTS(SCHEDULER_EVENT_INDEX)
+	APP_EVENT_COUNT
+} ;
+
+// Event bits
+enum app_events {
+	APP_EVENTS(SCHEDULER_EVENT_BIT)
+} ;
+
+// Characters received over BLE that request a report
+#define		STATS_DUMP_CMD			'?'		// dump the scheduler latency histograms
+
+// Software timers multiplexed on LETIMER0
+enum app_sw_timers {
+	SI7021_H_TIMER,			//0
+	SI7021_T_TIMER,			//1
+	VEML6030_TIMER,			//2
+	BLE_KEEPALIVE_TIMER,	//3
+	PERF_REPORT_TIMER,		//4
+	BOOT_TIMER,				//5, delays of the BLE naming boot step
+	BOOT_POWER_TIMER,		//6, sensor power up boot step
+	BOOT_SI7021_TIMER,		//7, SI7021 self test boot step
+	SI7021_H_POWER_TIMER,	//8, SI7021 power up before a humidity read
+	SI7021_T_POWER_TIMER,	//9, SI7021 power up before a temperature read
+	I2C0_SETTLE_TIMER,		//10, VEML6030 settle times, owned by the I2C driver
+	I2C1_SETTLE_TIMER		//11, SI7021 settle times, owned by the I2C driver
+} ;
+
+// Boot steps, each started once the steps it depends on are done.  Steps on
+// different buses or timers run concurrently, the micro sleeps while waiting
+enum app_boot_steps {
+	BOOT_STEP_TIMEBASE,		//0, start LETIMER0
+	BOOT_STEP_BLE_NAME,		//1, name the BLE module if BLE_TEST_ENABLED
+	BOOT_STEP_POWER,		//2, wait for the SI7021 to power up
+	BOOT_STEP_SI7021,		//3, SI7021 self test on I2C1 if TDD_TEST_ENABLED
+	BOOT_STEP_VEML6030,		//4, VEML6030 start up on I2C0
+	BOOT_STEP_SAMPLING,		//5, start the periodic reads
+	BOOT_STEP_COUNT			//6
+} ;
+#define		BOOT_STEP(step)			(1u << (step))
+
+// Sample periods in software timer ticks
+#define		SI7021_H_PERIOD			(60 * SW_TIMER_HZ)
+#define		SI7021_T_PERIOD			(60 * SW_TIMER_HZ)
+#define		VEML6030_PERIOD			(2 * SW_TIMER_HZ)
+#define		BLE_KEEPALIVE_PERIOD	(10 * SW_TIMER_HZ)
+#define		PERF_REPORT_PERIOD		(3600 * SW_TIMER_HZ)	// the performance counters are reported per hour
+
+// First reads, aligned so every SI7021 sample reads all three sensors in one
+// burst: the second SI7021 measurement starts once the first is read and the
+// BLE writes are queued by ble_write.  The SI7021 sample timers expire its power
+// up time earlier, the supply is off between samples
+#define		SI7021_H_PHASE			(1 * SW_TIMER_HZ)
+#define		SI7021_T_PHASE			(1 * SW_TIMER_HZ)
+#define		VEML6030_PHASE			(1 * SW_TIMER_HZ)
+#define		BLE_KEEPALIVE_PHASE		(BLE_KEEPALIVE_PERIOD + SW_TIMER_HZ / 2)
+
+// Boot task delays in software timer ticks
+#define		BLE_TEST_DELAY			(2 * SW_TIMER_HZ)
+
+// Longest expected sleep block holds in software timer ticks, a longer hold
+// is reported as overlong.  LETIMER0, the LEUART receiver and the system
+// block are held for as long as the application runs
+#define		I2C_HOLD_LIMIT			(100 * SW_TIMER_HZ / 1000)	// a sensor transfer with its retries
+#define		LEUART_TX_HOLD_LIMIT	(250 * SW_TIMER_HZ / 1000)	// a full BLE_TX_MAX_LEN string at 9600 baud
+
+// Capacity of the cell the performance report projects the lifetime for
+#define		APP_CELL_MAH			225		// CR2032 coin cell
 
 
 //***********************************************************************************
 // global variables
 //***********************************************************************************
 
+typedef struct {
+	uint32_t				wakes;		// wakes from sleep
+	uint32_t				i2c0_ticks;	// VEML6030 bus time in software timer ticks
+	uint32_t				i2c1_ticks;	// SI7021 bus time in software timer ticks
+	uint32_t				i2c_waits;	// transfers queued behind another on either bus
+	uint32_t				i2c_wait_ticks;	// ticks the queued transfers waited for their bus
+	uint32_t				i2c_max_depth;	// largest queue depth of either bus since boot
+	uint32_t				i2c_isr_max_ns;	// longest I2C interrupt of either bus since boot
+	uint32_t				i2c_isr_overruns;	// I2C interrupts longer than I2C_ISR_BUDGET_NS
+	uint32_t				bytes_sent;	// bytes sent over BLE
+	SLEEP_STATS				sleep;		// energy mode residency and blocked time in ticks
+	uint32_t				overlong;	// sleep blocks held longer than their limit
+	uint32_t				si7021_reads;	// humidity and temperature reads reported
+	uint32_t				si7021_conversions[SI7021_MEASUREMENT_TYPES];	// SI7021 measure commands of each type
+	uint32_t				veml6030_reads;	// light reads
+	uint32_t				now;		// software timer tick of the reading
+	uint32_t				clock_on[CMU_GATE_COUNT];	// ticks each gated peripheral clock was on
+	CMU_BAND_STATS			bands[CMU_BAND_COUNT];	// EM0 and EM1 residency of each core clock band
+	uint32_t				sensor_on[SENSOR_RAIL_COUNT];	// ticks each sensor supply was on
+} APP_PERF ;
+
+typedef struct {
+	TASK_STATUS				(*run)(TASK *task);	// task function of the step
+	uint32_t				depends;	// BOOT_STEP bits of the steps that must be done first
+	uint32_t				event;		// event that resumes the step
+	uint32_t				timer;		// software timer of its delays, or TASK_NO_TIMER
+} APP_BOOT_STEP ;
+
 
 //***********************************************************************************
 // function prototypes
 //***********************************************************************************
 void app_peripheral_setup(void);
-void scheduled_letimer0_uf_cb (void);
-void scheduled_letimer0_comp0_cb (void);
-void scheduled_letimer0_comp1_cb (void);
-void humidity_done_cb(void);
-void temp_done_cb(void);
-void light_done_cb(void);
-void scheduled_boot_up_cb(void);
-void scheduled_ble_tx_done_cb(void);
+APP_EVENTS(SCHEDULER_EVENT_HANDLER)
 
 #endif
@@ -30,6 +30,9 @@
 #define HM10_PARITY			leuartNoParity // No parity bits in use
 #define HM10_REFFREQ		0				// use reference clock
 #define HM10_STOPBITS		leuartStopbits1 // 1 stop bit
+#define BLE_KEEPALIVE_MSG	"\n"			// Periodic traffic that keeps the link up
+#define BLE_TX_MAX_LEN		80				// Longest string + 1, the size of the LEUART buffer
+#define BLE_TX_QUEUE_DEPTH	8				// Strings waiting behind the current transfer
 
 // Route to location 18 (expansion header)
 #define LEUART0_TX_ROUTE	LEUART_ROUTELOC0_TXLOC_LOC18   	// Route to PD11
@@ -46,6 +49,9 @@
 //***********************************************************************************
 void ble_open(uint32_t tx_event, uint32_t rx_event);
 void ble_write(char *string);
+void ble_tx_done(void);
+bool ble_tx_queue_full(void);
+uint32_t ble_tx_dropped(void);
 
 bool ble_test(char *mod_name);
 
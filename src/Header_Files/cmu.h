@@ -5,29 +5,80 @@
 #define	CMU_HG
 
 /* System include statements */
-
+#include <stdint.h>
+#include <stdbool.h>
 
 /* Silicon Labs include statements */
 #include "em_cmu.h"
 #include "em_assert.h"
+#include "em_core.h"
 
 /* The developer's include statements */
-
+#include "brd_config.h"
+#include "sleep_routines.h"
 
 
 //***********************************************************************************
 // defined files
 //***********************************************************************************
 
+// Clock governor HFRCO bands
+#define CMU_FAST_BAND			MCU_HFXO_FREQ			// bursts of compute, float formatting
+#define CMU_SLOW_BAND			cmuHFRCOFreq_4M0Hz		// everything else, mostly servicing interrupts
+#define CMU_CLOCK_LISTENERS		4						// functions called after the core clock changes
+#define CMU_BAND_MODES			(EM1 + 1)				// EM0 and EM1, whose current scales with HFCLK
+
+// Clock governor bands, each keeps the EM0 and EM1 residency spent in it
+enum cmu_bands {
+	CMU_BAND_SLOW,		//0, CMU_SLOW_BAND
+	CMU_BAND_FAST,		//1, CMU_FAST_BAND
+	CMU_BAND_COUNT		//2
+} ;
+
+// Peripheral clocks enabled only while a driver holds a reference
+enum cmu_gates {
+	CMU_GATE_HFPER,		//0, parent of the I2C clocks
+	CMU_GATE_I2C0,		//1
+	CMU_GATE_I2C1,		//2
+	CMU_GATE_LEUART0,	//3
+	CMU_GATE_LDMA,		//4, on the HFBUS, held while a channel moves data
+	CMU_GATE_COUNT		//5
+} ;
 
 //***********************************************************************************
 // global variables
 //***********************************************************************************
 
+typedef void (*CMU_CLOCK_CHANGED)(void);	// re-derives a timing from the new HFCLK
+typedef uint32_t (*CMU_TIMEBASE)(void);		// tick count the clock on time is measured in
+
+typedef struct {
+	uint32_t				refs;		// references held, the clock is on while not 0
+	uint32_t				enables;	// times the clock was turned on
+	uint32_t				on_ticks;	// ticks the clock was on, up to the last turn off
+	uint32_t				on_tick;	// tick the clock was last turned on
+} CMU_GATE ;
+
+typedef struct {
+	uint32_t				mhz;		// HFCLK in the band
+	uint32_t				residency[CMU_BAND_MODES];	// ticks spent in EM0 and EM1 while in the band
+} CMU_BAND_STATS ;
 
 //***********************************************************************************
 // function prototypes
 //***********************************************************************************
 void cmu_open(void);
+void cmu_clock_notify(CMU_CLOCK_CHANGED changed);
+void cmu_clock_raise(void);
+void cmu_clock_lower(void);
+void cmu_clock_lock(void);
+void cmu_clock_unlock(void);
+void cmu_clock_settle(void);
+uint32_t cmu_clock_changes(void);
+void cmu_band_stats(uint32_t band, CMU_BAND_STATS *stats);
+void cmu_timebase(CMU_TIMEBASE now);
+void cmu_gate_acquire(uint32_t gate);
+void cmu_gate_release(uint32_t gate);
+uint32_t cmu_gate_on_ticks(uint32_t gate);
 
 #endif
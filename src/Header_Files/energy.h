@@ -0,0 +1,69 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef ENERGY_HG
+#define ENERGY_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_assert.h"
+
+/* The developer's include statements */
+#include "sleep_routines.h"
+#include "cmu.h"
+#include "ble.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+// Typical currents of the EFM32PG12, SI7021 and VEML6030 datasheets, added to
+// the energy mode current while the peripheral or sensor is active.  The
+// energy mode currents are the SLEEP_EMx values of sleep_routines.h
+#define ENERGY_EM4_NA				400		// EM4H with RTCC
+#define ENERGY_I2C_NA				110000	// I2C peripheral at HFPERCLK
+#define ENERGY_I2C_PULLUP_NA		350000	// SCL and SDA 4.7 kohm pull ups at 3.3 V, low about half the bus time
+#define ENERGY_LEUART_NA			150		// LEUART at HM10_BAUDRATE from the LFXO
+#define ENERGY_LEUART_BITS			10		// start, 8 data and stop bit per byte
+#define ENERGY_SI7021_NA			90000	// SI7021 during a conversion
+#define ENERGY_SI7021_H_CONVERSION_US	22800	// 12 bit humidity conversion followed by its 14 bit temperature one
+#define ENERGY_SI7021_T_CONVERSION_US	10800	// 14 bit temperature conversion of a SI7021_TEMP_COMMAND
+#define ENERGY_SI7021_STANDBY_NA	60		// SI7021 powered on between conversions
+#define ENERGY_SI7021_PULLUP_NA		100		// SI7021 bus pull ups idle high, pin and sensor input leakage
+#define ENERGY_VEML6030_NA			45000	// VEML6030 powered on, between conversions too
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef struct {
+	uint32_t	hz;							// residency and activity ticks per second
+	uint32_t	residency[MAX_ENERGY_MODES];	// ticks spent in each energy mode
+	uint32_t	core_mhz[CMU_BAND_COUNT];	// HFCLK of each clock band in MHz, scales the EM0 and EM1 currents
+	uint32_t	band_residency[CMU_BAND_COUNT][CMU_BAND_MODES];	// EM0 and EM1 ticks spent in each clock band
+	uint32_t	i2c_ticks;					// ticks an I2C bus was busy, both buses added
+	uint32_t	leuart_bytes;				// bytes sent over the LEUART
+	uint32_t	si7021_h_conversions;		// humidity measure commands written
+	uint32_t	si7021_t_conversions;		// temperature measure commands written
+	uint32_t	si7021_on_ticks;			// ticks the SI7021 rail and its pull ups were powered on
+	uint32_t	veml6030_on_ticks;			// ticks the VEML6030 was powered on
+	uint32_t	samples;					// samples taken by all sensors
+} ENERGY_TRACE ;
+
+typedef struct {
+	uint32_t	average_na;					// average current
+	uint32_t	sample_nc;					// charge per sample
+	uint32_t	lifetime_h;					// projected lifetime of the cell in hours
+} ENERGY_ESTIMATE ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void energy_estimate(const ENERGY_TRACE *trace, uint32_t cell_mah, ENERGY_ESTIMATE *estimate);
+
+#endif
@@ -18,6 +18,7 @@
 #include "sleep_routines.h"
 #include "scheduler.h"
 #include "HW_delay.h"
+#include "ldma.h"
 
 //***********************************************************************************
 // defined files
@@ -26,6 +27,11 @@
 #define I2C_EM_BLOCK EM2
 #define I2C_READ 	 1
 #define I2C_WRITE	 0
+#define I2C_BUS_COUNT 2	// I2C0 and I2C1
+#define I2C_QUEUE_DEPTH 4	// transfers waiting behind the one in progress, per bus
+#define I2C_DMA_MIN_BYTES 4	// bytes the LDMA moves at least, fewer and the last two of a read move by the interrupt state machine
+#define I2C_DMA_DESCRIPTORS 2	// a read moves its bytes, then clears the automatic ACK
+#define I2C_ISR_BUDGET_NS 50000	// worst case time of one interrupt, longer ones are counted
 
 //***********************************************************************************
 // global variables
@@ -42,29 +48,113 @@ typedef struct {
 	uint32_t				SCL_route;	// SCL route
 	bool					SDAPEN;		// SDA pin enable
 	bool					SCLPEN;		// SCL pin enable
+
+	uint32_t				settle_timer;	// software timer of the settle waits of the bus
+	uint32_t				stop_event;		// thread mode event posted by the stop of every transfer, its handler calls i2c_stopped
+	uint32_t				settle_event;	// thread mode event of settle_timer, its handler calls i2c_settled
 } I2C_OPEN_STRUCT ;
 
+// Order of the bytes read, assembled into the value handed to the caller
+enum i2c_byte_orders {
+	I2C_MSB_FIRST,	//0, most significant byte first (SI7021)
+	I2C_LSB_FIRST	//1, least significant byte first (VEML6030)
+} ;
+
+// How a transfer ended
+enum i2c_results {
+	I2C_DONE,		//0, every byte transferred
+	I2C_NACKED,		//1, the slave NACKed the read address, such as during a conversion, or a byte written by LDMA
+	I2C_ERROR		//2, the LDMA failed and the transfer was stopped, or the driver of the slave found the data corrupt
+} ;
+
+// One bus transfer: the write bytes, then after a repeated start the read
+// bytes, or only the read bytes.  The write and read buffers must stay valid until the transfer is
+// done, the descriptor itself is copied by i2c_start.  Up to 4 bytes are read
+// into a value, a burst read needs a buffer
+typedef struct {
+	uint32_t				address;	// 7 bit slave address
+	const uint8_t			*tx;		// bytes written after the address, the command or register first
+	uint32_t				tx_len;		// bytes written, 0 for a read only
+	uint32_t				*rx;		// value read, or 0 if only the completion event carries it
+	uint8_t					*buffer;	// bytes read in bus order for a burst read, or 0 to read into the value
+	uint32_t				rx_len;		// bytes read, 0 for a write, at most 4 without a buffer
+	uint32_t				order;		// i2c_byte_orders of the bytes read into the value
+	uint32_t				settle;		// software timer ticks the slave needs after the transfer, such as a conversion or a register write
+	uint32_t				*result;	// i2c_results of the transfer, or 0 if the caller does not check it
+	uint32_t				callback;	// completion event, posted after the settle time, its payload is the value or the number of bytes read, or 0
+} I2C_TRANSFER ;
+
+// A transfer waiting for its bus
+typedef struct {
+	I2C_TRANSFER			transfer;
+	uint32_t				queued_tick;	// sw_timer_now() when it was queued
+} I2C_QUEUED ;
+
+// Context of one bus, its peripheral, the transfer in progress and the
+// transfers queued behind it
 typedef struct {
 	uint32_t				state;		// current state of state machine
 
 	I2C_TypeDef				*i2c_def;	// i2c0 or i2c1
-	uint32_t				slave_address;// slave device address
-	uint32_t				slave_reg;	// slave register address being requested
-	bool					w_r;		// write or read
-	uint32_t				*w_r_store;	// pointer of where to store read result or where to get write data
+	I2C_TRANSFER			transfer;	// transfer in progress
+	uint32_t				tx_index;	// next byte of transfer.tx to write
+	uint32_t				rx_index;	// bytes of transfer.rx_len read so far
+	uint32_t				value;		// bytes read so far, assembled in transfer.order
 	bool					i2c_busy;
-	uint32_t				bytes_count;
-	uint32_t 				callback;
+	uint32_t				owner;		// sleep_owners entry of the bus
+	uint32_t				gate;		// cmu_gates entry of the bus clock
+	uint32_t				queue;		// scheduler queue the completion record is posted to
+	uint32_t				settle_timer;	// software timer of the settle waits
+	uint32_t				stop_event;		// event that ends the transfer out of the interrupt
+	uint32_t				settle_event;	// event of settle_timer
+	uint32_t				start_tick;	// sw_timer_now() when the transfer started
+	uint32_t				transfers;	// transfers completed
+	uint32_t				bus_ticks;	// software timer ticks spent in transfers
+	I2C_QUEUED				pending[I2C_QUEUE_DEPTH];	// ring of queued transfers
+	uint32_t				head;		// oldest queued transfer, index into pending
+	uint32_t				depth;		// transfers queued
+	uint32_t				max_depth;	// largest depth seen
+	uint32_t				waits;		// transfers that were queued
+	uint32_t				wait_ticks;	// software timer ticks queued transfers waited for the bus
+	uint32_t				isr_max_cycles;	// longest interrupt of the bus at the current core clock
+	uint32_t				isr_max_ns;	// longest interrupt of the bus at earlier core clocks
+	uint32_t				isr_mhz;	// core clock isr_max_cycles is counted at
+	uint32_t				isr_budget_cycles;	// I2C_ISR_BUDGET_NS at that clock
+	uint32_t				isr_overruns;	// interrupts longer than I2C_ISR_BUDGET_NS
+	uint32_t				freq;		// bus frequency of i2c_open, kept across core clock changes
+	I2C_ClockHLR_TypeDef	clhr;		// clock low/high ratio of i2c_open
+	bool					freq_stale;	// the core clock changed while the bus clock was gated
+	bool					bus_stale;	// the sensor was powered off, the bus state may be wrong
+	uint32_t				dma_channel;	// ldma_channels entry of the bus
+	LDMA_PeripheralSignal_t	dma_tx_signal;	// TXBL request of the peripheral
+	LDMA_PeripheralSignal_t	dma_rx_signal;	// RXDATAV request of the peripheral
+	LDMA_Descriptor_t		dma_desc[I2C_DMA_DESCRIPTORS];	// LDMA transfer of the payload in progress
+	bool					dma_read;	// the LDMA is reading the bytes of this transfer
+	uint32_t				status;		// i2c_results of the transfer, anything but I2C_DONE stops it early
+
 
 } I2C_STATE_MACHINE ;
 
+typedef struct {
+	uint32_t				transfers;	// transfers completed
+	uint32_t				bus_ticks;	// software timer ticks spent in transfers
+	uint32_t				max_depth;	// largest queue depth seen
+	uint32_t				waits;		// transfers that were queued
+	uint32_t				wait_ticks;	// software timer ticks queued transfers waited for the bus
+	uint32_t				isr_max_ns;	// longest interrupt
+	uint32_t				isr_overruns;	// interrupts longer than I2C_ISR_BUDGET_NS
+} I2C_BUS_STATS ;
+
 enum i2c_defined_states {
-	StartCommand,	//0
-	ReadCommand,	//1
-	WriteCommand, 	//2
-	WaitRead,		//3
-	EndSensing,		//4
-	Stop			//5
+	StartCommand,	//0, address and write bit sent
+	WriteCommand, 	//1, write byte sent
+	WaitRead,		//2, address and read bit sent
+	EndSensing,		//3, reading bytes
+	Stop,			//4
+	WriteDma,		//5, LDMA writing bytes, waiting for TXC
+	ReadDma,		//6, LDMA reading all but the last two bytes
+	Settle,			//7, stopped, waiting out the settle time with the bus gated
+	Stopped			//8, stopped, i2c_stopped ends the transfer in the main loop
 } ;
 
 //***********************************************************************************
@@ -74,8 +164,11 @@ enum i2c_defined_states {
 void i2c_open(I2C_TypeDef *i2c_def, I2C_OPEN_STRUCT *i2c_setup);
 void I2C0_IRQHandler(void);
 void I2C1_IRQHandler(void);
-void i2c_start(I2C_TypeDef *i2c, uint32_t address, uint32_t reg, bool RW, uint32_t *loc, uint8_t byte_count, uint32_t SI7021_READ_CB);
-bool check_busy_0(I2C_TypeDef *i2c);
-bool check_busy_1(I2C_TypeDef *i2c);
+void i2c_start(I2C_TypeDef *i2c, const I2C_TRANSFER *transfer);
+bool i2c_busy(I2C_TypeDef *i2c);
+void i2c_bus_stats(I2C_TypeDef *i2c, I2C_BUS_STATS *stats);
+void i2c_bus_repowered(I2C_TypeDef *i2c);
+void i2c_stopped(I2C_TypeDef *i2c);
+void i2c_settled(I2C_TypeDef *i2c);
 
 #endif
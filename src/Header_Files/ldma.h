@@ -0,0 +1,44 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	LDMA_HG
+#define	LDMA_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_ldma.h"
+#include "em_assert.h"
+#include "em_core.h"
+
+/* The developer's include statements */
+#include "cmu.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+// LDMA channels, one per driver that moves its data by DMA
+enum ldma_channels {
+	LDMA_CHANNEL_I2C0,		//0
+	LDMA_CHANNEL_I2C1,		//1
+	LDMA_CHANNEL_COUNT		//2
+} ;
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef void (*LDMA_DONE)(uint32_t channel, bool error);	// called from the LDMA interrupt when a channel is done or failed
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void ldma_open(void);
+void ldma_start(uint32_t channel, const LDMA_TransferCfg_t *cfg, const LDMA_Descriptor_t *desc, LDMA_DONE done);
+void ldma_stop(uint32_t channel);
+void LDMA_IRQHandler(void);
+
+#endif
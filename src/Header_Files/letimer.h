@@ -23,6 +23,7 @@
 //***********************************************************************************
 #define LETIMER_HZ		1000			// Utilizing ULFRCO oscillator for LETIMERs
 #define LETIMER_EM 		EM4 			// Using the ULFRCO, block from entering Energy Mode 4
+#define LETIMER_TOP		_LETIMER_CNT_MASK	// Free running timebase counts the full counter range
 
 //***********************************************************************************
 // global variables
@@ -46,6 +47,13 @@ typedef struct {
 	uint32_t 		uf_cb;
 } APP_LETIMER_PWM_TypeDef ;
 
+typedef struct {
+	bool 			debugRun;			// True = keep LETIMER running will halted
+	bool 			enable;				// enable the LETIMER upon completion of open
+	uint32_t 		comp0_cb;			// event posted when the COMP0 deadline is reached
+	uint32_t 		uf_cb;				// event posted when the counter wraps
+} APP_LETIMER_TIMEBASE_TypeDef ;
+
 
 //***********************************************************************************
 // function prototypes
@@ -53,5 +61,9 @@ typedef struct {
 void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_letimer_struct);
 void letimer_start(LETIMER_TypeDef *letimer, bool enable);
 void LETIMER0_IRQHandler(void);
+void letimer_timebase_open(LETIMER_TypeDef *letimer, APP_LETIMER_TIMEBASE_TypeDef *app_letimer_struct);
+uint32_t letimer_now(LETIMER_TypeDef *letimer);
+bool letimer_compare_set(LETIMER_TypeDef *letimer, uint32_t delay);
+void letimer_compare_disable(LETIMER_TypeDef *letimer);
 
 #endif
@@ -84,6 +84,7 @@ void leuart_open(LEUART_TypeDef *leuart, LEUART_OPEN_STRUCT *leuart_settings);
 void LEUART0_IRQHandler(void);
 void leuart_start(LEUART_TypeDef *leuart, char *string, uint32_t string_len);
 bool leuart_tx_busy(LEUART_TypeDef *leuart);
+uint32_t leuart_bytes_sent(void);
 
 uint32_t leuart_status(LEUART_TypeDef *leuart);
 void leuart_cmd_write(LEUART_TypeDef *leuart, uint32_t cmd_update);
@@ -7,6 +7,7 @@
 
 /* System include statements */
 #include <stdint.h>
+#include <stdbool.h>
 
 /* Silicon Labs include statements */
 #include "em_assert.h"
@@ -19,17 +20,149 @@
 // defined files
 //***********************************************************************************
 
+#define SCHEDULER_MAX_EVENTS	32		// One event per bit of event_scheduled
+#define SCHEDULER_MAX_PRIORITY	31		// Priorities 0 (lowest) to 31 (highest)
+#define SCHEDULER_QUEUE_DEPTH	8		// Records per ISR queue, must be a power of 2
+
+// Per-event log2 histograms of the latency from post to dispatch and of the
+// handler service time, in nanoseconds so counts taken at different core
+// clocks add up.  Comment out to remove the instrumentation
+#define SCHEDULER_INSTRUMENTATION
+#define SCHEDULER_HIST_BUCKETS	28		// Bucket b counts times below 2^b ns, the last bucket saturates from 67 ms
+
+// Earliest deadline first dispatch.  An event with a relative deadline in the
+// event table is due that long after it is posted, and the pending event
+// that is due first is dispatched first.  Events without a deadline
+// run by priority once no deadline is pending.  Comment out to dispatch by
+// priority only
+#define SCHEDULER_EDF
+
+// Sleep on exit run mode.  An event marked SCHEDULER_MODE_HANDLER that is
+// posted from an interrupt handler is dispatched at once, in handler mode,
+// and while the main loop sleeps the core goes back to sleep when the
+// interrupt returns.  The main loop only wakes for events that need thread
+// mode.  Comment out to dispatch every event from the main loop
+#define SCHEDULER_SLEEP_ON_EXIT
+
+// One single-producer/single-consumer queue per context that posts records,
+// an interrupt handler or the main loop, which is the only consumer of all
+// of them.  The I2C queues are posted to by the main loop as it ends the
+// transfers of the bus
+enum scheduler_queues {
+	SCHEDULER_QUEUE_I2C0,		//0
+	SCHEDULER_QUEUE_I2C1,		//1
+	SCHEDULER_QUEUE_LEUART0,	//2
+	SCHEDULER_QUEUE_COUNT		//3
+} ;
+
+// What add_scheduled_event does with an event that is already pending
+enum scheduler_overrun_policies {
+	SCHEDULER_OVERRUN_COALESCE,	//0, the posts merge into one dispatch (default)
+	SCHEDULER_OVERRUN_QUEUE,	//1, the handler is dispatched once per post
+	SCHEDULER_OVERRUN_FAULT		//2, an overrun is a bug, assert
+} ;
+
+// Where an event posted from an interrupt handler is dispatched
+enum scheduler_run_modes {
+	SCHEDULER_MODE_THREAD,		//0, from the main loop (default)
+	SCHEDULER_MODE_HANDLER		//1, at once in the posting interrupt with SCHEDULER_SLEEP_ON_EXIT, for
+								//   short handlers that only touch interrupt safe state
+} ;
+
+/***************************************************************************//**
+ * @brief Event list X-macros
+ * @details
+ *  The application lists every event once as a row
+ *  X(name, handler, priority, deadline_us, overrun_policy, run_mode) of an
+ *  X-macro and
+ *  expands the list with the macros below to get the event bits, the handler
+ *  prototypes, the SCHEDULER_TABLE and the compile time checks.  The event
+ *  bit is the position of the row in the list
+ *
+ ******************************************************************************/
+
+#define SCHEDULER_EVENT_INDEX(name, handler, priority, deadline_us, policy, mode)		name##_BIT,
+#define SCHEDULER_EVENT_BIT(name, handler, priority, deadline_us, policy, mode)		name = 1u << name##_BIT,
+#define SCHEDULER_EVENT_HANDLER(name, handler, priority, deadline_us, policy, mode)	void handler(void);
+#define SCHEDULER_TABLE_DISPATCH(name, handler, priority, deadline_us, policy, mode)	[priority] = { name, handler },
+#define SCHEDULER_TABLE_PRIORITY(name, handler, priority, deadline_us, policy, mode)	[name##_BIT] = 1u << (priority),
+#define SCHEDULER_TABLE_DEADLINE(name, handler, priority, deadline_us, policy, mode)	[name##_BIT] = (deadline_us),
+#define SCHEDULER_TABLE_POLICY(name, handler, priority, deadline_us, policy, mode)	[name##_BIT] = (policy),
+#define SCHEDULER_TABLE_HANDLER(name, handler, priority, deadline_us, policy, mode)	| (((mode) == SCHEDULER_MODE_HANDLER) ? name : 0)
+// Each row adds its priority bit once, the sum only equals the OR if no two rows share a priority
+#define SCHEDULER_PRIORITY_SUM(name, handler, priority, deadline_us, policy, mode)	+ (1ull << (priority))
+#define SCHEDULER_PRIORITY_OR(name, handler, priority, deadline_us, policy, mode)		| (1ull << (priority))
+#define SCHEDULER_PRIORITY_CHECK(name, handler, priority, deadline_us, policy, mode)	\
+	_Static_assert((priority) <= SCHEDULER_MAX_PRIORITY, #name " priority out of range");
+
 //***********************************************************************************
 // global variables
 //***********************************************************************************
 
+typedef void (*SCHEDULER_HANDLER)(void);
+
+typedef struct {
+	uint32_t				event;		// event bit serviced at this priority
+	SCHEDULER_HANDLER		handler;	// callback run from the main loop
+} SCHEDULER_DISPATCH_ENTRY ;
+
+// Constant event table, built at compile time with the SCHEDULER_TABLE_*
+// macros below from an X-macro list of the application events
+typedef struct {
+	SCHEDULER_DISPATCH_ENTRY	dispatch[SCHEDULER_MAX_PRIORITY + 1];	// event and handler, by priority
+	uint32_t					priority_mask[SCHEDULER_MAX_EVENTS];	// priority bit, by event bit
+	uint32_t					deadline_us[SCHEDULER_MAX_EVENTS];		// relative deadline or 0, by event bit
+	uint8_t						overrun_policy[SCHEDULER_MAX_EVENTS];	// scheduler_overrun_policies, by event bit
+	uint32_t					handler_events;							// events with SCHEDULER_MODE_HANDLER
+} SCHEDULER_TABLE ;
+
+typedef struct {
+	uint32_t				event;		// event bit to dispatch
+	uint32_t				payload;	// data delivered with the event
+	uint32_t				timestamp;	// scheduler_timestamp() when posted
+} SCHEDULER_RECORD ;
+
+typedef struct {
+	uint32_t				pending;	// posts waiting for dispatch
+	uint32_t				high_water;	// largest pending count seen
+	uint32_t				overruns;	// posts made while the event was already pending
+} SCHEDULER_EVENT_STATS ;
+
+typedef struct {
+	volatile uint32_t		head;		// next record to dispatch, written by the main loop only
+	volatile uint32_t		tail;		// next free record, written by the producer only
+	uint32_t				dropped;	// posts lost to a full queue, written by the producer only
+	SCHEDULER_RECORD		records[SCHEDULER_QUEUE_DEPTH];
+} SCHEDULER_QUEUE ;
+
 //***********************************************************************************
 // function prototypes
 //***********************************************************************************
 
-void scheduler_open(void);
+void scheduler_open(const SCHEDULER_TABLE *table);
 void add_scheduled_event(uint32_t event);
 void remove_scheduled_event(uint32_t event);
 uint32_t get_scheduled_events(void);
+bool scheduler_dispatch(void);
+bool scheduler_post(uint32_t queue, uint32_t event, uint32_t payload);
+const SCHEDULER_RECORD *scheduler_current_record(void);
+uint32_t scheduler_queue_dropped(uint32_t queue);
+uint32_t scheduler_timestamp(void);
+void scheduler_clock_changed(void);
+void scheduler_event_stats(uint32_t event, SCHEDULER_EVENT_STATS *stats);
+uint32_t scheduler_overruns_total(void);
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+uint32_t scheduler_handler_dispatches(void);
+#endif
+#ifdef SCHEDULER_EDF
+uint32_t scheduler_deadline_misses(uint32_t event);
+uint32_t scheduler_deadline_misses_total(void);
+#endif
+#ifdef SCHEDULER_INSTRUMENTATION
+const uint32_t *scheduler_latency_histogram(uint32_t priority);
+const uint32_t *scheduler_service_histogram(uint32_t priority);
+bool scheduler_histogram_line(uint32_t *cursor, char *str, uint32_t size);
+void scheduler_histogram_clear(void);
+#endif
 
 #endif
@@ -0,0 +1,70 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	SENSOR_POWER_HG
+#define	SENSOR_POWER_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_gpio.h"
+#include "em_i2c.h"
+#include "em_assert.h"
+#include "em_core.h"
+
+/* The developer's include statements */
+#include "brd_config.h"
+#include "sw_timer.h"
+#include "i2c.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+// Sensor power up times in software timer ticks, from the enable pin rising to
+// the first transfer the sensor answers
+#define SENSOR_SI7021_POWER_UP	(80 * SW_TIMER_HZ / 1000)	// SI7021 power up time, full temperature range
+
+// Sensor supplies switched by an enable pin.  The VEML6030 has no enable pin on
+// this board and is always powered
+enum sensor_rails {
+	SENSOR_RAIL_SI7021,		//0, SENSOR_EN, also powers the SI7021 I2C pull ups
+	SENSOR_RAIL_COUNT		//1
+} ;
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef struct {
+	GPIO_Port_TypeDef		en_port;	// enable pin of the supply
+	uint32_t				en_pin;
+	GPIO_Port_TypeDef		scl_port;	// I2C pins of the sensor, disabled while it is off
+	uint32_t				scl_pin;
+	GPIO_Port_TypeDef		sda_port;
+	uint32_t				sda_pin;
+	I2C_TypeDef				*i2c;		// bus of the sensor
+	uint32_t				power_up;	// ticks from power on to the first transfer
+} SENSOR_RAIL_DEF ;
+
+typedef struct {
+	uint32_t				refs;		// references held, the supply is on while not 0
+	uint32_t				cycles;		// times the supply was turned on
+	uint32_t				on_ticks;	// ticks the supply was on, up to the last turn off
+	uint32_t				on_tick;	// tick the supply was last turned on
+} SENSOR_RAIL ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sensor_power_open(void);
+void sensor_power_timebase(void);
+void sensor_power_acquire(uint32_t rail);
+void sensor_power_release(uint32_t rail);
+uint32_t sensor_power_wait(uint32_t rail);
+uint32_t sensor_power_up_time(uint32_t rail);
+uint32_t sensor_power_on_ticks(uint32_t rail);
+
+#endif
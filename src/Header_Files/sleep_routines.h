@@ -30,14 +30,71 @@
 #define EM4 4
 #define MAX_ENERGY_MODES 5
 
+// Typical supply current and wake up time of the EFM32PG12 datasheet, used to
+// find how long a sleep must be for a deeper energy mode to save energy
+#define SLEEP_EM0_NA_PER_MHZ	69000	// EM0 from HFRCO
+#define SLEEP_EM1_NA_PER_MHZ	36000	// EM1 from HFRCO
+#define SLEEP_EM2_NA			2500	// EM2 with full RAM retention and the LETIMER
+#define SLEEP_EM3_NA			2100	// EM3 with full RAM retention and the LETIMER
+#define SLEEP_EM2_WAKE_US		11		// EM2 to EM0 wake up
+#define SLEEP_EM3_WAKE_US		11		// EM3 to EM0 wake up
+#define SLEEP_COST_WEIGHT		3		// the measured wake cost averages 1 / 2^3 of each new sleep
+
+// Owners of the sleep blocks, each holds at most one block at a time
+enum sleep_owners {
+	SLEEP_OWNER_APP,			//0, SYSTEM_BLOCK_EM
+	SLEEP_OWNER_LETIMER0,		//1
+	SLEEP_OWNER_I2C0,			//2
+	SLEEP_OWNER_I2C1,			//3
+	SLEEP_OWNER_LEUART0_TX,		//4
+	SLEEP_OWNER_LEUART0_RX,		//5
+	SLEEP_OWNER_COUNT			//6
+} ;
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef uint32_t (*SLEEP_TIMEBASE)(void);	// low frequency tick count that runs in EM2 and EM3
+typedef bool (*SLEEP_NEXT_WAKE)(uint32_t *tick);	// tick of the next timed wake, false if none is due
+typedef bool (*SLEEP_DONE)(void);	// condition a sleeping wait is over, set by an interrupt or the time
+
+typedef struct {
+	uint32_t	residency[MAX_ENERGY_MODES];	// ticks spent in each energy mode
+	uint32_t	blocked[MAX_ENERGY_MODES];		// ticks during which each energy mode was blocked
+} SLEEP_STATS;
+
+typedef struct {
+	uint32_t	EM;				// energy mode blocked by the current or last hold
+	bool		held;			// the owner currently holds its block
+	uint32_t	acquired;		// tick the current or last hold started
+	uint32_t	acquires;		// holds started
+	uint32_t	held_ticks;		// ticks of all completed holds
+	uint32_t	longest;		// ticks of the longest completed hold
+	uint32_t	limit;			// a hold longer than this many ticks is overlong, 0 for no limit
+	uint32_t	overlong;		// holds that exceeded limit
+	bool		flagged;		// the current hold has been counted as overlong
+} SLEEP_OWNER;
+
 //***********************************************************************************
 // function prototypes
 //***********************************************************************************
 
 void sleep_open(void); //Initialize the sleep_routines static /private variable, lowest_energy_mode[]
-void sleep_block_mode(uint32_t EM); //Utilized by a peripheral to prevent the Pearl Gecko going into that sleep mode while the peripheral is active.
-void sleep_unblock_mode(uint32_t EM); //Utilized to release the processor from going into a sleep mode with a peripheral that is no longer active.
+void sleep_block_mode(uint32_t owner, uint32_t EM); //Utilized by a peripheral to prevent the Pearl Gecko going into that sleep mode while the peripheral is active.
+void sleep_unblock_mode(uint32_t owner); //Utilized to release the processor from going into a sleep mode with a peripheral that is no longer active.
 void enter_sleep(void); //Function to enter sleep
+void sleep_wait(SLEEP_DONE done); //Function to sleep once unless a condition is met.
 uint32_t current_block_energy_mode(void); //Function that returns which energy mode that the current system cannot enter.
+uint32_t sleep_wake_count(void); //Function that returns the number of wakes from sleep.
+void sleep_timebase(SLEEP_TIMEBASE now); //Function that sets the timebase of the residency counters.
+void sleep_stats(SLEEP_STATS *stats); //Function that returns the energy mode residency and blocked time.
+void sleep_hold_limit(uint32_t owner, uint32_t limit); //Function that sets the longest expected hold of an owner.
+void sleep_owner_stats(uint32_t owner, SLEEP_OWNER *stats); //Function that returns the hold statistics of an owner.
+uint32_t sleep_overlong_holds(void); //Function that returns the number of holds of all owners that exceeded their limit.
+void sleep_predictor(SLEEP_NEXT_WAKE next, uint32_t hz); //Function that sets the source of the next timed wake.
+uint32_t sleep_break_even(uint32_t EM); //Function that returns the shortest sleep worth entering an energy mode for.
+void sleep_handler_enter(void); //Function that accounts a wake serviced in handler mode, called first by every interrupt handler.
+void sleep_handler_exit(void); //Function that returns to sleep after servicing an interrupt in handler mode, called last by every interrupt handler.
 
 #endif /* SRC_HEADER_FILES_SLEEP_ROUTINES_H_ */
@@ -0,0 +1,59 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef SW_TIMER_HG
+#define SW_TIMER_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_assert.h"
+
+/* The developer's include statements */
+#include "letimer.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define SW_TIMER_MAX			12		// Number of software timers available
+#define SW_TIMER_SLOT_BITS		5		// Each wheel level resolves 5 bits of the expiry
+#define SW_TIMER_SLOTS			(1u << SW_TIMER_SLOT_BITS)
+#define SW_TIMER_LEVELS			7		// 7 levels of 5 bits cover the 32 bit tick count
+#define SW_TIMER_FAR_LEVEL		SW_TIMER_LEVELS	// Expiries past the tick count wrap
+#define SW_TIMER_GUARD			2		// Deadlines this close are serviced immediately
+#define SW_TIMER_HZ				LETIMER_HZ	// Timer ticks per second
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef struct SW_TIMER {
+	struct SW_TIMER			*next;		// next timer in the same wheel slot
+	uint32_t				expiry;		// tick count at which the timer is due
+	uint32_t				period;		// reload in ticks, 0 for a one shot timer
+	uint32_t				event;		// event scheduled on expiry
+	uint8_t					level;		// wheel level holding the timer
+	uint8_t					slot;		// slot of that level holding the timer
+	bool					active;
+} SW_TIMER ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void sw_timer_open(LETIMER_TypeDef *letimer, bool tickless);
+void sw_timer_start(uint32_t timer, uint32_t delay, uint32_t period, uint32_t event);
+void sw_timer_stop(uint32_t timer);
+bool sw_timer_active(uint32_t timer);
+void sw_timer_process(void);
+bool sw_timer_next_expiry(uint32_t *expiry);
+uint32_t sw_timer_now(void);
+void sw_timer_sleep(uint32_t delay);
+
+#endif
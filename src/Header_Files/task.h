@@ -0,0 +1,98 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#ifndef TASK_HG
+#define TASK_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_assert.h"
+
+/* The developer's include statements */
+#include "scheduler.h"
+#include "sw_timer.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+#define TASK_NO_TIMER			SW_TIMER_MAX	// Task that never calls TASK_DELAY
+
+/***************************************************************************//**
+ * @brief Stackless tasks
+ * @details
+ *  A task is a function that is written as one linear sequence but returns to
+ *  the main loop at every wait, so the micro can sleep until the wait is over.
+ *  The resume point is kept in the TASK struct and the function body is one
+ *  switch statement on it, the waits below are case labels in that switch.
+ *  A task is resumed by calling its function again from the handler of its
+ *  event, which is used as the completion event of every transfer it starts
+ *  and as the expiry event of its delays.
+ *
+ *  Because the function returns at every wait:
+ *   - local variables do not keep their value across a wait, keep them in
+ *     static storage
+ *   - a task body may not contain a switch statement of its own
+ *   - a task only waits on one thing at a time, so its event is never
+ *     posted by two sources at once
+ *
+ *  Transfers and delays are waited on with TASK_YIELD_UNTIL, their completion
+ *  posts the task event even when it is immediate, so the task always returns
+ *  and is resumed by that event and no stale event is left behind.  A queued
+ *  I2C transfer is waited on with TASK_YIELD, its bus may already be busy
+ *  again with the next transfer when the event arrives.
+ *
+ ******************************************************************************/
+
+#define TASK_BEGIN(task)		switch((task)->line) { case 0:
+
+#define TASK_END(task)			} (task)->line = 0; return TASK_DONE
+
+// Return until cond is true, cond is evaluated again every time the task runs
+#define TASK_WAIT_UNTIL(task, cond)	(task)->line = __LINE__; case __LINE__: \
+								if(!(cond)) return TASK_WAITING
+
+// Return at least once, for waits whose completion always posts the task event
+#define TASK_YIELD_UNTIL(task, cond)	(task)->line = __LINE__; return TASK_WAITING; case __LINE__: \
+								if(!(cond)) return TASK_WAITING
+
+// Return once, for a wait whose completion is the only source of the task event
+#define TASK_YIELD(task)			TASK_YIELD_UNTIL((task), true)
+
+// Sleep for delay software timer ticks
+#define TASK_DELAY(task, delay)	task_delay((task), (delay)); \
+								TASK_YIELD_UNTIL((task), !sw_timer_active((task)->timer))
+
+// Run the child task to completion, sharing the event and timer of task
+#define TASK_SPAWN(task, child, run)	task_init((child), (task)->event, (task)->timer); \
+								TASK_WAIT_UNTIL((task), (run) == TASK_DONE)
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+typedef enum {
+	TASK_WAITING,
+	TASK_DONE
+} TASK_STATUS;
+
+typedef struct {
+	uint32_t				line;		// resume point, 0 when the task is idle
+	uint32_t				event;		// event that resumes the task
+	uint32_t				timer;		// software timer used by TASK_DELAY
+} TASK ;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+
+void task_init(TASK *task, uint32_t event, uint32_t timer);
+bool task_idle(TASK *task);
+void task_delay(TASK *task, uint32_t delay);
+uint32_t task_payload(void);
+
+#endif
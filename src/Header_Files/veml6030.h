@@ -19,6 +19,7 @@
 #include "i2c.h"
 #include "brd_config.h"
 #include "HW_delay.h"
+#include "task.h"
 
 //***********************************************************************************
 // defined files
@@ -31,6 +32,9 @@
 #define START_UP_COMMAND		0x00 // Start up command
 #define VEML6030_ADDRESS 		0x48 // 7 bit address
 #define VEML6030_COMMAND		0x04 // Read Command
+#define VEML6030_START_UP_CONFIG	0x0000 // ALS_CONF_0: gain x 1, 100 ms integration, powered on
+#define VEML6030_DATA_BYTES		2 // ALS output, LS Byte and MS Byte
+#define VEML6030_START_UP_DELAY	(15 * SW_TIMER_HZ / 1000) // 15 ms after the start up command
 
 //***********************************************************************************
 // global variables
@@ -40,9 +44,9 @@
 // function prototypes
 //***********************************************************************************
 
-void veml6030_i2c_open();
-void veml6030_read(uint32_t VEML6030_READ_CB);
-float veml6030_conversion();
-bool veml_start_up(uint32_t veml6030_read_cb);
+void veml6030_i2c_open(uint32_t settle_timer, uint32_t stop_event, uint32_t settle_event);
+void veml6030_read(uint32_t VEML6030_READ_CB, uint32_t *result);
+float veml6030_conversion(uint32_t raw);
+TASK_STATUS veml_start_up(TASK *task);
 
 #endif
@@ -6,6 +6,7 @@
 
 //** User Include Files
 #include "HW_delay.h"
+#include "sw_timer.h"
 
 //***********************************************************************************
 // defined files
@@ -31,21 +32,26 @@
 // Global functions
 //***********************************************************************************
 
+/***************************************************************************//**
+ * @brief
+ *   Function to wait a number of milliseconds
+ *
+ * @details
+ * 	 This routine sleeps in the deepest allowed energy mode for the delay,
+ * 	 rounded up to whole software timer ticks, instead of spinning on TIMER0
+ * 	 in EM0
+ *
+ * @note
+ *   Kept for legacy callers only, it holds up the main loop for the whole
+ *   delay.  It must not be called from an interrupt handler or before the
+ *   software timers have been opened, new code uses a task delay
+ *
+ * @param[in] ms_delay
+ *   Is the delay in milliseconds
+ *
+ ******************************************************************************/
+
 void timer_delay(uint32_t ms_delay){
-	uint32_t timer_clk_freq = CMU_ClockFreqGet(cmuClock_HFPER);
-	uint32_t delay_count = ms_delay *(timer_clk_freq/1000) / 1024;
-	CMU_ClockEnable(cmuClock_TIMER0, true);
-	TIMER_Init_TypeDef delay_counter_init = TIMER_INIT_DEFAULT;
-		delay_counter_init.oneShot = true;
-		delay_counter_init.enable = false;
-		delay_counter_init.mode = timerModeDown;
-		delay_counter_init.prescale = timerPrescale1024;
-		delay_counter_init.debugRun = false;
-	TIMER_Init(TIMER0, &delay_counter_init);
-	TIMER0->CNT = delay_count;
-	TIMER_Enable(TIMER0, true);
-	while (TIMER0->CNT != 00);
-	TIMER_Enable(TIMER0, false);
-	CMU_ClockEnable(cmuClock_TIMER0, false);
+	sw_timer_sleep((ms_delay * SW_TIMER_HZ + 999) / 1000);
 }
 
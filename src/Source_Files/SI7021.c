@@ -21,10 +21,28 @@
 // Private variables
 //***********************************************************************************
 
-uint32_t data;
-bool RW = true; //for now - read
-uint8_t byte_count = 2; //humidity and temp
-uint8_t byte_count_user1 = 1; //user1
+static uint32_t data; // value read by the self test
+static SI7021_MEASUREMENT self_test_measurement;
+static uint32_t sensor_owner; // event of the measurement converting, 0 if none
+static uint32_t sensor_waiting; // events of the measurements waiting for it
+static uint32_t conversions[SI7021_MEASUREMENT_TYPES]; // measure commands written of each type
+
+// Commands written by the transfers
+static const uint8_t humidity_command[] = {SI7021_COMMAND};
+static const uint8_t temp_command[] = {SI7021_TEMP_COMMAND};
+static const uint8_t user1_read_command[] = {SI7021_READ_COMMAND};
+static const uint8_t user1_write_command[] = {SI7021_WRITE_COMMAND, RESOLUTION_CONFIG};
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void si7021_transfer(const uint8_t *tx, uint32_t tx_len, uint32_t rx_len, uint32_t *rx, uint32_t *result, uint32_t settle, uint32_t callback);
+static void si7021_measure_read(SI7021_MEASUREMENT *measurement, uint32_t callback);
+static void si7021_measure_check(SI7021_MEASUREMENT *measurement);
+static uint8_t si7021_crc(const uint8_t *bytes, uint32_t count);
+static void si7021_claim(uint32_t event);
+static void si7021_release(void);
 
 //***********************************************************************************
 // Functions
@@ -40,13 +58,13 @@ uint8_t byte_count_user1 = 1; //user1
  * 	 Creates a struct with all the information needed for i2c SI7021 operation
  *
  * @note
- *   This function is called once in the beginning, in app_peripheral_setup
+ *   This function is called once in the beginning, in app_peripheral_setup.
+ *   The SI7021 power up time is waited out by the boot task before the first
+ *   transfer
  *
  ******************************************************************************/
 
-void si7021_i2c_open() {
-	timer_delay(80);
-
+void si7021_i2c_open(uint32_t settle_timer, uint32_t stop_event, uint32_t settle_event) {
 	I2C_OPEN_STRUCT i2c_open_s;
 	i2c_open_s.freq = SI7021_FREQ;
 	i2c_open_s.SCLPEN = SENSOR_I2C_SCL;
@@ -57,46 +75,119 @@ void si7021_i2c_open() {
 	i2c_open_s.master = true;
 	i2c_open_s.refFreq = 0;
 	i2c_open_s.enable = true;
+	i2c_open_s.settle_timer = settle_timer;
+	i2c_open_s.stop_event = stop_event;
+	i2c_open_s.settle_event = settle_event;
 
 	i2c_open(SI7021_I2C, &i2c_open_s);
 }
 
 /***************************************************************************//**
  * @brief
- *   Starts the i2c state machine
+ *   Sets up a measurement
  *
  * @details
- * 	 Calls i2c_start with all information needed to initialize the state machine
+ * 	 Selects the measure command and its conversion time
  *
  * @note
- *   This function is called every time there is an LETIMER underflow interrupt
+ *   This function is called before the measurement is spawned with
+ *   si7021_measure_run
+ *
+ * @param[in] measurement
+ *   Is the measurement, kept in static storage by the caller
+ *
+ * @param[in] type
+ *   Is SI7021_HUMIDITY or SI7021_TEMPERATURE
  *
- * @param[in] SI7021_h_read_cb
- *   Callback for when the SI7021 humidity read operation is completed
  ******************************************************************************/
 
-void si7021_h_read(uint32_t SI7021_h_read_cb) {
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_COMMAND, RW, &data, byte_count, SI7021_h_read_cb); //start i2c
-	timer_delay(15);
+void si7021_measure_init(SI7021_MEASUREMENT *measurement, uint32_t type) {
+	EFM_ASSERT((type == SI7021_HUMIDITY) || (type == SI7021_TEMPERATURE));
+	measurement->type = type;
+	measurement->command = (type == SI7021_HUMIDITY) ? humidity_command : temp_command;
+	measurement->conversion = (type == SI7021_HUMIDITY) ? SI7021_H_CONVERSION : SI7021_T_CONVERSION;
+	measurement->result = I2C_NACKED;
+	measurement->data = 0;
 }
 
 /***************************************************************************//**
  * @brief
- *   Starts the i2c state machine
+ *   Measurement task
  *
  * @details
- * 	 Calls i2c_start with all information needed to initialize the state machine
+ * 	 Writes the measure command with the conversion time as its settle time,
+ * 	 so the bus is released and the micro sleeps until the conversion is
+ * 	 done, then reads the result and its checksum in a single burst.  A read
+ * 	 the SI7021 NACKs because the conversion ran long is retried after
+ * 	 SI7021_RETRY_DELAY, at most SI7021_READ_RETRIES times, the result is
+ * 	 left I2C_NACKED if every read fails.  A result that fails its checksum
+ * 	 is left I2C_ERROR, the SI7021 only hands a conversion over once.
+ * 	 The SI7021 NACKs a command during a conversion, so one measurement runs
+ * 	 at a time, the others wait for it without a transfer.  Every measure
+ * 	 command written is counted by type, whether or not its result is valid
  *
  * @note
- *   This function is called every time there is an LETIMER underflow interrupt
+ *   This function is spawned by the humidity, temperature and self test tasks
+ *   and resumed by their event
+ *
+ * @param[in] measurement
+ *   Is the measurement set up by si7021_measure_init
+ *
+ * @return
+ *   Returns TASK_DONE once the result is known
  *
- * @param[in] SI7021_t_read_cb
- *   Callback for when the SI7021 temp read operation is completed
  ******************************************************************************/
 
-void si7021_t_read(uint32_t SI7021_t_read_cb) {
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_TEMP_COMMAND, RW, &data, byte_count, SI7021_t_read_cb); //start i2c
-	timer_delay(15);
+TASK_STATUS si7021_measure_run(SI7021_MEASUREMENT *measurement) {
+	TASK *task = &measurement->task;
+	TASK_BEGIN(task);
+
+	si7021_claim(task->event);
+	TASK_WAIT_UNTIL(task, sensor_owner == task->event);
+
+	// the bus is released and gated during the conversion, the completion follows it
+	conversions[measurement->type]++;
+	si7021_transfer(measurement->command, 1, 0, 0, 0, measurement->conversion, task->event);
+	TASK_YIELD(task);
+
+	measurement->retries = SI7021_READ_RETRIES;
+	si7021_measure_read(measurement, task->event);
+	TASK_YIELD(task);
+	while((measurement->result == I2C_NACKED) && measurement->retries) {
+		measurement->retries--;
+		TASK_DELAY(task, SI7021_RETRY_DELAY);
+		si7021_measure_read(measurement, task->event);
+		TASK_YIELD(task);
+	}
+	si7021_measure_check(measurement);
+
+	si7021_release();
+	TASK_END(task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the measure commands written
+ *
+ * @details
+ * 	 Every measure command starts a conversion, so this is the number of
+ * 	 conversions of the type since boot, including those of the self test
+ * 	 and those whose read failed or was discarded
+ *
+ * @note
+ *   Read by the performance report to cost the conversions
+ *
+ * @param[in] type
+ *   Is SI7021_HUMIDITY or SI7021_TEMPERATURE
+ *
+ * @return
+ *   Returns the count
+ *
+ ******************************************************************************/
+
+uint32_t si7021_conversions(uint32_t type) {
+	EFM_ASSERT(type < SI7021_MEASUREMENT_TYPES);
+	return conversions[type];
 }
 
 /***************************************************************************//**
@@ -109,10 +200,13 @@ void si7021_t_read(uint32_t SI7021_t_read_cb) {
  * @note
  *   This function is called every time there is an SI7021 humidity read callback interrupt (state machine done)
  *
+ * @param[in] raw
+ *   The 16 bit humidity code read from the SI7021
+ *
  ******************************************************************************/
 
-float si7021_humidity_conversion() {
-	uint32_t result = data;
+float si7021_humidity_conversion(uint32_t raw) {
+	uint32_t result = raw;
 	return ((125.0*result)/65536)-6;
 }
 
@@ -126,72 +220,249 @@ float si7021_humidity_conversion() {
  * @note
  *   This function is called every time there is an SI7021 temperature read callback interrupt (state machine done)
  *
+ * @param[in] raw
+ *   The 16 bit temperature code read from the SI7021
+ *
  ******************************************************************************/
 
-float si7021_temperature_conversion() {
-	uint32_t result = data;
+float si7021_temperature_conversion(uint32_t raw) {
+	uint32_t result = raw;
 	float celcius = ((175.72*result)/65536) - 46.85; //c
 	return celcius * 1.8 + 32; //f
 }
 
 /***************************************************************************//**
  * @brief
- *   Test driven development function to test granular pieces of code functionality
+ *   Test driven development task to test granular pieces of code functionality
  *
  * @details
  * 	 Tests:
  * 	 test read of user register 1 by reading from SI7021 user register 1 and checking for the default value
  * 	 test write to user register 1 by writing a data value and checking whether it was written
  * 	 test read again from user register 1 and check if the data value is what you just wrote
- * 	 test a 2 byte access: humidity reading
- * 	 test a 2 byte access: temperature reading
+ * 	 test a burst read with checksum: humidity reading
+ * 	 test a burst read with checksum: temperature reading
  * 	 No test coverage escapes
  *
+ * 	 Every access uses the task event as its completion event, the task sleeps
+ * 	 until the transfer is done instead of polling the I2C state machine
+ *
  * @note
- *   This function is called from the Boot up callback
+ *   This function is spawned by the boot task and resumed by its event
  *
- * @param[in] si7021_read_cb
- *   Callback for humidity done
+ * @param[in] task
+ *   The task running the test
  *
- * @param[in] si7021_t_read_cb
- *   Callback for temperature done
+ * @return
+ *   Returns TASK_DONE once every test has passed
  *
  ******************************************************************************/
 
-bool tdd_i2c_routine(uint32_t si7021_read_cb, uint32_t si7021_t_read_cb) {
+TASK_STATUS si7021_self_test(TASK *task) {
+	TASK_BEGIN(task);
+
 	//test read of user register 1
-	RW = true; //read
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_READ_COMMAND, RW, &data, byte_count_user1, si7021_read_cb);
-	while(check_busy_1(SI7021_I2C));
+	si7021_transfer(user1_read_command, sizeof(user1_read_command), SI7021_USER1_BYTES, &data, 0, 0, task->event);
+	TASK_YIELD(task);
 	EFM_ASSERT(data == RESET_VALUE || data == PREVIOUS_USER1_VALUE); //default initial setting user register 1
 
 	//test write to user register 1
 	//RESOLUTION_CONFIG = 0x01 for 8 bit RH, 12 bit temp resolution
-	data = RESOLUTION_CONFIG;
-	RW = false; //write
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_WRITE_COMMAND, RW, &data, byte_count_user1, si7021_read_cb);
-	while(check_busy_1(SI7021_I2C));
-	timer_delay(15);
-	EFM_ASSERT(data == RESOLUTION_CONFIG); //01
+	si7021_transfer(user1_write_command, sizeof(user1_write_command), 0, 0, 0, SI7021_WRITE_DELAY, task->event);
+	TASK_YIELD(task);
 
 	//read register back to make sure write actually occurred
-	RW = true; //read
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_READ_COMMAND, RW, &data, byte_count_user1, si7021_read_cb);
-	while(check_busy_1(SI7021_I2C));
+	si7021_transfer(user1_read_command, sizeof(user1_read_command), SI7021_USER1_BYTES, &data, 0, 0, task->event);
+	TASK_YIELD(task);
 	EFM_ASSERT(data == RESOLUTION_FOR_8_12); //3B
 
-	//test a 2 byte access of the humidity
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_COMMAND, RW, &data, byte_count, si7021_read_cb);
-	while(check_busy_1(SI7021_I2C));
-	int humidity = si7021_humidity_conversion();
+	//test a burst read of the humidity
+	si7021_measure_init(&self_test_measurement, SI7021_HUMIDITY);
+	TASK_SPAWN(task, &self_test_measurement.task, si7021_measure_run(&self_test_measurement));
+	EFM_ASSERT(self_test_measurement.result == I2C_DONE);
+	int humidity = si7021_humidity_conversion(self_test_measurement.data);
 	EFM_ASSERT((humidity > 10) && (humidity < 50));
 
-	//test a 2 byte access to the temp
-	i2c_start(SI7021_I2C, SI7021_SLAVE_ADDRESS, SI7021_TEMP_COMMAND, RW, &data, byte_count, si7021_t_read_cb);
-	while(check_busy_1(SI7021_I2C));
-	int temp = si7021_temperature_conversion();
+	//test a burst read of the temp
+	si7021_measure_init(&self_test_measurement, SI7021_TEMPERATURE);
+	TASK_SPAWN(task, &self_test_measurement.task, si7021_measure_run(&self_test_measurement));
+	EFM_ASSERT(self_test_measurement.result == I2C_DONE);
+	int temp = si7021_temperature_conversion(self_test_measurement.data);
 	EFM_ASSERT((temp > 40) && (temp < 80));
 
-	return true;
+	TASK_END(task);
 }
 
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Starts an SI7021 transfer
+ *
+ * @details
+ * 	 Writes the command bytes and reads the MS Byte first result, if any
+ *
+ * @param[in] tx
+ *   Is the command and its data, or 0 for a read only
+ *
+ * @param[in] tx_len
+ *   Is the number of bytes of tx
+ *
+ * @param[in] rx_len
+ *   Is the number of bytes read, 0 for a write
+ *
+ * @param[out] rx
+ *   Is where the value read is stored, or 0
+ *
+ * @param[out] result
+ *   Is where the i2c_results of a read the SI7021 may NACK is stored, or 0
+ *
+ * @param[in] settle
+ *   Is the time in software timer ticks the SI7021 needs after the transfer,
+ *   waited out by the I2C driver before the completion event
+ *
+ * @param[in] callback
+ *   Is the completion event
+ *
+ ******************************************************************************/
+
+static void si7021_transfer(const uint8_t *tx, uint32_t tx_len, uint32_t rx_len, uint32_t *rx, uint32_t *result, uint32_t settle, uint32_t callback) {
+	I2C_TRANSFER transfer;
+	transfer.address = SI7021_SLAVE_ADDRESS;
+	transfer.tx = tx;
+	transfer.tx_len = tx_len;
+	transfer.rx = rx;
+	transfer.buffer = 0;
+	transfer.rx_len = rx_len;
+	transfer.order = I2C_MSB_FIRST;
+	transfer.result = result;
+	transfer.settle = settle;
+	transfer.callback = callback;
+	i2c_start(SI7021_I2C, &transfer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Starts the read of a measurement
+ *
+ * @details
+ * 	 Reads the MS Byte, the LS Byte and the checksum of the conversion in one
+ * 	 burst, too short for the I2C driver to move by LDMA
+ *
+ * @param[in] measurement
+ *   Is the measurement whose conversion is read
+ *
+ * @param[in] callback
+ *   Is the completion event
+ *
+ ******************************************************************************/
+
+static void si7021_measure_read(SI7021_MEASUREMENT *measurement, uint32_t callback) {
+	I2C_TRANSFER transfer;
+	transfer.address = SI7021_SLAVE_ADDRESS;
+	transfer.tx = 0;
+	transfer.tx_len = 0;
+	transfer.rx = 0;
+	transfer.buffer = measurement->bytes;
+	transfer.rx_len = SI7021_MEASUREMENT_BYTES;
+	transfer.order = I2C_MSB_FIRST;
+	transfer.result = &measurement->result;
+	transfer.settle = 0;
+	transfer.callback = callback;
+	i2c_start(SI7021_I2C, &transfer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Checks the read of a measurement
+ *
+ * @details
+ * 	 Assembles the 16 bit code of a read that completed if its checksum
+ * 	 matches, otherwise marks the measurement I2C_ERROR
+ *
+ * @param[in] measurement
+ *   Is the measurement that was read
+ *
+ ******************************************************************************/
+
+static void si7021_measure_check(SI7021_MEASUREMENT *measurement) {
+	if(measurement->result != I2C_DONE) {
+		return;
+	}
+	if(si7021_crc(measurement->bytes, SI7021_MEASUREMENT_BYTES - 1) != measurement->bytes[SI7021_MEASUREMENT_BYTES - 1]) {
+		measurement->result = I2C_ERROR;
+		return;
+	}
+	measurement->data = ((uint32_t)measurement->bytes[0] << 8) | measurement->bytes[1];
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Computes the SI7021 checksum
+ *
+ * @details
+ * 	 CRC-8 of SI7021_CRC_POLYNOMIAL from 0x00, most significant bit first
+ *
+ * @param[in] bytes
+ *   Is the data the checksum covers
+ *
+ * @param[in] count
+ *   Is the number of bytes
+ *
+ * @return
+ *   Returns the checksum
+ *
+ ******************************************************************************/
+
+static uint8_t si7021_crc(const uint8_t *bytes, uint32_t count) {
+	uint8_t crc = 0;
+	for(uint32_t i = 0; i < count; i++) {
+		crc ^= bytes[i];
+		for(int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ SI7021_CRC_POLYNOMIAL) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Claims the SI7021 for a measurement
+ *
+ * @details
+ * 	 The measurement owns the sensor at once if it is free, otherwise its
+ * 	 event is kept until si7021_release hands the sensor over
+ *
+ * @param[in] event
+ *   Is the event of the measurement task
+ *
+ ******************************************************************************/
+
+static void si7021_claim(uint32_t event) {
+	if(!sensor_owner) {
+		sensor_owner = event;
+	}
+	else {
+		sensor_waiting |= event;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Releases the SI7021 after a measurement
+ *
+ * @details
+ * 	 Hands the sensor to the waiting measurement whose event has the lowest
+ * 	 bit and schedules that event to resume it
+ *
+ ******************************************************************************/
+
+static void si7021_release(void) {
+	sensor_owner = sensor_waiting & -sensor_waiting;
+	sensor_waiting &= ~sensor_owner;
+	if(sensor_owner) {
+		add_scheduled_event(sensor_owner);
+	}
+}
@@ -18,18 +18,92 @@
 
 //#define BLE_TEST_ENABLED
 #define TDD_TEST_ENABLED
+#define TICKLESS_ENABLED		// undefine to service the software timers from a PWM_PER heartbeat
 
 //***********************************************************************************
 // Static / Private Variables
 //***********************************************************************************
 
-static uint32_t i2c_counter;
+// Dispatch table, priorities, deadlines, overrun policies and run modes of
+// APP_EVENTS, resolved at compile time
+static const SCHEDULER_TABLE app_scheduler_table = {
+	.dispatch		= { APP_EVENTS(SCHEDULER_TABLE_DISPATCH) },
+	.priority_mask	= { APP_EVENTS(SCHEDULER_TABLE_PRIORITY) },
+	.deadline_us	= { APP_EVENTS(SCHEDULER_TABLE_DEADLINE) },
+	.overrun_policy	= { APP_EVENTS(SCHEDULER_TABLE_POLICY) },
+	.handler_events	= 0 APP_EVENTS(SCHEDULER_TABLE_HANDLER),
+};
 
+_Static_assert(APP_EVENT_COUNT <= SCHEDULER_MAX_EVENTS, "more events than event_scheduled bits");
+_Static_assert((0 APP_EVENTS(SCHEDULER_PRIORITY_SUM)) == (0 APP_EVENTS(SCHEDULER_PRIORITY_OR)), "two events share a priority");
+APP_EVENTS(SCHEDULER_PRIORITY_CHECK)
+
+static APP_PERF reported_perf;
+static uint32_t si7021_reads;
+static uint32_t veml6030_reads;
+
+// Multi-step sequences, each resumed by the handler of its event
+static TASK boot_tasks[BOOT_STEP_COUNT];
+static TASK si7021_h_task;
+static TASK si7021_t_task;
+static SI7021_MEASUREMENT si7021_h_measurement;	// child tasks of the SI7021 tasks
+static SI7021_MEASUREMENT si7021_t_measurement;
+static TASK veml6030_task;
+static uint32_t veml6030_result;	// i2c_results of the last VEML6030 read
+
+// Boot progress: steps started and done, the tick each step was done and
+// the tick of the first sample, reported once over BLE
+static uint32_t boot_started;
+static uint32_t boot_done;
+static uint32_t boot_milestones[BOOT_STEP_COUNT];
+static bool boot_reported;
+#ifdef SCHEDULER_INSTRUMENTATION
+static bool stats_dumping;
+static uint32_t stats_cursor;
+#endif
 //***********************************************************************************
 // Private functions
 //***********************************************************************************
 
+static void app_perf_read(APP_PERF *perf);
+static uint32_t app_perf_ms(uint32_t ticks);
+static void app_boot_advance(void);
+static void app_boot_resume(uint32_t event);
+static void app_boot_report(void);
+static TASK_STATUS boot_timebase_run(TASK *task);
+static TASK_STATUS boot_ble_name_run(TASK *task);
+static TASK_STATUS boot_power_run(TASK *task);
+static TASK_STATUS boot_skip_run(TASK *task);
+static TASK_STATUS boot_sampling_run(TASK *task);
+static TASK_STATUS si7021_h_task_run(TASK *task);
+static TASK_STATUS si7021_t_task_run(TASK *task);
+static TASK_STATUS veml6030_task_run(TASK *task);
+#ifdef SCHEDULER_INSTRUMENTATION
+static void app_stats_dump(void);
+#endif
+#ifdef TICKLESS_ENABLED
+static void app_letimer_timebase_open(void);
+#else
 static void app_letimer_pwm_open(float period, float act_period, uint32_t out0_route, uint32_t out1_route);
+#endif
+
+// Boot dependency graph.  The LETIMER is the timebase of every delay, the two
+// sensors are powered together and then set up concurrently on their own
+// buses, sampling starts once the sensors and the BLE module are ready.  The
+// steps that never wait share BOOT_UP_CB with the BLE naming step
+static const APP_BOOT_STEP boot_steps[BOOT_STEP_COUNT] = {
+	[BOOT_STEP_TIMEBASE]	= { boot_timebase_run,	0,												BOOT_UP_CB,			TASK_NO_TIMER },
+	[BOOT_STEP_BLE_NAME]	= { boot_ble_name_run,	BOOT_STEP(BOOT_STEP_TIMEBASE),					BOOT_UP_CB,			BOOT_TIMER },
+	[BOOT_STEP_POWER]		= { boot_power_run,		BOOT_STEP(BOOT_STEP_TIMEBASE),					BOOT_POWER_CB,		BOOT_POWER_TIMER },
+#ifdef TDD_TEST_ENABLED
+	[BOOT_STEP_SI7021]		= { si7021_self_test,	BOOT_STEP(BOOT_STEP_POWER),						BOOT_SI7021_CB,		BOOT_SI7021_TIMER },
+#else
+	[BOOT_STEP_SI7021]		= { boot_skip_run,		BOOT_STEP(BOOT_STEP_POWER),						BOOT_SI7021_CB,		BOOT_SI7021_TIMER },
+#endif
+	[BOOT_STEP_VEML6030]	= { veml_start_up,		BOOT_STEP(BOOT_STEP_POWER),						BOOT_VEML6030_CB,	TASK_NO_TIMER },
+	[BOOT_STEP_SAMPLING]	= { boot_sampling_run,	BOOT_STEP(BOOT_STEP_BLE_NAME) | BOOT_STEP(BOOT_STEP_SI7021) | BOOT_STEP(BOOT_STEP_VEML6030),
+																									BOOT_UP_CB,			TASK_NO_TIMER },
+};
 
 //***********************************************************************************
 // Global functions
@@ -57,31 +131,86 @@ void app_peripheral_setup(void){
 	// Configure and open the gpio pins used for LEDs, I2C, LETIMER, and LEUART
 	gpio_open();
 
-	// Configure and open the scheduler
-	scheduler_open();
+	// Power the sensors for boot, the SI7021 supply is released once sampling starts
+	sensor_power_open();
+
+	// Configure and open the scheduler with the events of APP_EVENTS
+	scheduler_open(&app_scheduler_table);
+	cmu_clock_notify(scheduler_clock_changed);
+
+	// Bind the tasks to the events that resume them, the boot steps are bound when they start
+	boot_started = 0;
+	boot_done = 0;
+	boot_reported = false;
+	task_init(&si7021_h_task, SI7021_H_READ_CB, SI7021_H_POWER_TIMER);
+	task_init(&si7021_t_task, SI7021_T_READ_CB, SI7021_T_POWER_TIMER);
+	task_init(&veml6030_task, VEML6030_READ_CB, TASK_NO_TIMER);
 
 	// Configure and open the sleep routines
 	sleep_open();
 
 	// Configure and open the i2c for the si7021
-	si7021_i2c_open();
+	si7021_i2c_open(I2C1_SETTLE_TIMER, I2C1_STOP_CB, I2C1_SETTLE_CB);
 
 	// Configure and open the i2c for the veml6030
-	veml6030_i2c_open();
+	veml6030_i2c_open(I2C0_SETTLE_TIMER, I2C0_STOP_CB, I2C0_SETTLE_CB);
 
-	// Configure and open the pwm from LETIMER0
+#ifdef TICKLESS_ENABLED
+	// Configure and open LETIMER0 as the timebase of the software timers,
+	// only waking when the next timer is due
+	app_letimer_timebase_open();
+	sw_timer_open(LETIMER0, true);
+#else
+	// Configure and open the pwm from LETIMER0, servicing the software timers
+	// on every underflow
 	app_letimer_pwm_open(PWM_PER, PWM_ACT_PER, PWM_ROUTE_0, PWM_ROUTE_1);
+	sw_timer_open(LETIMER0, false);
+#endif
+
+	// Count the energy mode residency in software timer ticks
+	sleep_timebase(sw_timer_now);
+	cmu_timebase(sw_timer_now);
+	sensor_power_timebase();
+	// Only sleep deeper than EM1 when the next software timer is far enough away
+	sleep_predictor(sw_timer_next_expiry, SW_TIMER_HZ);
+	sleep_hold_limit(SLEEP_OWNER_I2C0, I2C_HOLD_LIMIT);
+	sleep_hold_limit(SLEEP_OWNER_I2C1, I2C_HOLD_LIMIT);
+	sleep_hold_limit(SLEEP_OWNER_LEUART0_TX, LEUART_TX_HOLD_LIMIT);
 
 	// Configure and open the LEUART for BLE
-	ble_open(BLE_RX_DONE_CB, BLE_TX_DONE_CB);
+	ble_open(BLE_TX_DONE_CB, BLE_RX_DONE_CB);
 
 	// Block the system EM level
-	sleep_block_mode(SYSTEM_BLOCK_EM);
+	sleep_block_mode(SLEEP_OWNER_APP, SYSTEM_BLOCK_EM);
 
 	// Schedule the boot up event
 	add_scheduled_event(BOOT_UP_CB);
 }
 
+#ifdef TICKLESS_ENABLED
+/***************************************************************************//**
+ * @brief
+ *	Initializes LETIMER0 as a free running timebase
+ *
+ * @details
+ *	Creates a struct with the events posted by the LETIMER0 timebase.  COMP0
+ *	is reprogrammed by the software timers to their next expiry and the
+ *	underflow extends the tick count
+ *
+ * @note
+ *	Called once from the above app_peripheral_setup function
+ *
+ ******************************************************************************/
+void app_letimer_timebase_open(void){
+	APP_LETIMER_TIMEBASE_TypeDef letimerstruct;
+	letimerstruct.debugRun = false;
+	letimerstruct.enable = false;
+	letimerstruct.comp0_cb = LETIMER0_COMP0_CB;
+	letimerstruct.uf_cb = LETIMER0_UF_CB;
+
+	letimer_timebase_open(LETIMER0, &letimerstruct);
+}
+#else
 /***************************************************************************//**
  * @brief
  *	Initializes LETIEMER0 for PWM operation
@@ -122,22 +251,26 @@ void app_letimer_pwm_open(float period, float act_period, uint32_t out0_route, u
 	letimerstruct.comp0_cb = LETIMER0_COMP0_CB;
 	letimerstruct.comp1_irq_enable = false; // disable comp1 interrupt for now
 	letimerstruct.comp1_cb = LETIMER0_COMP1_CB;
-	letimerstruct.uf_irq_enable = true; 	// enable underflow interrupt to start sensor reads
+	letimerstruct.uf_irq_enable = true; 	// enable underflow interrupt as the software timer heartbeat
 	letimerstruct.uf_cb = LETIMER0_UF_CB;
 
 	letimer_pwm_open(LETIMER0, &letimerstruct);
 
 }
+#endif
 
 /***************************************************************************//**
  * @brief
  *	Handles underflow
  *
  * @details
- *	Calls SI7021_read to call i2c_start
+ *	Services the software timers.  In tickless mode their next expiry may fall
+ *	in the counter range that just started, otherwise the underflow is the
+ *	PWM_PER heartbeat they are serviced on
  *
  * @note
- *	Called once for each UF interrupt
+ *	Called once for each UF interrupt, in that interrupt with
+ *	SCHEDULER_SLEEP_ON_EXIT
  *
  *
  ******************************************************************************/
@@ -145,18 +278,7 @@ void app_letimer_pwm_open(float period, float act_period, uint32_t out0_route, u
 void scheduled_letimer0_uf_cb (void){
 	EFM_ASSERT(get_scheduled_events() & LETIMER0_UF_CB);
 	remove_scheduled_event(LETIMER0_UF_CB);
-
-	if (i2c_counter == 0) {
-		si7021_h_read(SI7021_H_READ_CB);
-	}
-	else if (i2c_counter == 1) {
-		si7021_t_read(SI7021_T_READ_CB);
-	}
-	else {
-		veml6030_read(VEML6030_READ_CB);
-		i2c_counter = -1;
-	}
-	i2c_counter++;
+	sw_timer_process();
 }
 
 /***************************************************************************//**
@@ -164,10 +286,12 @@ void scheduled_letimer0_uf_cb (void){
  *	Handles COMP0
  *
  * @details
- *	Then removes the scheduled COMP0 event
+ *	Removes the scheduled COMP0 event
+ *	Then services the software timers that are due
  *
  * @note
- *	Called once for each COMP0 interrupt
+ *	Called once for each COMP0 interrupt, which is programmed to the next
+ *	software timer expiry, in that interrupt with SCHEDULER_SLEEP_ON_EXIT
  *
  *
  ******************************************************************************/
@@ -175,7 +299,7 @@ void scheduled_letimer0_uf_cb (void){
 void scheduled_letimer0_comp0_cb (void) {
 	EFM_ASSERT(get_scheduled_events() & LETIMER0_COMP0_CB);
 	remove_scheduled_event(LETIMER0_COMP0_CB);
-	EFM_ASSERT(false);
+	sw_timer_process();
 }
 
 /***************************************************************************//**
@@ -202,11 +326,10 @@ void scheduled_letimer0_comp1_cb (void){
  *	Handles si7021_h_read_cb
  *
  * @details
- *	Converts the data read to a humidity value
- *	Also sends it via bluetooth
+ *	Resumes the humidity task, which is waiting for its read to complete
  *
  * @note
- *	Called every time the I2C0 state machine finishes and there is a value to be converted
+ *	Called every time the I2C1 state machine finishes a humidity read
  *
  *
  ******************************************************************************/
@@ -214,11 +337,8 @@ void scheduled_letimer0_comp1_cb (void){
 void humidity_done_cb (void){
 	EFM_ASSERT(get_scheduled_events() & SI7021_H_READ_CB);
 	remove_scheduled_event(SI7021_H_READ_CB);
-	float humidity = si7021_humidity_conversion();
-	char str[80];
-	sprintf(str, "%4.1f%% humidity\n", humidity);
-	ble_write(str);
-
+	EFM_ASSERT(!task_idle(&si7021_h_task));
+	si7021_h_task_run(&si7021_h_task);
 }
 
 /***************************************************************************//**
@@ -226,11 +346,10 @@ void humidity_done_cb (void){
  *	Handles si7021_t_read_cb
  *
  * @details
- *	Converts the data read to a temp value
- *	Also sends it via bluetooth
+ *	Resumes the temperature task, which is waiting for its read to complete
  *
  * @note
- *	Called every time the I2C0 state machine finishes and there is a value to be converted
+ *	Called every time the I2C1 state machine finishes a temperature read
  *
  *
  ******************************************************************************/
@@ -238,11 +357,8 @@ void humidity_done_cb (void){
 void temp_done_cb (void){
 	EFM_ASSERT(get_scheduled_events() & SI7021_T_READ_CB);
 	remove_scheduled_event(SI7021_T_READ_CB);
-	float temp = si7021_temperature_conversion();
-	char str[80];
-	sprintf(str, "%4.1f F\n", temp);
-	ble_write(str);
-
+	EFM_ASSERT(!task_idle(&si7021_t_task));
+	si7021_t_task_run(&si7021_t_task);
 }
 
 /***************************************************************************//**
@@ -250,11 +366,10 @@ void temp_done_cb (void){
  *	Handles veml6030_read_cb
  *
  * @details
- *	Converts the data read to a light value
- *	Also sends it via bluetooth
+ *	Resumes the light task, which is waiting for its read to complete
  *
  * @note
- *	Called every time the I2C1 state machine finishes and there is a value to be converted
+ *	Called every time the I2C0 state machine finishes a light read
  *
  *
  ******************************************************************************/
@@ -262,12 +377,8 @@ void temp_done_cb (void){
 void light_done_cb (void){
 	EFM_ASSERT(get_scheduled_events() & VEML6030_READ_CB);
 	remove_scheduled_event(VEML6030_READ_CB);
-	int light = veml6030_conversion();
-	char str[80];
-	unsigned int ulight = (unsigned int) light;
-	sprintf(str, "%3u lux\n", ulight);
-	ble_write(str);
-
+	EFM_ASSERT(!task_idle(&veml6030_task));
+	veml6030_task_run(&veml6030_task);
 }
 
 /***************************************************************************//**
@@ -275,10 +386,9 @@ void light_done_cb (void){
  *	Handles boot_up_cb
  *
  * @details
- *	if BLE TEST is enabled, names the Bluetooth Device
- *	if TDD TEST is enabled, runs the test driven development
- *	Starts VEML6030
- *	Starts LETIMER
+ *	Starts the boot steps that depend on nothing when the boot up event is
+ *	first scheduled, then resumes the BLE naming step every time its delay
+ *	completes
  *
  * @note
  *	Called to boot up the machine
@@ -289,16 +399,466 @@ void light_done_cb (void){
 void scheduled_boot_up_cb(void) {
 	EFM_ASSERT(get_scheduled_events() & BOOT_UP_CB);
 	remove_scheduled_event(BOOT_UP_CB);
+	if(!boot_started) {
+		app_boot_advance();
+	}
+	else {
+		app_boot_resume(BOOT_UP_CB);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles boot_power_cb
+ *
+ * @details
+ *	Resumes the sensor power up boot step when its delay completes
+ *
+ ******************************************************************************/
+
+void scheduled_boot_power_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & BOOT_POWER_CB);
+	remove_scheduled_event(BOOT_POWER_CB);
+	app_boot_resume(BOOT_POWER_CB);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles boot_si7021_cb
+ *
+ * @details
+ *	Resumes the SI7021 self test boot step when one of its transfers or
+ *	delays completes
+ *
+ ******************************************************************************/
+
+void scheduled_boot_si7021_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & BOOT_SI7021_CB);
+	remove_scheduled_event(BOOT_SI7021_CB);
+	app_boot_resume(BOOT_SI7021_CB);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles i2c0_stop_cb
+ *
+ * @details
+ *	Ends the VEML6030 transfer that just stopped, starting its settle time or
+ *	posting its completion and starting the next transfer of the bus
+ *
+ * @note
+ *	Scheduled by the I2C0 MSTOP interrupt
+ *
+ ******************************************************************************/
+
+void scheduled_i2c0_stop_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & I2C0_STOP_CB);
+	remove_scheduled_event(I2C0_STOP_CB);
+	i2c_stopped(I2C0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles i2c1_stop_cb
+ *
+ * @details
+ *	Ends the SI7021 transfer that just stopped, starting its settle time or
+ *	posting its completion and starting the next transfer of the bus
+ *
+ * @note
+ *	Scheduled by the I2C1 MSTOP interrupt
+ *
+ ******************************************************************************/
+
+void scheduled_i2c1_stop_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & I2C1_STOP_CB);
+	remove_scheduled_event(I2C1_STOP_CB);
+	i2c_stopped(I2C1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles i2c0_settle_cb
+ *
+ * @details
+ *	Ends the settle time of the VEML6030 bus, which posts the completion of
+ *	its transfer and starts the next one
+ *
+ * @note
+ *	Scheduled by the I2C0_SETTLE_TIMER software timer the I2C driver starts
+ *
+ ******************************************************************************/
+
+void scheduled_i2c0_settle_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & I2C0_SETTLE_CB);
+	remove_scheduled_event(I2C0_SETTLE_CB);
+	i2c_settled(I2C0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles i2c1_settle_cb
+ *
+ * @details
+ *	Ends the settle time of the SI7021 bus, which posts the completion of
+ *	its transfer and starts the next one
+ *
+ * @note
+ *	Scheduled by the I2C1_SETTLE_TIMER software timer the I2C driver starts
+ *
+ ******************************************************************************/
+
+void scheduled_i2c1_settle_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & I2C1_SETTLE_CB);
+	remove_scheduled_event(I2C1_SETTLE_CB);
+	i2c_settled(I2C1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles boot_veml6030_cb
+ *
+ * @details
+ *	Resumes the VEML6030 start up boot step when its transfer or delay
+ *	completes
+ *
+ ******************************************************************************/
+
+void scheduled_boot_veml6030_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & BOOT_VEML6030_CB);
+	remove_scheduled_event(BOOT_VEML6030_CB);
+	app_boot_resume(BOOT_VEML6030_CB);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts every boot step that is ready
+ *
+ * @details
+ *	A step is ready once all the steps it depends on are done.  It is bound
+ *	to its event and timer and run until its first wait, a step that does not
+ *	wait is done at once and may make further steps ready
+ *
+ * @note
+ *	Called when the boot up event is first scheduled and whenever a step is
+ *	done
+ *
+ ******************************************************************************/
+
+static void app_boot_advance(void) {
+	bool progress = true;
+	while(progress) {
+		progress = false;
+		for(uint32_t i = 0; i < BOOT_STEP_COUNT; i++) {
+			const APP_BOOT_STEP *step = &boot_steps[i];
+			if((boot_started & BOOT_STEP(i)) || ((boot_done & step->depends) != step->depends)) {
+				continue;
+			}
+			boot_started |= BOOT_STEP(i);
+			task_init(&boot_tasks[i], step->event, step->timer);
+			if(step->run(&boot_tasks[i]) == TASK_DONE) {
+				boot_done |= BOOT_STEP(i);
+				boot_milestones[i] = sw_timer_now();
+				progress = true;
+			}
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Resumes the boot step waiting on an event
+ *
+ * @details
+ *	Only one started step that is not done waits on each event.  When the
+ *	step is done, the steps that depended on it are started
+ *
+ * @param[in] event
+ *	Is the event that was dispatched
+ *
+ ******************************************************************************/
+
+static void app_boot_resume(uint32_t event) {
+	for(uint32_t i = 0; i < BOOT_STEP_COUNT; i++) {
+		if((boot_started & ~boot_done & BOOT_STEP(i)) && (boot_steps[i].event == event)) {
+			if(boot_steps[i].run(&boot_tasks[i]) == TASK_DONE) {
+				boot_done |= BOOT_STEP(i);
+				boot_milestones[i] = sw_timer_now();
+				app_boot_advance();
+			}
+			return;
+		}
+	}
+	EFM_ASSERT(false);	// no boot step waits on the event
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Reports the boot milestones
+ *
+ * @details
+ *	Sends the tick each boot step was done, the time to the first sample
+ *	and the time spent in EM0 until then in milliseconds via bluetooth.
+ *	Times are counted from the start of LETIMER0
+ *
+ * @note
+ *	Called by every sensor task when its sample is taken, only the first
+ *	call reports
+ *
+ ******************************************************************************/
+
+static void app_boot_report(void) {
+	if(boot_reported) {
+		return;
+	}
+	boot_reported = true;
+	SLEEP_STATS sleep;
+	sleep_stats(&sleep);
+	char str[80];
+	sprintf(str, "boot %lu/%lu/%lu/%lu/%lu ms 1st sample %lu ms EM0 %lu ms\n",
+			(unsigned long)app_perf_ms(boot_milestones[BOOT_STEP_BLE_NAME]),
+			(unsigned long)app_perf_ms(boot_milestones[BOOT_STEP_POWER]),
+			(unsigned long)app_perf_ms(boot_milestones[BOOT_STEP_SI7021]),
+			(unsigned long)app_perf_ms(boot_milestones[BOOT_STEP_VEML6030]),
+			(unsigned long)app_perf_ms(boot_milestones[BOOT_STEP_SAMPLING]),
+			(unsigned long)app_perf_ms(sw_timer_now()),
+			(unsigned long)app_perf_ms(sleep.residency[EM0]));
+	ble_write(str);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Timebase boot step
+ *
+ * @details
+ *	Starts LETIMER, the timebase of the delays of the other steps
+ *
+ * @param[in] task
+ *	The step task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS boot_timebase_run(TASK *task) {
+	(void)task;
+	letimer_start(LETIMER0, true);   // letimer_start will inform the LETIMER0 peripheral to begin counting.
+	return TASK_DONE;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	BLE naming boot step
+ *
+ * @details
+ *	if BLE TEST is enabled, names the Bluetooth Device and waits for the
+ *	module to reset
+ *
+ * @param[in] task
+ *	The step task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS boot_ble_name_run(TASK *task) {
+	TASK_BEGIN(task);
+
 #ifdef BLE_TEST_ENABLED
 	EFM_ASSERT(ble_test("BLE_Athena"));
-	timer_delay(2000);
-#endif
-#ifdef TDD_TEST_ENABLED
-	tdd_i2c_routine(SI7021_H_READ_CB, SI7021_T_READ_CB);
+	TASK_DELAY(task, BLE_TEST_DELAY);
 #endif
-	//ble_write("\nHello World\n");
-	veml_start_up(VEML6030_READ_CB);
-	letimer_start(LETIMER0, true);   // letimer_start will inform the LETIMER0 peripheral to begin counting.
+
+	TASK_END(task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sensor power up boot step
+ *
+ * @details
+ *	Waits for the SI7021, powered by sensor_power_open, to power up.  The
+ *	VEML6030 is not on a switched rail, its start up is the settle time of
+ *	its configuration write
+ *
+ * @param[in] task
+ *	The step task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS boot_power_run(TASK *task) {
+	TASK_BEGIN(task);
+
+	if(sensor_power_wait(SENSOR_RAIL_SI7021)) {
+		TASK_DELAY(task, sensor_power_wait(SENSOR_RAIL_SI7021));
+	}
+
+	TASK_END(task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Boot step that is compiled out
+ *
+ * @param[in] task
+ *	The step task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS boot_skip_run(TASK *task) {
+	(void)task;
+	return TASK_DONE;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sampling boot step
+ *
+ * @details
+ *	Starts the software timers of the periodic reads, the BLE keepalive and
+ *	the performance report
+ *
+ * @param[in] task
+ *	The step task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS boot_sampling_run(TASK *task) {
+	(void)task;
+
+	// Turn the SI7021 off until its first sample
+	sensor_power_release(SENSOR_RAIL_SI7021);
+
+	// Start the periodic sensor reads and BLE keepalive, the SI7021 samples
+	// start early enough to power it up before the read
+	uint32_t power_up = sensor_power_up_time(SENSOR_RAIL_SI7021);
+	sw_timer_start(SI7021_H_TIMER, SI7021_H_PHASE - power_up, SI7021_H_PERIOD, SI7021_H_SAMPLE_CB);
+	sw_timer_start(SI7021_T_TIMER, SI7021_T_PHASE - power_up, SI7021_T_PERIOD, SI7021_T_SAMPLE_CB);
+	sw_timer_start(VEML6030_TIMER, VEML6030_PHASE, VEML6030_PERIOD, VEML6030_SAMPLE_CB);
+	sw_timer_start(BLE_KEEPALIVE_TIMER, BLE_KEEPALIVE_PHASE, BLE_KEEPALIVE_PERIOD, BLE_KEEPALIVE_CB);
+
+	// Report the performance counters every hour
+	app_perf_read(&reported_perf);
+	sw_timer_start(PERF_REPORT_TIMER, PERF_REPORT_PERIOD, PERF_REPORT_PERIOD, PERF_REPORT_CB);
+
+	return TASK_DONE;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Humidity task
+ *
+ * @details
+ *	Powers the SI7021 up and measures its humidity, sleeping through the power
+ *	up time and the conversion, then powers it off again
+ *	Converts the data read to a humidity value
+ *	Also sends it via bluetooth
+ *
+ * @note
+ *	Started from scheduled_si7021_h_sample_cb and resumed from humidity_done_cb
+ *
+ * @param[in] task
+ *	The humidity task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS si7021_h_task_run(TASK *task) {
+	TASK_BEGIN(task);
+
+	sensor_power_acquire(SENSOR_RAIL_SI7021);
+	if(sensor_power_wait(SENSOR_RAIL_SI7021)) {
+		TASK_DELAY(task, sensor_power_wait(SENSOR_RAIL_SI7021));
+	}
+	si7021_measure_init(&si7021_h_measurement, SI7021_HUMIDITY);
+	TASK_SPAWN(task, &si7021_h_measurement.task, si7021_measure_run(&si7021_h_measurement));
+	sensor_power_release(SENSOR_RAIL_SI7021);
+	if(si7021_h_measurement.result == I2C_DONE) {	// nothing is reported if every read was NACKed or failed its checksum
+		cmu_clock_raise();	// float conversion and formatting
+		float humidity = si7021_humidity_conversion(si7021_h_measurement.data);
+		si7021_reads++;
+		char str[80];
+		sprintf(str, "%4.1f%% humidity\n", humidity);
+		cmu_clock_lower();
+		ble_write(str);
+		app_boot_report();
+	}
+
+	TASK_END(task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Temperature task
+ *
+ * @details
+ *	Powers the SI7021 up and measures its temperature, sleeping through the
+ *	power up time and the conversion, then powers it off again
+ *	Converts the data read to a temp value
+ *	Also sends it via bluetooth
+ *
+ * @note
+ *	Started from scheduled_si7021_t_sample_cb and resumed from temp_done_cb
+ *
+ * @param[in] task
+ *	The temperature task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS si7021_t_task_run(TASK *task) {
+	TASK_BEGIN(task);
+
+	sensor_power_acquire(SENSOR_RAIL_SI7021);
+	if(sensor_power_wait(SENSOR_RAIL_SI7021)) {
+		TASK_DELAY(task, sensor_power_wait(SENSOR_RAIL_SI7021));
+	}
+	si7021_measure_init(&si7021_t_measurement, SI7021_TEMPERATURE);
+	TASK_SPAWN(task, &si7021_t_measurement.task, si7021_measure_run(&si7021_t_measurement));
+	sensor_power_release(SENSOR_RAIL_SI7021);
+	if(si7021_t_measurement.result == I2C_DONE) {	// nothing is reported if every read was NACKed or failed its checksum
+		cmu_clock_raise();	// float conversion and formatting
+		float temp = si7021_temperature_conversion(si7021_t_measurement.data);
+		si7021_reads++;
+		char str[80];
+		sprintf(str, "%4.1f F\n", temp);
+		cmu_clock_lower();
+		ble_write(str);
+		app_boot_report();
+	}
+
+	TASK_END(task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Light task
+ *
+ * @details
+ *	Reads the VEML6030, sleeping until the read completes
+ *	Converts the data read, delivered as the event payload, to a light value
+ *	Also sends it via bluetooth, unless the read was NACKed
+ *
+ * @note
+ *	Started from scheduled_veml6030_sample_cb and resumed from light_done_cb
+ *
+ * @param[in] task
+ *	The light task
+ *
+ ******************************************************************************/
+
+static TASK_STATUS veml6030_task_run(TASK *task) {
+	TASK_BEGIN(task);
+
+	veml6030_read(task->event, &veml6030_result);
+	TASK_YIELD(task);
+	if(veml6030_result == I2C_DONE) {	// nothing is reported if the read was NACKed
+		cmu_clock_raise();	// float conversion and formatting
+		int light = veml6030_conversion(task_payload());
+		veml6030_reads++;
+		char str[80];
+		unsigned int ulight = (unsigned int) light;
+		sprintf(str, "%3u lux\n", ulight);
+		cmu_clock_lower();
+		ble_write(str);
+		app_boot_report();
+	}
+
+	TASK_END(task);
 }
 
 /***************************************************************************//**
@@ -307,6 +867,7 @@ void scheduled_boot_up_cb(void) {
  *
  * @details
  *	Removes BLE TX DONE CB event
+ *	Starts the next queued BLE string and continues a histogram dump
  *
  * @note
  *	Called when BLE TX DONE is set
@@ -317,5 +878,338 @@ void scheduled_boot_up_cb(void) {
 void scheduled_ble_tx_done_cb(void) {
 	EFM_ASSERT(get_scheduled_events() & BLE_TX_DONE_CB);
 	remove_scheduled_event(BLE_TX_DONE_CB);
+	ble_tx_done();
+#ifdef SCHEDULER_INSTRUMENTATION
+	app_stats_dump();
+#endif
 }
 
+/***************************************************************************//**
+ * @brief
+ *	Handles ble_rx_done_cb
+ *
+ * @details
+ *	Acts on a character received over BLE, delivered as the event payload.
+ *	STATS_DUMP_CMD schedules a dump of the scheduler histograms, any other
+ *	character is ignored
+ *
+ * @note
+ *	Called for every character received by the LEUART, in the LEUART0
+ *	interrupt with SCHEDULER_SLEEP_ON_EXIT so a character needs no wake of
+ *	the main loop
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_ble_rx_done_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & BLE_RX_DONE_CB);
+	const SCHEDULER_RECORD *record = scheduler_current_record();
+	EFM_ASSERT(record);
+	remove_scheduled_event(BLE_RX_DONE_CB);
+	if(record->payload == STATS_DUMP_CMD) {
+		add_scheduled_event(STATS_DUMP_CB);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles stats_dump_cb
+ *
+ * @details
+ *	Starts a dump of the scheduler histograms unless one is running
+ *
+ * @note
+ *	Scheduled by scheduled_ble_rx_done_cb for a received STATS_DUMP_CMD
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_stats_dump_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & STATS_DUMP_CB);
+	remove_scheduled_event(STATS_DUMP_CB);
+#ifdef SCHEDULER_INSTRUMENTATION
+	if(!stats_dumping) {
+		stats_dumping = true;
+		stats_cursor = 0;
+		app_stats_dump();
+	}
+#endif
+}
+
+#ifdef SCHEDULER_INSTRUMENTATION
+/***************************************************************************//**
+ * @brief
+ *	Writes the next lines of a histogram dump
+ *
+ * @details
+ *	Queues histogram lines until the BLE tx queue is full, the dump resumes
+ *	from the next tx done event.  The dump ends with the number of event
+ *	overruns and missed deadlines
+ *
+ * @note
+ *	Called from the stats dump and tx done handlers
+ *
+ *
+ ******************************************************************************/
+
+static void app_stats_dump(void) {
+	char str[BLE_TX_MAX_LEN];
+	while(stats_dumping && !ble_tx_queue_full()) {
+		if(scheduler_histogram_line(&stats_cursor, str, sizeof(str))) {
+			ble_write(str);
+		}
+		else {
+			// one line, the loop only guarantees room for one more string
+#ifdef SCHEDULER_EDF
+			sprintf(str, "%lu overruns %lu deadline misses\n", (unsigned long)scheduler_overruns_total(),
+					(unsigned long)scheduler_deadline_misses_total());
+#else
+			sprintf(str, "%lu overruns\n", (unsigned long)scheduler_overruns_total());
+#endif
+			ble_write(str);
+			stats_dumping = false;
+		}
+	}
+}
+#endif
+
+/***************************************************************************//**
+ * @brief
+ *	Handles si7021_h_sample_cb
+ *
+ * @details
+ *	Starts the humidity task, the read of the previous period has completed
+ *
+ * @note
+ *	Called every SI7021_H_PERIOD from the SI7021_H_TIMER software timer
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_si7021_h_sample_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & SI7021_H_SAMPLE_CB);
+	remove_scheduled_event(SI7021_H_SAMPLE_CB);
+	EFM_ASSERT(task_idle(&si7021_h_task));
+	si7021_h_task_run(&si7021_h_task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles si7021_t_sample_cb
+ *
+ * @details
+ *	Starts the temperature task, the read of the previous period has completed
+ *
+ * @note
+ *	Called every SI7021_T_PERIOD from the SI7021_T_TIMER software timer
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_si7021_t_sample_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & SI7021_T_SAMPLE_CB);
+	remove_scheduled_event(SI7021_T_SAMPLE_CB);
+	EFM_ASSERT(task_idle(&si7021_t_task));
+	si7021_t_task_run(&si7021_t_task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles veml6030_sample_cb
+ *
+ * @details
+ *	Starts the light task, the read of the previous period has completed
+ *
+ * @note
+ *	Called every VEML6030_PERIOD from the VEML6030_TIMER software timer
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_veml6030_sample_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & VEML6030_SAMPLE_CB);
+	remove_scheduled_event(VEML6030_SAMPLE_CB);
+	EFM_ASSERT(task_idle(&veml6030_task));
+	veml6030_task_run(&veml6030_task);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles ble_keepalive_cb
+ *
+ * @details
+ *	Sends the keepalive message over BLE
+ *
+ * @note
+ *	Called every BLE_KEEPALIVE_PERIOD from the BLE_KEEPALIVE_TIMER software timer
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_ble_keepalive_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & BLE_KEEPALIVE_CB);
+	remove_scheduled_event(BLE_KEEPALIVE_CB);
+	ble_write(BLE_KEEPALIVE_MSG);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles perf_report_cb
+ *
+ * @details
+ *	Sends the wakes from sleep, the I2C bus time of each sensor bus, the
+ *	bytes sent over BLE, the I2C transfers queued and their wait for the bus,
+ *	the longest I2C interrupt and the interrupts over its budget,
+ *	the time spent in each energy mode and the time each
+ *	energy mode was blocked and the sleep blocks held longer than their limit
+ *	in the last hour via bluetooth, followed by the average current, charge
+ *	per sample and APP_CELL_MAH lifetime the energy model estimates from them
+ *	and the time each gated peripheral clock was on.
+ *	Compared across builds, the report is the performance and energy
+ *	baseline of a change
+ *
+ * @note
+ *	Called every PERF_REPORT_PERIOD from the PERF_REPORT_TIMER software timer
+ *
+ *
+ ******************************************************************************/
+
+void scheduled_perf_report_cb(void) {
+	EFM_ASSERT(get_scheduled_events() & PERF_REPORT_CB);
+	remove_scheduled_event(PERF_REPORT_CB);
+	APP_PERF perf;
+	app_perf_read(&perf);
+	char str[80];
+	sprintf(str, "%lu wakes %lu/%lu ms i2c0/1 %lu B/h\n",
+			(unsigned long)(perf.wakes - reported_perf.wakes),
+			(unsigned long)app_perf_ms(perf.i2c0_ticks - reported_perf.i2c0_ticks),
+			(unsigned long)app_perf_ms(perf.i2c1_ticks - reported_perf.i2c1_ticks),
+			(unsigned long)(perf.bytes_sent - reported_perf.bytes_sent));
+	ble_write(str);
+	sprintf(str, "i2c %lu queued %lu ms wait %lu max depth\n",
+			(unsigned long)(perf.i2c_waits - reported_perf.i2c_waits),
+			(unsigned long)app_perf_ms(perf.i2c_wait_ticks - reported_perf.i2c_wait_ticks),
+			(unsigned long)perf.i2c_max_depth);
+	ble_write(str);
+	sprintf(str, "i2c isr %lu us max %lu over budget\n",
+			(unsigned long)(perf.i2c_isr_max_ns / 1000),
+			(unsigned long)(perf.i2c_isr_overruns - reported_perf.i2c_isr_overruns));
+	ble_write(str);
+	sprintf(str, "EM0-3 %lu/%lu/%lu/%lu ms\n",
+			(unsigned long)app_perf_ms(perf.sleep.residency[EM0] - reported_perf.sleep.residency[EM0]),
+			(unsigned long)app_perf_ms(perf.sleep.residency[EM1] - reported_perf.sleep.residency[EM1]),
+			(unsigned long)app_perf_ms(perf.sleep.residency[EM2] - reported_perf.sleep.residency[EM2]),
+			(unsigned long)app_perf_ms(perf.sleep.residency[EM3] - reported_perf.sleep.residency[EM3]));
+	ble_write(str);
+	sprintf(str, "EM1-4 blocked %lu/%lu/%lu/%lu ms %lu overlong\n",
+			(unsigned long)app_perf_ms(perf.sleep.blocked[EM1] - reported_perf.sleep.blocked[EM1]),
+			(unsigned long)app_perf_ms(perf.sleep.blocked[EM2] - reported_perf.sleep.blocked[EM2]),
+			(unsigned long)app_perf_ms(perf.sleep.blocked[EM3] - reported_perf.sleep.blocked[EM3]),
+			(unsigned long)app_perf_ms(perf.sleep.blocked[EM4] - reported_perf.sleep.blocked[EM4]),
+			(unsigned long)(perf.overlong - reported_perf.overlong));
+	ble_write(str);
+	ENERGY_TRACE trace;
+	ENERGY_ESTIMATE estimate;
+	trace.hz = SW_TIMER_HZ;
+	for(int i = 0; i < MAX_ENERGY_MODES; i++) {
+		trace.residency[i] = perf.sleep.residency[i] - reported_perf.sleep.residency[i];
+	}
+	for(int band = 0; band < CMU_BAND_COUNT; band++) {
+		trace.core_mhz[band] = perf.bands[band].mhz;
+		for(int i = 0; i < CMU_BAND_MODES; i++) {
+			trace.band_residency[band][i] = perf.bands[band].residency[i] - reported_perf.bands[band].residency[i];
+		}
+	}
+	trace.i2c_ticks = (perf.i2c0_ticks - reported_perf.i2c0_ticks) + (perf.i2c1_ticks - reported_perf.i2c1_ticks);
+	trace.leuart_bytes = perf.bytes_sent - reported_perf.bytes_sent;
+	trace.si7021_h_conversions = perf.si7021_conversions[SI7021_HUMIDITY] - reported_perf.si7021_conversions[SI7021_HUMIDITY];
+	trace.si7021_t_conversions = perf.si7021_conversions[SI7021_TEMPERATURE] - reported_perf.si7021_conversions[SI7021_TEMPERATURE];
+	trace.si7021_on_ticks = perf.sensor_on[SENSOR_RAIL_SI7021] - reported_perf.sensor_on[SENSOR_RAIL_SI7021];
+	trace.veml6030_on_ticks = perf.now - reported_perf.now;	// powered on from boot
+	trace.samples = (perf.si7021_reads - reported_perf.si7021_reads) + (perf.veml6030_reads - reported_perf.veml6030_reads);
+	energy_estimate(&trace, APP_CELL_MAH, &estimate);
+	sprintf(str, "%lu nA avg %lu nC/sample %lu h\n",
+			(unsigned long)estimate.average_na,
+			(unsigned long)estimate.sample_nc,
+			(unsigned long)estimate.lifetime_h);
+	ble_write(str);
+	sprintf(str, "HFPER I2C0/1 LEUART0 SI7021 on %lu/%lu/%lu/%lu/%lu ms\n",
+			(unsigned long)app_perf_ms(perf.clock_on[CMU_GATE_HFPER] - reported_perf.clock_on[CMU_GATE_HFPER]),
+			(unsigned long)app_perf_ms(perf.clock_on[CMU_GATE_I2C0] - reported_perf.clock_on[CMU_GATE_I2C0]),
+			(unsigned long)app_perf_ms(perf.clock_on[CMU_GATE_I2C1] - reported_perf.clock_on[CMU_GATE_I2C1]),
+			(unsigned long)app_perf_ms(perf.clock_on[CMU_GATE_LEUART0] - reported_perf.clock_on[CMU_GATE_LEUART0]),
+			(unsigned long)app_perf_ms(perf.sensor_on[SENSOR_RAIL_SI7021] - reported_perf.sensor_on[SENSOR_RAIL_SI7021]));
+	ble_write(str);
+	reported_perf = perf;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Reads the performance counters
+ *
+ * @details
+ *	Collects the counters kept by the sleep routines, the clock gates, the
+ *	sensor supplies, the I2C driver, the LEUART driver and the sensor tasks,
+ *	the report sends the difference of two readings
+ *
+ * @note
+ *	Called at boot and from scheduled_perf_report_cb
+ *
+ * @param[out] perf
+ *	Is where the counters are copied to
+ *
+ ******************************************************************************/
+
+static void app_perf_read(APP_PERF *perf) {
+	I2C_BUS_STATS bus;
+	perf->wakes = sleep_wake_count();
+	i2c_bus_stats(I2C0, &bus);
+	perf->i2c0_ticks = bus.bus_ticks;
+	perf->i2c_waits = bus.waits;
+	perf->i2c_wait_ticks = bus.wait_ticks;
+	perf->i2c_max_depth = bus.max_depth;
+	perf->i2c_isr_max_ns = bus.isr_max_ns;
+	perf->i2c_isr_overruns = bus.isr_overruns;
+	i2c_bus_stats(I2C1, &bus);
+	perf->i2c1_ticks = bus.bus_ticks;
+	perf->i2c_waits += bus.waits;
+	perf->i2c_wait_ticks += bus.wait_ticks;
+	if(bus.max_depth > perf->i2c_max_depth) {
+		perf->i2c_max_depth = bus.max_depth;
+	}
+	if(bus.isr_max_ns > perf->i2c_isr_max_ns) {
+		perf->i2c_isr_max_ns = bus.isr_max_ns;
+	}
+	perf->i2c_isr_overruns += bus.isr_overruns;
+	perf->bytes_sent = leuart_bytes_sent();
+	sleep_stats(&perf->sleep);
+	perf->overlong = sleep_overlong_holds();
+	perf->si7021_reads = si7021_reads;
+	for(int i = 0; i < SI7021_MEASUREMENT_TYPES; i++) {
+		perf->si7021_conversions[i] = si7021_conversions(i);
+	}
+	perf->veml6030_reads = veml6030_reads;
+	perf->now = sw_timer_now();
+	for(int i = 0; i < CMU_GATE_COUNT; i++) {
+		perf->clock_on[i] = cmu_gate_on_ticks(i);
+	}
+	for(int i = 0; i < CMU_BAND_COUNT; i++) {
+		cmu_band_stats(i, &perf->bands[i]);
+	}
+	for(int i = 0; i < SENSOR_RAIL_COUNT; i++) {
+		perf->sensor_on[i] = sensor_power_on_ticks(i);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Converts software timer ticks to milliseconds
+ *
+ * @param[in] ticks
+ *	Is a tick count
+ *
+ ******************************************************************************/
+
+static uint32_t app_perf_ms(uint32_t ticks) {
+	return (uint64_t)ticks * 1000 / SW_TIMER_HZ;
+}
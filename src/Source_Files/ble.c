@@ -23,6 +23,12 @@
 // private variables
 //***********************************************************************************
 
+// Strings written while the LEUART is busy, sent in order from ble_tx_done()
+static char		ble_tx_queue[BLE_TX_QUEUE_DEPTH][BLE_TX_MAX_LEN];
+static uint32_t	ble_tx_head;
+static uint32_t	ble_tx_tail;
+static uint32_t	ble_tx_drops;
+
 /***************************************************************************//**
  * @brief BLE module
  * @details
@@ -83,19 +89,77 @@ void ble_open(uint32_t tx_event, uint32_t rx_event){
  * 	Function to write a string to the BLE
  *
  * @details
- *  Calls leuart_start with the string passed in
+ *  Calls leuart_start with the string passed in.  If a transfer is already in
+ *  progress the string is copied to the tx queue and sent by ble_tx_done(),
+ *  if the queue is full the string is dropped and counted
  *
  * @note
- *  Called from humidity_done_cb which is called every time a humidity value is read on LETIMER underflow
+ *  Called from the application event handlers that report readings
  *
  * @param[in] *string
- *   The string to be written
+ *   The string to be written, shorter than BLE_TX_MAX_LEN
  *
  ******************************************************************************/
 
 void ble_write(char* string){
 	uint32_t str_len = strlen(string);
-	leuart_start(LEUART0, string, str_len);
+	EFM_ASSERT(str_len < BLE_TX_MAX_LEN);
+	if(str_len == 0) {
+		return;
+	}
+	if(!leuart_tx_busy(HM10_LEUART0) && (ble_tx_head == ble_tx_tail)) {
+		leuart_start(LEUART0, string, str_len);
+	}
+	else if(!ble_tx_queue_full()) {
+		strcpy(ble_tx_queue[ble_tx_tail % BLE_TX_QUEUE_DEPTH], string);
+		ble_tx_tail++;
+	}
+	else {
+		ble_tx_drops++;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ * 	Function to send the next queued string
+ *
+ * @details
+ *  Starts the oldest string of the tx queue once the LEUART is idle
+ *
+ * @note
+ *  Called from the tx done event handler
+ *
+ ******************************************************************************/
+
+void ble_tx_done(void){
+	if((ble_tx_head != ble_tx_tail) && !leuart_tx_busy(HM10_LEUART0)) {
+		char *string = ble_tx_queue[ble_tx_head % BLE_TX_QUEUE_DEPTH];
+		leuart_start(LEUART0, string, strlen(string));
+		ble_tx_head++;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ * 	Function to check whether the tx queue is full
+ *
+ * @note
+ *  Called by writers of long reports to pace them to the LEUART
+ *
+ ******************************************************************************/
+
+bool ble_tx_queue_full(void){
+	return (ble_tx_tail - ble_tx_head) >= BLE_TX_QUEUE_DEPTH;
+}
+
+/***************************************************************************//**
+ * @brief
+ * 	Function to get the number of strings dropped by ble_write
+ *
+ ******************************************************************************/
+
+uint32_t ble_tx_dropped(void){
+	return ble_tx_drops;
 }
 
 /***************************************************************************//**
@@ -201,6 +265,8 @@ bool ble_test(char *mod_name){
 	// save the current state of the LEUART driver that will be used later to
 	// re-instate the LEUART configuration
 
+	// Keep the LEUART clocked for the polled test
+	cmu_gate_acquire(CMU_GATE_LEUART0);
 	status = leuart_status(HM10_LEUART0);
 	if (status & LEUART_STATUS_RXBLOCK) {
 		rx_disabled = true;
@@ -287,6 +353,7 @@ bool ble_test(char *mod_name){
 	if (rx_disabled) leuart_cmd_write(HM10_LEUART0, LEUART_CMD_RXBLOCKEN);
 	if (!tx_en) leuart_cmd_write(HM10_LEUART0, LEUART_CMD_TXDIS);
 	leuart_if_reset(HM10_LEUART0);
+	cmu_gate_release(CMU_GATE_LEUART0);
 
 	success = true;
 
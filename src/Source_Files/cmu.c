@@ -20,11 +20,36 @@
 // Private variables
 //***********************************************************************************
 
+// Clock governor: the HFRCO runs in CMU_FAST_BAND while any burst is raised
+// and in CMU_SLOW_BAND otherwise.  While a lock is held, such as an I2C
+// transfer whose SCL is divided from HFPERCLK, the band is kept and the
+// change is made by the next cmu_clock_settle
+static CMU_HFRCOFreq_TypeDef	clock_band;
+static uint32_t					clock_bursts;
+static uint32_t					clock_locks;
+static uint32_t					clock_changes;
+static CMU_CLOCK_CHANGED		clock_listeners[CMU_CLOCK_LISTENERS];
+static uint32_t					clock_listener_count;
+
+// EM0 and EM1 residency of each band, taken from the sleep routines
+// residency each time the band changes
+static const uint32_t			band_hz[CMU_BAND_COUNT] = {CMU_SLOW_BAND, CMU_FAST_BAND};
+static uint32_t					band_residency[CMU_BAND_COUNT][CMU_BAND_MODES];
+static uint32_t					band_mark[CMU_BAND_MODES];
+
+// Peripheral clock gates: a gate turns its clock on with the first reference
+// and off with the last, taking a reference on its parent meanwhile
+static const CMU_Clock_TypeDef	gate_clock[CMU_GATE_COUNT] = {cmuClock_HFPER, cmuClock_I2C0, cmuClock_I2C1, cmuClock_LEUART0, cmuClock_LDMA};
+static const uint32_t			gate_parent[CMU_GATE_COUNT] = {CMU_GATE_COUNT, CMU_GATE_HFPER, CMU_GATE_HFPER, CMU_GATE_COUNT, CMU_GATE_COUNT};
+static CMU_GATE					gates[CMU_GATE_COUNT];
+static CMU_TIMEBASE				gate_now;
 
 //***********************************************************************************
 // Private functions
 //***********************************************************************************
 
+static uint32_t cmu_gate_tick(void);
+static void cmu_band_account(void);
 
 //***********************************************************************************
 // Global functions
@@ -39,6 +64,7 @@
  *	Then enables LFRCO and LFXO oscillators
  *	Then selects the correct clock tree for LETIMER0
  *	Finally, enables LF
+ *	The HFPER and peripheral clocks are left to the clock gates
  *
  * @note
  *	Called once at the beginning
@@ -47,8 +73,15 @@
 
 void cmu_open(void){
 
-		// Enable the High Frequency Peripheral Clock
-		CMU_ClockEnable(cmuClock_HFPER, true);
+		// The High Frequency Peripheral Clock and the peripheral clocks are
+		// enabled by the drivers through the clock gates, only while in use
+		for(int i = 0; i < CMU_GATE_COUNT; i++) {
+			gates[i].refs = 0;
+			gates[i].enables = 0;
+			gates[i].on_ticks = 0;
+			gates[i].on_tick = 0;
+		}
+		gate_now = 0;
 
 		// By default, Low Frequency Resistor Capacitor Oscillator, LFRCO, is enabled,
 		// Disable the LFRCO oscillator
@@ -68,5 +101,344 @@ void cmu_open(void){
 		// Now, you must ensure that the global Low Frequency is enabled
 		CMU_ClockEnable(cmuClock_CORELE, true);
 
+		// main() starts the HFRCO in CMU_FAST_BAND, the first settle lowers it
+		clock_band = CMU_FAST_BAND;
+		clock_bursts = 0;
+		clock_locks = 0;
+		clock_changes = 0;
+		clock_listener_count = 0;
+		for(int i = 0; i < CMU_BAND_MODES; i++) {
+			band_residency[CMU_BAND_SLOW][i] = 0;
+			band_residency[CMU_BAND_FAST][i] = 0;
+			band_mark[i] = 0;
+		}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Registers a function to call after the core clock changes
+ *
+ * @details
+ *	Peripherals clocked from HFPERCLK and conversions of microseconds to core
+ *	cycles re-derive their timing in the function, SystemCoreClock already
+ *	holds the new frequency when it is called
+ *
+ * @note
+ *	Called once per timing, after cmu_open
+ *
+ * @param[in] changed
+ *	Is the function to call, with interrupts disabled
+ *
+ ******************************************************************************/
+
+void cmu_clock_notify(CMU_CLOCK_CHANGED changed) {
+	EFM_ASSERT(clock_listener_count < CMU_CLOCK_LISTENERS);
+	clock_listeners[clock_listener_count++] = changed;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Raises the core clock for a burst of work
+ *
+ * @details
+ *	Switches the HFRCO to CMU_FAST_BAND unless a lock is held, in which case
+ *	the burst runs in the current band
+ *
+ * @note
+ *	Called from the main loop around compute that finishes sooner at the
+ *	higher frequency, every raise is paired with a cmu_clock_lower
+ *
+ ******************************************************************************/
+
+void cmu_clock_raise(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	clock_bursts++;
+	CORE_EXIT_CRITICAL();
+	cmu_clock_settle();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Ends a burst of work
+ *
+ * @details
+ *	Switches the HFRCO back to CMU_SLOW_BAND after the last burst, unless a
+ *	lock is held
+ *
+ * @note
+ *	Called from the main loop
+ *
+ ******************************************************************************/
+
+void cmu_clock_lower(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	EFM_ASSERT(clock_bursts);
+	clock_bursts--;
+	CORE_EXIT_CRITICAL();
+	cmu_clock_settle();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Keeps the core clock band
+ *
+ * @details
+ *	Holds off band changes while a peripheral timed from HFPERCLK is active,
+ *	changes requested meanwhile are made by the next cmu_clock_settle
+ *
+ * @note
+ *	Called when an I2C transfer starts
+ *
+ ******************************************************************************/
+
+void cmu_clock_lock(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	clock_locks++;
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Releases a lock taken with cmu_clock_lock
+ *
+ * @note
+ *	Called when an I2C transfer completes, also from its interrupt handler,
+ *	so it does not change the band itself
+ *
+ ******************************************************************************/
+
+void cmu_clock_unlock(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	EFM_ASSERT(clock_locks);
+	clock_locks--;
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Moves the core clock to the band requested
+ *
+ * @details
+ *	When no lock is held, switches the HFRCO to CMU_FAST_BAND while a burst
+ *	is raised and to CMU_SLOW_BAND otherwise.  CMU_HFRCOBandSet adjusts the
+ *	flash wait states, then SystemCoreClock is updated and every registered
+ *	function re-derives its timing before interrupts are enabled again.  The
+ *	EM0 and EM1 residency since the last change is booked to the old band
+ *
+ * @note
+ *	Called by cmu_clock_raise and cmu_clock_lower, and from the main loop
+ *	before sleeping to make a change that a lock held off
+ *
+ ******************************************************************************/
+
+void cmu_clock_settle(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	CMU_HFRCOFreq_TypeDef band = clock_bursts ? CMU_FAST_BAND : CMU_SLOW_BAND;
+	if(!clock_locks && (band != clock_band)) {
+		cmu_band_account();
+		CMU_HFRCOBandSet(band);
+		SystemCoreClockUpdate();
+		clock_band = band;
+		clock_changes++;
+		for(uint32_t i = 0; i < clock_listener_count; i++) {
+			clock_listeners[i]();
+		}
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of core clock band changes
+ *
+ ******************************************************************************/
+
+uint32_t cmu_clock_changes(void) {
+	return clock_changes;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the residency of a core clock band
+ *
+ * @details
+ *	Brings the residency of the current band up to date and copies the EM0
+ *	and EM1 ticks spent in the band with its frequency, so the energy model
+ *	costs the active time at the clock it actually ran at
+ *
+ * @note
+ *	Called by the application performance report
+ *
+ * @param[in] band
+ *	Is the cmu_bands entry
+ *
+ * @param[out] stats
+ *	Is where the residency is copied to
+ *
+ ******************************************************************************/
+
+void cmu_band_stats(uint32_t band, CMU_BAND_STATS *stats) {
+	EFM_ASSERT(band < CMU_BAND_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	cmu_band_account();
+	stats->mhz = band_hz[band] / 1000000;
+	for(int i = 0; i < CMU_BAND_MODES; i++) {
+		stats->residency[i] = band_residency[band][i];
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sets the timebase of the clock on time
+ *
+ * @note
+ *	Called in app_peripheral_setup once the software timers are open, time
+ *	before that is not counted
+ *
+ * @param[in] now
+ *	Is the function that returns the current tick count
+ *
+ ******************************************************************************/
+
+void cmu_timebase(CMU_TIMEBASE now) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	gate_now = now;
+	for(int i = 0; i < CMU_GATE_COUNT; i++) {
+		gates[i].on_tick = cmu_gate_tick();
+	}
+	CORE_EXIT_CRITICAL();
 }
 
+/***************************************************************************//**
+ * @brief
+ *	Takes a reference on a peripheral clock
+ *
+ * @details
+ *	The first reference turns the clock on, after its parent.  The
+ *	peripheral registers keep their values while the clock is off, so the
+ *	driver only restores what changed meanwhile
+ *
+ * @note
+ *	Called by a driver before it accesses the peripheral registers, from the
+ *	main loop or an interrupt handler
+ *
+ * @param[in] gate
+ *	Is the cmu_gates entry of the clock
+ *
+ ******************************************************************************/
+
+void cmu_gate_acquire(uint32_t gate) {
+	EFM_ASSERT(gate < CMU_GATE_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(!gates[gate].refs++) {
+		if(gate_parent[gate] < CMU_GATE_COUNT) {
+			cmu_gate_acquire(gate_parent[gate]);
+		}
+		CMU_ClockEnable(gate_clock[gate], true);
+		gates[gate].enables++;
+		gates[gate].on_tick = cmu_gate_tick();
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Releases a reference taken with cmu_gate_acquire
+ *
+ * @details
+ *	The last reference turns the clock off, then releases its parent
+ *
+ * @note
+ *	Called by a driver when the peripheral has gone idle, such as at the end
+ *	of a transfer in its interrupt handler
+ *
+ * @param[in] gate
+ *	Is the cmu_gates entry of the clock
+ *
+ ******************************************************************************/
+
+void cmu_gate_release(uint32_t gate) {
+	EFM_ASSERT(gate < CMU_GATE_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	EFM_ASSERT(gates[gate].refs);
+	if(!--gates[gate].refs) {
+		CMU_ClockEnable(gate_clock[gate], false);
+		gates[gate].on_ticks += cmu_gate_tick() - gates[gate].on_tick;
+		if(gate_parent[gate] < CMU_GATE_COUNT) {
+			cmu_gate_release(gate_parent[gate]);
+		}
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns how long a peripheral clock has been on
+ *
+ * @param[in] gate
+ *	Is the cmu_gates entry of the clock
+ *
+ * @return
+ *	Returns the ticks of the timebase the clock was on, including the time
+ *	since it was last turned on if it is on now
+ *
+ ******************************************************************************/
+
+uint32_t cmu_gate_on_ticks(uint32_t gate) {
+	EFM_ASSERT(gate < CMU_GATE_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	uint32_t ticks = gates[gate].on_ticks;
+	if(gates[gate].refs) {
+		ticks += cmu_gate_tick() - gates[gate].on_tick;
+	}
+	CORE_EXIT_CRITICAL();
+	return ticks;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Reads the timebase of the clock on time
+ *
+ * @return
+ *	Returns the tick count, or 0 until cmu_timebase has been called
+ *
+ ******************************************************************************/
+
+static uint32_t cmu_gate_tick(void) {
+	return gate_now ? gate_now() : 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Books the EM0 and EM1 residency since the last call to the current band
+ *
+ * @note
+ *	Called with interrupts disabled before every band change and when the
+ *	band residency is read
+ *
+ ******************************************************************************/
+
+static void cmu_band_account(void) {
+	SLEEP_STATS stats;
+	uint32_t band = (clock_band == CMU_FAST_BAND) ? CMU_BAND_FAST : CMU_BAND_SLOW;
+	sleep_stats(&stats);
+	for(int i = 0; i < CMU_BAND_MODES; i++) {
+		band_residency[band][i] += stats.residency[i] - band_mark[i];
+		band_mark[i] = stats.residency[i];
+	}
+}
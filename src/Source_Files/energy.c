@@ -0,0 +1,114 @@
+/**
+ * @file energy.c
+ * @author Gerritt Luoma
+ * @date May 9th, 2021
+ * @brief Contains the energy model that estimates the average current and battery life
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#include "energy.h"
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint64_t energy_mode_na(uint32_t EM, uint32_t core_mhz);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to estimate the energy use of a trace
+ *
+ * @details
+ * 	 This routine adds up the charge of the time spent in each energy mode,
+ * 	 EM0 and EM1 at the clock of each band they were spent in, of the I2C
+ * 	 buses while busy, of the LEUART bytes sent at HM10_BAUDRATE, of the
+ * 	 sensor conversions, each at the length of its type, and of the time each
+ * 	 sensor supply was on, the SI7021 with its bus pull ups, and divides it
+ * 	 by the length of the trace, the samples taken and the capacity of the
+ * 	 cell.  The current of the BLE module itself is not included
+ *
+ * @note
+ *   This function only reads the trace, so it gives the same result for the
+ *   counters read live from the firmware and for a trace written by hand or
+ *   by a simulation, which makes the energy delta of a change comparable
+ *
+ * @param[in] trace
+ *   Is the residency and activity of the interval to estimate
+ *
+ * @param[in] cell_mah
+ *   Is the capacity of the cell in mAh
+ *
+ * @param[out] estimate
+ *   Is the average current, charge per sample and projected lifetime
+ *
+ ******************************************************************************/
+
+void energy_estimate(const ENERGY_TRACE *trace, uint32_t cell_mah, ENERGY_ESTIMATE *estimate) {
+	EFM_ASSERT(trace->hz);
+	uint64_t ticks = 0;
+	uint64_t charge = 0;	// nA * ticks
+
+	for(uint32_t i = 0; i < MAX_ENERGY_MODES; i++) {
+		ticks += trace->residency[i];
+		if(i >= CMU_BAND_MODES) {
+			charge += trace->residency[i] * energy_mode_na(i, 0);
+		}
+	}
+	for(uint32_t band = 0; band < CMU_BAND_COUNT; band++) {
+		for(uint32_t i = 0; i < CMU_BAND_MODES; i++) {
+			charge += trace->band_residency[band][i] * energy_mode_na(i, trace->core_mhz[band]);
+		}
+	}
+	charge += (uint64_t)trace->i2c_ticks * (ENERGY_I2C_NA + ENERGY_I2C_PULLUP_NA);
+	charge += (uint64_t)trace->leuart_bytes * ENERGY_LEUART_BITS * ENERGY_LEUART_NA * trace->hz / HM10_BAUDRATE;
+	charge += (uint64_t)trace->si7021_h_conversions * ENERGY_SI7021_NA * ENERGY_SI7021_H_CONVERSION_US * trace->hz / 1000000;
+	charge += (uint64_t)trace->si7021_t_conversions * ENERGY_SI7021_NA * ENERGY_SI7021_T_CONVERSION_US * trace->hz / 1000000;
+	charge += (uint64_t)trace->si7021_on_ticks * (ENERGY_SI7021_STANDBY_NA + ENERGY_SI7021_PULLUP_NA);
+	charge += (uint64_t)trace->veml6030_on_ticks * ENERGY_VEML6030_NA;
+
+	estimate->average_na = ticks ? (uint32_t)(charge / ticks) : 0;
+	estimate->sample_nc = trace->samples ? (uint32_t)(charge / trace->hz / trace->samples) : 0;
+	estimate->lifetime_h = estimate->average_na ? (uint32_t)((uint64_t)cell_mah * 1000000 / estimate->average_na) : 0;
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the current of an energy mode
+ *
+ * @param[in] EM
+ *   Is the energy mode
+ *
+ * @param[in] core_mhz
+ *   Is the HFCLK in MHz, only used for EM0 and EM1
+ *
+ * @return
+ *   Returns the current in nA
+ *
+ ******************************************************************************/
+
+static uint64_t energy_mode_na(uint32_t EM, uint32_t core_mhz) {
+	switch(EM) {
+		case EM0:
+			return (uint64_t)SLEEP_EM0_NA_PER_MHZ * core_mhz;
+		case EM1:
+			return (uint64_t)SLEEP_EM1_NA_PER_MHZ * core_mhz;
+		case EM2:
+			return SLEEP_EM2_NA;
+		case EM3:
+			return SLEEP_EM3_NA;
+		default:
+			return ENERGY_EM4_NA;
+	}
+}
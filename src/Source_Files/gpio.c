@@ -56,12 +56,7 @@ void gpio_open(void){
 	GPIO_DriveStrengthSet(LED1_PORT, LED1_DRIVE_STRENGTH);
 	GPIO_PinModeSet(LED1_PORT, LED1_PIN, LED1_GPIOMODE, LED1_DEFAULT);
 
-	//configure SI7021 pins
-	GPIO_DriveStrengthSet(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_DRIVE_STRENGTH);
-	GPIO_PinModeSet(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN, SI7021_SENSOR_GPIOMODE, true);
-
-	GPIO_PinModeSet(SI7021_SCL_PORT, SI7021_SCL_PIN, SI7021_I2C_GPIOMODE, SENSOR_I2C_SCL);
-	GPIO_PinModeSet(SI7021_SDA_PORT, SI7021_SDA_PIN, SI7021_I2C_GPIOMODE, SENSOR_I2C_SDA);
+	//the SI7021 enable and I2C pins are switched by sensor_power_open
 
 	//configure VEML pins
 	GPIO_PinModeSet(VEML6030_SCL_PORT, VEML6030_SCL_PIN, VEML6030_GPIOMODE, SENSOR_I2C_SCL);
@@ -11,11 +11,13 @@
 //***********************************************************************************
 
 #include "i2c.h"
+#include "sw_timer.h"
 #include "em_assert.h"
 #include "em_core.h"
 #include "em_emu.h"
 #include "em_i2c.h"
 #include "em_cmu.h"
+#include "cmu.h"
 
 //***********************************************************************************
 // Private variables
@@ -23,9 +25,8 @@
 
 
 
-static I2C_STATE_MACHINE 	 i2c_veml; //for light sensor = I2C0
-static I2C_STATE_MACHINE	 i2c_si7021; //for SI7021 = I2C1
-//static uint32_t			 SI7021_READ_CB;
+// One context per bus, the devices on a bus only differ in their transfers
+static I2C_STATE_MACHINE	 i2c_buses[I2C_BUS_COUNT]; //I2C0 and I2C1
 
 
 //***********************************************************************************
@@ -37,6 +38,21 @@ static void i2c_ack(I2C_STATE_MACHINE *i2c_state);
 static void i2c_nack(I2C_STATE_MACHINE *i2c_state);
 static void i2c_rxdatav(I2C_STATE_MACHINE *i2c_state);
 static void i2c_mstop(I2C_STATE_MACHINE *i2c_state);
+static void i2c_clock_changed(void);
+static I2C_STATE_MACHINE *i2c_bus(I2C_TypeDef *i2c);
+static void i2c_irq(I2C_STATE_MACHINE *i2c_state);
+static void i2c_next(I2C_STATE_MACHINE *i2c_state);
+static void i2c_begin(I2C_STATE_MACHINE *i2c_state, const I2C_TRANSFER *transfer);
+static void i2c_txc(I2C_STATE_MACHINE *i2c_state);
+static void i2c_dma_done(uint32_t channel, bool error);
+static void i2c_abort(I2C_STATE_MACHINE *i2c_state, uint32_t status);
+static void i2c_acquire(I2C_STATE_MACHINE *i2c_state);
+static void i2c_release(I2C_STATE_MACHINE *i2c_state);
+static void i2c_complete(I2C_STATE_MACHINE *i2c_state);
+static void i2c_dequeue(I2C_STATE_MACHINE *i2c_state);
+static void i2c_isr_time(I2C_STATE_MACHINE *i2c_state, uint32_t start);
+static void i2c_isr_clock(I2C_STATE_MACHINE *i2c_state);
+static uint32_t i2c_isr_max_ns(const I2C_STATE_MACHINE *i2c_state);
 void i2c_bus_reset(I2C_TypeDef *i2c_def);
 
 /***************************************************************************//**
@@ -92,13 +108,29 @@ void i2c_bus_reset(I2C_TypeDef *i2c_def) {
  ******************************************************************************/
 
 void i2c_open(I2C_TypeDef *i2c_def, I2C_OPEN_STRUCT *i2c_setup) {
-	//enable correct clock
-	if(i2c_def == I2C0) {
-		CMU_ClockEnable(cmuClock_I2C0, true);
-	}
-	else if(i2c_def == I2C1) {
-		CMU_ClockEnable(cmuClock_I2C1, true);
+	// bind the context of the bus to its peripheral, the only place the two differ
+	I2C_STATE_MACHINE *i2c_state = &i2c_buses[(i2c_def == I2C1) ? 1 : 0];
+	EFM_ASSERT((i2c_def == I2C0) || (i2c_def == I2C1));
+	if(!i2c_buses[0].i2c_def && !i2c_buses[1].i2c_def) {
+		cmu_clock_notify(i2c_clock_changed);	// keep the bus frequency when the clock governor changes HFPERCLK
+		ldma_open();	// long payloads are moved by LDMA
 	}
+	i2c_state->i2c_def = i2c_def;
+	i2c_state->owner = (i2c_def == I2C1) ? SLEEP_OWNER_I2C1 : SLEEP_OWNER_I2C0;
+	i2c_state->gate = (i2c_def == I2C1) ? CMU_GATE_I2C1 : CMU_GATE_I2C0;
+	i2c_state->queue = (i2c_def == I2C1) ? SCHEDULER_QUEUE_I2C1 : SCHEDULER_QUEUE_I2C0;
+	i2c_state->dma_channel = (i2c_def == I2C1) ? LDMA_CHANNEL_I2C1 : LDMA_CHANNEL_I2C0;
+	i2c_state->dma_tx_signal = (i2c_def == I2C1) ? ldmaPeripheralSignal_I2C1_TXBL : ldmaPeripheralSignal_I2C0_TXBL;
+	i2c_state->dma_rx_signal = (i2c_def == I2C1) ? ldmaPeripheralSignal_I2C1_RXDATAV : ldmaPeripheralSignal_I2C0_RXDATAV;
+	i2c_state->settle_timer = i2c_setup->settle_timer;
+	i2c_state->stop_event = i2c_setup->stop_event;
+	i2c_state->settle_event = i2c_setup->settle_event;
+	i2c_state->state = StartCommand;
+	i2c_state->i2c_busy = false;
+	i2c_isr_clock(i2c_state);
+
+	//enable the clock for the set up, it is gated again once the bus is reset
+	cmu_gate_acquire(i2c_state->gate);
 	// Test if clock is enabled and we can read/set/clear interrupt flags
 	if ((i2c_def->IF & 0x01) == 0) {
 		i2c_def->IFS = 0x01;
@@ -119,6 +151,11 @@ void i2c_open(I2C_TypeDef *i2c_def, I2C_OPEN_STRUCT *i2c_setup) {
 
 	I2C_Init(i2c_def, &i2c_init);
 
+	i2c_state->freq = i2c_setup->freq;
+	i2c_state->clhr = i2c_setup->clhr;
+	i2c_state->freq_stale = false;
+	i2c_state->bus_stale = false;
+
 	// Route the I2C to the correct pins and enable pins
 	i2c_def->ROUTELOC0 = i2c_setup->SCL_route | i2c_setup->SDA_route;
 	i2c_def->ROUTEPEN = (I2C_ROUTEPEN_SCLPEN*i2c_setup->SCLPEN | I2C_ROUTEPEN_SDAPEN*i2c_setup->SDAPEN);
@@ -144,13 +181,10 @@ void i2c_open(I2C_TypeDef *i2c_def, I2C_OPEN_STRUCT *i2c_setup) {
 
 
 	// enable interrupts for specific i2c
-	if(i2c_def == I2C0) {
-		NVIC_EnableIRQ(I2C0_IRQn);
-	}
-	if(i2c_def == I2C1) {
-		NVIC_EnableIRQ(I2C1_IRQn);
-	}
+	NVIC_EnableIRQ((i2c_def == I2C1) ? I2C1_IRQn : I2C0_IRQn);
 
+	// the registers keep their values while the clock is gated until i2c_start
+	cmu_gate_release(i2c_state->gate);
 }
 
 /***************************************************************************//**
@@ -158,72 +192,51 @@ void i2c_open(I2C_TypeDef *i2c_def, I2C_OPEN_STRUCT *i2c_setup) {
  *   Function to start i2c
  *
  * @details
- * 	 This routine sets up the i2c state machine struct to initialize the state machine
- * 	 depending on whether we are using I2C0 or I2C1
+ * 	 This routine starts the transfer if the bus is idle, otherwise (atomic)
+ * 	 copies it to the queue of the bus, the end of the transfer in progress
+ * 	 then starts it.  The interrupt handler writes the transfer
+ * 	 bytes, reads the requested bytes after a repeated start and posts the
+ * 	 completion event with the value read
  *
  * @note
- *   This function is called from SI7021_read at every underflow interrupt
+ *   This function is called by the sensor drivers, every device on a bus is
+ *   driven by its own transfers without changes to this driver.  The clock,
+ *   its gate and the sleep block are held from the transfer that finds the
+ *   bus idle until the queue is empty
  *
  * @param[in] *i2c
- *   Pointer to the base peripheral address of the i2c peripheral being opened
+ *   Pointer to the base peripheral address of the i2c peripheral of the device
  *
- * @param[in] address
- *   Is the address of the SI7021
- *
- * @param[in] reg
- *   Is the register of the SI7021 being used
- *
- * @param[in] RW
- *   Is the boolean to tell whether we are reading or writing
- *
- * @param[in] *loc
- *   Location where the data to read or dara to be written is/will be stored
- *
- * @param[in] byte_count
- *   Is the number of bytes to be read/written
- *
- * @param[in] SI7021_READ_CB
- *   Is the callback once reading is completed
+ * @param[in] *transfer
+ *   Is the transfer to run, copied so it may be a local of the caller
  *
  ******************************************************************************/
 
-void i2c_start(I2C_TypeDef *i2c, uint32_t address, uint32_t reg, bool RW, uint32_t *loc, uint8_t byte_count, uint32_t CallBack) {
-	// triggers if i2c peripheral has not finished pervious i2c operation
-	EFM_ASSERT((i2c->STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE); // X = the I2C peripheral #
-	sleep_block_mode(I2C_EM_BLOCK);
-
-	if(i2c == I2C1) { //si7021
-		i2c_si7021.i2c_def = i2c;
-		i2c_si7021.slave_address = address;
-		i2c_si7021.slave_reg = reg;
-		i2c_si7021.w_r_store = loc;
-		i2c_si7021.w_r = RW;
-		i2c_si7021.bytes_count = byte_count;
-
-		i2c_si7021.state = StartCommand;
-		i2c_si7021.i2c_def->CMD = I2C_CMD_START;
-		i2c_si7021.i2c_def->TXDATA = (i2c_si7021.slave_address << 1) | I2C_WRITE;
-		i2c_si7021.i2c_busy = true;
-		i2c_si7021.callback = CallBack;
-	}
-	else if(i2c == I2C0) { //veml6030
-		i2c_veml.i2c_def = i2c;
-		i2c_veml.slave_address = address;
-		i2c_veml.slave_reg = reg;
-		i2c_veml.w_r_store = loc;
-		i2c_veml.w_r = RW;
-		i2c_veml.bytes_count = byte_count;
-
-		i2c_veml.state = StartCommand;
-		i2c_veml.i2c_def->CMD = I2C_CMD_START;
-		i2c_veml.i2c_def->TXDATA = (i2c_veml.slave_address << 1) | I2C_WRITE;
-		i2c_veml.i2c_busy = true;
-		i2c_veml.callback = CallBack;
-	}
-
+void i2c_start(I2C_TypeDef *i2c, const I2C_TRANSFER *transfer) {
+	I2C_STATE_MACHINE *i2c_state = i2c_bus(i2c);
+	EFM_ASSERT((transfer->tx_len || transfer->rx_len) && (transfer->buffer || (transfer->rx_len <= sizeof(uint32_t))));
 
-	//for light sensing: if i2c = i2c1, do light sensing, if 0, ^
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(i2c_state->i2c_busy) {
+		// triggers if more transfers are outstanding than the queue holds
+		EFM_ASSERT(i2c_state->depth < I2C_QUEUE_DEPTH);
+		I2C_QUEUED *queued = &i2c_state->pending[(i2c_state->head + i2c_state->depth) % I2C_QUEUE_DEPTH];
+		queued->transfer = *transfer;
+		queued->queued_tick = sw_timer_now();
+		i2c_state->depth++;
+		i2c_state->waits++;
+		if(i2c_state->depth > i2c_state->max_depth) {
+			i2c_state->max_depth = i2c_state->depth;
+		}
+		CORE_EXIT_CRITICAL();
+		return;
+	}
+	i2c_state->i2c_busy = true;
+	CORE_EXIT_CRITICAL();
 
+	i2c_acquire(i2c_state);
+	i2c_begin(i2c_state, transfer);
 }
 
 /***************************************************************************//**
@@ -231,8 +244,7 @@ void i2c_start(I2C_TypeDef *i2c, uint32_t address, uint32_t reg, bool RW, uint32
  *   Function to handle interrupts for I2C0
  *
  * @details
- * 	 This routine checks whether there is an interrupt, and whether it is ACK, NACK, RXDATAV, MSTOP
- * 	 Then calls the function for the specific interrupt
+ * 	 This routine services the bus context of I2C0
  *
  * @note
  *   This function is called to any time there is an interrupt of any type
@@ -240,27 +252,7 @@ void i2c_start(I2C_TypeDef *i2c, uint32_t address, uint32_t reg, bool RW, uint32
  ******************************************************************************/
 
 void I2C0_IRQHandler(void) {
-	 uint32_t int_flag; // store source interrupts
-
-	 //AND the interrupt source (IF), with the interrupt enable register (IEN)
-	 // your interrupt source variable will only contain interrupts of interest
-	 int_flag = I2C0->IF & I2C0->IEN;
-
-	 //clear interrupt flag register
-	 I2C0->IFC = int_flag;
-
-	 if (int_flag & I2C_IF_ACK){
-		 i2c_ack(&i2c_veml);
-	 }
-	 if (int_flag & I2C_IF_NACK){
-		 i2c_nack(&i2c_veml);
-	 }
-	 if (int_flag & I2C_IF_RXDATAV){
-		 i2c_rxdatav(&i2c_veml);
-	 }
-	 if (int_flag & I2C_IF_MSTOP){
-	 	 i2c_mstop(&i2c_veml);
-	 }
+	i2c_irq(&i2c_buses[0]);
 }
 
 /***************************************************************************//**
@@ -268,8 +260,7 @@ void I2C0_IRQHandler(void) {
  *   Function to handle interrupts for I2C1
  *
  * @details
- * 	 This routine checks whether there is an interrupt, and whether it is ACK, NACK, RXDATAV, MSTOP
- * 	 Then calls the function for the specific interrupt
+ * 	 This routine services the bus context of I2C1
  *
  * @note
  *   This function is called to any time there is an interrupt of any type
@@ -277,27 +268,7 @@ void I2C0_IRQHandler(void) {
  ******************************************************************************/
 
 void I2C1_IRQHandler(void) {
-	 uint32_t int_flag; // store source interrupts
-
-	 //AND the interrupt source (IF), with the interrupt enable register (IEN)
-	 // your interrupt source variable will only contain interrupts of interest
-	 int_flag = I2C1->IF & I2C1->IEN;
-
-	 //clear interrupt flag register
-	 I2C1->IFC = int_flag;
-
-	 if (int_flag & I2C_IF_ACK){
-		 i2c_ack(&i2c_si7021);
-	 }
-	 if (int_flag & I2C_IF_NACK){
-		 i2c_nack(&i2c_si7021);
-	 }
-	 if (int_flag & I2C_IF_RXDATAV){
-		 i2c_rxdatav(&i2c_si7021);
-	 }
-	 if (int_flag & I2C_IF_MSTOP){
-	 	 i2c_mstop(&i2c_si7021);
-	 }
+	i2c_irq(&i2c_buses[1]);
 }
 
 /***************************************************************************//**
@@ -315,48 +286,40 @@ void I2C1_IRQHandler(void) {
 
 static void i2c_ack (I2C_STATE_MACHINE *i2c_state){
 	switch(i2c_state->state) {
-		case StartCommand: {
-			if (i2c_state->w_r == I2C_READ) {
-				i2c_state->state = ReadCommand;
-				i2c_state->i2c_def->TXDATA = i2c_state->slave_reg;
-			}
-			else { //write
-				i2c_state->state = WriteCommand;
-				i2c_state->i2c_def->TXDATA = i2c_state->slave_reg;
-			}
-			break;
-		}
-		case ReadCommand: {
-			i2c_state->state = WaitRead;
-			i2c_state->i2c_def->CMD = I2C_CMD_START;
-			i2c_state->i2c_def->TXDATA = (i2c_state->slave_address << 1) | I2C_READ;
-			break;
-		}
+		case StartCommand:
 		case WriteCommand: {
-			i2c_state->state = EndSensing;
-			//i2c_state->i2c_def->CMD = I2C_CMD_START;
-			i2c_state->i2c_def->TXDATA = *(i2c_state->w_r_store);
-			timer_delay(15);
+			i2c_next(i2c_state);
 			break;
 		}
 		case WaitRead: {
-			i2c_state->state = EndSensing; //if acknowledged exit loop
+			//if acknowledged exit loop, the LDMA reads the bytes if armed
+			i2c_state->state = i2c_state->dma_read ? ReadDma : EndSensing;
 			break;
 		}
 		case EndSensing: {
-			if (i2c_state->w_r == I2C_WRITE) {
-				i2c_state->state = Stop;
-				i2c_state->i2c_def->CMD = I2C_CMD_STOP;
-			}
-			else {
-				EFM_ASSERT(false);
-			}
+			EFM_ASSERT(false);
 			break;
 		}
 		case Stop: {
 			EFM_ASSERT(false);
 			break;
 		}
+		case WriteDma: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case ReadDma: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Settle: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Stopped: {
+			EFM_ASSERT(false);
+			break;
+		}
 		default: {
 			EFM_ASSERT(false);
 			break;
@@ -383,18 +346,14 @@ static void i2c_nack (I2C_STATE_MACHINE *i2c_state){
 			EFM_ASSERT(false);
 			break;
 		}
-		case ReadCommand: {
-			EFM_ASSERT(false);
-			break;
-		}
 		case WriteCommand: {
 			EFM_ASSERT(false);
 			break;
 		}
 		case WaitRead: {
-			i2c_state->state = WaitRead; //loop
-			i2c_state->i2c_def->CMD = I2C_CMD_START;
-			i2c_state->i2c_def->TXDATA = (i2c_state->slave_address << 1) | I2C_READ;
+			// the slave is busy, stop and leave the retry to the caller, which
+			// sleeps instead of holding the bus with repeated starts
+			i2c_abort(i2c_state, I2C_NACKED);
 			break;
 		}
 		case EndSensing: {
@@ -405,6 +364,20 @@ static void i2c_nack (I2C_STATE_MACHINE *i2c_state){
 			EFM_ASSERT(false);
 			break;
 		}
+		case WriteDma:
+		case ReadDma: {
+			// a byte moved by the LDMA was NACKed, stop the channel and the bus
+			i2c_abort(i2c_state, I2C_NACKED);
+			break;
+		}
+		case Settle: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Stopped: {
+			EFM_ASSERT(false);
+			break;
+		}
 		default: {
 			EFM_ASSERT(false);
 			break;
@@ -431,10 +404,6 @@ static void i2c_rxdatav (I2C_STATE_MACHINE *i2c_state){
 			EFM_ASSERT(false);
 			break;
 		}
-		case ReadCommand: {
-			EFM_ASSERT(false);
-			break;
-		}
 		case WriteCommand: {
 			EFM_ASSERT(false);
 			break;
@@ -444,28 +413,20 @@ static void i2c_rxdatav (I2C_STATE_MACHINE *i2c_state){
 			break;
 		}
 		case EndSensing: {
-			i2c_state->bytes_count -= 1;
-			// Handle si7021 reads.  MS Byte first, LS Byte second
-			if(i2c_state->i2c_def == i2c_si7021.i2c_def) {
-				if(i2c_state->bytes_count > 0){
-					*i2c_state->w_r_store = (i2c_state->i2c_def->RXDATA) << (8 * i2c_state->bytes_count);
-				}
-				else{
-					*i2c_state->w_r_store |= i2c_state->i2c_def->RXDATA;
-				}
+			// Store a burst in bus order, assemble a value in the byte order of the transfer
+			uint32_t byte = i2c_state->i2c_def->RXDATA;
+			if(i2c_state->transfer.buffer) {
+				i2c_state->transfer.buffer[i2c_state->rx_index] = byte;
+			}
+			else if(i2c_state->transfer.order == I2C_MSB_FIRST) {
+				i2c_state->value = (i2c_state->value << 8) | byte;
 			}
-			// Handle VEML6030 reads.  LS Byte first, MS Byte second
 			else {
-				if(i2c_state->bytes_count > 0) {
-					*i2c_state->w_r_store = i2c_state->i2c_def->RXDATA;
-				}
-				else {
-					*i2c_state->w_r_store |= (i2c_state->i2c_def->RXDATA) << (8 * i2c_state->bytes_count);
-				}
+				i2c_state->value |= byte << (8 * i2c_state->rx_index);
 			}
+			i2c_state->rx_index++;
 
-			// Both VEML6030 and SI7021 have 2 bytes of data and the same communication to stop
-			if(i2c_state->bytes_count > 0) {
+			if(i2c_state->rx_index < i2c_state->transfer.rx_len) {
 				i2c_state->i2c_def->CMD = I2C_CMD_ACK;
 			}
 			else {
@@ -476,6 +437,24 @@ static void i2c_rxdatav (I2C_STATE_MACHINE *i2c_state){
 			break;
 		}
 		case Stop: {
+			// a byte that arrived before an abort took effect is dropped, the transfer has ended
+			EFM_ASSERT(i2c_state->status != I2C_DONE);
+			(void) i2c_state->i2c_def->RXDATA;
+			break;
+		}
+		case WriteDma: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case ReadDma: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Settle: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Stopped: {
 			EFM_ASSERT(false);
 			break;
 		}
@@ -505,10 +484,6 @@ static void i2c_mstop (I2C_STATE_MACHINE *i2c_state){
 			EFM_ASSERT(false);
 			break;
 		}
-		case ReadCommand: {
-			EFM_ASSERT(false);
-			break;
-		}
 		case WriteCommand: {
 			EFM_ASSERT(false);
 			break;
@@ -522,10 +497,38 @@ static void i2c_mstop (I2C_STATE_MACHINE *i2c_state){
 			break;
 		}
 		case Stop: {
-			sleep_unblock_mode(I2C_EM_BLOCK);
-			add_scheduled_event(i2c_state->callback);
-			i2c_state->state = StartCommand;
-			i2c_state->i2c_busy = false;
+			i2c_state->transfers++;
+			i2c_state->bus_ticks += sw_timer_now() - i2c_state->start_tick;
+			if(i2c_state->transfer.result) {
+				*i2c_state->transfer.result = i2c_state->status;
+			}
+			if(i2c_state->transfer.buffer) {
+				i2c_state->value = i2c_state->rx_index;	// a burst hands over the number of bytes read
+			}
+			else if(i2c_state->transfer.rx && (i2c_state->status == I2C_DONE)) {
+				*i2c_state->transfer.rx = i2c_state->value;
+			}
+			// releasing the bus, starting the settle time or the next queued
+			// transfer and posting the completion take longer than the interrupt
+			// budget, i2c_stopped does them in the main loop
+			i2c_state->state = Stopped;
+			add_scheduled_event(i2c_state->stop_event);
+			break;
+		}
+		case WriteDma: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case ReadDma: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Settle: {
+			EFM_ASSERT(false);
+			break;
+		}
+		case Stopped: {
+			EFM_ASSERT(false);
 			break;
 		}
 		default: {
@@ -537,38 +540,651 @@ static void i2c_mstop (I2C_STATE_MACHINE *i2c_state){
 
 /***************************************************************************//**
  * @brief
- *   Function that checks whether I2C0 is busy
+ *   Function that checks whether a bus is busy
+ *
+ * @details
+ * 	 This routine returns false if i2c is not busy, true while a transfer is
+ * 	 in progress or queued
+ *
+ * @note
+ *   A caller waiting for its own transfer waits for the completion event
+ *   instead, the bus may still be busy with the transfers queued behind it
+ *
+ * @param[in] *i2c
+ *   Pointer to the base peripheral address of the i2c peripheral
+ *
+ ******************************************************************************/
+
+bool i2c_busy(I2C_TypeDef *i2c) {
+	return i2c_bus(i2c)->i2c_busy;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the bus statistics of an I2C peripheral
+ *
+ * @details
+ * 	 This routine (atomic) copies the number of completed transfers and the
+ * 	 time spent in them, from sending the address to the MSTOP interrupt,
+ * 	 and the queue statistics: the largest depth, the number of transfers
+ * 	 that were queued and the time they waited for the bus, and the longest
+ * 	 interrupt with the number over I2C_ISR_BUDGET_NS.  The bus times are
+ * 	 counted in whole software timer ticks, which averages out over many
+ * 	 transfers shorter than a tick
+ *
+ * @note
+ *   This function is called by the application performance report
+ *
+ * @param[in] *i2c
+ *   Pointer to the base peripheral address of the i2c peripheral
+ *
+ * @param[out] *stats
+ *   Is where the statistics are copied to
+ *
+ ******************************************************************************/
+
+void i2c_bus_stats(I2C_TypeDef *i2c, I2C_BUS_STATS *stats) {
+	I2C_STATE_MACHINE *i2c_state = i2c_bus(i2c);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	stats->transfers = i2c_state->transfers;
+	stats->bus_ticks = i2c_state->bus_ticks;
+	stats->max_depth = i2c_state->max_depth;
+	stats->waits = i2c_state->waits;
+	stats->wait_ticks = i2c_state->wait_ticks;
+	stats->isr_max_ns = i2c_isr_max_ns(i2c_state);
+	stats->isr_overruns = i2c_state->isr_overruns;
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to mark a bus whose sensor was powered off
+ *
+ * @details
+ * 	 While a sensor is off its I2C pins are disabled, which the peripheral may
+ * 	 see as a bus held by another master.  The next transfer aborts to idle
+ * 	 once the bus clock is on.  A bus not opened yet is left alone, i2c_open
+ * 	 resets it
+ *
+ * @note
+ *   This function is called by sensor_power_acquire when a supply is turned on,
+ *   the first time from sensor_power_open before the buses are opened
+ *
+ * @param[in] *i2c
+ *   Pointer to the base peripheral address of the i2c peripheral of the sensor
+ *
+ ******************************************************************************/
+
+void i2c_bus_repowered(I2C_TypeDef *i2c) {
+	for(int i = 0; i < I2C_BUS_COUNT; i++) {
+		if(i2c_buses[i].i2c_def == i2c) {
+			i2c_buses[i].bus_stale = true;
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end a transfer that stopped
+ *
+ * @details
+ * 	 This routine does the work of the MSTOP interrupt that does not fit its
+ * 	 budget at the slowest core clock.  A transfer with a settle time gates
+ * 	 the bus and starts the settle timer, the settle time counts from here
+ * 	 and the main loop latency only lengthens it.  Any other transfer posts
+ * 	 its completion event, then starts the next queued transfer back to
+ * 	 back or releases the bus
+ *
+ * @note
+ *   This function is called by the handler of the stop event given to
+ *   i2c_open, a thread mode event posted by every MSTOP interrupt
+ *
+ * @param[in] *i2c
+ *   Pointer to the base peripheral address of the i2c peripheral
+ *
+ ******************************************************************************/
+
+void i2c_stopped(I2C_TypeDef *i2c) {
+	I2C_STATE_MACHINE *i2c_state = i2c_bus(i2c);
+	EFM_ASSERT(i2c_state->state == Stopped);
+	if(i2c_state->transfer.settle && (i2c_state->status == I2C_DONE)) {
+		// gate the bus and sleep until the slave has settled, i2c_settled completes the transfer
+		i2c_state->state = Settle;
+		i2c_release(i2c_state);
+		sw_timer_start(i2c_state->settle_timer, i2c_state->transfer.settle, 0, i2c_state->settle_event);
+		return;
+	}
+	i2c_complete(i2c_state);
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();	// i2c_start may queue from an interrupt
+	if(!i2c_state->depth) {
+		i2c_state->state = StartCommand;
+		i2c_state->i2c_busy = false;
+		i2c_release(i2c_state);
+		CORE_EXIT_CRITICAL();
+		return;
+	}
+	CORE_EXIT_CRITICAL();
+	i2c_dequeue(i2c_state);	// back to back, the bus stays ungated
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to end the settle time of a transfer
+ *
+ * @details
+ * 	 This routine posts the completion event of the transfer that was
+ * 	 settling, then ungates the bus for the next queued transfer or leaves
+ * 	 it idle
+ *
+ * @note
+ *   This function is called by the handler of the settle event given to
+ *   i2c_open, a thread mode event the settle timer schedules
+ *
+ * @param[in] *i2c
+ *   Pointer to the base peripheral address of the i2c peripheral
+ *
+ ******************************************************************************/
+
+void i2c_settled(I2C_TypeDef *i2c) {
+	I2C_STATE_MACHINE *i2c_state = i2c_bus(i2c);
+	EFM_ASSERT(i2c_state->state == Settle);
+	i2c_complete(i2c_state);
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();	// i2c_start may queue from an interrupt
+	if(!i2c_state->depth) {
+		i2c_state->state = StartCommand;
+		i2c_state->i2c_busy = false;
+		CORE_EXIT_CRITICAL();
+		return;
+	}
+	CORE_EXIT_CRITICAL();
+	i2c_acquire(i2c_state);
+	i2c_dequeue(i2c_state);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to follow a change of the core clock
+ *
+ * @details
+ * 	 This routine marks the clock divider of each opened bus as stale, the
+ * 	 bus clock is gated between transfers so the divider is recalculated
+ * 	 from the new HFPERCLK by the next i2c_start, keeping SCL at the
+ * 	 frequency requested in i2c_open.  The interrupt times move to the new
+ * 	 clock through i2c_isr_clock
+ *
+ * @note
+ *   This function is registered with cmu_clock_notify by the first i2c_open.
+ *   The clock governor only changes the clock while no transfer holds its
+ *   lock
+ *
+ ******************************************************************************/
+
+static void i2c_clock_changed(void) {
+	for(int i = 0; i < I2C_BUS_COUNT; i++) {
+		i2c_buses[i].freq_stale = (i2c_buses[i].i2c_def != 0);
+		if(i2c_buses[i].i2c_def) {
+			i2c_isr_clock(&i2c_buses[i]);
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the context of a bus
+ *
+ * @param[in] *i2c
+ *   Pointer to the base peripheral address of an opened i2c peripheral
+ *
+ ******************************************************************************/
+
+static I2C_STATE_MACHINE *i2c_bus(I2C_TypeDef *i2c) {
+	for(int i = 0; i < I2C_BUS_COUNT; i++) {
+		if(i2c_buses[i].i2c_def == i2c) {
+			return &i2c_buses[i];
+		}
+	}
+	EFM_ASSERT(false);	// the bus was not opened
+	return &i2c_buses[0];
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to service the interrupts of a bus
+ *
+ * @details
+ * 	 This routine checks whether there is an interrupt, and whether it is ACK,
+ * 	 NACK, RXDATAV, TXC, MSTOP.  Then calls the function for the specific interrupt
+ * 	 and records how long the interrupt took.  No state waits in the interrupt,
+ * 	 the settle time of a slave is slept through with the bus gated.  The
+ * 	 interrupt is bracketed by sleep_handler_enter and sleep_handler_exit
+ *
+ * @note
+ *   This function is called by the interrupt handler of each peripheral with
+ *   the context of its bus
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_irq(I2C_STATE_MACHINE *i2c_state) {
+	 sleep_handler_enter();
+	 uint32_t start = scheduler_timestamp();
+	 uint32_t int_flag; // store source interrupts
+	 I2C_TypeDef *i2c = i2c_state->i2c_def;
+
+	 //AND the interrupt source (IF), with the interrupt enable register (IEN)
+	 // your interrupt source variable will only contain interrupts of interest
+	 int_flag = i2c->IF & i2c->IEN;
+
+	 //clear interrupt flag register
+	 i2c->IFC = int_flag;
+
+	 if (int_flag & I2C_IF_ACK){
+		 i2c_ack(i2c_state);
+	 }
+	 if (int_flag & I2C_IF_NACK){
+		 i2c_nack(i2c_state);
+	 }
+	 if (int_flag & I2C_IF_RXDATAV){
+		 i2c_rxdatav(i2c_state);
+	 }
+	 if (int_flag & I2C_IF_TXC){
+		 i2c_txc(i2c_state);
+	 }
+	 if (int_flag & I2C_IF_MSTOP){
+	 	 i2c_mstop(i2c_state);
+	 }
+	 i2c_isr_time(i2c_state, start);
+	 sleep_handler_exit();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to continue a transfer after an acknowledged write
+ *
+ * @details
+ * 	 This routine writes the next transfer byte.  Once all are written it
+ * 	 sends a repeated start with the read address if bytes are to be read,
+ * 	 otherwise it stops
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_next(I2C_STATE_MACHINE *i2c_state) {
+	const I2C_TRANSFER *transfer = &i2c_state->transfer;
+	I2C_TypeDef *i2c = i2c_state->i2c_def;
+	uint32_t tx_left = transfer->tx_len - i2c_state->tx_index;
+	if(tx_left >= I2C_DMA_MIN_BYTES) {
+		// the LDMA writes the bytes on TXBL, the ACK of each byte is not taken
+		LDMA_TransferCfg_t cfg = LDMA_TRANSFER_CFG_PERIPHERAL(i2c_state->dma_tx_signal);
+		LDMA_Descriptor_t desc = LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(&transfer->tx[i2c_state->tx_index], &i2c->TXDATA, tx_left);
+		i2c_state->dma_desc[0] = desc;
+		i2c_state->tx_index = transfer->tx_len;
+		i2c_state->state = WriteDma;
+		i2c->IEN &= ~I2C_IF_ACK;
+		i2c->IFC = I2C_IF_TXC;
+		i2c->IEN |= I2C_IF_TXC;
+		ldma_start(i2c_state->dma_channel, &cfg, i2c_state->dma_desc, i2c_dma_done);
+	}
+	else if(i2c_state->tx_index < transfer->tx_len) {
+		i2c_state->state = WriteCommand;
+		i2c->TXDATA = transfer->tx[i2c_state->tx_index++];
+	}
+	else if(transfer->rx_len) {
+		if(transfer->buffer && (transfer->rx_len >= I2C_DMA_MIN_BYTES + 2)) {
+			// the LDMA reads all but the last two bytes, acknowledged by the peripheral,
+			// then clears the automatic ACK before the next byte ends.  The interrupt
+			// state machine reads the last two to NACK the last one
+			LDMA_TransferCfg_t cfg = LDMA_TRANSFER_CFG_PERIPHERAL(i2c_state->dma_rx_signal);
+			LDMA_Descriptor_t desc = LDMA_DESCRIPTOR_LINKREL_P2M_BYTE(&i2c->RXDATA, transfer->buffer, transfer->rx_len - 2, 1);
+			LDMA_Descriptor_t ack_off = LDMA_DESCRIPTOR_SINGLE_WRITE(i2c->CTRL & ~I2C_CTRL_AUTOACK, &i2c->CTRL);
+			i2c_state->dma_desc[0] = desc;
+			i2c_state->dma_desc[1] = ack_off;
+			i2c_state->dma_read = true;
+			i2c->IEN &= ~I2C_IF_RXDATAV;
+			i2c->CTRL |= I2C_CTRL_AUTOACK;
+			ldma_start(i2c_state->dma_channel, &cfg, i2c_state->dma_desc, i2c_dma_done);
+		}
+		i2c_state->state = WaitRead;
+		i2c->CMD = I2C_CMD_START;
+		i2c->TXDATA = (transfer->address << 1) | I2C_READ;
+	}
+	else {
+		i2c_state->state = Stop;
+		i2c->CMD = I2C_CMD_STOP;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to begin a transfer on an ungated bus
+ *
+ * @details
+ * 	 This routine copies the transfer into the context of the bus and starts
+ * 	 it by sending the slave address, with the read bit for a read only
+ *
+ * @note
+ *   This function is called by i2c_start for a bus that was idle and by
+ *   i2c_dequeue for the next queued transfer
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ * @param[in] *transfer
+ *   Is the transfer to run
+ *
+ ******************************************************************************/
+
+static void i2c_begin(I2C_STATE_MACHINE *i2c_state, const I2C_TRANSFER *transfer) {
+	I2C_TypeDef *i2c = i2c_state->i2c_def;
+	if(i2c_state->bus_stale) {
+		i2c->CMD = I2C_CMD_ABORT;	// the pins were disabled, the bus may be seen as busy
+		i2c_state->bus_stale = false;
+	}
+	// triggers if i2c peripheral has not finished pervious i2c operation
+	EFM_ASSERT((i2c->STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE); // X = the I2C peripheral #
+
+	i2c_state->transfer = *transfer;
+	i2c_state->tx_index = 0;
+	i2c_state->rx_index = 0;
+	i2c_state->value = 0;
+	i2c_state->dma_read = false;
+	i2c_state->status = I2C_DONE;
+	i2c_state->start_tick = sw_timer_now();
+
+	if(transfer->tx_len) {
+		i2c_state->state = StartCommand;
+		i2c->CMD = I2C_CMD_START;
+		i2c->TXDATA = (transfer->address << 1) | I2C_WRITE;
+	}
+	else {
+		i2c_next(i2c_state);	// read only, straight to the read address
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function that handles the TXC interrupt
+ *
+ * @details
+ * 	 The last byte written by the LDMA has been sent and acknowledged, this
+ * 	 routine takes the ACK interrupt back and continues the transfer
+ *
+ * @note
+ *   This function is called when a TXC interrupt is received
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_txc(I2C_STATE_MACHINE *i2c_state) {
+	I2C_TypeDef *i2c = i2c_state->i2c_def;
+	EFM_ASSERT(i2c_state->state == WriteDma);
+	i2c->IEN &= ~I2C_IF_TXC;
+	i2c->IFC = I2C_IF_ACK;
+	i2c->IEN |= I2C_IF_ACK;
+	i2c_next(i2c_state);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to finish the LDMA part of a transfer
+ *
+ * @details
+ * 	 A failed channel stops the transfer with I2C_ERROR.  A write continues
+ * 	 on the TXC interrupt.  After a read all but the last two bytes are in
+ * 	 the buffer and the LDMA has stopped the automatic ACK.  This routine
+ * 	 hands the last two bytes to the RXDATAV interrupt, which ACKs the first
+ * 	 and NACKs the second and stops.  A byte that has already arrived is
+ * 	 taken at once
+ *
+ * @note
+ *   This function is called from the LDMA interrupt handler.  The automatic
+ *   ACK is stopped by the last descriptor of the read, not here: the second
+ *   to last byte must not be acknowledged by the peripheral, and this
+ *   handler can run after it has ended
+ *
+ * @param[in] channel
+ *   Is the ldma_channels entry of the bus
+ *
+ * @param[in] error
+ *   Is true if the LDMA failed
+ *
+ ******************************************************************************/
+
+static void i2c_dma_done(uint32_t channel, bool error) {
+	for(int i = 0; i < I2C_BUS_COUNT; i++) {
+		I2C_STATE_MACHINE *i2c_state = &i2c_buses[i];
+		if(i2c_state->i2c_def && (i2c_state->dma_channel == channel)) {
+			if(error) {
+				i2c_abort(i2c_state, I2C_ERROR);
+				return;
+			}
+			if(!i2c_state->dma_read) {
+				return;
+			}
+			i2c_state->dma_read = false;
+			i2c_state->rx_index = i2c_state->transfer.rx_len - 2;
+			i2c_state->state = EndSensing;
+			i2c_state->i2c_def->IEN |= I2C_IF_RXDATAV;
+			return;
+		}
+	}
+	EFM_ASSERT(false);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to stop a transfer early
+ *
+ * @details
+ * 	 This routine stops the LDMA channel of the bus, takes the interrupts
+ * 	 the LDMA used back, NACKs a byte being read or drops a byte waiting to
+ * 	 be written and stops the bus.  The MSTOP interrupt and i2c_stopped then
+ * 	 complete the transfer with the status, without handing over a value or
+ * 	 waiting out the settle time
+ *
+ * @note
+ *   This function is called from the I2C and LDMA interrupts on a NACK or an
+ *   LDMA error
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ * @param[in] status
+ *   Is I2C_NACKED or I2C_ERROR
+ *
+ ******************************************************************************/
+
+static void i2c_abort(I2C_STATE_MACHINE *i2c_state, uint32_t status) {
+	I2C_TypeDef *i2c = i2c_state->i2c_def;
+	bool reading = (i2c_state->state == ReadDma) || (i2c_state->state == EndSensing);
+	ldma_stop(i2c_state->dma_channel);
+	i2c->CTRL &= ~I2C_CTRL_AUTOACK;
+	i2c->IEN &= ~I2C_IF_TXC;
+	i2c->IFC = I2C_IF_ACK;	// the ACKs of the bytes the LDMA wrote are still flagged
+	i2c->IEN |= I2C_IF_ACK | I2C_IF_RXDATAV;
+	i2c_state->dma_read = false;
+	i2c_state->status = status;
+	i2c_state->state = Stop;
+	if(reading) {
+		i2c->CMD = I2C_CMD_NACK;
+	}
+	else {
+		i2c->CMD = I2C_CMD_CLEARTX;
+	}
+	i2c->CMD = I2C_CMD_STOP;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to hold the resources of a bus for its transfers
+ *
+ * @details
+ * 	 This routine locks the core clock, ungates the bus clock, restoring the
+ * 	 bus frequency if the core clock changed while it was gated, and blocks
+ * 	 the energy modes the peripheral does not run in
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_acquire(I2C_STATE_MACHINE *i2c_state) {
+	cmu_clock_lock();	// SCL is divided from HFPERCLK, keep it for the transfer
+	cmu_gate_acquire(i2c_state->gate);
+	if(i2c_state->freq_stale) {
+		I2C_BusFreqSet(i2c_state->i2c_def, 0, i2c_state->freq, i2c_state->clhr);
+		i2c_state->freq_stale = false;
+	}
+	sleep_block_mode(i2c_state->owner, I2C_EM_BLOCK);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to release the resources held by i2c_acquire
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_release(I2C_STATE_MACHINE *i2c_state) {
+	sleep_unblock_mode(i2c_state->owner);
+	cmu_gate_release(i2c_state->gate);
+	cmu_clock_unlock();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to post the completion event of the last transfer
  *
  * @details
- * 	 This routine returns false if i2c is not busy, true if busy
+ * 	 This routine hands the result to the main loop with the completion
+ * 	 event, its payload is the value or the number of bytes read
  *
  * @note
- *   This function is called when needing to wait for i2c0 operation to be done
+ *   This function is only called in thread mode, by i2c_stopped and
+ *   i2c_settled, so the main loop is the single context posting to the
+ *   scheduler queue of the bus
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
  *
  ******************************************************************************/
 
-bool check_busy_0(I2C_TypeDef *i2c) {
-	if (i2c_veml.i2c_def == i2c){
-		return i2c_veml.i2c_busy;
+static void i2c_complete(I2C_STATE_MACHINE *i2c_state) {
+	if(i2c_state->transfer.callback) {
+		scheduler_post(i2c_state->queue, i2c_state->transfer.callback, i2c_state->value);
 	}
-	return true;
 }
 
 /***************************************************************************//**
  * @brief
- *   Function that checks whether I2C1 is busy
+ *   Function to start the oldest queued transfer
+ *
+ * @note
+ *   This function is called with the resources of the bus held, once the
+ *   transfer before it stopped or settled
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_dequeue(I2C_STATE_MACHINE *i2c_state) {
+	EFM_ASSERT(i2c_state->depth);
+	I2C_QUEUED *queued = &i2c_state->pending[i2c_state->head];
+	i2c_state->wait_ticks += sw_timer_now() - queued->queued_tick;
+	i2c_begin(i2c_state, &queued->transfer);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	i2c_state->head = (i2c_state->head + 1) % I2C_QUEUE_DEPTH;
+	i2c_state->depth--;
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to record the time of an interrupt
  *
  * @details
- * 	 This routine returns false if i2c is not busy, true if busy
+ * 	 This routine keeps the longest interrupt of the bus in cycles of the
+ * 	 current core clock and counts those over I2C_ISR_BUDGET_NS, compared in
+ * 	 cycles so the interrupt does not divide
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ * @param[in] start
+ *   Is the scheduler_timestamp() at the start of the interrupt
+ *
+ ******************************************************************************/
+
+static void i2c_isr_time(I2C_STATE_MACHINE *i2c_state, uint32_t start) {
+	uint32_t cycles = scheduler_timestamp() - start;
+	if(cycles > i2c_state->isr_max_cycles) {
+		i2c_state->isr_max_cycles = cycles;
+	}
+	if(cycles > i2c_state->isr_budget_cycles) {
+		i2c_state->isr_overruns++;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to move the interrupt times of a bus to the current core clock
+ *
+ * @details
+ * 	 This routine (atomic) folds the longest interrupt counted at the old
+ * 	 clock into the nanosecond maximum, restarts the cycle maximum and
+ * 	 converts I2C_ISR_BUDGET_NS to cycles of the current clock
  *
  * @note
- *   This function is called when needing to wait for i2c1 operation to be done
+ *   This function is called by i2c_open and, on a change of the core clock,
+ *   by i2c_clock_changed
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ ******************************************************************************/
+
+static void i2c_isr_clock(I2C_STATE_MACHINE *i2c_state) {
+	uint32_t mhz = SystemCoreClock / 1000000;
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	i2c_state->isr_max_ns = i2c_isr_max_ns(i2c_state);
+	i2c_state->isr_max_cycles = 0;
+	i2c_state->isr_mhz = mhz ? mhz : 1;
+	i2c_state->isr_budget_cycles = (uint32_t)(((uint64_t)I2C_ISR_BUDGET_NS * i2c_state->isr_mhz) / 1000);
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the longest interrupt of a bus
+ *
+ * @param[in] *i2c_state
+ *   Is the context of the bus
+ *
+ * @return
+ *   Returns the longest interrupt at any core clock in nanoseconds
  *
  ******************************************************************************/
 
-bool check_busy_1(I2C_TypeDef *i2c) {
-	if (i2c_si7021.i2c_def == i2c){
-		return i2c_si7021.i2c_busy;
+static uint32_t i2c_isr_max_ns(const I2C_STATE_MACHINE *i2c_state) {
+	if(!i2c_state->isr_mhz) {
+		return i2c_state->isr_max_ns;
 	}
-	return true;
+	uint32_t ns = (uint32_t)(((uint64_t)i2c_state->isr_max_cycles * 1000) / i2c_state->isr_mhz);
+	return (ns > i2c_state->isr_max_ns) ? ns : i2c_state->isr_max_ns;
 }
@@ -0,0 +1,170 @@
+/**
+ * @file ldma.c
+ * @author Gerritt Luoma
+ * @date May 12th, 2021
+ * @brief Shares the LDMA channels between the drivers
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "ldma.h"
+#include "sleep_routines.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+static bool			channel_active[LDMA_CHANNEL_COUNT];	// the channel holds the LDMA clock
+static LDMA_DONE	channel_done[LDMA_CHANNEL_COUNT];	// completion of the transfer of each channel, or 0
+static bool			ldma_opened;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Initializes the LDMA
+ *
+ * @details
+ *	The LDMA clock is on for the initialization, then gated until a channel
+ *	starts.  The registers keep their values while the clock is off
+ *
+ * @note
+ *	Called by the first driver that opens with DMA, later calls do nothing
+ *
+ ******************************************************************************/
+
+void ldma_open(void) {
+	if(ldma_opened) {
+		return;
+	}
+	for(int i = 0; i < LDMA_CHANNEL_COUNT; i++) {
+		channel_active[i] = false;
+		channel_done[i] = 0;
+	}
+	LDMA_Init_t ldma_init = LDMA_INIT_DEFAULT;
+	cmu_gate_acquire(CMU_GATE_LDMA);
+	LDMA_Init(&ldma_init);	// also enables the LDMA interrupt
+	cmu_gate_release(CMU_GATE_LDMA);
+	ldma_opened = true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts the transfer of a channel
+ *
+ * @details
+ *	Holds the LDMA clock until the channel is done or failed, then calls
+ *	done, if any, from the LDMA interrupt
+ *
+ * @note
+ *	Called by a driver from thread or interrupt context, the descriptors must
+ *	stay valid until the channel is done
+ *
+ * @param[in] channel
+ *	Is the ldma_channels entry of the driver
+ *
+ * @param[in] cfg
+ *	Is the peripheral request the channel follows
+ *
+ * @param[in] desc
+ *	Is the transfer, the first of a list of linked descriptors
+ *
+ * @param[in] done
+ *	Is called when the channel is done or failed, or 0
+ *
+ ******************************************************************************/
+
+void ldma_start(uint32_t channel, const LDMA_TransferCfg_t *cfg, const LDMA_Descriptor_t *desc, LDMA_DONE done) {
+	EFM_ASSERT(ldma_opened);
+	EFM_ASSERT(channel < LDMA_CHANNEL_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	// triggers if the channel is still moving the data of the last transfer
+	EFM_ASSERT(!channel_active[channel]);
+	channel_active[channel] = true;
+	channel_done[channel] = done;
+	cmu_gate_acquire(CMU_GATE_LDMA);
+	LDMA_StartTransfer(channel, cfg, desc);
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Stops the transfer of a channel before it is done
+ *
+ * @details
+ *	The channel is released without calling its done function
+ *
+ * @note
+ *	Called by a driver abandoning a transfer, such as on a NACK
+ *
+ * @param[in] channel
+ *	Is the ldma_channels entry of the driver
+ *
+ ******************************************************************************/
+
+void ldma_stop(uint32_t channel) {
+	EFM_ASSERT(channel < LDMA_CHANNEL_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(channel_active[channel]) {
+		LDMA_StopTransfer(channel);
+		LDMA->IFC = 1 << channel;
+		channel_active[channel] = false;
+		cmu_gate_release(CMU_GATE_LDMA);
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	LDMA interrupt handler
+ *
+ * @details
+ *	Releases the LDMA clock of each channel that is done and calls its done
+ *	function, if any.  On a bus error of the LDMA every active channel is
+ *	stopped and reports the error to its done function, so the drivers end
+ *	their transfers with an error result instead of waiting for them.  The
+ *	wake is accounted by sleep_handler_enter and sleep_handler_exit
+ *
+ * @note
+ *	Replaces the emlib handler, which is only built with
+ *	LDMA_IRQ_HANDLER_TEMPLATE
+ *
+ ******************************************************************************/
+
+void LDMA_IRQHandler(void) {
+	sleep_handler_enter();
+	uint32_t int_flag = LDMA->IF & LDMA->IEN;
+	bool error = (int_flag & LDMA_IF_ERROR) != 0;
+	LDMA->IFC = int_flag;
+
+	for(uint32_t channel = 0; channel < LDMA_CHANNEL_COUNT; channel++) {
+		if((error || (int_flag & (1 << channel))) && channel_active[channel]) {
+			if(error) {
+				LDMA_StopTransfer(channel);
+				LDMA->IFC = 1 << channel;
+			}
+			channel_active[channel] = false;
+			cmu_gate_release(CMU_GATE_LDMA);
+			if(channel_done[channel]) {
+				channel_done[channel](channel, error);
+			}
+		}
+	}
+	sleep_handler_exit();
+}
@@ -31,10 +31,18 @@ static uint32_t scheduled_comp0_cb;
 static uint32_t scheduled_comp1_cb;
 static uint32_t scheduled_uf_cb;
 
+// Underflows counted by LETIMER0_IRQHandler extend the counter into a 32 bit
+// tick count, letimer_top is the count loaded on each underflow
+static volatile uint32_t letimer_epoch;
+static uint32_t letimer_top;
+static bool letimer_free_run;
+
 //***********************************************************************************
 // Private functions
 //***********************************************************************************
 
+static uint32_t letimer_cnt_read(LETIMER_TypeDef *letimer);
+
 
 //***********************************************************************************
 // Global functions
@@ -70,6 +78,8 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 	scheduled_comp0_cb = app_letimer_struct->comp0_cb;
 	scheduled_comp1_cb = app_letimer_struct->comp1_cb;
 	scheduled_uf_cb = app_letimer_struct->uf_cb;
+	letimer_epoch = 0;
+	letimer_free_run = false;
 
 	unsigned int period_cnt;
 	unsigned int period_active_cnt;
@@ -137,6 +147,7 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 	period_active_cnt = app_letimer_struct->active_period * LETIMER_HZ;
 	letimer->COMP0 = period_cnt;
 	letimer->COMP1 = period_active_cnt;
+	letimer_top = period_cnt;
 
 
 
@@ -178,7 +189,7 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 
 
 	if((LETIMER_STATUS_RUNNING & letimer->STATUS)) {
-		sleep_block_mode(LETIMER_EM);
+		sleep_block_mode(SLEEP_OWNER_LETIMER0, LETIMER_EM);
 	}
 }
 
@@ -202,12 +213,12 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 
 void letimer_start(LETIMER_TypeDef *letimer, bool enable){
 	if(!(LETIMER_STATUS_RUNNING & letimer->STATUS) & enable) {
-		sleep_block_mode(LETIMER_EM);
+		sleep_block_mode(SLEEP_OWNER_LETIMER0, LETIMER_EM);
 		LETIMER_Enable(letimer, enable);
 		while(letimer->SYNCBUSY);
 	}
 	else if((LETIMER_STATUS_RUNNING & letimer->STATUS) & !enable) {
-		sleep_unblock_mode(LETIMER_EM);
+		sleep_unblock_mode(SLEEP_OWNER_LETIMER0);
 		LETIMER_Enable(letimer, enable);
 		while(letimer->SYNCBUSY);
 	}
@@ -219,7 +230,8 @@ void letimer_start(LETIMER_TypeDef *letimer, bool enable){
  *
  * @details
  * 	 This routine checks whether there is an interrupt, and whether it is a COMP0, COMP1, UF
- * 	 Then adds the corresponding interrupt as a scheduled event
+ * 	 Then adds the corresponding interrupt as a scheduled event.  The wake is
+ * 	 accounted by sleep_handler_enter and sleep_handler_exit
  *
  * @note
  *   This function is called to any time there is an interrupt of any type
@@ -228,6 +240,7 @@ void letimer_start(LETIMER_TypeDef *letimer, bool enable){
 
 void LETIMER0_IRQHandler(void){
 	 uint32_t int_flag; // store source interrupts
+	 sleep_handler_enter();
 
 	 //AND the interrupt source (IF), with the interrupt enable register (IEN)
 	 // your interrupt source variable will only contain interrupts of interest
@@ -245,9 +258,201 @@ void LETIMER0_IRQHandler(void){
 		 EFM_ASSERT(!(LETIMER0->IF & LETIMER_IF_COMP1));
 	 }
 	 if (int_flag & LETIMER_IF_UF){
+		 letimer_epoch++;
 		 add_scheduled_event(scheduled_uf_cb);
 		 EFM_ASSERT(!(LETIMER0->IF & LETIMER_IF_UF));
 	 }
+	 sleep_handler_exit();
+}
+
+
+/***************************************************************************//**
+ * @brief
+ *   Driver to open an LETIMER peripheral as a free running timebase
+ *
+ * @details
+ * 	 This routine configures the LETIMER to count down through its full range
+ * 	 without reloading COMP0, so COMP0 is free to be used as a one shot
+ * 	 compare by letimer_compare_set().  The underflow interrupt is always
+ * 	 enabled to extend the counter into the tick count of letimer_now()
+ *
+ * @note
+ *   This function is called once instead of letimer_pwm_open() and
+ *   letimer_start() is called to start counting
+ *
+ * @param[in] letimer
+ *   Pointer to the base peripheral address of the LETIMER peripheral being opened
+ *
+ * @param[in] app_letimer_struct
+ *   Is the STRUCT that the calling routine will use to set the timebase events
+ *
+ ******************************************************************************/
+void letimer_timebase_open(LETIMER_TypeDef *letimer, APP_LETIMER_TIMEBASE_TypeDef *app_letimer_struct){
+	LETIMER_Init_TypeDef letimer_values;
+
+	scheduled_comp0_cb = app_letimer_struct->comp0_cb;
+	scheduled_comp1_cb = 0;
+	scheduled_uf_cb = app_letimer_struct->uf_cb;
+	letimer_epoch = 0;
+	letimer_top = LETIMER_TOP;
+	letimer_free_run = true;
+
+	if(letimer == LETIMER0) {
+		CMU_ClockEnable(cmuClock_LETIMER0, true);
+	}
+	else {
+		// We should never get here since the LETIMER0 is the only LETIMER peripheral being used
+		EFM_ASSERT(false);
+	}
+
+	// Stop the LETIMER before configuring it
+	letimer_start(letimer, false);
+
+	// Verify the LETIMER clock tree as in letimer_pwm_open()
+	letimer->CMD = LETIMER_CMD_START;
+	while (letimer->SYNCBUSY);
+	EFM_ASSERT(letimer->STATUS & LETIMER_STATUS_RUNNING);
+	letimer->CMD = LETIMER_CMD_STOP;
+	while(letimer->SYNCBUSY);
+	letimer->CNT = 0;
+
+	letimer_values.bufTop = false;
+	letimer_values.comp0Top = false;		// wrap through the full counter range, COMP0 is a compare
+	letimer_values.debugRun = app_letimer_struct->debugRun;
+	letimer_values.enable = false;
+	letimer_values.out0Pol = 0;
+	letimer_values.out1Pol = 0;
+	letimer_values.repMode = _LETIMER_CTRL_REPMODE_FREE;
+	letimer_values.ufoa0 = _LETIMER_CTRL_UFOA0_NONE;		// no outputs are driven by the timebase
+	letimer_values.ufoa1 = _LETIMER_CTRL_UFOA1_NONE;
+
+	LETIMER_Init(letimer, &letimer_values);
+	while(letimer->SYNCBUSY);
+
+	// COMP0 is only enabled once a deadline is set, the underflow keeps time
+	letimer->IFC = LETIMER_IF_COMP0 | LETIMER_IF_COMP1 | LETIMER_IF_UF;
+	letimer->IEN = LETIMER_IEN_UF;
+	NVIC_EnableIRQ(LETIMER0_IRQn);
+
+	if(app_letimer_struct->enable) {
+		letimer_start(letimer, true);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the LETIMER tick count
+ *
+ * @details
+ * 	 This routine combines the number of underflows with the down counter
+ * 	 into a monotonic count of LETIMER_HZ ticks since the LETIMER was opened.
+ * 	 An underflow that has not yet been serviced by LETIMER0_IRQHandler is
+ * 	 accounted for from the pending UF flag
+ *
+ * @note
+ *   This function may be called with interrupts enabled or disabled
+ *
+ * @param[in] letimer
+ *   Pointer to the base peripheral address of the LETIMER peripheral
+ *
+ * @return
+ *   Returns the tick count, wrapping at 2^32 ticks
+ *
+ ******************************************************************************/
+uint32_t letimer_now(LETIMER_TypeDef *letimer){
+	uint32_t epoch;
+	uint32_t cnt;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	epoch = letimer_epoch;
+	cnt = letimer_cnt_read(letimer);
+	if((letimer->IF & LETIMER_IF_UF) && (cnt > letimer_top / 2)) {
+		epoch++;	// the count was read after an underflow the ISR has not counted yet
+	}
+	CORE_EXIT_CRITICAL();
 
+	return (uint32_t)((uint64_t)epoch * (letimer_top + 1) + (letimer_top - cnt));
 }
 
+/***************************************************************************//**
+ * @brief
+ *   Function to arm the COMP0 deadline of a free running LETIMER
+ *
+ * @details
+ * 	 This routine programs COMP0 to match delay ticks from now.  If the
+ * 	 counter underflows before the deadline, COMP0 is disabled instead and the
+ * 	 caller re-arms it from the underflow event
+ *
+ * @note
+ *   The LETIMER must have been opened with letimer_timebase_open()
+ *
+ * @param[in] letimer
+ *   Pointer to the base peripheral address of the LETIMER peripheral
+ *
+ * @param[in] delay
+ *   Is the number of ticks from now to the deadline
+ *
+ * @return
+ *   Returns true if COMP0 was armed, false if the underflow comes first
+ *
+ ******************************************************************************/
+bool letimer_compare_set(LETIMER_TypeDef *letimer, uint32_t delay){
+	bool armed;
+	EFM_ASSERT(letimer_free_run);
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	uint32_t cnt = letimer_cnt_read(letimer);
+	if(delay <= cnt) {
+		letimer->COMP0 = cnt - delay;
+		letimer->IFC = LETIMER_IF_COMP0;
+		letimer->IEN |= LETIMER_IEN_COMP0;
+		armed = true;
+	}
+	else {
+		letimer->IEN &= ~LETIMER_IEN_COMP0;
+		armed = false;
+	}
+	CORE_EXIT_CRITICAL();
+	return armed;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to disarm the COMP0 deadline of a free running LETIMER
+ *
+ * @details
+ * 	 This routine disables and clears the COMP0 interrupt
+ *
+ * @note
+ *   This function is called when no deadline is pending
+ *
+ * @param[in] letimer
+ *   Pointer to the base peripheral address of the LETIMER peripheral
+ *
+ ******************************************************************************/
+void letimer_compare_disable(LETIMER_TypeDef *letimer){
+	letimer->IEN &= ~LETIMER_IEN_COMP0;
+	letimer->IFC = LETIMER_IF_COMP0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the LETIMER counter
+ *
+ * @details
+ * 	 This routine reads CNT until two reads agree since the counter is
+ * 	 clocked from the low frequency domain
+ *
+ * @param[in] letimer
+ *   Pointer to the base peripheral address of the LETIMER peripheral
+ *
+ ******************************************************************************/
+static uint32_t letimer_cnt_read(LETIMER_TypeDef *letimer){
+	uint32_t cnt;
+	do {
+		cnt = letimer->CNT;
+	} while(cnt != letimer->CNT);
+	return cnt;
+}
@@ -34,6 +34,7 @@ uint32_t	tx_done_evt;
 bool		leuart0_tx_busy;
 
 static LEUART_STATE_MACHINE 	 leuart_state;
+static uint32_t				 leuart_tx_bytes;
 
 /***************************************************************************//**
  * @brief LEUART driver
@@ -79,9 +80,9 @@ static void leuart_txc(LEUART_STATE_MACHINE *leuart_state);
  ******************************************************************************/
 
 void leuart_open(LEUART_TypeDef *leuart, LEUART_OPEN_STRUCT *leuart_settings){
-	// Enable the clock for the selected LEUART
+	// Enable the clock for the selected LEUART, it is gated again unless the receiver listens
 	if(leuart == LEUART0) {
-		CMU_ClockEnable(cmuClock_LEUART0, true);
+		cmu_gate_acquire(CMU_GATE_LEUART0);
 	}
 	else {
 		// We are only using LEUART0
@@ -133,6 +134,18 @@ void leuart_open(LEUART_TypeDef *leuart, LEUART_OPEN_STRUCT *leuart_settings){
 	// clear TXBL interrupts
 	LEUART0->IFC = LEUART_IF_TXBL;
 
+	// Post every received byte to the scheduler with the rx done event
+	rx_done_evt = leuart_settings->rx_done_evt;
+	tx_done_evt = leuart_settings->tx_done_evt;
+	if(rx_done_evt) {
+		leuart->IEN |= LEUART_IEN_RXDATAV;
+		sleep_block_mode(SLEEP_OWNER_LEUART0_RX, LEUART_RX_EM);
+	}
+	else {
+		// nothing to receive, the clock is only needed by leuart_start
+		cmu_gate_release(CMU_GATE_LEUART0);
+	}
+
 
 	NVIC_EnableIRQ(LEUART0_IRQn);
 
@@ -143,8 +156,11 @@ void leuart_open(LEUART_TypeDef *leuart, LEUART_OPEN_STRUCT *leuart_settings){
  *   Function to handle interrupts for LEUART0
  *
  * @details
- * 	 This routine checks whether there is an interrupt, and whether it is TXBL or TXC
- * 	 Then calls the function for the specific interrupt
+ * 	 This routine checks whether there is an interrupt, and whether it is TXBL, TXC or RXDATAV
+ * 	 Then calls the function for the specific interrupt, a received byte is
+ * 	 posted to the scheduler as the payload of the rx done event.  Each byte
+ * 	 sent wakes the core, the wake is accounted by sleep_handler_enter and
+ * 	 sleep_handler_exit
  *
  * @note
  *   This function is called to any time there is an interrupt of any type
@@ -153,6 +169,7 @@ void leuart_open(LEUART_TypeDef *leuart, LEUART_OPEN_STRUCT *leuart_settings){
 
 void LEUART0_IRQHandler(void){
 	 uint32_t int_flag; // store source interrupts
+	 sleep_handler_enter();
 
 	 //AND the interrupt source (IF), with the interrupt enable register (IEN)
 	 // your interrupt source variable will only contain interrupts of interest
@@ -167,6 +184,10 @@ void LEUART0_IRQHandler(void){
 	 if (int_flag & LEUART_IF_TXC){
 		 leuart_txc(&leuart_state);
 	 }
+	 if (int_flag & LEUART_IF_RXDATAV){
+		 scheduler_post(SCHEDULER_QUEUE_LEUART0, rx_done_evt, LEUART0->RXDATA);
+	 }
+	 sleep_handler_exit();
 }
 
 /***************************************************************************//**
@@ -195,6 +216,7 @@ static void leuart_txbl(LEUART_STATE_MACHINE *leuart_state) {
 			//increment count
 			leuart_app_transmit_byte(LEUART0, leuart_state->string[leuart_state->count]);
 			leuart_state->count++;
+			leuart_tx_bytes++;
 			if (leuart_state->count == leuart_state->length){
 				LEUART0->IEN &= ~LEUART_IF_TXBL;
 				//enable txc
@@ -241,10 +263,11 @@ static void leuart_txc(LEUART_STATE_MACHINE *leuart_state) {
 		case EndTransfer: {
 			//unblock sleep mode
 			//set done event
-			sleep_unblock_mode(LEUART_TX_EM);
-			add_scheduled_event(leuart_state->callback);
+			sleep_unblock_mode(SLEEP_OWNER_LEUART0_TX);
+			scheduler_post(SCHEDULER_QUEUE_LEUART0, leuart_state->callback, leuart_state->length);
 			leuart_state->state = EnableTransfer;
 			LEUART0->IEN &= ~LEUART_IF_TXC;
+			cmu_gate_release(CMU_GATE_LEUART0);	// last register access of the transfer
 			leuart_state->tx_busy = false;
 			break;
 		}
@@ -278,14 +301,15 @@ static void leuart_txc(LEUART_STATE_MACHINE *leuart_state) {
 
 void leuart_start(LEUART_TypeDef *leuart, char *string, uint32_t string_len){
 	// triggers if i2c peripheral has not finished pervious i2c operation
-	sleep_block_mode(LEUART_TX_EM);
+	sleep_block_mode(SLEEP_OWNER_LEUART0_TX, LEUART_TX_EM);
+	cmu_gate_acquire(CMU_GATE_LEUART0);	// the registers kept their values while gated
 
 	leuart_state.count = 0;
 	leuart_state.length = string_len;
 	strcpy(leuart_state.string, string);
 	leuart_state.leuart = leuart;
 	leuart_state.state = EnableTransfer;
-	leuart_state.callback = BLE_TX_DONE_CB;
+	leuart_state.callback = tx_done_evt;
 	leuart_state.tx_busy = true;
 
 	LEUART0->IEN |= LEUART_IF_TXBL;
@@ -293,7 +317,17 @@ void leuart_start(LEUART_TypeDef *leuart, char *string, uint32_t string_len){
 
 /***************************************************************************//**
  * @brief
- *   Not used
+ *   Function to check whether a LEUART transmission is in progress
+ *
+ * @details
+ * 	 This routine returns true from leuart_start until the TXC interrupt of
+ * 	 the last character
+ *
+ * @note
+ *   This function is called by ble_write to queue strings behind a transfer
+ *
+ * @param[in] *leuart
+ *   Pointer to the base peripheral address of the leuart peripheral
  *
  ******************************************************************************/
 
@@ -301,6 +335,19 @@ bool leuart_tx_busy(LEUART_TypeDef *leuart){
 	return leuart_state.tx_busy;
 }
 
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of bytes transmitted
+ *
+ * @note
+ *   This function is called by the application performance report
+ *
+ ******************************************************************************/
+
+uint32_t leuart_bytes_sent(void){
+	return leuart_tx_bytes;
+}
+
 /***************************************************************************//**
  * @brief
  *   LEUART STATUS function returns the STATUS of the peripheral for the
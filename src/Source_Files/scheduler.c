@@ -10,17 +10,95 @@
 // Include files
 //***********************************************************************************
 
+#include <stdio.h>
+#include <string.h>
+
 #include "scheduler.h"
+#include "sleep_routines.h"
 #include "em_assert.h"
 #include "em_core.h"
 #include "em_emu.h"
 
+#ifndef DWT
+#include <time.h>	// host builds timestamp with clock()
+#endif
+
 //***********************************************************************************
 // Private variables
 //***********************************************************************************
 
 static unsigned int event_scheduled;
 
+// Constant event table of the application.  dispatch_pending mirrors
+// event_scheduled in priority order: bit n is set while the event at priority
+// n is pending, so the highest priority pending event is found with a single
+// count-leading-zeros and its handler with one table lookup
+static const SCHEDULER_TABLE *event_table;
+static uint32_t dispatch_pending;
+
+// Pending count, high-water mark and overruns of each add_scheduled_event()
+// event, by event bit
+static SCHEDULER_EVENT_STATS event_stats[SCHEDULER_MAX_EVENTS];
+
+// Records posted by the interrupt handlers and the main loop.  Each queue has
+// exactly one producer (its ISR, or the main loop for the I2C queues) and one
+// consumer (the main loop) so posting needs no critical section, only a
+// barrier before the tail is published
+static SCHEDULER_QUEUE event_queue[SCHEDULER_QUEUE_COUNT];
+static const SCHEDULER_RECORD *current_record;
+
+#ifdef SCHEDULER_EDF
+// Relative deadline of each event in scheduler_timestamp() units, 0 for none,
+// the absolute deadline of each pending add_scheduled_event() event, and the
+// dispatches that started after their deadline, all by event bit.  The
+// priorities whose event has a deadline are the only ones EDF compares
+static uint32_t deadline_ticks[SCHEDULER_MAX_EVENTS];
+static uint32_t deadline_at[SCHEDULER_MAX_EVENTS];
+static uint32_t deadline_misses[SCHEDULER_MAX_EVENTS];
+static uint32_t deadline_priorities;
+#endif
+
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+// Events serviced in the interrupt that posted them
+static uint32_t handler_dispatches;
+#endif
+
+#ifdef SCHEDULER_INSTRUMENTATION
+// Post time of each pending add_scheduled_event() event, by event bit, the
+// start of the dispatch in progress, the histograms of each registered event,
+// by priority, and the nanoseconds per timestamp unit in 16.16 fixed point
+static uint32_t post_time[SCHEDULER_MAX_EVENTS];
+static uint32_t dispatch_start;
+static uint32_t latency_hist[SCHEDULER_MAX_PRIORITY + 1][SCHEDULER_HIST_BUCKETS];
+static uint32_t service_hist[SCHEDULER_MAX_PRIORITY + 1][SCHEDULER_HIST_BUCKETS];
+static uint32_t hist_ns_scale;
+#endif
+
+// Core clock in MHz the stored timestamps are counted at.  A change of the
+// core clock rescales them, so differences of timestamps never mix clocks
+static uint32_t stamp_mhz;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static uint32_t scheduler_priority_mask(uint32_t event);
+static uint32_t scheduler_queued_events(void);
+static SCHEDULER_QUEUE *scheduler_queue_head(uint32_t event);
+static void scheduler_overrun(uint32_t bit);
+static void scheduler_clock_convert(void);
+static uint32_t scheduler_rescale(uint32_t stamp, uint32_t now, uint32_t mhz);
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+static bool scheduler_dispatch_handler(uint32_t event, const SCHEDULER_RECORD *record);
+#endif
+#ifdef SCHEDULER_EDF
+static uint32_t scheduler_edf_select(uint32_t pending, uint32_t now);
+static void scheduler_deadline_convert(void);
+#endif
+#ifdef SCHEDULER_INSTRUMENTATION
+static void scheduler_histogram_add(uint32_t *histogram, uint32_t time);
+#endif
+
 //***********************************************************************************
 // Functions
 //***********************************************************************************
@@ -31,17 +109,56 @@ static unsigned int event_scheduled;
  *
  * @details
  * 	 This routine (atomic) opens the scheduler by setting no events scheduled
+ * 	 and installing the constant table of the events, their handlers,
+ * 	 priorities, deadlines and overrun policies
  *
  * @note
  *   This function is called once in the beginning, in app_peripheral_setup
  *
+ * @param[in] table
+ *   Is the event table, built at compile time from the application event list
+ *
  ******************************************************************************/
 
-void scheduler_open(void) {
+void scheduler_open(const SCHEDULER_TABLE *table) {
+	EFM_ASSERT(table);
 	CORE_DECLARE_IRQ_STATE;
 	CORE_ENTER_CRITICAL();
+	event_table = table;
 	event_scheduled = 0;
+	dispatch_pending = 0;
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+		event_stats[i].pending = 0;
+		event_stats[i].high_water = 0;
+		event_stats[i].overruns = 0;
+	}
+	for(int i = 0; i < SCHEDULER_QUEUE_COUNT; i++) {
+		event_queue[i].head = 0;
+		event_queue[i].tail = 0;
+		event_queue[i].dropped = 0;
+	}
+	current_record = 0;
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+	handler_dispatches = 0;
+#endif
+#ifdef SCHEDULER_EDF
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+		deadline_misses[i] = 0;
+	}
+#endif
+
+#ifdef DWT
+	// Enable the DWT cycle counter used to timestamp posted records
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	stamp_mhz = 0;
+	scheduler_clock_convert();
 	CORE_EXIT_CRITICAL();
+#ifdef SCHEDULER_INSTRUMENTATION
+	scheduler_histogram_clear();
+#endif
 }
 
 /***************************************************************************//**
@@ -49,7 +166,11 @@ void scheduler_open(void) {
  *   Function to add a scheduled event
  *
  * @details
- * 	 This routine (atomic) adds the parameter event to event_scheduled
+ * 	 This routine (atomic) adds the parameter event to event_scheduled.  An
+ * 	 event that is already pending is an overrun, it is counted and handled
+ * 	 by the overrun policy of the event.  With SCHEDULER_SLEEP_ON_EXIT a
+ * 	 handler mode event posted from an interrupt is serviced at once instead,
+ * 	 any other event wakes the main loop
  *
  * @note
  *   This function is called when a new interrupt of any type is raised
@@ -60,9 +181,38 @@ void scheduler_open(void) {
  ******************************************************************************/
 
 void add_scheduled_event(uint32_t event) {
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+	if(scheduler_dispatch_handler(event, 0)) {
+		return;
+	}
+	SCB->SCR &= ~SCB_SCR_SLEEPONEXIT_Msk;	// return to the main loop from the interrupt
+#endif
 	CORE_DECLARE_IRQ_STATE;
 	CORE_ENTER_CRITICAL();
+	uint32_t mask = scheduler_priority_mask(event);
+	EFM_ASSERT(mask);	// the event must be in the event table
+#if defined(SCHEDULER_INSTRUMENTATION) || defined(SCHEDULER_EDF)
+	uint32_t now = scheduler_timestamp();
+#endif
+	for(uint32_t posted = event; posted; posted &= posted - 1) {
+		uint32_t bit = 31 - __CLZ(posted & -posted);
+		if(event_scheduled & (1u << bit)) {
+			scheduler_overrun(bit);
+			continue;
+		}
+		event_stats[bit].pending = 1;
+		if(!event_stats[bit].high_water) {
+			event_stats[bit].high_water = 1;
+		}
+#ifdef SCHEDULER_INSTRUMENTATION
+		post_time[bit] = now;
+#endif
+#ifdef SCHEDULER_EDF
+		deadline_at[bit] = now + deadline_ticks[bit];
+#endif
+	}
 	event_scheduled |= event;
+	dispatch_pending |= mask;
 	CORE_EXIT_CRITICAL();
 }
 
@@ -71,7 +221,9 @@ void add_scheduled_event(uint32_t event) {
  *   Function to remove a scheduled event
  *
  * @details
- * 	 This routine (atomic) removes the parameter event from event_scheduled
+ * 	 This routine (atomic) removes the parameter event from event_scheduled.
+ * 	 An event with SCHEDULER_OVERRUN_QUEUE posts still waiting stays
+ * 	 scheduled with one post less, keeping the post time of the first
  *
  * @note
  *   This function is called when an interrupt of any type is done being handled
@@ -84,7 +236,18 @@ void add_scheduled_event(uint32_t event) {
 void remove_scheduled_event(uint32_t event) {
 	CORE_DECLARE_IRQ_STATE;
 	CORE_ENTER_CRITICAL();
+	for(uint32_t removed = event & event_scheduled; removed; removed &= removed - 1) {
+		uint32_t bit = 31 - __CLZ(removed & -removed);
+		if(event_stats[bit].pending > 1) {
+			event_stats[bit].pending--;
+			event &= ~(1u << bit);
+		}
+		else {
+			event_stats[bit].pending = 0;
+		}
+	}
 	event_scheduled &= ~event;
+	dispatch_pending &= ~scheduler_priority_mask(event);
 	CORE_EXIT_CRITICAL();
 }
 
@@ -93,7 +256,8 @@ void remove_scheduled_event(uint32_t event) {
  *   Function to get the currently scheduled events
  *
  * @details
- * 	 This routine returns the currently scheduled events
+ * 	 This routine returns the currently scheduled events, including the events
+ * 	 of the records waiting at the head of the ISR queues
  *
  * @note
  *   This function is called at many times to see if there are any interrupts
@@ -101,5 +265,807 @@ void remove_scheduled_event(uint32_t event) {
  ******************************************************************************/
 
 uint32_t get_scheduled_events(void) {
-	return event_scheduled;
+	return event_scheduled | scheduler_queued_events();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to service the highest priority scheduled event
+ *
+ * @details
+ * 	 This routine finds the highest priority pending event with one count
+ * 	 leading zeros instruction and calls its handler.  The cost does not grow
+ * 	 with the number of registered events.  If the event came from an ISR
+ * 	 queue, its record is available to the handler through
+ * 	 scheduler_current_record() and is released once the handler returns.
+ * 	 With SCHEDULER_EDF the pending event with the earliest deadline is
+ * 	 serviced instead, and a dispatch that starts after the deadline is
+ * 	 counted as a miss
+ *
+ * @note
+ *   This function is called from the main loop after every wake.  The handler
+ *   is responsible for removing its event as it did before
+ *
+ * @return
+ *   Returns true if a handler was called, false if no event was pending
+ *
+ ******************************************************************************/
+
+bool scheduler_dispatch(void) {
+	uint32_t pending = dispatch_pending | scheduler_priority_mask(scheduler_queued_events());
+	if(!pending) {
+		return false;
+	}
+#if defined(SCHEDULER_INSTRUMENTATION) || defined(SCHEDULER_EDF)
+	uint32_t start = scheduler_timestamp();
+#endif
+#ifdef SCHEDULER_EDF
+	uint32_t priority = scheduler_edf_select(pending, start);
+#else
+	uint32_t priority = 31 - __CLZ(pending);
+#endif
+	const SCHEDULER_DISPATCH_ENTRY *entry = &event_table->dispatch[priority];
+	SCHEDULER_QUEUE *queue = scheduler_queue_head(entry->event);
+	const SCHEDULER_RECORD *record = queue ? &queue->records[queue->head & (SCHEDULER_QUEUE_DEPTH - 1)] : 0;
+
+#ifdef SCHEDULER_EDF
+	uint32_t bit = 31 - __CLZ(entry->event);
+	if(deadline_ticks[bit]) {
+		uint32_t deadline = record ? record->timestamp + deadline_ticks[bit] : deadline_at[bit];
+		if((int32_t)(start - deadline) > 0) {
+			deadline_misses[bit]++;
+		}
+	}
+#endif
+
+#ifdef SCHEDULER_INSTRUMENTATION
+	uint32_t posted = record ? record->timestamp : post_time[31 - __CLZ(entry->event)];
+	scheduler_histogram_add(latency_hist[priority], start - posted);
+#endif
+
+#ifdef SCHEDULER_INSTRUMENTATION
+	dispatch_start = start;	// rescaled if the handler changes the core clock
+#endif
+	current_record = record;
+	entry->handler();
+	current_record = 0;
+
+#ifdef SCHEDULER_INSTRUMENTATION
+	scheduler_histogram_add(service_hist[priority], scheduler_timestamp() - dispatch_start);
+#endif
+
+	if(queue) {
+		__DMB();	// finish reading the record before handing its slot back
+		queue->head++;
+	}
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to post an event record from an interrupt handler
+ *
+ * @details
+ * 	 This routine appends an {event, payload, timestamp} record to the queue
+ * 	 owned by the calling context without a critical section.  Unlike
+ * 	 add_scheduled_event, two posts of the same event are both delivered.
+ * 	 With SCHEDULER_SLEEP_ON_EXIT a handler mode event is serviced at once
+ * 	 with the record instead, unless earlier posts of it are still queued
+ *
+ * @note
+ *   Each queue must only be posted to from a single context, one interrupt
+ *   handler or the main loop.  A record posted from the main loop waits for
+ *   the next pass of the main loop, it is never serviced in handler mode
+ *
+ * @param[in] queue
+ *   Is the scheduler_queues entry owned by the caller
+ *
+ * @param[in] event
+ *   Is the event to be dispatched
+ *
+ * @param[in] payload
+ *   Is the data handed to the event handler
+ *
+ * @return
+ *   Returns false if the queue was full and the record was dropped
+ *
+ ******************************************************************************/
+
+bool scheduler_post(uint32_t queue, uint32_t event, uint32_t payload) {
+	EFM_ASSERT(queue < SCHEDULER_QUEUE_COUNT);
+	EFM_ASSERT(scheduler_priority_mask(event));	// the event must be in the event table
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+	SCHEDULER_RECORD handler_record = { event, payload, scheduler_timestamp() };
+	if(scheduler_dispatch_handler(event, &handler_record)) {
+		return true;
+	}
+	SCB->SCR &= ~SCB_SCR_SLEEPONEXIT_Msk;	// return to the main loop from the interrupt
+#endif
+	SCHEDULER_QUEUE *q = &event_queue[queue];
+	uint32_t tail = q->tail;
+
+	if((tail - q->head) >= SCHEDULER_QUEUE_DEPTH) {
+		q->dropped++;
+		return false;
+	}
+	SCHEDULER_RECORD *record = &q->records[tail & (SCHEDULER_QUEUE_DEPTH - 1)];
+	record->event = event;
+	record->payload = payload;
+	record->timestamp = scheduler_timestamp();
+	__DMB();	// record must be visible before the main loop can see the new tail
+	q->tail = tail + 1;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the record of the event being dispatched
+ *
+ * @details
+ * 	 This routine returns the queued record whose handler is currently running
+ *
+ * @note
+ *   This function is called from event handlers to read their payload
+ *
+ * @return
+ *   Returns the record, or 0 if the event was scheduled with add_scheduled_event
+ *
+ ******************************************************************************/
+
+const SCHEDULER_RECORD *scheduler_current_record(void) {
+	return current_record;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of records lost on a queue
+ *
+ * @details
+ * 	 This routine returns how many posts found the queue full
+ *
+ * @note
+ *   This function is called to check whether the main loop keeps up
+ *
+ * @param[in] queue
+ *   Is the scheduler_queues entry to check
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_queue_dropped(uint32_t queue) {
+	EFM_ASSERT(queue < SCHEDULER_QUEUE_COUNT);
+	return event_queue[queue].dropped;
+}
+
+#ifdef SCHEDULER_EDF
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of deadlines an event missed
+ *
+ * @param[in] event
+ *   Is the event bit
+ *
+ * @return
+ *   Returns how many dispatches of the event started after its deadline
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_deadline_misses(uint32_t event) {
+	EFM_ASSERT(event && !(event & (event - 1)));
+	return deadline_misses[31 - __CLZ(event)];
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of deadlines all events missed
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_deadline_misses_total(void) {
+	uint32_t total = 0;
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+		total += deadline_misses[i];
+	}
+	return total;
+}
+#endif
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the overrun statistics of an event
+ *
+ * @details
+ * 	 This routine (atomic) copies the pending count, the high-water mark of
+ * 	 the pending count and the number of overruns of the event
+ *
+ * @note
+ *   This function is called to check whether the main loop keeps up with an
+ *   event
+ *
+ * @param[in] event
+ *   Is the event bit
+ *
+ * @param[out] stats
+ *   Is where the statistics are copied to
+ *
+ ******************************************************************************/
+
+void scheduler_event_stats(uint32_t event, SCHEDULER_EVENT_STATS *stats) {
+	EFM_ASSERT(event && !(event & (event - 1)));		// exactly one event bit
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	*stats = event_stats[31 - __CLZ(event)];
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of overruns of all events
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_overruns_total(void) {
+	uint32_t total = 0;
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+		total += event_stats[i].overruns;
+	}
+	return total;
+}
+
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of events serviced in handler mode
+ *
+ * @details
+ * 	 Each of these posts was serviced without waking the main loop
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_handler_dispatches(void) {
+	return handler_dispatches;
+}
+#endif
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the scheduler timebase
+ *
+ * @details
+ * 	 This routine returns the DWT cycle counter enabled in scheduler_open, or
+ * 	 the C library processor clock when built for a host without a DWT
+ *
+ * @note
+ *   This function is called to timestamp posted records and dispatches.  The
+ *   cycle counter only advances while the core is clocked, so time asleep is
+ *   not included
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_timestamp(void) {
+#ifdef DWT
+	return DWT->CYCCNT;
+#else
+	return (uint32_t)clock();
+#endif
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to follow a change of the core clock
+ *
+ * @details
+ * 	 This routine moves the stored timestamps and the conversions to the new
+ * 	 rate of the cycle counter through scheduler_clock_convert
+ *
+ * @note
+ *   This function is registered with cmu_clock_notify, which calls it with
+ *   interrupts disabled
+ *
+ ******************************************************************************/
+
+void scheduler_clock_changed(void) {
+	scheduler_clock_convert();
+}
+
+#ifdef SCHEDULER_INSTRUMENTATION
+/***************************************************************************//**
+ * @brief
+ *   Function to get the post to dispatch latency histogram of an event
+ *
+ * @param[in] priority
+ *   Is the priority of the event in the event table
+ *
+ * @return
+ *   Returns the SCHEDULER_HIST_BUCKETS counts, bucket b counting latencies
+ *   from 2^(b-1) up to 2^b - 1 ns
+ *
+ ******************************************************************************/
+
+const uint32_t *scheduler_latency_histogram(uint32_t priority) {
+	EFM_ASSERT(priority <= SCHEDULER_MAX_PRIORITY);
+	return latency_hist[priority];
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the handler service time histogram of an event
+ *
+ * @param[in] priority
+ *   Is the priority of the event in the event table
+ *
+ * @return
+ *   Returns the SCHEDULER_HIST_BUCKETS counts, bucket b counting service
+ *   times from 2^(b-1) up to 2^b - 1 ns
+ *
+ ******************************************************************************/
+
+const uint32_t *scheduler_service_histogram(uint32_t priority) {
+	EFM_ASSERT(priority <= SCHEDULER_MAX_PRIORITY);
+	return service_hist[priority];
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to format the histograms as text, one line at a time
+ *
+ * @details
+ * 	 This routine writes the next line of the dump, "<event> lat|svc b:count ...",
+ * 	 listing the non-empty buckets of one histogram.  Histograms too wide for
+ * 	 one line continue on the next.  Events that were never dispatched are
+ * 	 skipped
+ *
+ * @note
+ *   This function is called repeatedly, starting with *cursor = 0, to send
+ *   the dump over BLE a line at a time
+ *
+ * @param[in,out] cursor
+ *   Is the position in the dump, advanced past the line written
+ *
+ * @param[out] str
+ *   Is the buffer the line is written to
+ *
+ * @param[in] size
+ *   Is the size of str
+ *
+ * @return
+ *   Returns false once the dump is complete and nothing was written
+ *
+ ******************************************************************************/
+
+bool scheduler_histogram_line(uint32_t *cursor, char *str, uint32_t size) {
+	// cursor holds the histogram (priority * 2 + service) above the first bucket to print
+	uint32_t histogram = *cursor / SCHEDULER_HIST_BUCKETS;
+	uint32_t bucket = *cursor % SCHEDULER_HIST_BUCKETS;
+
+	for(; histogram < 2 * (SCHEDULER_MAX_PRIORITY + 1); histogram++, bucket = 0) {
+		const SCHEDULER_DISPATCH_ENTRY *entry = &event_table->dispatch[histogram / 2];
+		const uint32_t *counts = (histogram & 1) ? service_hist[histogram / 2] : latency_hist[histogram / 2];
+		while((bucket < SCHEDULER_HIST_BUCKETS) && !counts[bucket]) {
+			bucket++;
+		}
+		if(!entry->handler || (bucket == SCHEDULER_HIST_BUCKETS)) {
+			continue;
+		}
+
+		uint32_t len = snprintf(str, size, "%lx %s", (unsigned long)entry->event, (histogram & 1) ? "svc" : "lat");
+		for(; bucket < SCHEDULER_HIST_BUCKETS; bucket++) {
+			if(!counts[bucket]) {
+				continue;
+			}
+			char item[16];
+			uint32_t item_len = snprintf(item, sizeof(item), " %lu:%lu", (unsigned long)bucket, (unsigned long)counts[bucket]);
+			if(len + item_len + 2 > size) {
+				break;
+			}
+			strcpy(str + len, item);
+			len += item_len;
+		}
+		strcpy(str + len, "\n");
+		*cursor = (bucket < SCHEDULER_HIST_BUCKETS) ? histogram * SCHEDULER_HIST_BUCKETS + bucket : (histogram + 1) * SCHEDULER_HIST_BUCKETS;
+		return true;
+	}
+	*cursor = histogram * SCHEDULER_HIST_BUCKETS;
+	return false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to empty the histograms
+ *
+ * @note
+ *   This function is called from scheduler_open and to start a new measurement
+ *
+ ******************************************************************************/
+
+void scheduler_histogram_clear(void) {
+	for(int i = 0; i <= SCHEDULER_MAX_PRIORITY; i++) {
+		for(int b = 0; b < SCHEDULER_HIST_BUCKETS; b++) {
+			latency_hist[i][b] = 0;
+			service_hist[i][b] = 0;
+		}
+	}
+}
+#endif
+
+/***************************************************************************//**
+ * @brief
+ *   Function to translate event bits to their priority bits
+ *
+ * @details
+ * 	 This routine returns the dispatch_pending bits of every registered event
+ * 	 in the parameter event.  Unregistered events map to no priority bit
+ *
+ * @note
+ *   This function is called with interrupts disabled from add_scheduled_event
+ *   and remove_scheduled_event
+ *
+ * @param[in] event
+ *   Is the event or events to translate
+ *
+ ******************************************************************************/
+
+static uint32_t scheduler_priority_mask(uint32_t event) {
+	uint32_t mask = 0;
+	while(event) {
+		uint32_t bit = 31 - __CLZ(event);
+		mask |= event_table->priority_mask[bit];
+		event &= ~(1u << bit);
+	}
+	return mask;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to collect the events waiting at the head of the ISR queues
+ *
+ * @details
+ * 	 This routine returns the OR of the event of the oldest record in each queue
+ *
+ * @note
+ *   This function is called from get_scheduled_events and scheduler_dispatch
+ *
+ ******************************************************************************/
+
+static uint32_t scheduler_queued_events(void) {
+	uint32_t events = 0;
+	for(int i = 0; i < SCHEDULER_QUEUE_COUNT; i++) {
+		uint32_t head = event_queue[i].head;
+		if(head != event_queue[i].tail) {
+			__DMB();	// read the tail before the record it publishes
+			events |= event_queue[i].records[head & (SCHEDULER_QUEUE_DEPTH - 1)].event;
+		}
+	}
+	return events;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the ISR queue with a record of an event at its head
+ *
+ * @note
+ *   This function is called from scheduler_dispatch and scheduler_edf_select
+ *
+ * @param[in] event
+ *   Is the event bit
+ *
+ * @return
+ *   Returns the queue, or 0 if the event was not posted to a queue
+ *
+ ******************************************************************************/
+
+static SCHEDULER_QUEUE *scheduler_queue_head(uint32_t event) {
+	for(int i = 0; i < SCHEDULER_QUEUE_COUNT; i++) {
+		uint32_t head = event_queue[i].head;
+		if(head == event_queue[i].tail) {
+			continue;
+		}
+		__DMB();	// read the tail before the record it publishes
+		if(event_queue[i].records[head & (SCHEDULER_QUEUE_DEPTH - 1)].event == event) {
+			return &event_queue[i];
+		}
+	}
+	return 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to handle a post of an event that is already pending
+ *
+ * @details
+ * 	 This routine counts the overrun and applies the overrun policy of the
+ * 	 event, only SCHEDULER_OVERRUN_QUEUE adds to the pending count
+ *
+ * @note
+ *   This function is called with interrupts disabled from add_scheduled_event
+ *
+ * @param[in] bit
+ *   Is the bit number of the event
+ *
+ ******************************************************************************/
+
+static void scheduler_overrun(uint32_t bit) {
+	SCHEDULER_EVENT_STATS *stats = &event_stats[bit];
+	stats->overruns++;
+	if(event_table->overrun_policy[bit] == SCHEDULER_OVERRUN_QUEUE) {
+		stats->pending++;
+		if(stats->pending > stats->high_water) {
+			stats->high_water = stats->pending;
+		}
+	}
+	else if(event_table->overrun_policy[bit] == SCHEDULER_OVERRUN_FAULT) {
+		EFM_ASSERT(false);
+	}
+}
+
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+/***************************************************************************//**
+ * @brief
+ *   Function to service an event in the interrupt that posted it
+ *
+ * @details
+ * 	 A single handler mode event posted from an interrupt handler is marked
+ * 	 scheduled and its handler is called at once, with the record as the
+ * 	 current record.  The record of a dispatch the interrupt preempted is
+ * 	 restored afterwards.  The event is left to the main loop when it is
+ * 	 posted from thread mode or while an earlier post of it is pending, which
+ * 	 keeps the posts in order.  The wake is counted by sleep_handler_enter
+ * 	 at the start of the posting interrupt, and its sleep_handler_exit
+ * 	 decides whether the core may sleep again in the same mode when the
+ * 	 interrupt returns
+ *
+ * @note
+ *   Handler mode events must only touch state that is safe to change from
+ *   an interrupt, the scheduler, software timer and sleep functions are
+ *
+ * @param[in] event
+ *   Is the event posted
+ *
+ * @param[in] record
+ *   Is the record posted with the event, or 0 for add_scheduled_event
+ *
+ * @return
+ *   Returns true if the handler was called
+ *
+ ******************************************************************************/
+
+static bool scheduler_dispatch_handler(uint32_t event, const SCHEDULER_RECORD *record) {
+	if(!event_table || !(event & event_table->handler_events) || (event & (event - 1))
+			|| !(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) || (get_scheduled_events() & event)) {
+		return false;
+	}
+	uint32_t mask = scheduler_priority_mask(event);
+	uint32_t priority = 31 - __CLZ(mask);
+	uint32_t bit = 31 - __CLZ(event);
+#ifdef SCHEDULER_INSTRUMENTATION
+	uint32_t start = scheduler_timestamp();
+	scheduler_histogram_add(latency_hist[priority], record ? start - record->timestamp : 0);
+#endif
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	event_stats[bit].pending = 1;
+	if(!event_stats[bit].high_water) {
+		event_stats[bit].high_water = 1;
+	}
+	event_scheduled |= event;
+	dispatch_pending |= mask;
+	CORE_EXIT_CRITICAL();
+
+#ifdef SCHEDULER_INSTRUMENTATION
+	uint32_t preempted_start = dispatch_start;
+	dispatch_start = start;
+#endif
+	const SCHEDULER_RECORD *preempted = current_record;
+	current_record = record;
+	event_table->dispatch[priority].handler();
+	current_record = preempted;
+	handler_dispatches++;
+
+#ifdef SCHEDULER_INSTRUMENTATION
+	scheduler_histogram_add(service_hist[priority], scheduler_timestamp() - dispatch_start);
+	dispatch_start = preempted_start;
+#endif
+	return true;
+}
+#endif
+
+#ifdef SCHEDULER_EDF
+/***************************************************************************//**
+ * @brief
+ *   Function to pick the pending event with the earliest deadline
+ *
+ * @details
+ * 	 This routine walks the pending priority bits that have a deadline from
+ * 	 the highest down and keeps the event with the least time left to its
+ * 	 deadline, so equal deadlines go to the higher priority.  A queued record
+ * 	 is due its deadline after its own timestamp.  If no pending event has a
+ * 	 deadline the highest priority is returned, as without SCHEDULER_EDF, in
+ * 	 one __CLZ however many events are pending
+ *
+ * @note
+ *   This function is called from scheduler_dispatch
+ *
+ * @param[in] pending
+ *   Is the non-zero mask of pending priorities
+ *
+ * @param[in] now
+ *   Is the scheduler_timestamp() of the dispatch
+ *
+ * @return
+ *   Returns the priority to dispatch
+ *
+ ******************************************************************************/
+
+static uint32_t scheduler_edf_select(uint32_t pending, uint32_t now) {
+	uint32_t selected = 31 - __CLZ(pending);
+	int32_t least = INT32_MAX;
+
+	pending &= deadline_priorities;
+	while(pending) {
+		uint32_t priority = 31 - __CLZ(pending);
+		pending &= ~(1u << priority);
+		uint32_t event = event_table->dispatch[priority].event;
+		uint32_t bit = 31 - __CLZ(event);
+		SCHEDULER_QUEUE *queue = scheduler_queue_head(event);
+		uint32_t deadline = queue ? queue->records[queue->head & (SCHEDULER_QUEUE_DEPTH - 1)].timestamp + deadline_ticks[bit] : deadline_at[bit];
+		int32_t left = (int32_t)(deadline - now);
+		if(left < least) {
+			least = left;
+			selected = priority;
+		}
+	}
+	return selected;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to convert the deadlines of the event table to timestamp units
+ *
+ * @details
+ * 	 This routine converts the microsecond deadline of every event with the
+ * 	 current core clock, in 64 bits so a long deadline at a fast clock is
+ * 	 caught by the range check rather than wrapping.  A non-zero deadline is
+ * 	 at least one tick.  The priorities of the events with a deadline are
+ * 	 marked for scheduler_edf_select
+ *
+ * @note
+ *   This function is called from scheduler_open and scheduler_clock_changed
+ *
+ ******************************************************************************/
+
+static void scheduler_deadline_convert(void) {
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+		uint32_t deadline_us = event_table->deadline_us[i];
+#ifdef DWT
+		uint64_t ticks = (uint64_t)deadline_us * (SystemCoreClock / 1000000);
+#else
+		uint64_t ticks = ((uint64_t)deadline_us * CLOCKS_PER_SEC) / 1000000;
+#endif
+		EFM_ASSERT(ticks < 0x80000000);
+		deadline_ticks[i] = (deadline_us && !ticks) ? 1 : (uint32_t)ticks;
+	}
+	deadline_priorities = 0;
+	for(int i = 0; i <= SCHEDULER_MAX_PRIORITY; i++) {
+		uint32_t event = event_table->dispatch[i].event;
+		if(event && deadline_ticks[31 - __CLZ(event)]) {
+			deadline_priorities |= 1u << i;
+		}
+	}
+}
+#endif
+
+/***************************************************************************//**
+ * @brief
+ *   Function to move the timestamps to the current core clock
+ *
+ * @details
+ * 	 The cycle counter runs at the core clock, so a timestamp taken before a
+ * 	 change of the clock is in different units than one taken after.  This
+ * 	 routine rescales every stored timestamp, the records still queued, the
+ * 	 post times, the absolute deadlines and the start of the dispatch in
+ * 	 progress, as if the counter had always run at the new clock.  It then
+ * 	 converts the event deadlines and the histogram unit for the new clock
+ *
+ * @note
+ *   This function is called with interrupts disabled, from scheduler_open
+ *   and scheduler_clock_changed.  A host build without a DWT timestamps
+ *   with clock(), whose rate never changes
+ *
+ ******************************************************************************/
+
+static void scheduler_clock_convert(void) {
+#ifdef DWT
+	uint32_t mhz = SystemCoreClock / 1000000;
+	if(!mhz) {
+		mhz = 1;
+	}
+	if(stamp_mhz && (mhz != stamp_mhz)) {
+		uint32_t now = scheduler_timestamp();
+		for(int i = 0; i < SCHEDULER_QUEUE_COUNT; i++) {
+			SCHEDULER_QUEUE *q = &event_queue[i];
+			for(uint32_t r = q->head; r != q->tail; r++) {
+				SCHEDULER_RECORD *record = &q->records[r & (SCHEDULER_QUEUE_DEPTH - 1)];
+				record->timestamp = scheduler_rescale(record->timestamp, now, mhz);
+			}
+		}
+		for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+#ifdef SCHEDULER_EDF
+			deadline_at[i] = scheduler_rescale(deadline_at[i], now, mhz);
+#endif
+#ifdef SCHEDULER_INSTRUMENTATION
+			post_time[i] = scheduler_rescale(post_time[i], now, mhz);
+#endif
+		}
+#ifdef SCHEDULER_INSTRUMENTATION
+		dispatch_start = scheduler_rescale(dispatch_start, now, mhz);
+#endif
+	}
+	stamp_mhz = mhz;
+#ifdef SCHEDULER_INSTRUMENTATION
+	hist_ns_scale = (1000u << 16) / mhz;
+#endif
+#else
+	stamp_mhz = 1;
+#ifdef SCHEDULER_INSTRUMENTATION
+	hist_ns_scale = (uint32_t)((1000000000ull << 16) / CLOCKS_PER_SEC);
+#endif
+#endif
+#ifdef SCHEDULER_EDF
+	scheduler_deadline_convert();
+#endif
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to rescale a timestamp to a new core clock
+ *
+ * @details
+ * 	 This routine scales the distance of the timestamp from now, in the past
+ * 	 for a post time or in the future for a deadline, from the clock the
+ * 	 timestamps were counted at to the new one
+ *
+ * @param[in] stamp
+ *   Is the timestamp counted at stamp_mhz
+ *
+ * @param[in] now
+ *   Is the scheduler_timestamp() of the change
+ *
+ * @param[in] mhz
+ *   Is the new core clock in MHz
+ *
+ * @return
+ *   Returns the timestamp counted at the new clock
+ *
+ ******************************************************************************/
+
+static uint32_t scheduler_rescale(uint32_t stamp, uint32_t now, uint32_t mhz) {
+	int32_t distance = (int32_t)(stamp - now);
+	return now + (uint32_t)(int32_t)(((int64_t)distance * mhz) / stamp_mhz);
+}
+
+#ifdef SCHEDULER_INSTRUMENTATION
+/***************************************************************************//**
+ * @brief
+ *   Function to count a time in a log2 histogram
+ *
+ * @details
+ * 	 This routine converts the time to nanoseconds at the current core clock
+ * 	 and increments bucket floor(log2(ns)) + 1, 0 for a time of 0,
+ * 	 saturating in the last bucket
+ *
+ * @param[in] histogram
+ *   Is the histogram to update
+ *
+ * @param[in] time
+ *   Is the time to count, in scheduler_timestamp() units
+ *
+ ******************************************************************************/
+
+static void scheduler_histogram_add(uint32_t *histogram, uint32_t time) {
+	uint32_t ns = (uint32_t)(((uint64_t)time * hist_ns_scale) >> 16);
+	uint32_t bucket = 32 - __CLZ(ns);
+	if(bucket >= SCHEDULER_HIST_BUCKETS) {
+		bucket = SCHEDULER_HIST_BUCKETS - 1;
+	}
+	histogram[bucket]++;
 }
+#endif
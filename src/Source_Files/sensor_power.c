@@ -0,0 +1,212 @@
+/**
+ * @file sensor_power.c
+ * @author Gerritt Luoma
+ * @date May 10th, 2021
+ * @brief Switches the sensor supplies off between samples
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "sensor_power.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+// Sensor supplies: a supply is turned on with the first reference and off with
+// the last.  While it is off its I2C pins are disabled so they neither drive
+// nor back power the sensor through its pull ups
+static const SENSOR_RAIL_DEF rail_def[SENSOR_RAIL_COUNT] = {
+	[SENSOR_RAIL_SI7021] = { SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN, SI7021_SCL_PORT, SI7021_SCL_PIN,
+							 SI7021_SDA_PORT, SI7021_SDA_PIN, I2C1, SENSOR_SI7021_POWER_UP },
+};
+static SENSOR_RAIL rails[SENSOR_RAIL_COUNT];
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Configures the sensor supply pins and turns the supplies on
+ *
+ * @details
+ *	Every supply is turned on with one reference held by the caller, so the
+ *	I2C buses can be reset and the sensors set up at boot
+ *
+ * @note
+ *	Called once after gpio_open and before the sensor I2C buses are opened.
+ *	The boot reference is released with sensor_power_release once the sensors
+ *	are set up
+ *
+ ******************************************************************************/
+
+void sensor_power_open(void) {
+	for(uint32_t rail = 0; rail < SENSOR_RAIL_COUNT; rail++) {
+		GPIO_DriveStrengthSet(rail_def[rail].en_port, SI7021_SENSOR_DRIVE_STRENGTH);
+		GPIO_PinModeSet(rail_def[rail].en_port, rail_def[rail].en_pin, SI7021_SENSOR_GPIOMODE, false);
+		rails[rail].refs = 0;
+		rails[rail].cycles = 0;
+		rails[rail].on_ticks = 0;
+		sensor_power_acquire(rail);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Restarts the on time of the supplies turned on at boot
+ *
+ * @details
+ *	The software timer count jumps when its timebase is opened, so the power
+ *	up time and the on time of a supply turned on before then count from now
+ *
+ * @note
+ *	Called in app_peripheral_setup once the software timers are open
+ *
+ ******************************************************************************/
+
+void sensor_power_timebase(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	for(uint32_t rail = 0; rail < SENSOR_RAIL_COUNT; rail++) {
+		rails[rail].on_tick = sw_timer_now();
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes a reference on a sensor supply
+ *
+ * @details
+ *	The first reference drives the enable pin, then connects the I2C pins.
+ *	The bus is marked repowered so its next transfer starts from idle
+ *
+ * @note
+ *	Called by a sample task ahead of its read, which waits sensor_power_wait
+ *	ticks before the first transfer
+ *
+ * @param[in] rail
+ *	Is the sensor_rails entry of the supply
+ *
+ ******************************************************************************/
+
+void sensor_power_acquire(uint32_t rail) {
+	EFM_ASSERT(rail < SENSOR_RAIL_COUNT);
+	const SENSOR_RAIL_DEF *def = &rail_def[rail];
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(!rails[rail].refs++) {
+		GPIO_PinOutSet(def->en_port, def->en_pin);
+		GPIO_PinModeSet(def->scl_port, def->scl_pin, SI7021_I2C_GPIOMODE, SENSOR_I2C_SCL);
+		GPIO_PinModeSet(def->sda_port, def->sda_pin, SI7021_I2C_GPIOMODE, SENSOR_I2C_SDA);
+		i2c_bus_repowered(def->i2c);
+		rails[rail].cycles++;
+		rails[rail].on_tick = sw_timer_now();
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Releases a reference taken with sensor_power_acquire
+ *
+ * @details
+ *	The last reference disables the I2C pins, then turns the supply off
+ *
+ * @note
+ *	Called by a sample task once its read has completed, the bus must be idle
+ *
+ * @param[in] rail
+ *	Is the sensor_rails entry of the supply
+ *
+ ******************************************************************************/
+
+void sensor_power_release(uint32_t rail) {
+	EFM_ASSERT(rail < SENSOR_RAIL_COUNT);
+	const SENSOR_RAIL_DEF *def = &rail_def[rail];
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	EFM_ASSERT(rails[rail].refs);
+	if(!--rails[rail].refs) {
+		GPIO_PinModeSet(def->scl_port, def->scl_pin, gpioModeDisabled, false);
+		GPIO_PinModeSet(def->sda_port, def->sda_pin, gpioModeDisabled, false);
+		GPIO_PinOutClear(def->en_port, def->en_pin);
+		rails[rail].on_ticks += sw_timer_now() - rails[rail].on_tick;
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns how long until a sensor has powered up
+ *
+ * @param[in] rail
+ *	Is the sensor_rails entry of the supply, a reference must be held
+ *
+ * @return
+ *	Returns the software timer ticks left of the power up time, 0 once the
+ *	sensor answers transfers
+ *
+ ******************************************************************************/
+
+uint32_t sensor_power_wait(uint32_t rail) {
+	EFM_ASSERT(rail < SENSOR_RAIL_COUNT);
+	EFM_ASSERT(rails[rail].refs);
+	uint32_t elapsed = sw_timer_now() - rails[rail].on_tick;
+	return (elapsed < rail_def[rail].power_up) ? rail_def[rail].power_up - elapsed : 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the power up time of a sensor
+ *
+ * @note
+ *	Used to start a sample that far ahead of its read
+ *
+ * @param[in] rail
+ *	Is the sensor_rails entry of the supply
+ *
+ ******************************************************************************/
+
+uint32_t sensor_power_up_time(uint32_t rail) {
+	EFM_ASSERT(rail < SENSOR_RAIL_COUNT);
+	return rail_def[rail].power_up;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns how long a sensor supply has been on
+ *
+ * @param[in] rail
+ *	Is the sensor_rails entry of the supply
+ *
+ * @return
+ *	Returns the software timer ticks the supply was on, including the time
+ *	since it was last turned on if it is on now
+ *
+ ******************************************************************************/
+
+uint32_t sensor_power_on_ticks(uint32_t rail) {
+	EFM_ASSERT(rail < SENSOR_RAIL_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	uint32_t ticks = rails[rail].on_ticks;
+	if(rails[rail].refs) {
+		ticks += sw_timer_now() - rails[rail].on_tick;
+	}
+	CORE_EXIT_CRITICAL();
+	return ticks;
+}
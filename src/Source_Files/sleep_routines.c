@@ -41,12 +41,57 @@
 //***********************************************************************************
 
 #include "sleep_routines.h"
+#include "scheduler.h"
 
 //***********************************************************************************
 // Private variables
 //***********************************************************************************
 
 static int lowest_energy_mode[MAX_ENERGY_MODES];
+static uint32_t sleep_wakes;
+
+// Residency accounting: time since last_tick is added to the energy mode the
+// core was in and to every energy mode that was blocked meanwhile, each time
+// the core sleeps, wakes or a block changes
+static SLEEP_TIMEBASE sleep_now;
+static uint32_t last_tick;
+static SLEEP_STATS stats_ticks;
+
+// Block held by each owner, with the duration of its holds
+static SLEEP_OWNER sleep_owners[SLEEP_OWNER_COUNT];
+
+// Wake cost aware selection: the deepest unblocked energy mode is only
+// entered when the next timed wake is at least its break even time away.
+// The break even time follows from the active time measured around each
+// entry and exit of the mode, averaged in nanoseconds so samples taken at
+// different core clocks mix
+static SLEEP_NEXT_WAKE sleep_next;
+static uint32_t sleep_hz;
+static uint32_t wake_ns[MAX_ENERGY_MODES];
+static uint32_t break_even[MAX_ENERGY_MODES];
+
+// Energy mode the core is asleep in, EM0 while it runs, and the cycle count
+// when it went to sleep.  With SCHEDULER_SLEEP_ON_EXIT sleep_round is the
+// mode interrupts return to sleep in, EM0 outside enter_sleep
+static uint32_t sleep_mode;
+static uint32_t sleep_start;
+static uint32_t sleep_round;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sleep_account(uint32_t EM);
+static uint32_t sleep_tick(void);
+static void sleep_check_holds(void);
+static uint32_t sleep_select(void);
+static uint32_t sleep_deepest(void);
+static uint32_t sleep_predict(uint32_t EM);
+static void sleep_enter(uint32_t EM);
+static void sleep_wake(void);
+static void sleep_calibrate(uint32_t EM, uint32_t cycles);
+static void sleep_break_even_update(void);
+static uint64_t sleep_wake_energy(uint32_t EM, uint32_t mhz);
 
 //***********************************************************************************
 // Functions
@@ -68,7 +113,28 @@ void sleep_open(void) {
 	//Initialize the sleep_routines static /private variable, lowest_energy_mode[]
 	for(int i = 0; i < MAX_ENERGY_MODES; i++) {
 		lowest_energy_mode[i] = 0;
+		stats_ticks.residency[i] = 0;
+		stats_ticks.blocked[i] = 0;
+		wake_ns[i] = 0;
+		break_even[i] = 0;
+	}
+	for(int i = 0; i < SLEEP_OWNER_COUNT; i++) {
+		sleep_owners[i].EM = 0;
+		sleep_owners[i].held = false;
+		sleep_owners[i].acquired = 0;
+		sleep_owners[i].acquires = 0;
+		sleep_owners[i].held_ticks = 0;
+		sleep_owners[i].longest = 0;
+		sleep_owners[i].limit = 0;
+		sleep_owners[i].overlong = 0;
+		sleep_owners[i].flagged = false;
 	}
+	sleep_wakes = 0;
+	sleep_mode = EM0;
+	sleep_round = EM0;
+	sleep_now = 0;
+	sleep_next = 0;
+	sleep_hz = 0;
 }
 
 /***************************************************************************//**
@@ -76,23 +142,44 @@ void sleep_open(void) {
  *   Function to block a sleep mode
  *
  * @details
- * 	 This routine blocks the energy mode passed as a parameter
+ * 	 This routine blocks the energy mode passed as a parameter on behalf of
+ * 	 the owner and records when the hold started.  A block taken in handler
+ * 	 mode while the core sleeps on exit in that mode or a deeper one returns
+ * 	 the core to the main loop, which sleeps again in a shallower mode
  *
  * @note
- *   This function is called to block an energy mode
+ *   This function is called to block an energy mode.  An owner holds at most
+ *   one block, it must release it with sleep_unblock_mode before blocking again
+ *
+ * @param[in] owner
+ *   Is the sleep_owners entry of the caller
  *
  * @param[in] EM
  *   Is the energy mode to be blocked
  *
  ******************************************************************************/
 
-void sleep_block_mode(uint32_t EM) {
+void sleep_block_mode(uint32_t owner, uint32_t EM) {
 	//Utilized by a peripheral to prevent the Pearl Gecko going into that sleep mode while the peripheral is active.
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT);
+	EFM_ASSERT(EM < MAX_ENERGY_MODES);
 	CORE_DECLARE_IRQ_STATE;
 	CORE_ENTER_CRITICAL();
 
+	SLEEP_OWNER *token = &sleep_owners[owner];
+	EFM_ASSERT(!token->held);
+	sleep_account(sleep_mode);
 	lowest_energy_mode[EM]++;
-	EFM_ASSERT(lowest_energy_mode[EM] < 5);
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+	if((sleep_round != EM0) && (EM <= sleep_round)) {
+		SCB->SCR &= ~SCB_SCR_SLEEPONEXIT_Msk;	// the main loop sleeps again in a shallower mode
+	}
+#endif
+	token->EM = EM;
+	token->held = true;
+	token->flagged = false;
+	token->acquired = sleep_tick();
+	token->acquires++;
 	CORE_EXIT_CRITICAL();
 }
 
@@ -101,23 +188,38 @@ void sleep_block_mode(uint32_t EM) {
  *   Function to unblock a sleep mode
  *
  * @details
- * 	 This routine unblocks the energy mode passed as a parameter
+ * 	 This routine unblocks the energy mode held by the owner and adds the
+ * 	 hold to its statistics, a hold longer than the limit of the owner is
+ * 	 counted as overlong
  *
  * @note
  *   This function is called to unblock an energy mode
  *
- * @param[in] EM
- *   Is the energy mode to be unblocked
+ * @param[in] owner
+ *   Is the sleep_owners entry of the caller
  *
  ******************************************************************************/
 
-void sleep_unblock_mode(uint32_t EM) {
+void sleep_unblock_mode(uint32_t owner) {
 	//Utilized to release the processor from going into a sleep mode with a peripheral that is no longer active.
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT);
 	CORE_DECLARE_IRQ_STATE;
 	CORE_ENTER_CRITICAL();
 
-	lowest_energy_mode[EM]--;
-	EFM_ASSERT(lowest_energy_mode[EM] >= 0);
+	SLEEP_OWNER *token = &sleep_owners[owner];
+	EFM_ASSERT(token->held);
+	sleep_account(sleep_mode);
+	lowest_energy_mode[token->EM]--;
+	EFM_ASSERT(lowest_energy_mode[token->EM] >= 0);
+	uint32_t hold = sleep_tick() - token->acquired;
+	token->held = false;
+	token->held_ticks += hold;
+	if(hold > token->longest) {
+		token->longest = hold;
+	}
+	if(token->limit && (hold > token->limit) && !token->flagged) {
+		token->overlong++;
+	}
 	CORE_EXIT_CRITICAL();
 }
 
@@ -126,10 +228,22 @@ void sleep_unblock_mode(uint32_t EM) {
  *   Function to enter sleep modes
  *
  * @details
- * 	 This routine checks which sleep mode is the lowest, and enters energy modes based on that
+ * 	 This routine checks which sleep mode is the lowest, and enters energy modes based on that.
+ * 	 The core stays asleep until an event is scheduled: interrupts that wake it
+ * 	 without scheduling an event, such as an LETIMER underflow with no timer due,
+ * 	 put it straight back to sleep without returning to the main loop, with
+ * 	 SCHEDULER_SLEEP_ON_EXIT without running any thread mode code at all.  EM2
+ * 	 and EM3 are only entered when the next timed wake is at least their break
+ * 	 even time away, otherwise the next shallower mode is.  Every wake from a
+ * 	 sleep mode is counted and the time asleep is added to the residency of
+ * 	 the energy mode, wakes serviced in handler mode through
+ * 	 sleep_handler_enter and sleep_handler_exit, which bracket every
+ * 	 interrupt handler.  Blocks held longer than the
+ * 	 limit of their owner are flagged before going to sleep
  *
  * @note
- *   This function is called to enter sleep
+ *   This function is called from the main loop with interrupts enabled.  The
+ *   event check and the sleep entry are atomic so a wake cannot be missed
  *
  ******************************************************************************/
 
@@ -137,22 +251,316 @@ void enter_sleep(void) {
 	//Function to enter sleep
 	CORE_DECLARE_IRQ_STATE;
 	CORE_ENTER_CRITICAL();
-	if (lowest_energy_mode[EM0] > 0) {
-	}
-	else if (lowest_energy_mode[EM1] > 0) {
-	}
-	else if (lowest_energy_mode[EM2] > 0) {
-		EMU_EnterEM1();
+	sleep_check_holds();
+	while (!get_scheduled_events()) {
+		uint32_t EM = sleep_deepest();
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+		// Interrupts serviced in handler mode put the core back to sleep in
+		// the same mode when they return, until one schedules an event
+		if(EM != EM0) {
+			sleep_round = EM;
+			SCB->SCR |= SCB_SCR_SLEEPONEXIT_Msk;
+		}
+#endif
+		// Let the interrupt that woke the core run before checking for events
+		CORE_EXIT_CRITICAL();
+		CORE_ENTER_CRITICAL();
+#ifdef SCHEDULER_SLEEP_ON_EXIT
+		if(EM != EM0) {
+			SCB->SCR &= ~SCB_SCR_SLEEPONEXIT_Msk;
+			sleep_wake();	// the wake that returned to the main loop
+			sleep_round = EM0;
+		}
+#endif
 	}
-	else if (lowest_energy_mode[EM3] > 0) {
-		EMU_EnterEM2(1);
+
+	CORE_EXIT_CRITICAL();
+	return;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to account a wake serviced in handler mode
+ *
+ * @details
+ * 	 This routine counts the wake and adds the time asleep to the residency
+ * 	 of the energy mode, as sleep_enter does for a wake that returns to the
+ * 	 main loop.  The cycles since sleep_handler_exit put the core back to
+ * 	 sleep are the cost of the sleep and the wake, which calibrates the
+ * 	 break even time.  The interrupt runs in EM0 from here on.  It does
+ * 	 nothing if the core was not asleep, such as in a nested interrupt
+ *
+ * @note
+ *   This function is called first by every interrupt handler, so with
+ *   SCHEDULER_SLEEP_ON_EXIT the wakes of interrupts that return to sleep
+ *   without scheduling an event, such as a byte sent by the LEUART, are
+ *   counted and their time is EM0 time
+ *
+ ******************************************************************************/
+
+void sleep_handler_enter(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sleep_wake();
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to return to sleep after servicing an event in handler mode
+ *
+ * @details
+ * 	 This routine adds the time the interrupt ran to the residency of EM0
+ * 	 and selects the next energy mode again, as the main loop would.  While
+ * 	 it is the mode the core sleeps on exit in, the core goes back to sleep
+ * 	 when the interrupt returns and the next wake calibrates the mode.
+ * 	 Otherwise, after a new block or when the next timed wake is closer than
+ * 	 the break even time, sleep on exit is cleared so the main loop enters
+ * 	 the new mode.  Nested interrupts leave this to the outermost one
+ *
+ * @note
+ *   This function is called last by every interrupt handler, after the
+ *   handlers of the handler mode events it posted returned.  It does nothing
+ *   outside enter_sleep or once the interrupt returns to the main loop
+ *
+ ******************************************************************************/
+
+void sleep_handler_exit(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if((sleep_round != EM0) && (SCB->SCR & SCB_SCR_SLEEPONEXIT_Msk)
+			&& (SCB->ICSR & SCB_ICSR_RETTOBASE_Msk)) {
+		sleep_account(EM0);
+		if(sleep_select() == sleep_round) {
+			sleep_mode = sleep_round;
+			sleep_start = scheduler_timestamp();
+		}
+		else {
+			SCB->SCR &= ~SCB_SCR_SLEEPONEXIT_Msk;
+		}
 	}
-	else {
-		EMU_EnterEM3(1);
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of wakes from sleep
+ *
+ * @details
+ * 	 This routine returns how many times the core has woken from EM1 or deeper
+ * 	 since sleep_open
+ *
+ * @note
+ *   This function is called to compare the wake rate of the timing modes
+ *
+ ******************************************************************************/
+
+uint32_t sleep_wake_count(void) {
+	return sleep_wakes;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the timebase of the residency counters
+ *
+ * @details
+ * 	 This routine starts the residency accounting from the current tick of
+ * 	 the timebase.  The timebase must keep counting in EM3
+ *
+ * @note
+ *   This function is called once in app_peripheral_setup, after the timebase
+ *   has been opened
+ *
+ * @param[in] now
+ *   Is the function returning the tick count
+ *
+ ******************************************************************************/
+
+void sleep_timebase(SLEEP_TIMEBASE now) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sleep_now = now;
+	last_tick = now();
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the energy mode residency counters
+ *
+ * @details
+ * 	 This routine (atomic) brings the counters up to date and copies, for
+ * 	 every energy mode, the ticks spent in it and the ticks during which it
+ * 	 was blocked.  A mode that stays blocked while its peripheral is idle
+ * 	 points to a missing sleep_unblock_mode
+ *
+ * @note
+ *   This function is called by the application performance report
+ *
+ * @param[out] stats
+ *   Is where the counters are copied to
+ *
+ ******************************************************************************/
+
+void sleep_stats(SLEEP_STATS *stats) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sleep_account(sleep_mode);
+	sleep_check_holds();
+	*stats = stats_ticks;
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the hold limit of an owner
+ *
+ * @details
+ * 	 This routine sets how long the owner is expected to hold its block at
+ * 	 most.  A longer hold, which usually is a transfer that never completed
+ * 	 and leaked its block, is counted in the overlong statistics of the owner
+ *
+ * @note
+ *   This function is called in app_peripheral_setup
+ *
+ * @param[in] owner
+ *   Is the sleep_owners entry
+ *
+ * @param[in] limit
+ *   Is the limit in timebase ticks, 0 for a block that may be held forever
+ *
+ ******************************************************************************/
+
+void sleep_hold_limit(uint32_t owner, uint32_t limit) {
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT);
+	sleep_owners[owner].limit = limit;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the hold statistics of an owner
+ *
+ * @details
+ * 	 This routine (atomic) copies the block of the owner, when its current or
+ * 	 last hold started, the number and total duration of its holds, the
+ * 	 longest hold and the number of overlong holds
+ *
+ * @note
+ *   This function is called to find the owner of a leaked block
+ *
+ * @param[in] owner
+ *   Is the sleep_owners entry
+ *
+ * @param[out] stats
+ *   Is where the statistics are copied to
+ *
+ ******************************************************************************/
+
+void sleep_owner_stats(uint32_t owner, SLEEP_OWNER *stats) {
+	EFM_ASSERT(owner < SLEEP_OWNER_COUNT);
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sleep_check_holds();
+	*stats = sleep_owners[owner];
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the number of overlong holds of all owners
+ *
+ * @note
+ *   This function is called by the application performance report
+ *
+ ******************************************************************************/
+
+uint32_t sleep_overlong_holds(void) {
+	uint32_t total = 0;
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sleep_check_holds();
+	for(int i = 0; i < SLEEP_OWNER_COUNT; i++) {
+		total += sleep_owners[i].overlong;
 	}
+	CORE_EXIT_CRITICAL();
+	return total;
+}
 
+/***************************************************************************//**
+ * @brief
+ *   Function to sleep until the next interrupt
+ *
+ * @details
+ * 	 This routine sleeps once in the same energy mode enter_sleep would
+ * 	 select, unless done is already true.  The check and the sleep entry are
+ * 	 atomic, so an interrupt that makes done true cannot be missed.  It
+ * 	 returns after any interrupt, the caller repeats the wait until done
+ *
+ * @note
+ *   This function is called from blocking waits in the main loop, such as
+ *   sw_timer_sleep, that must sleep without waiting for a scheduled event.
+ *   It is never called from an interrupt handler
+ *
+ * @param[in] done
+ *   Is the condition that ends the wait
+ *
+ ******************************************************************************/
+
+void sleep_wait(SLEEP_DONE done) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(!done()) {
+		sleep_deepest();
+	}
 	CORE_EXIT_CRITICAL();
-	return;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to set the source of the next timed wake
+ *
+ * @details
+ * 	 This routine enables the wake cost aware energy mode selection of
+ * 	 enter_sleep.  Without it the deepest unblocked energy mode is always
+ * 	 entered
+ *
+ * @note
+ *   This function is called in app_peripheral_setup with the software timers,
+ *   whose next expiry is the next timed wake
+ *
+ * @param[in] next
+ *   Is the function that returns the tick of the next timed wake, in ticks of
+ *   the timebase set with sleep_timebase
+ *
+ * @param[in] hz
+ *   Is the number of ticks per second
+ *
+ ******************************************************************************/
+
+void sleep_predictor(SLEEP_NEXT_WAKE next, uint32_t hz) {
+	EFM_ASSERT(hz);
+	sleep_hz = hz;
+	sleep_break_even_update();
+	sleep_next = next;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the break even time of an energy mode
+ *
+ * @details
+ * 	 This routine returns the shortest sleep, in ticks, for which entering the
+ * 	 energy mode uses less energy than the next shallower mode including the
+ * 	 extra cost of waking up from it
+ *
+ * @param[in] EM
+ *   Is the energy mode
+ *
+ ******************************************************************************/
+
+uint32_t sleep_break_even(uint32_t EM) {
+	EFM_ASSERT(EM < MAX_ENERGY_MODES);
+	return break_even[EM];
 }
 
 /***************************************************************************//**
@@ -177,3 +585,326 @@ uint32_t current_block_energy_mode(void) {
 	return MAX_ENERGY_MODES - 1;
 }
 
+/***************************************************************************//**
+ * @brief
+ *   Function to account the time since the last call
+ *
+ * @details
+ * 	 This routine adds the ticks since the last call to the residency of the
+ * 	 energy mode EM and to the blocked time of every energy mode that has a
+ * 	 block.  Nothing is counted until sleep_timebase has been called
+ *
+ * @note
+ *   This function is called with interrupts disabled on every sleep, wake,
+ *   block and unblock
+ *
+ * @param[in] EM
+ *   Is the energy mode the core was in since the last call
+ *
+ ******************************************************************************/
+
+static void sleep_account(uint32_t EM) {
+	if(!sleep_now) {
+		return;
+	}
+	uint32_t now = sleep_tick();
+	uint32_t elapsed = now - last_tick;
+	last_tick = now;
+	stats_ticks.residency[EM] += elapsed;
+	for(int i = 0; i < MAX_ENERGY_MODES; i++) {
+		if(lowest_energy_mode[i] > 0) {
+			stats_ticks.blocked[i] += elapsed;
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the timebase
+ *
+ * @return
+ *   Returns the tick count, or 0 until sleep_timebase has been called
+ *
+ ******************************************************************************/
+
+static uint32_t sleep_tick(void) {
+	return sleep_now ? sleep_now() : 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to flag the blocks held longer than their limit
+ *
+ * @details
+ * 	 This routine counts a hold that is still in progress as overlong as
+ * 	 soon as it passes the limit of its owner, so a block that is never
+ * 	 released is reported too.  Each hold is counted once
+ *
+ * @note
+ *   This function is called with interrupts disabled before every sleep and
+ *   when the statistics are read
+ *
+ ******************************************************************************/
+
+static void sleep_check_holds(void) {
+	uint32_t now = sleep_tick();
+	for(int i = 0; i < SLEEP_OWNER_COUNT; i++) {
+		SLEEP_OWNER *token = &sleep_owners[i];
+		if(token->held && token->limit && !token->flagged && ((now - token->acquired) > token->limit)) {
+			token->overlong++;
+			token->flagged = true;
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to select the deepest energy mode worth entering
+ *
+ * @details
+ * 	 This routine returns EM0 while EM0 or EM1 is blocked.  EM2 and EM3 are
+ * 	 selected through sleep_predict
+ *
+ * @note
+ *   This function is called with interrupts disabled
+ *
+ * @return
+ *   Returns the energy mode to enter, EM0 if the core must not sleep
+ *
+ ******************************************************************************/
+
+static uint32_t sleep_select(void) {
+	uint32_t EM = EM0;
+	if (lowest_energy_mode[EM0] > 0) {
+	}
+	else if (lowest_energy_mode[EM1] > 0) {
+	}
+	else if (lowest_energy_mode[EM2] > 0) {
+		EM = EM1;
+	}
+	else if (lowest_energy_mode[EM3] > 0) {
+		EM = sleep_predict(EM2);
+	}
+	else {
+		EM = sleep_predict(EM3);
+	}
+	return EM;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to sleep once in the deepest energy mode worth entering
+ *
+ * @details
+ * 	 This routine returns without sleeping while sleep_select returns EM0
+ *
+ * @note
+ *   This function is called with interrupts disabled
+ *
+ * @return
+ *   Returns the energy mode entered, EM0 if the core did not sleep
+ *
+ ******************************************************************************/
+
+static uint32_t sleep_deepest(void) {
+	uint32_t EM = sleep_select();
+	if(EM != EM0) {
+		sleep_enter(EM);
+	}
+	return EM;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to select the energy mode of the next sleep
+ *
+ * @details
+ * 	 This routine starts from the deepest unblocked energy mode and steps to a
+ * 	 shallower mode while the next timed wake is closer than the break even
+ * 	 time of the mode.  Wakes that are not timed, such as received bytes, are
+ * 	 not predicted
+ *
+ * @param[in] EM
+ *   Is the deepest unblocked energy mode
+ *
+ * @return
+ *   Returns the energy mode to enter
+ *
+ ******************************************************************************/
+
+static uint32_t sleep_predict(uint32_t EM) {
+	uint32_t tick;
+	if(!sleep_next || !sleep_now || !sleep_next(&tick)) {
+		return EM;
+	}
+	int32_t remaining = (int32_t)(tick - sleep_now());
+	while((EM > EM1) && (remaining < (int32_t)break_even[EM])) {
+		EM--;
+	}
+	return EM;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to sleep in an energy mode
+ *
+ * @details
+ * 	 This routine enters the energy mode and accounts the wake through
+ * 	 sleep_wake
+ *
+ * @note
+ *   This function is called by enter_sleep with interrupts disabled
+ *
+ * @param[in] EM
+ *   Is EM1, EM2 or EM3
+ *
+ ******************************************************************************/
+
+static void sleep_enter(uint32_t EM) {
+	sleep_account(EM0);
+	sleep_mode = EM;
+	sleep_start = scheduler_timestamp();
+	if(EM == EM1) {
+		EMU_EnterEM1();
+	}
+	else if(EM == EM2) {
+		EMU_EnterEM2(1);
+	}
+	else {
+		EMU_EnterEM3(1);
+	}
+	sleep_wake();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to account a wake from sleep
+ *
+ * @details
+ * 	 This routine adds the time asleep to the residency of the energy mode
+ * 	 and counts the wake.  The cycle counter only runs while the core is
+ * 	 clocked, so its count across the sleep is the active time spent entering
+ * 	 and leaving the energy mode, which calibrates the break even time.  The
+ * 	 core clock cannot change while the core sleeps, so the count is in
+ * 	 cycles of the current clock.  It does nothing if the core was not asleep
+ *
+ * @note
+ *   This function is called with interrupts disabled, by sleep_enter and for
+ *   the interrupts that wake the core from sleep on exit
+ *
+ ******************************************************************************/
+
+static void sleep_wake(void) {
+	uint32_t EM = sleep_mode;
+	if(EM == EM0) {
+		return;
+	}
+	uint32_t cycles = scheduler_timestamp() - sleep_start;
+	sleep_mode = EM0;
+	sleep_account(EM);
+	sleep_wakes++;
+	if(EM > EM1) {
+		sleep_calibrate(EM, cycles);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to average the wake cost of an energy mode
+ *
+ * @details
+ * 	 This routine converts the active cycles of entering and leaving the
+ * 	 energy mode to nanoseconds at the core clock they were counted at,
+ * 	 adds them to the average of the mode and updates the break even times
+ *
+ * @param[in] EM
+ *   Is EM2 or EM3
+ *
+ * @param[in] cycles
+ *   Is the active cycles measured around the last sleep in the energy mode
+ *
+ ******************************************************************************/
+
+static void sleep_calibrate(uint32_t EM, uint32_t cycles) {
+	uint32_t mhz = SystemCoreClock / 1000000;
+	if(!mhz) {
+		mhz = 1;
+	}
+	uint32_t ns = (uint32_t)(((uint64_t)cycles * 1000) / mhz);
+	if(wake_ns[EM]) {
+		wake_ns[EM] += ((int32_t)ns - (int32_t)wake_ns[EM]) >> SLEEP_COST_WEIGHT;
+	}
+	else {
+		wake_ns[EM] = ns;
+	}
+	sleep_break_even_update();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to update the break even times of the energy modes
+ *
+ * @details
+ * 	 This routine recomputes the break even time of EM2 and EM3 together, as
+ * 	 the time of EM3 depends on the wake cost of EM2.  The break even time is
+ * 	 the energy a wake from the mode costs over a wake from the next
+ * 	 shallower mode, divided by the current saved compared to that mode,
+ * 	 rounded up to whole ticks.  A wake from EM1 is taken as free, a wake
+ * 	 from EM3 is only charged what it costs over a wake from EM2
+ *
+ * @note
+ *   This function is called by sleep_calibrate and sleep_predictor
+ *
+ ******************************************************************************/
+
+static void sleep_break_even_update(void) {
+	uint32_t mhz = SystemCoreClock / 1000000;
+	if(!mhz) {
+		mhz = 1;
+	}
+	for(uint32_t mode = EM2; mode <= EM3; mode++) {
+		uint32_t shallow_na;
+		uint32_t deep_na;
+		uint64_t wake_energy = sleep_wake_energy(mode, mhz);
+		if(mode == EM2) {
+			shallow_na = SLEEP_EM1_NA_PER_MHZ * mhz;
+			deep_na = SLEEP_EM2_NA;
+		}
+		else {
+			uint64_t shallow_energy = sleep_wake_energy(EM2, mhz);
+			shallow_na = SLEEP_EM2_NA;
+			deep_na = SLEEP_EM3_NA;
+			wake_energy = (wake_energy > shallow_energy) ? wake_energy - shallow_energy : 0;
+		}
+		if(!sleep_hz || (shallow_na <= deep_na)) {
+			break_even[mode] = 0;
+			continue;
+		}
+		uint64_t saved = (uint64_t)(shallow_na - deep_na) * 1000000;
+		break_even[mode] = (uint32_t)((wake_energy * sleep_hz + saved - 1) / saved);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the energy of one wake from an energy mode
+ *
+ * @details
+ * 	 This routine adds the datasheet wake up time of the energy mode to its
+ * 	 averaged active time, both spent at the EM0 current of the core clock
+ *
+ * @param[in] EM
+ *   Is EM2 or EM3
+ *
+ * @param[in] mhz
+ *   Is the core clock in MHz
+ *
+ * @return
+ *   Returns the energy of one wake in nA * us
+ *
+ ******************************************************************************/
+
+static uint64_t sleep_wake_energy(uint32_t EM, uint32_t mhz) {
+	uint32_t wake_us = (EM == EM2) ? SLEEP_EM2_WAKE_US : SLEEP_EM3_WAKE_US;
+	return ((uint64_t)SLEEP_EM0_NA_PER_MHZ * mhz * ((uint64_t)wake_us * 1000 + wake_ns[EM])) / 1000;
+}
@@ -0,0 +1,610 @@
+/**
+ * @file sw_timer.c
+ * @author Gerritt Luoma
+ * @date May 4th, 2021
+ * @brief Contains the software timer wheel multiplexed on LETIMER0
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#include "sw_timer.h"
+#include "em_assert.h"
+#include "em_core.h"
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief Software timer wheel
+ * @details
+ *  Timers are kept on a hierarchical wheel of SW_TIMER_LEVELS levels of
+ *  SW_TIMER_SLOTS slots.  A timer sits on the level of the highest 5 bit digit
+ *  in which its expiry differs from wheel_now, in the slot of that digit, so
+ *  every occupied slot lies after the current one.  When wheel_now reaches an
+ *  occupied slot its timers cascade down a level or expire.  The occupancy
+ *  bitmap of each level locates the next slot with a single count leading
+ *  zeros, so the LETIMER is only ever programmed for the next real expiry.
+ *  Expiries that wrap past 2^32 ticks wait on a far list until the tick
+ *  count wraps.
+ *
+ ******************************************************************************/
+
+static LETIMER_TypeDef	*timer_letimer;
+static bool				timer_tickless;
+static SW_TIMER			timer_pool[SW_TIMER_MAX];
+static SW_TIMER			*wheel[SW_TIMER_LEVELS + 1][SW_TIMER_SLOTS];
+static uint32_t			wheel_occupied[SW_TIMER_LEVELS];
+static uint32_t			wheel_now;
+
+// Events of the timers that expired during a walk of the wheel, scheduled
+// once the wheel is consistent and interrupts are enabled again
+static uint32_t			wheel_expired;
+
+// Private one shot timer of sw_timer_sleep, it wakes the core without
+// scheduling an event
+static SW_TIMER			delay_timer;
+static uint32_t			delay_until;
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void sw_timer_insert(SW_TIMER *timer);
+static void sw_timer_unlink(SW_TIMER *timer);
+static void sw_timer_expire(SW_TIMER *timer);
+static bool sw_timer_next_slot(uint32_t *point, uint32_t *level);
+static void sw_timer_advance(uint32_t target);
+static void sw_timer_catch_up(uint32_t now);
+static void sw_timer_rearm(void);
+static bool sw_timer_delay_over(void);
+static void sw_timer_post(void);
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to open the software timer service
+ *
+ * @details
+ * 	 This routine stops every software timer and aligns the wheel with the
+ * 	 LETIMER tick count
+ *
+ * @note
+ *   This function is called once in app_peripheral_setup, after the LETIMER
+ *   has been opened with letimer_timebase_open() for tickless operation or
+ *   with letimer_pwm_open() for a fixed heartbeat
+ *
+ * @param[in] letimer
+ *   Pointer to the LETIMER peripheral providing the timebase
+ *
+ * @param[in] tickless
+ *   True to program LETIMER COMP0 for each expiry, false if the timers are
+ *   serviced from a fixed LETIMER underflow heartbeat
+ *
+ ******************************************************************************/
+
+void sw_timer_open(LETIMER_TypeDef *letimer, bool tickless) {
+	timer_letimer = letimer;
+	timer_tickless = tickless;
+	for(int i = 0; i < SW_TIMER_MAX; i++) {
+		timer_pool[i].active = false;
+		timer_pool[i].next = 0;
+	}
+	delay_timer.active = false;
+	delay_timer.next = 0;
+	for(int level = 0; level <= SW_TIMER_LEVELS; level++) {
+		for(int slot = 0; slot < SW_TIMER_SLOTS; slot++) {
+			wheel[level][slot] = 0;
+		}
+	}
+	for(int level = 0; level < SW_TIMER_LEVELS; level++) {
+		wheel_occupied[level] = 0;
+	}
+	wheel_now = letimer_now(timer_letimer);
+	wheel_expired = 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start a software timer
+ *
+ * @details
+ * 	 This routine (re)starts the timer so that event is scheduled delay ticks
+ * 	 from now and then every period ticks.  The LETIMER is reprogrammed if
+ * 	 this is now the next timer to expire
+ *
+ * @note
+ *   This function, like sw_timer_stop and sw_timer_process, may be called
+ *   from the main loop, an interrupt handler or a handler mode event.  Each
+ *   changes the wheel under its own critical section and schedules expired
+ *   events only after leaving it.  sw_timer_sleep is the one exception, it
+ *   is called from the main loop only
+ *
+ * @param[in] timer
+ *   Is the timer number, 0 to SW_TIMER_MAX - 1
+ *
+ * @param[in] delay
+ *   Is the number of ticks to the first expiry
+ *
+ * @param[in] period
+ *   Is the number of ticks between expiries, 0 for a one shot timer
+ *
+ * @param[in] event
+ *   Is the event scheduled on every expiry
+ *
+ ******************************************************************************/
+
+void sw_timer_start(uint32_t timer, uint32_t delay, uint32_t period, uint32_t event) {
+	EFM_ASSERT(timer < SW_TIMER_MAX);
+	EFM_ASSERT(delay < 0x80000000 && period < 0x80000000);
+	SW_TIMER *t = &timer_pool[timer];
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();	// the wheel is also advanced by handler mode events
+	if(t->active) {
+		sw_timer_unlink(t);
+	}
+	sw_timer_catch_up(letimer_now(timer_letimer));
+
+	t->expiry = wheel_now + delay;
+	t->period = period;
+	t->event = event;
+	t->active = true;
+	sw_timer_insert(t);
+	sw_timer_rearm();
+	CORE_EXIT_CRITICAL();
+	sw_timer_post();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to stop a software timer
+ *
+ * @details
+ * 	 This routine removes the timer from the wheel if it is running
+ *
+ * @note
+ *   An expiry that has already scheduled its event is not withdrawn.  This
+ *   function may be called from an interrupt handler
+ *
+ * @param[in] timer
+ *   Is the timer number, 0 to SW_TIMER_MAX - 1
+ *
+ ******************************************************************************/
+
+void sw_timer_stop(uint32_t timer) {
+	EFM_ASSERT(timer < SW_TIMER_MAX);
+	SW_TIMER *t = &timer_pool[timer];
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(t->active) {
+		sw_timer_unlink(t);
+		t->active = false;
+		sw_timer_rearm();
+	}
+	CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to check whether a software timer is running
+ *
+ * @param[in] timer
+ *   Is the timer number, 0 to SW_TIMER_MAX - 1
+ *
+ ******************************************************************************/
+
+bool sw_timer_active(uint32_t timer) {
+	EFM_ASSERT(timer < SW_TIMER_MAX);
+	return timer_pool[timer].active;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to service the software timers
+ *
+ * @details
+ * 	 This routine advances the wheel to the current tick count, programs the
+ * 	 LETIMER for the next expiry and then schedules the event of every timer
+ * 	 that expired
+ *
+ * @note
+ *   This function is called from the LETIMER0 COMP0 and underflow event
+ *   handlers, in handler mode with SCHEDULER_SLEEP_ON_EXIT
+ *
+ ******************************************************************************/
+
+void sw_timer_process(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sw_timer_catch_up(letimer_now(timer_letimer));
+	sw_timer_rearm();
+	CORE_EXIT_CRITICAL();
+	sw_timer_post();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the next software timer expiry
+ *
+ * @details
+ * 	 This routine finds the first occupied slot of the lowest occupied wheel
+ * 	 level, which holds the earliest timer, and returns the earliest expiry
+ * 	 in that slot
+ *
+ * @param[out] expiry
+ *   Is the tick count of the next expiry
+ *
+ * @return
+ *   Returns false if no timer is running
+ *
+ ******************************************************************************/
+
+bool sw_timer_next_expiry(uint32_t *expiry) {
+	uint32_t point;
+	uint32_t level;
+	SW_TIMER *list;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	if(sw_timer_next_slot(&point, &level)) {
+		list = wheel[level][(point >> (level * SW_TIMER_SLOT_BITS)) & (SW_TIMER_SLOTS - 1)];
+	}
+	else {
+		list = wheel[SW_TIMER_FAR_LEVEL][0];
+	}
+	bool running = (list != 0);
+	if(running) {
+		*expiry = list->expiry;
+		for(list = list->next; list; list = list->next) {
+			if(list->expiry < *expiry) {
+				*expiry = list->expiry;
+			}
+		}
+	}
+	CORE_EXIT_CRITICAL();
+	return running;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to read the software timer tick count
+ *
+ * @note
+ *   One tick is 1 / SW_TIMER_HZ seconds.  The count is 0 until sw_timer_open
+ *
+ ******************************************************************************/
+
+uint32_t sw_timer_now(void) {
+	return timer_letimer ? letimer_now(timer_letimer) : 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to wait while sleeping
+ *
+ * @details
+ * 	 This routine puts a private one shot timer on the wheel, which programs
+ * 	 the LETIMER to wake the core when the delay is over, and sleeps until
+ * 	 then.  Because the main loop is held up, the wheel is brought up to date
+ * 	 after every wake, so an underflow that passed the compare before its
+ * 	 deadline re-arms it and other timers that expire meanwhile schedule
+ * 	 their events for after the wait.  Deadlines within SW_TIMER_GUARD ticks
+ * 	 and, with a fixed heartbeat, the rest of the last heartbeat are waited
+ * 	 out in EM0
+ *
+ * @note
+ *   This function is a blocking replacement for busy waits in code that
+ *   cannot be written as a task.  It is called from the main loop only, an
+ *   event handler that calls it delays every other event.  Software timers
+ *   with an event, started with sw_timer_start, are the non blocking delay
+ *
+ * @param[in] delay
+ *   Is the number of ticks to wait
+ *
+ ******************************************************************************/
+
+void sw_timer_sleep(uint32_t delay) {
+	EFM_ASSERT(delay < 0x80000000);
+	EFM_ASSERT(!(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk));	// never from an interrupt handler
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	sw_timer_catch_up(letimer_now(timer_letimer));
+	delay_until = wheel_now + delay;
+	delay_timer.expiry = delay_until;
+	delay_timer.period = 0;
+	delay_timer.event = 0;
+	delay_timer.active = true;
+	sw_timer_insert(&delay_timer);
+	sw_timer_rearm();
+	CORE_EXIT_CRITICAL();
+	sw_timer_post();
+
+	while(delay_timer.active) {
+		sleep_wait(sw_timer_delay_over);
+		sw_timer_process();
+	}
+	while(!sw_timer_delay_over());
+}
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to place a timer on the wheel
+ *
+ * @details
+ * 	 This routine selects the level from the highest 5 bit digit in which the
+ * 	 expiry differs from wheel_now.  A timer that is due now expires instead
+ *
+ * @param[in] timer
+ *   Is the timer to place
+ *
+ ******************************************************************************/
+
+static void sw_timer_insert(SW_TIMER *timer) {
+	uint32_t diff = timer->expiry ^ wheel_now;
+	uint32_t level;
+	uint32_t slot;
+
+	if(timer->expiry < wheel_now) {
+		// expiry wrapped past 2^32, wait for the tick count to wrap as well
+		level = SW_TIMER_FAR_LEVEL;
+		slot = 0;
+	}
+	else if(diff == 0) {
+		sw_timer_expire(timer);
+		return;
+	}
+	else {
+		level = (31 - __CLZ(diff)) / SW_TIMER_SLOT_BITS;
+		slot = (timer->expiry >> (level * SW_TIMER_SLOT_BITS)) & (SW_TIMER_SLOTS - 1);
+		wheel_occupied[level] |= 1u << slot;
+	}
+	timer->level = level;
+	timer->slot = slot;
+	timer->next = wheel[level][slot];
+	wheel[level][slot] = timer;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to remove a timer from its wheel slot
+ *
+ * @param[in] timer
+ *   Is the timer to remove
+ *
+ ******************************************************************************/
+
+static void sw_timer_unlink(SW_TIMER *timer) {
+	SW_TIMER **link = &wheel[timer->level][timer->slot];
+
+	while(*link != timer) {
+		EFM_ASSERT(*link);
+		link = &(*link)->next;
+	}
+	*link = timer->next;
+	timer->next = 0;
+	if((timer->level < SW_TIMER_LEVELS) && !wheel[timer->level][timer->slot]) {
+		wheel_occupied[timer->level] &= ~(1u << timer->slot);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to expire a timer
+ *
+ * @details
+ * 	 This routine collects the timer event for sw_timer_post and places a
+ * 	 periodic timer back on the wheel one period later.  A periodic timer
+ * 	 that fell more than a period behind restarts from now rather than
+ * 	 expiring repeatedly
+ *
+ * @param[in] timer
+ *   Is the timer that reached its expiry
+ *
+ ******************************************************************************/
+
+static void sw_timer_expire(SW_TIMER *timer) {
+	wheel_expired |= timer->event;
+	if(timer->period) {
+		timer->expiry += timer->period;
+		if((int32_t)(timer->expiry - wheel_now) <= 0) {
+			timer->expiry = wheel_now + timer->period;
+		}
+		sw_timer_insert(timer);
+	}
+	else {
+		timer->active = false;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to find the next occupied wheel slot
+ *
+ * @details
+ * 	 This routine returns the tick count at which the first occupied slot of
+ * 	 the lowest occupied level begins
+ *
+ * @param[out] point
+ *   Is the tick count at which the slot begins
+ *
+ * @param[out] level
+ *   Is the wheel level of the slot
+ *
+ * @return
+ *   Returns false if the wheel is empty
+ *
+ ******************************************************************************/
+
+static bool sw_timer_next_slot(uint32_t *point, uint32_t *level) {
+	for(uint32_t k = 0; k < SW_TIMER_LEVELS; k++) {
+		uint32_t occupied = wheel_occupied[k];
+		if(!occupied) {
+			continue;
+		}
+		uint32_t shift = k * SW_TIMER_SLOT_BITS;
+		uint32_t current = (wheel_now >> shift) & (SW_TIMER_SLOTS - 1);
+		occupied &= ~((2u << current) - 1);
+		EFM_ASSERT(occupied);	// occupied slots always lie after the current one
+		uint32_t slot = __CLZ(__RBIT(occupied));
+		uint32_t base = (shift + SW_TIMER_SLOT_BITS >= 32) ? 0 : wheel_now & ~((1u << (shift + SW_TIMER_SLOT_BITS)) - 1);
+		*point = base + (slot << shift);
+		*level = k;
+		return true;
+	}
+	return false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to advance the wheel without crossing a tick count wrap
+ *
+ * @details
+ * 	 This routine visits each occupied slot up to target in order, cascading
+ * 	 its timers down the wheel or expiring them.  Empty slots are skipped
+ *
+ * @param[in] target
+ *   Is the tick count to advance to, not below wheel_now
+ *
+ ******************************************************************************/
+
+static void sw_timer_advance(uint32_t target) {
+	uint32_t point;
+	uint32_t level;
+
+	while(sw_timer_next_slot(&point, &level) && (point <= target)) {
+		uint32_t slot = (point >> (level * SW_TIMER_SLOT_BITS)) & (SW_TIMER_SLOTS - 1);
+		SW_TIMER *list = wheel[level][slot];
+
+		wheel[level][slot] = 0;
+		wheel_occupied[level] &= ~(1u << slot);
+		wheel_now = point;
+		while(list) {
+			SW_TIMER *timer = list;
+			list = list->next;
+			sw_timer_insert(timer);
+		}
+	}
+	wheel_now = target;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to bring the wheel up to the current tick count
+ *
+ * @details
+ * 	 This routine advances the wheel to now.  When the tick count has wrapped
+ * 	 the wheel is first run out to the end of the count and the far list is
+ * 	 moved onto it
+ *
+ * @param[in] now
+ *   Is the current tick count
+ *
+ ******************************************************************************/
+
+static void sw_timer_catch_up(uint32_t now) {
+	if((int32_t)(now - wheel_now) <= 0) {
+		// no time has passed, or the wheel ran ahead to service a guarded deadline
+		return;
+	}
+	if(now < wheel_now) {
+		sw_timer_advance(0xFFFFFFFF);
+		SW_TIMER *list = wheel[SW_TIMER_FAR_LEVEL][0];
+		wheel[SW_TIMER_FAR_LEVEL][0] = 0;
+		wheel_now = 0;
+		while(list) {
+			SW_TIMER *timer = list;
+			list = list->next;
+			sw_timer_insert(timer);
+		}
+	}
+	sw_timer_advance(now);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to program the LETIMER for the next expiry
+ *
+ * @details
+ * 	 This routine arms LETIMER COMP0 for the next expiry.  Expiries closer than
+ * 	 SW_TIMER_GUARD ticks, which COMP0 could miss while its write synchronizes,
+ * 	 are serviced immediately
+ *
+ * @note
+ *   With a fixed heartbeat, COMP0 is the LETIMER top and expiries are only
+ *   serviced on the next underflow
+ *
+ ******************************************************************************/
+
+static void sw_timer_rearm(void) {
+	uint32_t expiry;
+
+	if(!timer_tickless) {
+		return;
+	}
+
+	while(sw_timer_next_expiry(&expiry)) {
+		uint32_t now = letimer_now(timer_letimer);
+		int32_t delay = (int32_t)(expiry - now);
+		if(delay > SW_TIMER_GUARD) {
+			// if the counter underflows first, its event calls sw_timer_process again
+			letimer_compare_set(timer_letimer, delay);
+			return;
+		}
+		sw_timer_catch_up((delay > 0) ? expiry : now);
+	}
+	letimer_compare_disable(timer_letimer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to check whether the wait of sw_timer_sleep is over
+ *
+ * @note
+ *   This function is called by sleep_wait with interrupts disabled
+ *
+ ******************************************************************************/
+
+static bool sw_timer_delay_over(void) {
+	return (int32_t)(letimer_now(timer_letimer) - delay_until) >= 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to schedule the events of the expired timers
+ *
+ * @details
+ * 	 This routine (atomic) takes the events collected during the last walks
+ * 	 of the wheel and schedules them one at a time, so each handler mode
+ * 	 event can be serviced at once.  Their handlers run with interrupts
+ * 	 enabled and the wheel consistent, so they may start and stop timers
+ *
+ * @note
+ *   This function is called after the critical section of every function
+ *   that walks the wheel
+ *
+ ******************************************************************************/
+
+static void sw_timer_post(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_CRITICAL();
+	uint32_t events = wheel_expired;
+	wheel_expired = 0;
+	CORE_EXIT_CRITICAL();
+
+	for(; events; events &= events - 1) {
+		add_scheduled_event(events & -events);
+	}
+}
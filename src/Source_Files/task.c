@@ -0,0 +1,105 @@
+/**
+ * @file task.c
+ * @author Gerritt Luoma
+ * @date May 6th, 2021
+ * @brief Contains the helper functions of the stackless tasks
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+#include "task.h"
+#include "em_assert.h"
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Function to initialize a task
+ *
+ * @details
+ * 	 This routine binds the task to the event that resumes it and to the
+ * 	 software timer of its delays, and sets it to start from the beginning
+ *
+ * @note
+ *   This function is called once per task in app_peripheral_setup, when a boot
+ *   step starts, and by TASK_SPAWN for a child task
+ *
+ * @param[in] task
+ *   Pointer to the task
+ *
+ * @param[in] event
+ *   Is the event whose handler runs the task
+ *
+ * @param[in] timer
+ *   Is the software timer used by TASK_DELAY, or TASK_NO_TIMER
+ *
+ ******************************************************************************/
+
+void task_init(TASK *task, uint32_t event, uint32_t timer) {
+	EFM_ASSERT(event);
+	task->line = 0;
+	task->event = event;
+	task->timer = timer;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to check whether a task has run to completion
+ *
+ * @note
+ *   This function is called before a task is started again, a task that is
+ *   still waiting would be resumed instead of restarted
+ *
+ * @param[in] task
+ *   Pointer to the task
+ *
+ ******************************************************************************/
+
+bool task_idle(TASK *task) {
+	return task->line == 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to start the delay of a task
+ *
+ * @details
+ * 	 This routine starts the one shot software timer of the task, which
+ * 	 schedules the task event when it expires
+ *
+ * @note
+ *   This function is called by TASK_DELAY
+ *
+ * @param[in] task
+ *   Pointer to the task
+ *
+ * @param[in] delay
+ *   Is the delay in software timer ticks
+ *
+ ******************************************************************************/
+
+void task_delay(TASK *task, uint32_t delay) {
+	EFM_ASSERT(task->timer != TASK_NO_TIMER);
+	sw_timer_start(task->timer, delay, 0, task->event);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Function to get the payload of the event that resumed the task
+ *
+ * @note
+ *   This function is called after waiting on a transfer, whose completion
+ *   record carries the data read
+ *
+ ******************************************************************************/
+
+uint32_t task_payload(void) {
+	const SCHEDULER_RECORD *record = scheduler_current_record();
+	EFM_ASSERT(record);
+	return record->payload;
+}
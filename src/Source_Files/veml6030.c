@@ -21,9 +21,17 @@
 // Private variables
 //***********************************************************************************
 
-uint32_t data;
-bool veml_RW = true; //for now - read
-uint8_t veml_byte_count = 2; //2 byte
+static uint32_t data; // value read, results reach the app as event payloads
+
+// Command code and 2 data bytes, LS Byte first, written by the transfers
+static const uint8_t read_command[] = {VEML6030_COMMAND};
+static const uint8_t start_up_command[] = {START_UP_COMMAND, VEML6030_START_UP_CONFIG & 0xFF, VEML6030_START_UP_CONFIG >> 8};
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+static void veml6030_transfer(const uint8_t *tx, uint32_t tx_len, uint32_t rx_len, uint32_t *result, uint32_t settle, uint32_t callback);
 
 //***********************************************************************************
 // Functions
@@ -39,13 +47,13 @@ uint8_t veml_byte_count = 2; //2 byte
  * 	 Creates a struct with all the information needed for i2c VEML6030 operation
  *
  * @note
- *   This function is called once in the beginning, in app_peripheral_setup
+ *   This function is called once in the beginning, in app_peripheral_setup.
+ *   The VEML6030 power up time is waited out by the boot task before the
+ *   first transfer
  *
  ******************************************************************************/
 
-void veml6030_i2c_open() {
-	timer_delay(80);
-
+void veml6030_i2c_open(uint32_t settle_timer, uint32_t stop_event, uint32_t settle_event) {
 	I2C_OPEN_STRUCT i2c_open_s;
 	i2c_open_s.freq = VEML6030_FREQ;
 	i2c_open_s.SCLPEN = SENSOR_I2C_SCL;
@@ -56,6 +64,9 @@ void veml6030_i2c_open() {
 	i2c_open_s.master = true;
 	i2c_open_s.refFreq = 0;
 	i2c_open_s.enable = true;
+	i2c_open_s.settle_timer = settle_timer;
+	i2c_open_s.stop_event = stop_event;
+	i2c_open_s.settle_event = settle_event;
 
 	i2c_open(VEML6030_I2C, &i2c_open_s);
 }
@@ -65,18 +76,23 @@ void veml6030_i2c_open() {
  *   Starts the i2c state machine
  *
  * @details
- * 	 Calls i2c_start with all information needed to initialize the state machine
+ * 	 Starts a transfer of the ALS output command and a 2 byte read.  A read
+ * 	 the VEML6030 NACKs ends with I2C_NACKED in result and no value
  *
  * @note
- *   This function is called every time there is an LETIMER underflow interrupt
+ *   This function is called by the light task, which waits for the
+ *   VEML6030_read_cb completion event
  *
  * @param[in] VEML6030_read_cb
  *   Callback for when the VEML6030 read operation is completed
+ *
+ * @param[out] result
+ *   Is where the i2c_results of the read is stored, the light value is only
+ *   valid for I2C_DONE
  ******************************************************************************/
 
-void veml6030_read(uint32_t VEML6030_read_cb) {
-	i2c_start(VEML6030_I2C, VEML6030_ADDRESS, VEML6030_COMMAND, veml_RW, &data, veml_byte_count, VEML6030_read_cb); //start i2c
-	timer_delay(15);
+void veml6030_read(uint32_t VEML6030_read_cb, uint32_t *result) {
+	veml6030_transfer(read_command, sizeof(read_command), VEML6030_DATA_BYTES, result, 0, VEML6030_read_cb); //start i2c
 }
 
 /***************************************************************************//**
@@ -89,13 +105,16 @@ void veml6030_read(uint32_t VEML6030_read_cb) {
  * @note
  *   This function is called every time there is a VEML6030 read callback interrupt (state machine done)
  *
+ * @param[in] raw
+ *   The 16 bit ALS code read from the VEML6030
+ *
  ******************************************************************************/
 
 //Light level [lx] is (ALS OUTPUT DATA [dec.] / ALS Gain x responsivity). Please study also the application note
 //for cofiguration 0x00, gain x 1, intergration time 100 ms, multiply data by 0.0576
 
-float veml6030_conversion() {
-	uint32_t result = data;
+float veml6030_conversion(uint32_t raw) {
+	uint32_t result = raw;
 	return 0.0576*result; //lux
 }
 
@@ -104,24 +123,74 @@ float veml6030_conversion() {
  *   Starts the VEML6030
  *
  * @details
- * 	 Does a 2 byte write to the VEML6030 with the start up command, 0x00, to prepare for later reading
+ * 	 Does a 2 byte write to the VEML6030 with the start up command, 0x00, to prepare for later reading.
+ * 	 The task sleeps until the write completes and for the start up delay
  *
  * @note
- *   This function is called from boot up cb function in app.c
+ *   This function is spawned by the boot task and resumed by its event
+ *
+ * @param[in] task
+ *   The task running the start up, its event is the completion event of the write
+ *
+ * @return
+ *   Returns TASK_DONE once the VEML6030 is ready to be read
  *
- * @param[in] VEML6030_read_cb
- *   Callback for when the VEML6030 read operation is completed
  ******************************************************************************/
 
-bool veml_start_up(uint32_t veml6030_read_cb) {
+TASK_STATUS veml_start_up(TASK *task) {
+	TASK_BEGIN(task);
+
 	//2 byte write to the veml
 	//START_UP_COMMAND = 0x0
-	data = START_UP_COMMAND;
-	veml_RW = false; //write
-	i2c_start(VEML6030_I2C, VEML6030_ADDRESS, START_UP_COMMAND, veml_RW, &data, veml_byte_count, veml6030_read_cb);
-	while(check_busy_0(VEML6030_I2C));
-	timer_delay(15);
-	EFM_ASSERT(data == START_UP_COMMAND); //01
-	return true;
+	veml6030_transfer(start_up_command, sizeof(start_up_command), 0, 0, VEML6030_START_UP_DELAY, task->event);
+	TASK_YIELD(task);
+
+	TASK_END(task);
 }
 
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Starts a VEML6030 transfer
+ *
+ * @details
+ * 	 Writes the command code and its data and reads the LS Byte first result
+ *
+ * @param[in] tx
+ *   Is the command code and its data
+ *
+ * @param[in] tx_len
+ *   Is the number of bytes of tx
+ *
+ * @param[in] rx_len
+ *   Is the number of bytes read, 0 for a write
+ *
+ * @param[out] result
+ *   Is where the i2c_results of a read is stored, or 0
+ *
+ * @param[in] settle
+ *   Is the time in software timer ticks the VEML6030 needs after the transfer,
+ *   waited out by the I2C driver before the completion event
+ *
+ * @param[in] callback
+ *   Is the completion event
+ *
+ ******************************************************************************/
+
+static void veml6030_transfer(const uint8_t *tx, uint32_t tx_len, uint32_t rx_len, uint32_t *result, uint32_t settle, uint32_t callback) {
+	I2C_TRANSFER transfer;
+	transfer.address = VEML6030_ADDRESS;
+	transfer.tx = tx;
+	transfer.tx_len = tx_len;
+	transfer.rx = &data;
+	transfer.buffer = 0;
+	transfer.rx_len = rx_len;
+	transfer.order = I2C_LSB_FIRST;
+	transfer.result = result;
+	transfer.settle = settle;
+	transfer.callback = callback;
+	i2c_start(VEML6030_I2C, &transfer);
+}
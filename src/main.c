@@ -31,37 +31,14 @@ int main(void)
 	EFM_ASSERT(get_scheduled_events() & BOOT_UP_CB);
 	/* Infinite loop */
 	while (1) {
+		// Sleep until the next event is scheduled
 		if (!get_scheduled_events()) {
-			CORE_DECLARE_IRQ_STATE;
-			CORE_ENTER_CRITICAL();
+			// Make a clock change held off by a transfer, then sleep
+			cmu_clock_settle();
 			enter_sleep();
-			CORE_EXIT_CRITICAL();
 		}
 
-		// Check for events and call callbacks
-		if(get_scheduled_events() & LETIMER0_UF_CB) {
-			scheduled_letimer0_uf_cb();
-		}
-		if(get_scheduled_events() & LETIMER0_COMP0_CB) {
-			scheduled_letimer0_comp0_cb();
-		}
-		if(get_scheduled_events() & LETIMER0_COMP1_CB) {
-			scheduled_letimer0_comp1_cb();
-		}
-		if(get_scheduled_events() & SI7021_H_READ_CB) {
-			humidity_done_cb();
-		}
-		if(get_scheduled_events() & SI7021_T_READ_CB) {
-			temp_done_cb();
-		}
-		if(get_scheduled_events() & VEML6030_READ_CB) {
-			light_done_cb();
-		}
-		if(get_scheduled_events() & BOOT_UP_CB) {
-			scheduled_boot_up_cb();
-		}
-		if(get_scheduled_events() & BLE_TX_DONE_CB) {
-			scheduled_ble_tx_done_cb();
-		}
+		// Call the callback of the highest priority scheduled event
+		scheduler_dispatch();
 	}
 }